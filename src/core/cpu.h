@@ -0,0 +1,60 @@
+#ifndef CPU_H
+#define CPU_H
+
+/*
+ * host cpu feature detection, used to select between the scalar and simd
+ * versions of hot conversion routines at runtime
+ */
+
+#if ARCH_X64
+#if COMPILER_MSVC
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
+/* attribute enabling avx2 code generation for a single function, so the rest
+   of the translation unit can still run on hosts without it */
+#if ARCH_X64 && !COMPILER_MSVC
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+static inline int cpu_has_sse2() {
+#if ARCH_X64
+  /* sse2 is part of the x64 baseline */
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static inline int cpu_has_avx2() {
+#if ARCH_X64 && COMPILER_MSVC
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return 0;
+  }
+
+  /* avx2 requires the os to save the ymm registers on context switches */
+  __cpuid(info, 1);
+  int osxsave = (info[2] >> 27) & 1;
+  int avx = (info[2] >> 28) & 1;
+  if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+    return 0;
+  }
+
+  __cpuidex(info, 7, 0);
+  return (info[1] >> 5) & 1;
+#elif ARCH_X64
+  /* also checks the os has enabled the ymm state */
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include <string.h>
+#include "core/hash.h"
+
+#define PRIME64_1 0x9e3779b185ebca87ull
+#define PRIME64_2 0xc2b2ae3d27d4eb4full
+#define PRIME64_3 0x165667b19e3779f9ull
+#define PRIME64_4 0x85ebca77c2b2ae63ull
+#define PRIME64_5 0x27d4eb2f165667c5ull
+
+static inline uint64_t rotl64(uint64_t v, int n) {
+  return (v << n) | (v >> (64 - n));
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t hash64_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  acc *= PRIME64_1;
+  return acc;
+}
+
+static inline uint64_t hash64_merge_round(uint64_t acc, uint64_t val) {
+  acc ^= hash64_round(0, val);
+  acc = acc * PRIME64_1 + PRIME64_4;
+  return acc;
+}
+
+uint64_t hash64(const void *data, int size, uint64_t seed) {
+  const uint8_t *p = data;
+  const uint8_t *end = p + size;
+  uint64_t h;
+
+  if (size >= 32) {
+    /* process 32 byte stripes with four independent accumulators */
+    const uint8_t *limit = end - 32;
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+
+    do {
+      v1 = hash64_round(v1, read64(p));
+      v2 = hash64_round(v2, read64(p + 8));
+      v3 = hash64_round(v3, read64(p + 16));
+      v4 = hash64_round(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = hash64_merge_round(h, v1);
+    h = hash64_merge_round(h, v2);
+    h = hash64_merge_round(h, v3);
+    h = hash64_merge_round(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+
+  h += (uint64_t)size;
+
+  /* mix in the remaining tail */
+  while (p + 8 <= end) {
+    h ^= hash64_round(0, read64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+
+  if (p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+
+  while (p < end) {
+    h ^= (*p) * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+    p++;
+  }
+
+  /* final avalanche */
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
@@ -0,0 +1,11 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+/* non-cryptographic 64-bit hash, an implementation of the xxh64 algorithm.
+   used to detect changes to large blocks of guest memory, so it's designed
+   for throughput rather than resistance to malicious inputs */
+uint64_t hash64(const void *data, int size, uint64_t seed);
+
+#endif
@@ -19,6 +19,8 @@ size_t get_page_size();
 size_t get_allocation_granularity();
 int protect_pages(void *ptr, size_t size, enum page_access access);
 void *reserve_pages(void *ptr, size_t size);
+/* back a range of reserved pages with memory, making it read / write */
+int commit_pages(void *ptr, size_t size);
 int release_pages(void *ptr, size_t size);
 
 /*
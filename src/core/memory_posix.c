@@ -87,6 +87,12 @@ void *reserve_pages(void *ptr, size_t size) {
   return res;
 }
 
+int commit_pages(void *ptr, size_t size) {
+  /* reserved pages are mapped without being backed, memory is only allocated
+     for them once they're touched */
+  return protect_pages(ptr, size, ACC_READWRITE);
+}
+
 int protect_pages(void *ptr, size_t size, enum page_access access) {
   int prot = access_to_protect_flags(access);
   return mprotect(ptr, size, prot) == 0;
@@ -46,6 +46,10 @@ void *reserve_pages(void *ptr, size_t size) {
   return res;
 }
 
+int commit_pages(void *ptr, size_t size) {
+  return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
 int protect_pages(void *ptr, size_t size, enum page_access access) {
   DWORD new_protect = access_to_protection_flags(access);
   DWORD old_protect;
@@ -44,3 +44,74 @@ void msort(void *data, int num, size_t size, sort_cmp cmp) {
   msort_noalloc(data, tmp, num, size, cmp);
   free(tmp);
 }
+
+#define RSORT_RADIX_BITS 8
+#define RSORT_RADIX_SIZE (1 << RSORT_RADIX_BITS)
+#define RSORT_RADIX_MASK (RSORT_RADIX_SIZE - 1)
+#define RSORT_PASSES (32 / RSORT_RADIX_BITS)
+
+void rsort_noalloc(uint32_t *keys, int *values, uint32_t *tmp_keys,
+                   int *tmp_values, int num) {
+  if (!num) {
+    return;
+  }
+
+  int counts[RSORT_PASSES][RSORT_RADIX_SIZE];
+  memset(counts, 0, sizeof(counts));
+
+  /* build the histogram for each pass up front */
+  for (int i = 0; i < num; i++) {
+    uint32_t key = keys[i];
+
+    for (int pass = 0; pass < RSORT_PASSES; pass++) {
+      int digit = (key >> (pass * RSORT_RADIX_BITS)) & RSORT_RADIX_MASK;
+      counts[pass][digit]++;
+    }
+  }
+
+  uint32_t *src_keys = keys;
+  uint32_t *dst_keys = tmp_keys;
+  int *src_values = values;
+  int *dst_values = tmp_values;
+
+  for (int pass = 0; pass < RSORT_PASSES; pass++) {
+    int *count = counts[pass];
+    int shift = pass * RSORT_RADIX_BITS;
+
+    /* skip passes where every key has the same digit, this is common for the
+       upper bits of similarly sized floats */
+    int digit = (src_keys[0] >> shift) & RSORT_RADIX_MASK;
+    if (count[digit] == num) {
+      continue;
+    }
+
+    /* convert the histogram to offsets */
+    int offset = 0;
+    for (int i = 0; i < RSORT_RADIX_SIZE; i++) {
+      int n = count[i];
+      count[i] = offset;
+      offset += n;
+    }
+
+    for (int i = 0; i < num; i++) {
+      uint32_t key = src_keys[i];
+      int dst = count[(key >> shift) & RSORT_RADIX_MASK]++;
+      dst_keys[dst] = key;
+      dst_values[dst] = src_values[i];
+    }
+
+    uint32_t *swap_keys = src_keys;
+    src_keys = dst_keys;
+    dst_keys = swap_keys;
+
+    int *swap_values = src_values;
+    src_values = dst_values;
+    dst_values = swap_values;
+  }
+
+  /* an odd number of passes leaves the results in the temporary buffers */
+  if (src_keys != keys) {
+    memcpy(keys, src_keys, num * sizeof(keys[0]));
+    memcpy(values, src_values, num * sizeof(values[0]));
+  }
+}
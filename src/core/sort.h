@@ -2,6 +2,8 @@
 #define SORT_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 /* returns if a is <= b */
 typedef int (*sort_cmp)(const void *, const void *);
@@ -10,4 +12,19 @@ typedef int (*sort_cmp)(const void *, const void *);
 void msort_noalloc(void *data, void *tmp, int num, size_t size, sort_cmp cmp);
 void msort(void *data, int num, size_t size, sort_cmp cmp);
 
+/* stable lsd radix sort of values by their 32-bit keys in ascending order.
+   keys and values are both reordered, tmp_keys and tmp_values must be able
+   to hold num elements each */
+void rsort_noalloc(uint32_t *keys, int *values, uint32_t *tmp_keys,
+                   int *tmp_values, int num);
+
+/* map a float to a radix sort key which orders the same way. -0.0 is mapped
+   to the same key as 0.0 so they compare equal, as they do for floats */
+static inline uint32_t rsort_float_key(float f) {
+  uint32_t u;
+  f += 0.0f;
+  memcpy(&u, &f, sizeof(u));
+  return u ^ ((u >> 31) ? 0xffffffff : 0x80000000);
+}
+
 #endif
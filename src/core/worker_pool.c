@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include "core/worker_pool.h"
+#include "core/assert.h"
+#include "core/math.h"
+#include "core/thread.h"
+
+struct worker_pool {
+  int num_workers;
+  thread_t *workers;
+  mutex_t mutex;
+  cond_t work_cond;
+  cond_t done_cond;
+  int running;
+
+  /* current batch, protected by the mutex */
+  worker_pool_job fn;
+  void *data;
+  int num_jobs;
+  int next_job;
+  int jobs_done;
+};
+
+/* run the next job of the batch, called and returning with the mutex held.
+   returns 0 if every job has been picked up */
+static int worker_pool_run_job(struct worker_pool *pool) {
+  if (pool->next_job >= pool->num_jobs) {
+    return 0;
+  }
+
+  int n = pool->next_job++;
+  worker_pool_job fn = pool->fn;
+  void *data = pool->data;
+
+  mutex_unlock(pool->mutex);
+  fn(data, n);
+  mutex_lock(pool->mutex);
+
+  if (++pool->jobs_done == pool->num_jobs) {
+    cond_signal(pool->done_cond);
+  }
+
+  return 1;
+}
+
+static void *worker_pool_worker(void *data) {
+  struct worker_pool *pool = data;
+
+  mutex_lock(pool->mutex);
+
+  while (pool->running) {
+    if (!worker_pool_run_job(pool)) {
+      cond_wait(pool->work_cond, pool->mutex);
+    }
+  }
+
+  mutex_unlock(pool->mutex);
+
+  return NULL;
+}
+
+void worker_pool_run(struct worker_pool *pool, worker_pool_job fn, void *data,
+                     int num_jobs) {
+  worker_pool_begin(pool, fn, data);
+  worker_pool_queue(pool, num_jobs);
+  worker_pool_end(pool);
+}
+
+void worker_pool_end(struct worker_pool *pool) {
+  mutex_lock(pool->mutex);
+
+  /* help out with the jobs the workers haven't picked up */
+  while (worker_pool_run_job(pool)) {
+  }
+
+  /* wait for the jobs still being ran by the workers */
+  while (pool->jobs_done < pool->num_jobs) {
+    cond_wait(pool->done_cond, pool->mutex);
+  }
+
+  pool->fn = NULL;
+  pool->data = NULL;
+  pool->num_jobs = 0;
+  pool->next_job = 0;
+  pool->jobs_done = 0;
+
+  mutex_unlock(pool->mutex);
+}
+
+void worker_pool_queue(struct worker_pool *pool, int num_jobs) {
+  mutex_lock(pool->mutex);
+
+  CHECK_NOTNULL(pool->fn);
+  pool->num_jobs += num_jobs;
+
+  if (num_jobs >= pool->num_workers) {
+    cond_broadcast(pool->work_cond);
+  } else {
+    for (int i = 0; i < num_jobs; i++) {
+      cond_signal(pool->work_cond);
+    }
+  }
+
+  mutex_unlock(pool->mutex);
+}
+
+void worker_pool_begin(struct worker_pool *pool, worker_pool_job fn,
+                       void *data) {
+  mutex_lock(pool->mutex);
+
+  /* the previous batch must have been ended */
+  CHECK(!pool->fn && !pool->num_jobs);
+  pool->fn = fn;
+  pool->data = data;
+
+  mutex_unlock(pool->mutex);
+}
+
+int worker_pool_num_workers(struct worker_pool *pool) {
+  return pool->num_workers;
+}
+
+void worker_pool_destroy(struct worker_pool *pool) {
+  mutex_lock(pool->mutex);
+  pool->running = 0;
+  cond_broadcast(pool->work_cond);
+  mutex_unlock(pool->mutex);
+
+  for (int i = 0; i < pool->num_workers; i++) {
+    void *result;
+    thread_join(pool->workers[i], &result);
+  }
+
+  cond_destroy(pool->done_cond);
+  cond_destroy(pool->work_cond);
+  mutex_destroy(pool->mutex);
+
+  free(pool->workers);
+  free(pool);
+}
+
+struct worker_pool *worker_pool_create(int num_workers) {
+  struct worker_pool *pool = calloc(1, sizeof(struct worker_pool));
+
+  pool->mutex = mutex_create();
+  pool->work_cond = cond_create();
+  pool->done_cond = cond_create();
+  pool->running = 1;
+  pool->num_workers = MAX(num_workers, 0);
+
+  if (pool->num_workers) {
+    pool->workers = calloc(pool->num_workers, sizeof(thread_t));
+    CHECK_NOTNULL(pool->workers);
+  }
+
+  for (int i = 0; i < pool->num_workers; i++) {
+    pool->workers[i] = thread_create(&worker_pool_worker, NULL, pool);
+    CHECK_NOTNULL(pool->workers[i]);
+  }
+
+  return pool;
+}
@@ -0,0 +1,31 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+/*
+ * pool of worker threads running batches of indexed jobs. the thread
+ * ending a batch helps run any jobs the workers haven't picked up yet
+ */
+struct worker_pool;
+
+typedef void (*worker_pool_job)(void *data, int n);
+
+struct worker_pool *worker_pool_create(int num_workers);
+void worker_pool_destroy(struct worker_pool *pool);
+
+int worker_pool_num_workers(struct worker_pool *pool);
+
+/* begin a batch whose jobs each call fn with their index in the batch, and
+   wake the workers as jobs are queued onto it */
+void worker_pool_begin(struct worker_pool *pool, worker_pool_job fn,
+                       void *data);
+void worker_pool_queue(struct worker_pool *pool, int num_jobs);
+
+/* run the jobs the workers haven't started on this thread, and wait for the
+   rest to finish */
+void worker_pool_end(struct worker_pool *pool);
+
+/* run a complete batch of num_jobs */
+void worker_pool_run(struct worker_pool *pool, worker_pool_job fn, void *data,
+                     int num_jobs);
+
+#endif
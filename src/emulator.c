@@ -12,10 +12,13 @@
  */
 
 #include "emulator.h"
+#include "core/hash.h"
 #include "core/option.h"
 #include "core/profiler.h"
+#include "core/ringbuf.h"
 #include "core/thread.h"
 #include "core/time.h"
+#include "core/worker_pool.h"
 #include "file/trace.h"
 #include "guest/aica/aica.h"
 #include "guest/arm7/arm7.h"
@@ -25,9 +28,11 @@
 #include "guest/holly/holly.h"
 #include "guest/maple/maple.h"
 #include "guest/memory.h"
+#include "guest/pvr/pixel_convert.h"
 #include "guest/pvr/pvr.h"
 #include "guest/pvr/ta.h"
 #include "guest/pvr/tr.h"
+#include "guest/pvr/tr_atlas.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "host/host.h"
@@ -35,7 +40,107 @@
 #include "render/microprofile.h"
 #include "render/render_backend.h"
 
+DEFINE_OPTION_INT(texture_workers, 3,
+                  "Number of threads converting textures ahead of rendering");
+DEFINE_OPTION_INT(convert_workers, 2,
+                  "Number of threads parsing a context's params in parallel "
+                  "when it's converted in one go");
+DEFINE_OPTION_INT(texture_watches, 0,
+                  "Invalidate textures with page protection write watches "
+                  "instead of the video ram dirty bitmaps");
+DEFINE_OPTION_INT(frameskip, 0,
+                  "Skip converting and rendering frames while the host is "
+                  "slower than the guest's vblank rate");
+DEFINE_OPTION_INT(max_frameskip, 2,
+                  "Maximum number of consecutive frames to skip");
+
 DEFINE_AGGREGATE_COUNTER(frames);
+DEFINE_AGGREGATE_COUNTER(frames_skipped);
+DEFINE_COUNTER(host_frame_time);
+DEFINE_COUNTER(convert_latency);
+DEFINE_COUNTER(textures_converted);
+DEFINE_COUNTER(texture_wait);
+DEFINE_COUNTER(texture_lookups);
+DEFINE_COUNTER(texture_hits);
+DEFINE_COUNTER(texture_skips);
+DEFINE_COUNTER(texture_dedups);
+DEFINE_COUNTER(texture_faults);
+DEFINE_COUNTER(vram_dirty_blocks);
+DEFINE_COUNTER(palette_banks_updated);
+DEFINE_COUNTER(frame_latency);
+DEFINE_COUNTER(frame_queue_depth);
+
+/* messages sent from the emulation thread to the convert thread */
+enum {
+  CONVERT_BEGIN,
+  CONVERT_PARSE,
+  CONVERT_END,
+  CONVERT_CANCEL,
+};
+
+struct emu_convert_msg {
+  int type;
+  int autosort;
+  int end;
+  struct tile_context *ctx;
+};
+
+#define CONVERT_QUEUE_SIZE (sizeof(struct emu_convert_msg) * 4096)
+
+/* number of frames which can be in flight at once. one frame is being
+   presented, while the others are being converted and rendered */
+#define MAX_FRAMES 3
+
+/* a frame is queued by the emulation thread when the guest starts a render,
+   converted and rendered to its own framebuffer by the video thread, and
+   then handed back to the emulation thread to be presented */
+struct emu_frame {
+  /* guest context, only valid until the frame has been converted */
+  struct tile_context *ctx;
+  int incremental;
+  /* when the frame was queued, cleared once it's first presented */
+  int64_t queued_time;
+
+  struct tr_context rc;
+  /* drawing commands recorded from the converted context */
+  struct r_cmdbuf *cmds;
+
+  framebuffer_handle_t fb;
+  texture_handle_t tex;
+  int width;
+  int height;
+  sync_handle_t sync;
+};
+
+#define RENDERED_QUEUE_SIZE (sizeof(struct emu_frame *) * MAX_FRAMES)
+
+#define MAX_TEXTURE_WORKERS 8
+#define MAX_TEXTURE_JOBS 1024
+
+/* state of a texture's conversion on the worker threads */
+enum {
+  TEXTURE_JOB_NONE,
+  TEXTURE_JOB_QUEUED,
+  TEXTURE_JOB_RUNNING,
+  TEXTURE_JOB_DONE,
+};
+
+/* backend texture created for a particular content hash. texture entries
+   whose source data hashes the same share a single one of these */
+struct emu_shared_texture {
+  struct list_node free_it;
+  struct rb_node live_it;
+  uint64_t hash;
+  int refs;
+
+  enum pxl_format format;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+  int width;
+  int height;
+  texture_handle_t handle;
+};
 
 struct emu_texture {
   struct tr_texture;
@@ -44,9 +149,28 @@ struct emu_texture {
   struct rb_node live_it;
 
   struct memory_watch *texture_watch;
-  struct memory_watch *palette_watch;
   struct list_node modified_it;
   int modified;
+
+  /* frame the texture's source was last checked against the dirty bitmaps */
+  unsigned checked;
+
+  /* conversion parameters from the context the texture was last registered
+     by, they affect the converted output along with the source data */
+  int pal_pxl_format;
+  int stride;
+
+  /* backend texture currently referenced by the entry. while the entry is
+     being converted, hash is the content hash of its new source data */
+  struct emu_shared_texture *shared;
+  struct list_node uploaded_it;
+  uint64_t hash;
+
+  /* conversion job, protected by texture_mutex */
+  int job_state;
+  int job_converted;
+  uint64_t job_hash;
+  uint8_t *job_output;
 };
 
 struct emu {
@@ -56,7 +180,6 @@ struct emu {
   volatile int running;
   volatile int video_width;
   volatile int video_height;
-  volatile int video_resized;
   volatile unsigned frame;
 
   struct render_backend *r;
@@ -72,17 +195,49 @@ struct emu {
   int multi_threaded;
   thread_t video_thread;
 
-  /* latest context from the dreamcast, ready to be presented */
+  /* the video context is shared by the emulation thread, which presents the
+     frames, and the video thread, which converts and renders them. whichever
+     has it bound holds this mutex */
+  mutex_t context_mutex;
+
+  /* latest frame from the dreamcast, waiting to be converted. the mutex is
+     held by the video thread while converting, and by the emulation thread
+     while it's accessing the texture cache */
   mutex_t pending_mutex;
   cond_t pending_cond;
   unsigned pending_id;
-  struct tile_context *pending_ctx;
-  struct tr_context pending_rc;
-
-  /* offscreen framebuffer the video output is rendered to */
-  framebuffer_handle_t video_fb;
-  texture_handle_t video_tex;
-  sync_handle_t video_sync;
+  struct emu_frame *pending_frame;
+
+  /* frames are converted one at a time, but once converted the guest is free
+     to continue while the frame is rendered to its own framebuffer. rendered
+     frames are handed back through a lock-free queue, the emulation thread
+     only blocks on the video thread when every frame is in flight */
+  struct emu_frame frames[MAX_FRAMES];
+  struct ringbuf *rendered_frames;
+  mutex_t rendered_mutex;
+  cond_t rendered_cond;
+  /* only accessed by the emulation thread */
+  struct emu_frame *free_frames[MAX_FRAMES];
+  int num_free_frames;
+  struct emu_frame *presented_frame;
+
+  /* when running with multiple threads, contexts are also converted
+     incrementally on a secondary convert thread while the ta is receiving
+     them. the emulation thread feeds it the params as they arrive through a
+     lock-free queue, leaving just the texture conversion and sorting for the
+     video thread to perform once the context is rendered */
+  thread_t convert_thread;
+  struct ringbuf *convert_queue;
+  mutex_t convert_mutex;
+  cond_t convert_cond;
+  struct tr *convert_tr;
+  struct tr_context convert_rc;
+  /* context currently being fed to the convert thread */
+  struct tile_context *convert_ctx;
+  int convert_autosort;
+  /* set by the convert thread once it has parsed all of a context's params,
+     and cleared once the video thread has finished converting it */
+  int convert_ended;
 
   /* texture cache. the dreamcast interface calls into us when new contexts are
      available to be rendered. parsing the contexts, uploading their textures to
@@ -100,6 +255,70 @@ struct emu {
      emulation thread when modified. instead, they are added to this modified
      list which will be processed the next time the threads are synchronized */
   struct list modified_textures;
+  /* write watch faults taken since the last context */
+  int texture_faults;
+
+  /* when not using memory watches, writes to video ram are instead tracked
+     in a bitmap of dirty blocks by the dreamcast. the bitmap is collected
+     when each context is received, stamping each dirty block with the frame
+     it was seen in. a texture is dirty if any block of its source has been
+     stamped since the texture was last registered */
+  unsigned vram_stamps[PVR_VRAM_NUM_BLOCKS];
+
+  /* paletted textures are uploaded as indices, which are looked up in a
+     single palette texture holding all of palette ram. each bank of 16
+     entries written to is tracked by the dreamcast, and accumulated here by
+     the emulation thread as each context is received. the video thread then
+     converts just those banks into the palette texture before converting the
+     next context, leaving the textures referencing them untouched */
+  texture_handle_t palette_texture;
+  uint64_t palette_dirty;
+  int palette_format;
+
+  /* backend textures, keyed by the content hash of their source data. when
+     a memory watch fires without the data actually changing, the existing
+     backend texture is reused, and aliases of the same data referenced
+     through different tsp / tcw combinations share a single one */
+  struct emu_shared_texture shared_textures[8192];
+  struct list free_shared_textures;
+  struct rb_tree live_shared_textures;
+  /* textures uploaded while converting the current context, to be added to
+     the shared textures once the conversion is done */
+  struct list uploaded_textures;
+
+  /* small textures are additionally packed into the pages of an atlas. each
+     entry owns its space in the atlas, independent of its backend texture
+     being shared */
+  struct tr_atlas *atlas;
+
+  /* contexts which weren't converted incrementally are split into chunks,
+     which are parsed in parallel by a pool of worker threads */
+  struct tr_workers *convert_workers;
+
+  /* when running with multiple threads, dirty textures are converted on a
+     pool of worker threads as soon as the context is received, leaving only
+     the upload for the video thread. jobs are queued by the emulation thread
+     in emu_guest_start_render and finished by the video thread once the
+     context has been converted */
+  struct worker_pool *texture_workers;
+  mutex_t texture_mutex;
+  cond_t texture_done_cond;
+  struct emu_texture *texture_jobs[MAX_TEXTURE_JOBS];
+  int num_texture_jobs;
+  /* per-frame stats, only accessed by the video thread */
+  int textures_converted;
+  int64_t texture_wait;
+  int texture_lookups;
+  int texture_hits;
+  int texture_skips;
+  int texture_dedups;
+
+  /* automatic frameskip. host_frame_time is a running average of the time
+     taken to run and present each guest frame, while it's longer than the
+     guest's vblank period contexts are dropped without being converted or
+     rendered */
+  int64_t host_frame_time;
+  int frames_skipped;
 
   /* debug stats */
   int debug_menu;
@@ -145,6 +364,8 @@ static void emu_dirty_textures(struct emu *emu) {
 
     it = next;
   }
+
+  emu->palette_dirty = ~UINT64_C(0);
 }
 
 static void emu_dirty_modified_textures(struct emu *emu) {
@@ -160,6 +381,7 @@ static void emu_dirty_modified_textures(struct emu *emu) {
 static void emu_texture_modified(const struct exception_state *ex, void *data) {
   struct emu_texture *tex = data;
   tex->texture_watch = NULL;
+  tex->emu->texture_faults++;
 
   if (!tex->modified) {
     list_add(&tex->emu->modified_textures, &tex->modified_it);
@@ -167,16 +389,97 @@ static void emu_texture_modified(const struct exception_state *ex, void *data) {
   }
 }
 
-static void emu_palette_modified(const struct exception_state *ex, void *data) {
-  struct emu_texture *tex = data;
-  tex->palette_watch = NULL;
+static void emu_stamp_dirty_blocks(unsigned *stamps, const uint64_t *dirty,
+                                   int num_words, unsigned frame) {
+  for (int i = 0; i < num_words; i++) {
+    uint64_t bits = dirty[i];
 
-  if (!tex->modified) {
-    list_add(&tex->emu->modified_textures, &tex->modified_it);
-    tex->modified = 1;
+    while (bits) {
+      int bit = ctz64(bits);
+      stamps[i * 64 + bit] = frame;
+      bits &= bits - 1;
+    }
   }
 }
 
+static void emu_collect_dirty_blocks(struct emu *emu) {
+  uint64_t vram_dirty[PVR_VRAM_DIRTY_WORDS];
+  uint64_t palette_dirty;
+
+  int num_dirty = pvr_collect_dirty(emu->dc->pvr, vram_dirty, &palette_dirty);
+
+  emu_stamp_dirty_blocks(emu->vram_stamps, vram_dirty, PVR_VRAM_DIRTY_WORDS,
+                         emu->pending_id);
+  emu->palette_dirty |= palette_dirty;
+
+  prof_counter_set(COUNTER_vram_dirty_blocks, num_dirty);
+}
+
+static int emu_blocks_written(const unsigned *stamps, int num_blocks,
+                              int offset, int size, int shift,
+                              unsigned since) {
+  int first = offset >> shift;
+  int last = MIN((offset + size - 1) >> shift, num_blocks - 1);
+
+  for (int i = first; i <= last; i++) {
+    if ((int)(stamps[i] - since) > 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int emu_texture_written(struct emu *emu, struct emu_texture *tex) {
+  struct pvr *pvr = emu->dc->pvr;
+
+  return emu_blocks_written(emu->vram_stamps, PVR_VRAM_NUM_BLOCKS,
+                            (int)(tex->texture - pvr->video_ram),
+                            tex->texture_size, PVR_VRAM_BLOCK_SHIFT,
+                            tex->checked);
+}
+
+/* convert the palette banks written to since the last context into the
+   palette texture, uploading each run of consecutive banks at once */
+static void emu_update_palette(struct emu *emu,
+                               const struct tile_context *ctx) {
+  static const int bank_entries = 1 << (PVR_PALETTE_BLOCK_SHIFT - 2);
+  const uint8_t *palette_ram = emu->dc->pvr->palette_ram;
+  uint8_t converted[TR_PALETTE_ENTRIES * 4];
+
+  /* every entry converts differently once the format changes */
+  if (ctx->pal_pxl_format != emu->palette_format) {
+    emu->palette_format = ctx->pal_pxl_format;
+    emu->palette_dirty = ~UINT64_C(0);
+  }
+
+  uint64_t dirty = emu->palette_dirty;
+  int num_banks = 0;
+
+  while (dirty) {
+    int first = ctz64(dirty);
+    uint64_t run = ~(dirty >> first);
+    int count = run ? ctz64(run) : PVR_PALETTE_NUM_BLOCKS;
+
+    tr_palette_convert(emu->palette_format,
+                       palette_ram + (first << PVR_PALETTE_BLOCK_SHIFT),
+                       count * bank_entries, converted);
+    r_update_texture(emu->r, emu->palette_texture, first * bank_entries, 0,
+                     count * bank_entries, 1, converted);
+
+    if (count == PVR_PALETTE_NUM_BLOCKS) {
+      dirty = 0;
+    } else {
+      dirty &= ~(((UINT64_C(1) << count) - 1) << first);
+    }
+    num_banks += count;
+  }
+
+  emu->palette_dirty = 0;
+
+  prof_counter_set(COUNTER_palette_banks_updated, num_banks);
+}
+
 static void emu_free_texture(struct emu *emu, struct emu_texture *tex) {
   /* remove from live tree */
   rb_unlink(&emu->live_textures, &tex->live_it, &emu_texture_cb);
@@ -205,24 +508,384 @@ static struct emu_texture *emu_alloc_texture(struct emu *emu, union tsp tsp,
   return tex;
 }
 
+static struct emu_texture *emu_lookup_texture(struct emu *emu, union tsp tsp,
+                                              union tcw tcw) {
+  struct emu_texture search;
+  search.tsp = tsp;
+  search.tcw = tcw;
+
+  return rb_find_entry(&emu->live_textures, &search, struct emu_texture,
+                       live_it, &emu_texture_cb);
+}
+
+static int emu_shared_texture_cmp(const struct rb_node *rb_lhs,
+                                  const struct rb_node *rb_rhs) {
+  const struct emu_shared_texture *lhs =
+      rb_entry(rb_lhs, const struct emu_shared_texture, live_it);
+  const struct emu_shared_texture *rhs =
+      rb_entry(rb_rhs, const struct emu_shared_texture, live_it);
+
+  if (lhs->hash < rhs->hash) {
+    return -1;
+  } else if (lhs->hash > rhs->hash) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static struct rb_callbacks emu_shared_texture_cb = {&emu_shared_texture_cmp,
+                                                    NULL, NULL};
+
+static struct emu_shared_texture *emu_lookup_shared_texture(struct emu *emu,
+                                                            uint64_t hash) {
+  struct emu_shared_texture search;
+  search.hash = hash;
+
+  return rb_find_entry(&emu->live_shared_textures, &search,
+                       struct emu_shared_texture, live_it,
+                       &emu_shared_texture_cb);
+}
+
+static void emu_share_texture(struct emu_texture *tex,
+                              struct emu_shared_texture *shared) {
+  shared->refs++;
+
+  tex->shared = shared;
+  tex->format = shared->format;
+  tex->filter = shared->filter;
+  tex->wrap_u = shared->wrap_u;
+  tex->wrap_v = shared->wrap_v;
+  tex->width = shared->width;
+  tex->height = shared->height;
+  tex->handle = shared->handle;
+}
+
+/* drop the entry's reference to its backend texture, destroying it if no
+   other entry is sharing it */
+static void emu_release_texture(struct emu *emu, struct emu_texture *tex) {
+  struct emu_shared_texture *shared = tex->shared;
+
+  tr_atlas_release(emu->atlas, (struct tr_texture *)tex);
+
+  if (!shared) {
+    if (tex->handle) {
+      r_destroy_texture(emu->r, tex->handle);
+    }
+  } else if (--shared->refs == 0) {
+    r_destroy_texture(emu->r, shared->handle);
+    rb_unlink(&emu->live_shared_textures, &shared->live_it,
+              &emu_shared_texture_cb);
+    list_add(&emu->free_shared_textures, &shared->free_it);
+  }
+
+  tex->shared = NULL;
+  tex->handle = 0;
+}
+
+/* called once the textures uploaded for a context are no longer being
+   referenced by the backend, registering them as shared textures */
+static void emu_share_uploaded_textures(struct emu *emu) {
+  list_for_each_entry(tex, &emu->uploaded_textures, struct emu_texture,
+                      uploaded_it) {
+    if (tex->dirty || !tex->handle) {
+      continue;
+    }
+
+    /* identical data may have been uploaded for another entry while
+       converting the same context */
+    struct emu_shared_texture *shared =
+        emu_lookup_shared_texture(emu, tex->hash);
+
+    if (shared) {
+      r_destroy_texture(emu->r, tex->handle);
+      emu_share_texture(tex, shared);
+      emu->texture_dedups++;
+      continue;
+    }
+
+    shared = list_first_entry(&emu->free_shared_textures,
+                              struct emu_shared_texture, free_it);
+    CHECK_NOTNULL(shared);
+    list_remove(&emu->free_shared_textures, &shared->free_it);
+
+    shared->hash = tex->hash;
+    shared->refs = 1;
+    shared->format = tex->format;
+    shared->filter = tex->filter;
+    shared->wrap_u = tex->wrap_u;
+    shared->wrap_v = tex->wrap_v;
+    shared->width = tex->width;
+    shared->height = tex->height;
+    shared->handle = tex->handle;
+    rb_insert(&emu->live_shared_textures, &shared->live_it,
+              &emu_shared_texture_cb);
+
+    tex->shared = shared;
+  }
+
+  list_clear(&emu->uploaded_textures);
+}
+
+/* hash the texture's source data along with everything else affecting the
+   backend texture created from it. the texture address and palette selector
+   only locate the source data, so textures differing by just them hash the
+   same if their data is identical. paletted textures are uploaded as
+   indices, so the palette they reference doesn't affect it either */
+static uint64_t emu_hash_texture(const struct emu_texture *tex) {
+  union tsp tsp;
+  tsp.full = 0;
+  tsp.texture_u_size = tex->tsp.texture_u_size;
+  tsp.texture_v_size = tex->tsp.texture_v_size;
+  tsp.filter_mode = tex->tsp.filter_mode;
+  tsp.clamp_u = tex->tsp.clamp_u;
+  tsp.clamp_v = tex->tsp.clamp_v;
+  tsp.flip_u = tex->tsp.flip_u;
+  tsp.flip_v = tex->tsp.flip_v;
+
+  union tcw tcw = tex->tcw;
+  tcw.texture_addr = 0;
+
+  int paletted = tcw.pixel_format == TA_PIXEL_4BPP ||
+                 tcw.pixel_format == TA_PIXEL_8BPP;
+  int strided = !ta_texture_twiddled(tcw) && tcw.stride_select;
+  int texture_size = tex->texture_size;
+
+  if (paletted) {
+    tcw.p.palette_selector = 0;
+  }
+
+  /* strided textures read a full stride for each row */
+  if (strided) {
+    int height = ta_texture_height(tex->tsp, tex->tcw);
+    texture_size = MAX(texture_size, height * tex->stride * 2);
+  }
+
+  uint32_t desc[3] = {tsp.full, tcw.full, 0};
+  if (strided) {
+    desc[2] = tex->stride;
+  }
+
+  uint64_t hash = hash64(desc, sizeof(desc), 0);
+  return hash64(tex->texture, texture_size, hash);
+}
+
+static void emu_texture_job(void *data, int n) {
+  struct emu *emu = data;
+
+  mutex_lock(emu->texture_mutex);
+
+  struct emu_texture *tex = emu->texture_jobs[n];
+
+  /* the job may have been stolen by the video thread */
+  if (tex->job_state != TEXTURE_JOB_QUEUED) {
+    mutex_unlock(emu->texture_mutex);
+    return;
+  }
+
+  tex->job_state = TEXTURE_JOB_RUNNING;
+  mutex_unlock(emu->texture_mutex);
+
+  /* skip the conversion if the data hasn't actually changed since the
+     backend texture was created. the video thread doesn't modify the entry
+     until the job is done */
+  uint64_t hash = emu_hash_texture(tex);
+  int converted = !tex->shared || tex->shared->hash != hash;
+
+  if (converted) {
+    tr_texture_convert((struct tr_texture *)tex, tex->pal_pxl_format,
+                       tex->stride, tex->job_output);
+  }
+
+  mutex_lock(emu->texture_mutex);
+  tex->job_hash = hash;
+  tex->job_converted = converted;
+  tex->job_state = TEXTURE_JOB_DONE;
+  cond_broadcast(emu->texture_done_cond);
+  mutex_unlock(emu->texture_mutex);
+}
+
+static void emu_queue_texture(struct emu *emu, struct emu_texture *tex) {
+  if (!emu->texture_workers) {
+    return;
+  }
+
+  int queued = 0;
+
+  mutex_lock(emu->texture_mutex);
+
+  /* if the queue is full, the texture is converted inline by the video
+     thread like normal */
+  if (tex->job_state == TEXTURE_JOB_NONE &&
+      emu->num_texture_jobs < MAX_TEXTURE_JOBS) {
+    int size = tr_texture_converted_size(tex->tsp, tex->tcw, tex->stride);
+    tex->job_output = malloc(size);
+    CHECK_NOTNULL(tex->job_output);
+
+    tex->job_state = TEXTURE_JOB_QUEUED;
+    emu->texture_jobs[emu->num_texture_jobs++] = tex;
+    queued = 1;
+  }
+
+  mutex_unlock(emu->texture_mutex);
+
+  /* each job's index in the pool's batch is its index in texture_jobs */
+  if (queued) {
+    worker_pool_queue(emu->texture_workers, 1);
+  }
+}
+
+/* called by the video thread before uploading a texture. if the texture is
+   being converted by a worker, wait for it to finish. if a worker hasn't
+   started on it yet, steal the job back and let it be converted inline.
+   returns 1 and the content hash if a worker finished the job */
+static int emu_wait_texture(struct emu *emu, struct emu_texture *tex,
+                            uint64_t *hash) {
+  int done = 0;
+
+  mutex_lock(emu->texture_mutex);
+
+  if (tex->job_state == TEXTURE_JOB_QUEUED) {
+    tex->job_state = TEXTURE_JOB_NONE;
+    free(tex->job_output);
+    tex->job_output = NULL;
+  } else if (tex->job_state == TEXTURE_JOB_RUNNING) {
+    int64_t start = time_nanoseconds();
+
+    while (tex->job_state == TEXTURE_JOB_RUNNING) {
+      cond_wait(emu->texture_done_cond, emu->texture_mutex);
+    }
+
+    emu->texture_wait += time_nanoseconds() - start;
+  }
+
+  if (tex->job_state == TEXTURE_JOB_DONE) {
+    if (tex->job_converted) {
+      tex->converted = tex->job_output;
+    }
+    *hash = tex->job_hash;
+    done = 1;
+  }
+
+  mutex_unlock(emu->texture_mutex);
+
+  return done;
+}
+
+/* release the output of each job queued for the current context. called once
+   the context has been converted, or when it's being skipped */
+static void emu_finish_texture_jobs(struct emu *emu) {
+  if (!emu->texture_workers) {
+    return;
+  }
+
+  /* drop the jobs no worker has started on */
+  mutex_lock(emu->texture_mutex);
+
+  for (int i = 0; i < emu->num_texture_jobs; i++) {
+    struct emu_texture *tex = emu->texture_jobs[i];
+
+    if (tex->job_state == TEXTURE_JOB_QUEUED) {
+      tex->job_state = TEXTURE_JOB_NONE;
+    }
+  }
+
+  mutex_unlock(emu->texture_mutex);
+
+  /* wait for the running jobs, the dropped ones return immediately */
+  worker_pool_end(emu->texture_workers);
+
+  mutex_lock(emu->texture_mutex);
+
+  for (int i = 0; i < emu->num_texture_jobs; i++) {
+    struct emu_texture *tex = emu->texture_jobs[i];
+
+    tex->job_state = TEXTURE_JOB_NONE;
+    tex->converted = NULL;
+    free(tex->job_output);
+    tex->job_output = NULL;
+  }
+
+  emu->num_texture_jobs = 0;
+
+  mutex_unlock(emu->texture_mutex);
+
+  worker_pool_begin(emu->texture_workers, &emu_texture_job, emu);
+}
+
+static void emu_reset_texture_stats(struct emu *emu) {
+  emu->textures_converted = 0;
+  emu->texture_wait = 0;
+  emu->texture_lookups = 0;
+  emu->texture_hits = 0;
+  emu->texture_skips = 0;
+  emu->texture_dedups = 0;
+}
+
+static void emu_update_texture_stats(struct emu *emu) {
+  prof_counter_set(COUNTER_textures_converted, emu->textures_converted);
+  prof_counter_set(COUNTER_texture_wait, emu->texture_wait);
+  prof_counter_set(COUNTER_texture_lookups, emu->texture_lookups);
+  prof_counter_set(COUNTER_texture_hits, emu->texture_hits);
+  prof_counter_set(COUNTER_texture_skips, emu->texture_skips);
+  prof_counter_set(COUNTER_texture_dedups, emu->texture_dedups);
+}
+
 static struct tr_texture *emu_find_texture(void *userdata, union tsp tsp,
                                            union tcw tcw) {
   struct emu *emu = userdata;
 
-  struct emu_texture search;
-  search.tsp = tsp;
-  search.tcw = tcw;
+  struct emu_texture *tex = emu_lookup_texture(emu, tsp, tcw);
+
+  if (!tex) {
+    return NULL;
+  }
+
+  emu->texture_lookups++;
+
+  if (!tex->dirty) {
+    emu->texture_hits++;
+    return (struct tr_texture *)tex;
+  }
+
+  uint64_t hash;
+  if (!emu->texture_workers || !emu_wait_texture(emu, tex, &hash)) {
+    hash = emu_hash_texture(tex);
+  }
+
+  /* memory watches are page granular, and are often triggered without the
+     data actually changing. if so, keep using the existing backend texture */
+  if (tex->shared && tex->shared->hash == hash) {
+    tex->dirty = 0;
+    emu->texture_skips++;
+    return (struct tr_texture *)tex;
+  }
+
+  emu_release_texture(emu, tex);
+
+  /* share the backend texture of identical data referenced through a
+     different tsp / tcw */
+  struct emu_shared_texture *shared = emu_lookup_shared_texture(emu, hash);
+
+  if (shared) {
+    emu_share_texture(tex, shared);
+    tex->dirty = 0;
+    emu->texture_dedups++;
+    return (struct tr_texture *)tex;
+  }
+
+  /* let the tile renderer upload a new backend texture */
+  tex->hash = hash;
+  list_add(&emu->uploaded_textures, &tex->uploaded_it);
+  emu->textures_converted++;
 
-  struct emu_texture *tex =
-      rb_find_entry(&emu->live_textures, &search, struct emu_texture, live_it,
-                    &emu_texture_cb);
   return (struct tr_texture *)tex;
 }
 
-static void emu_register_texture_source(struct emu *emu, union tsp tsp,
-                                        union tcw tcw) {
-  struct emu_texture *entry =
-      (struct emu_texture *)emu_find_texture(emu, tsp, tcw);
+static void emu_register_texture_source(struct emu *emu,
+                                        const struct tile_context *ctx,
+                                        union tsp tsp, union tcw tcw) {
+  struct emu_texture *entry = emu_lookup_texture(emu, tsp, tcw);
 
   if (!entry) {
     entry = emu_alloc_texture(emu, tsp, tcw);
@@ -240,26 +903,41 @@ static void emu_register_texture_source(struct emu *emu, union tsp tsp,
                     &entry->palette_size);
   }
 
-#ifdef NDEBUG
-  /* add write callback in order to invalidate on future writes. the callback
-     address will be page aligned, therefore it will be triggered falsely in
-     some cases. over invalidate in these cases */
-  if (!entry->texture_watch) {
-    entry->texture_watch = add_single_write_watch(
-        entry->texture, entry->texture_size, &emu_texture_modified, entry);
-  }
+  /* paletted textures look up their palette bank in the palette texture */
+  entry->palette_texture = emu->palette_texture;
 
-  if (entry->palette && !entry->palette_watch) {
-    entry->palette_watch = add_single_write_watch(
-        entry->palette, entry->palette_size, &emu_palette_modified, entry);
-  }
+  if (OPTION_texture_watches) {
+#ifdef NDEBUG
+    /* add write callback in order to invalidate on future writes. the
+       callback address will be page aligned, therefore it will be triggered
+       falsely in some cases. over invalidate in these cases */
+    if (!entry->texture_watch) {
+      entry->texture_watch = add_single_write_watch(
+          entry->texture, entry->texture_size, &emu_texture_modified, entry);
+    }
 #endif
+  } else {
+    /* check the source against the blocks written since the texture was last
+       registered. the blocks are smaller than a page, but the texture will
+       still be over invalidated when writes land next to its source */
+    if (!entry->dirty && emu_texture_written(emu, entry)) {
+      entry->dirty = 1;
+    }
+    entry->checked = emu->pending_id;
+  }
 
   if (emu->trace_writer && entry->dirty && first_registration_this_frame) {
     trace_writer_insert_texture(emu->trace_writer, tsp, tcw, entry->frame,
                                 entry->palette, entry->palette_size,
                                 entry->texture, entry->texture_size);
   }
+
+  /* start converting the texture on the worker threads */
+  if (entry->dirty) {
+    entry->pal_pxl_format = ctx->pal_pxl_format;
+    entry->stride = ctx->stride;
+    emu_queue_texture(emu, entry);
+  }
 }
 
 static void emu_register_texture_sources(struct emu *emu,
@@ -279,7 +957,8 @@ static void emu_register_texture_sources(struct emu *emu,
         vertex_type = ta_get_vert_type(param->type0.pcw);
 
         if (param->type0.pcw.texture) {
-          emu_register_texture_source(emu, param->type0.tsp, param->type0.tcw);
+          emu_register_texture_source(emu, ctx, param->type0.tsp,
+                                      param->type0.tcw);
         }
       } break;
 
@@ -291,11 +970,28 @@ static void emu_register_texture_sources(struct emu *emu,
   }
 }
 
+/* the palette texture starts out cleared, and is converted in full before
+   the first context is */
+static void emu_create_palette(struct emu *emu) {
+  uint8_t pixels[TR_PALETTE_ENTRIES * 4] = {0};
+
+  emu->palette_texture = r_create_texture(
+      emu->r, PXL_RGBA, FILTER_NEAREST, WRAP_CLAMP_TO_EDGE, WRAP_CLAMP_TO_EDGE,
+      0, TR_PALETTE_ENTRIES, 1, pixels);
+  emu->palette_dirty = ~UINT64_C(0);
+  emu->palette_format = -1;
+}
+
 static void emu_init_textures(struct emu *emu) {
   for (int i = 0; i < array_size(emu->textures); i++) {
     struct emu_texture *tex = &emu->textures[i];
     list_add(&emu->free_textures, &tex->free_it);
   }
+
+  for (int i = 0; i < array_size(emu->shared_textures); i++) {
+    struct emu_shared_texture *shared = &emu->shared_textures[i];
+    list_add(&emu->free_shared_textures, &shared->free_it);
+  }
 }
 
 /*
@@ -334,34 +1030,328 @@ static void emu_start_tracing(struct emu *emu) {
   LOG_INFO("begin tracing to %s", filename);
 }
 
+/*
+ * incremental context conversion
+ */
+/* the emulation, video and convert threads all wait on convert_cond for
+   different state, so every change to the queue or to convert_ended is
+   broadcast. waiters check their state under convert_mutex, which the queue
+   updates are followed by, so no wakeup is lost */
+static void emu_convert_signal(struct emu *emu) {
+  mutex_lock(emu->convert_mutex);
+  cond_broadcast(emu->convert_cond);
+  mutex_unlock(emu->convert_mutex);
+}
+
+static void emu_convert_push(struct emu *emu, int type,
+                             struct tile_context *ctx, int end) {
+  struct emu_convert_msg msg;
+  msg.type = type;
+  msg.autosort = emu->convert_autosort;
+  msg.end = end;
+  msg.ctx = ctx;
+
+  if (ringbuf_remaining(emu->convert_queue) < (int)sizeof(msg)) {
+    /* parse messages can be dropped when the queue is full, the next one will
+       pick up where the last one left off */
+    if (type == CONVERT_PARSE) {
+      return;
+    }
+
+    mutex_lock(emu->convert_mutex);
+    while (emu->running &&
+           ringbuf_remaining(emu->convert_queue) < (int)sizeof(msg)) {
+      cond_wait(emu->convert_cond, emu->convert_mutex);
+    }
+    mutex_unlock(emu->convert_mutex);
+
+    if (!emu->running) {
+      return;
+    }
+  }
+
+  void *write_ptr = ringbuf_write_ptr(emu->convert_queue);
+  memcpy(write_ptr, &msg, sizeof(msg));
+  ringbuf_advance_write_ptr(emu->convert_queue, sizeof(msg));
+
+  emu_convert_signal(emu);
+}
+
+static void emu_convert_drain(struct emu *emu) {
+  mutex_lock(emu->convert_mutex);
+  while (emu->running && ringbuf_available(emu->convert_queue)) {
+    cond_wait(emu->convert_cond, emu->convert_mutex);
+  }
+  mutex_unlock(emu->convert_mutex);
+}
+
+/* wait for the convert thread to finish parsing the pending context, and
+   finish converting it into the frame. returns 0 if the context must be
+   converted again from scratch */
+static int emu_convert_finish(struct emu *emu, struct emu_frame *frame) {
+  int converted = 0;
+
+  mutex_lock(emu->convert_mutex);
+
+  while (emu->running && !emu->convert_ended) {
+    cond_wait(emu->convert_cond, emu->convert_mutex);
+  }
+
+  if (emu->convert_ended) {
+    converted = tr_end_context(emu->convert_tr, frame->ctx, &emu->convert_rc);
+
+    /* swap the storage rather than copying the converted context, the
+       frame's previous storage is reused for the next conversion */
+    if (converted) {
+      struct tr_context rc = frame->rc;
+      frame->rc = emu->convert_rc;
+      emu->convert_rc = rc;
+    }
+
+    emu->convert_ended = 0;
+    cond_broadcast(emu->convert_cond);
+  }
+
+  mutex_unlock(emu->convert_mutex);
+
+  return converted;
+}
+
+/* release the pending context's conversion without using it, called when
+   the video thread never got around to it */
+static void emu_convert_release(struct emu *emu) {
+  mutex_lock(emu->convert_mutex);
+
+  while (emu->running && !emu->convert_ended) {
+    cond_wait(emu->convert_cond, emu->convert_mutex);
+  }
+
+  emu->convert_ended = 0;
+  cond_broadcast(emu->convert_cond);
+
+  mutex_unlock(emu->convert_mutex);
+}
+
+static void *emu_convert_thread(void *data) {
+  struct emu *emu = data;
+  struct tile_context *ctx = NULL;
+
+  while (emu->running) {
+    struct emu_convert_msg msg;
+
+    if (ringbuf_available(emu->convert_queue) < (int)sizeof(msg)) {
+      mutex_lock(emu->convert_mutex);
+      while (emu->running &&
+             ringbuf_available(emu->convert_queue) < (int)sizeof(msg)) {
+        cond_wait(emu->convert_cond, emu->convert_mutex);
+      }
+      mutex_unlock(emu->convert_mutex);
+      continue;
+    }
+
+    void *read_ptr = ringbuf_read_ptr(emu->convert_queue);
+    memcpy(&msg, read_ptr, sizeof(msg));
+
+    switch (msg.type) {
+      case CONVERT_BEGIN: {
+        /* wait for the video thread to finish with the previous context */
+        mutex_lock(emu->convert_mutex);
+        while (emu->running && emu->convert_ended) {
+          cond_wait(emu->convert_cond, emu->convert_mutex);
+        }
+        mutex_unlock(emu->convert_mutex);
+
+        ctx = msg.ctx;
+        tr_begin_context(emu->convert_tr, &emu->convert_rc, msg.autosort);
+      } break;
+
+      case CONVERT_PARSE: {
+        if (msg.ctx == ctx) {
+          tr_parse_context(emu->convert_tr, ctx, &emu->convert_rc, msg.end);
+        }
+      } break;
+
+      case CONVERT_END: {
+        CHECK_EQ(msg.ctx, ctx);
+        tr_parse_context(emu->convert_tr, ctx, &emu->convert_rc, msg.end);
+        ctx = NULL;
+
+        mutex_lock(emu->convert_mutex);
+        emu->convert_ended = 1;
+        cond_broadcast(emu->convert_cond);
+        mutex_unlock(emu->convert_mutex);
+      } break;
+
+      /* the context was skipped, drop it without handing it to the video
+         thread */
+      case CONVERT_CANCEL: {
+        CHECK_EQ(msg.ctx, ctx);
+        ctx = NULL;
+      } break;
+    }
+
+    /* only advance once the message has been processed, so an empty queue
+       means the thread is no longer reading any context */
+    ringbuf_advance_read_ptr(emu->convert_queue, sizeof(msg));
+    emu_convert_signal(emu);
+  }
+
+  return NULL;
+}
+
+/*
+ * frame queue. frames cycle from the emulation thread, which queues them when
+ * the guest starts a render, to the video thread, which converts and renders
+ * them, and back to the emulation thread, which presents them
+ */
+static void emu_reclaim_frames(struct emu *emu) {
+  /* the newest rendered frame replaces the presented frame, any older frames
+     are skipped */
+  while (ringbuf_available(emu->rendered_frames) >=
+         (int)sizeof(struct emu_frame *)) {
+    struct emu_frame *frame;
+    void *read_ptr = ringbuf_read_ptr(emu->rendered_frames);
+    memcpy(&frame, read_ptr, sizeof(frame));
+    ringbuf_advance_read_ptr(emu->rendered_frames, sizeof(frame));
+
+    if (emu->presented_frame) {
+      CHECK_LT(emu->num_free_frames, MAX_FRAMES);
+      emu->free_frames[emu->num_free_frames++] = emu->presented_frame;
+    }
+
+    emu->presented_frame = frame;
+  }
+}
+
+static struct emu_frame *emu_acquire_frame(struct emu *emu) {
+  emu_reclaim_frames(emu);
+
+  /* every frame is in flight, wait for the video thread to finish one. it
+     signals rendered_cond under rendered_mutex after pushing each frame */
+  while (emu->running && !emu->num_free_frames) {
+    mutex_lock(emu->rendered_mutex);
+    while (emu->running && !ringbuf_available(emu->rendered_frames)) {
+      cond_wait(emu->rendered_cond, emu->rendered_mutex);
+    }
+    mutex_unlock(emu->rendered_mutex);
+
+    emu_reclaim_frames(emu);
+  }
+
+  if (!emu->num_free_frames) {
+    return NULL;
+  }
+
+  return emu->free_frames[--emu->num_free_frames];
+}
+
+static void emu_release_frame(struct emu *emu, struct emu_frame *frame) {
+  CHECK_LT(emu->num_free_frames, MAX_FRAMES);
+  frame->ctx = NULL;
+  frame->incremental = 0;
+  emu->free_frames[emu->num_free_frames++] = frame;
+}
+
+static void emu_push_frame(struct emu *emu, struct emu_frame *frame) {
+  CHECK_GE(ringbuf_remaining(emu->rendered_frames), (int)sizeof(frame));
+
+  void *write_ptr = ringbuf_write_ptr(emu->rendered_frames);
+  memcpy(write_ptr, &frame, sizeof(frame));
+  ringbuf_advance_write_ptr(emu->rendered_frames, sizeof(frame));
+
+  if (emu->multi_threaded) {
+    mutex_lock(emu->rendered_mutex);
+    cond_signal(emu->rendered_cond);
+    mutex_unlock(emu->rendered_mutex);
+  }
+}
+
+static void emu_destroy_frames(struct emu *emu) {
+  for (int i = 0; i < MAX_FRAMES; i++) {
+    struct emu_frame *frame = &emu->frames[i];
+
+    if (frame->fb) {
+      r_destroy_framebuffer(emu->r, frame->fb);
+    }
+
+    if (frame->sync) {
+      r_destroy_sync(emu->r, frame->sync);
+    }
+
+    frame->ctx = NULL;
+    frame->incremental = 0;
+    frame->queued_time = 0;
+    frame->fb = 0;
+    frame->tex = 0;
+    frame->width = 0;
+    frame->height = 0;
+    frame->sync = 0;
+  }
+
+  if (emu->rendered_frames) {
+    ringbuf_destroy(emu->rendered_frames);
+    emu->rendered_frames = NULL;
+  }
+
+  emu->num_free_frames = 0;
+  emu->presented_frame = NULL;
+}
+
+static void emu_init_frames(struct emu *emu) {
+  emu->rendered_frames = ringbuf_create(RENDERED_QUEUE_SIZE);
+
+  for (int i = 0; i < MAX_FRAMES; i++) {
+    emu->free_frames[i] = &emu->frames[MAX_FRAMES - i - 1];
+  }
+  emu->num_free_frames = MAX_FRAMES;
+  emu->presented_frame = NULL;
+}
+
 /*
  * video rendering. responsible for dequeuing the latest raw tile_context from
  * the dreamcast, converting it into a renderable tr_context, and then rendering
- * and presenting it
+ * it to the frame's framebuffer to be presented
  */
-static void emu_render_frame(struct emu *emu) {
+static void emu_render_frame(struct emu *emu, struct emu_frame *frame) {
   prof_counter_add(COUNTER_frames, 1);
 
-  /* resize the framebuffer at this time if the output size has changed */
-  if (emu->video_resized) {
-    r_destroy_framebuffer(emu->r, emu->video_fb);
+  int width = emu->video_width;
+  int height = emu->video_height;
+
+  /* each frame's framebuffer is lazily created, and recreated at this time if
+     the output size has changed since it was last rendered to */
+  if (frame->fb && (frame->width != width || frame->height != height)) {
+    r_destroy_framebuffer(emu->r, frame->fb);
+    frame->fb = 0;
+  }
 
-    emu->video_fb = r_create_framebuffer(emu->r, emu->video_width,
-                                         emu->video_height, &emu->video_tex);
-    emu->video_resized = 0;
+  if (!frame->fb) {
+    frame->fb = r_create_framebuffer(emu->r, width, height, &frame->tex);
+    frame->width = width;
+    frame->height = height;
   }
 
-  /* render the current render context to the video framebuffer */
+  /* record the converted context's drawing to the frame's framebuffer, and
+     replay it against the backend */
   framebuffer_handle_t original = r_get_framebuffer(emu->r);
-  r_bind_framebuffer(emu->r, emu->video_fb);
-  r_viewport(emu->r, emu->video_width, emu->video_height);
-  tr_render_context(emu->r, &emu->pending_rc);
-  r_bind_framebuffer(emu->r, original);
+
+  r_reset_cmdbuf(frame->cmds);
+  r_cmd_bind_framebuffer(frame->cmds, frame->fb);
+  r_cmd_viewport(frame->cmds, width, height);
+  tr_record_context(frame->cmds, &frame->rc);
+  r_cmd_bind_framebuffer(frame->cmds, original);
+
+  r_replay_cmdbuf(emu->r, frame->cmds);
 
   /* insert fence for main thread to synchronize on in order to ensure that
      the context has completely rendered */
   if (emu->multi_threaded) {
-    emu->video_sync = r_insert_sync(emu->r);
+    /* frames which were skipped without being presented still have the sync
+       from when they were last rendered */
+    if (frame->sync) {
+      r_destroy_sync(emu->r, frame->sync);
+    }
+    frame->sync = r_insert_sync(emu->r);
   }
 
   /* update frame-based profiler stats */
@@ -374,42 +1364,80 @@ static void *emu_video_thread(void *data) {
   while (1) {
     mutex_lock(emu->pending_mutex);
 
-    /* wait for the next tile context provided by emu_start_render */
-    while (emu->running && !emu->pending_ctx) {
+    /* wait for the next frame provided by emu_start_render */
+    while (emu->running && !emu->pending_frame) {
       cond_wait(emu->pending_cond, emu->pending_mutex);
     }
 
+    mutex_unlock(emu->pending_mutex);
+
+    /* wait for the main thread to finish presenting. the context mutex is
+       always acquired before the pending mutex */
+    mutex_lock(emu->context_mutex);
+    mutex_lock(emu->pending_mutex);
+
     /* check for shutdown */
     if (!emu->running) {
-      emu->pending_ctx = NULL;
       mutex_unlock(emu->pending_mutex);
+      mutex_unlock(emu->context_mutex);
       break;
     }
 
+    /* the frame may have been skipped while waiting on the context */
+    struct emu_frame *frame = emu->pending_frame;
+    if (!frame) {
+      mutex_unlock(emu->pending_mutex);
+      mutex_unlock(emu->context_mutex);
+      continue;
+    }
+
     video_bind_context(emu->host, emu->r);
 
-    /* convert the context, uploading its textures to the render backend */
-    tr_convert_context(emu->r, emu, &emu_find_texture, emu->pending_ctx,
-                       &emu->pending_rc);
-    emu->pending_ctx = NULL;
+    /* convert the context, uploading its textures to the render backend. if
+       the convert thread has been parsing it, only finish the conversion */
+    int converted = 0;
 
-    /* render the parsed context to an offscreen framebuffer */
-    emu_render_frame(emu);
+    emu_reset_texture_stats(emu);
+    emu_update_palette(emu, frame->ctx);
 
-    /* release the context for the main thread to use */
-    video_unbind_context(emu->host);
+    if (frame->incremental) {
+      converted = emu_convert_finish(emu, frame);
+    }
+
+    if (!converted) {
+      tr_convert_context_parallel(emu->convert_workers, emu->r, emu->atlas,
+                                  emu, &emu_find_texture, frame->ctx,
+                                  &frame->rc);
+    }
+
+    emu_finish_texture_jobs(emu);
+
+    prof_counter_set(COUNTER_convert_latency,
+                     time_nanoseconds() - frame->queued_time);
+
+    frame->ctx = NULL;
+    frame->incremental = 0;
+    emu->pending_frame = NULL;
 
-    /* after the context has been rendered, release the mutex to unblock
-       emu_guest_finish_render
+    /* once converted, the frame no longer references guest memory. release
+       the mutex to unblock emu_guest_finish_render, letting the guest carry
+       on while the frame is rendered */
+    mutex_unlock(emu->pending_mutex);
+
+    /* render the converted context to the frame's framebuffer */
+    emu_render_frame(emu, frame);
 
-       note, the main purpose of this mutex is to prevent the cpu from writing
-       to texture memory before it's been uploaded to the render backend. from
-       that perspective, this mutex could be released after tr_convert_context
-       and before emu_render_frame, enabling the frame to take more time to
-       render on the host than estimated by emu_guest_finish_render. however,
-       then multiple framebuffers would have to be managed and synchronized in
-       order to allow emu_render_frame and emu_paint to run in parallel */
+    /* the texture cache is shared with the emulation thread */
+    mutex_lock(emu->pending_mutex);
+    emu_share_uploaded_textures(emu);
+    emu_update_texture_stats(emu);
     mutex_unlock(emu->pending_mutex);
+
+    /* release the context for the main thread to present with */
+    video_unbind_context(emu->host);
+    mutex_unlock(emu->context_mutex);
+
+    emu_push_frame(emu, frame);
   }
 
   return NULL;
@@ -426,7 +1454,11 @@ static void emu_paint(struct emu *emu) {
   r_viewport(emu->r, emu->video_width, emu->video_height);
 
   /* present the latest frame from the video thread */
-  {
+  emu_reclaim_frames(emu);
+
+  struct emu_frame *frame = emu->presented_frame;
+
+  if (frame) {
     struct ui_vertex verts[6] = {
         /* triangle 1, top left  */
         {{0.0f, 0.0f}, {0.0f, 1.0f}, 0xffffffff},
@@ -444,17 +1476,25 @@ static void emu_paint(struct emu *emu) {
 
     struct ui_surface quad = {0};
     quad.prim_type = PRIM_TRIANGLES;
-    quad.texture = emu->video_tex;
+    quad.texture = frame->tex;
     quad.src_blend = BLEND_NONE;
     quad.dst_blend = BLEND_NONE;
     quad.first_vert = 0;
     quad.num_verts = 6;
 
     /* wait for the frame to finish rendering */
-    if (emu->video_sync) {
-      r_wait_sync(emu->r, emu->video_sync);
-      r_destroy_sync(emu->r, emu->video_sync);
-      emu->video_sync = 0;
+    if (frame->sync) {
+      r_wait_sync(emu->r, frame->sync);
+      r_destroy_sync(emu->r, frame->sync);
+      frame->sync = 0;
+    }
+
+    /* latency is measured from when the guest started the render to when the
+       frame is first presented */
+    if (frame->queued_time) {
+      prof_counter_set(COUNTER_frame_latency,
+                       time_nanoseconds() - frame->queued_time);
+      frame->queued_time = 0;
     }
 
     r_begin_ui_surfaces(emu->r, verts, 6, NULL, 0);
@@ -462,6 +1502,9 @@ static void emu_paint(struct emu *emu) {
     r_end_ui_surfaces(emu->r);
   }
 
+  prof_counter_set(COUNTER_frame_queue_depth,
+                   MAX_FRAMES - emu->num_free_frames - (frame ? 1 : 0));
+
 #if ENABLE_IMGUI
   if (emu->debug_menu) {
     if (igBeginMainMenuBar()) {
@@ -481,6 +1524,22 @@ static void emu_paint(struct emu *emu) {
           emu_dirty_textures(emu);
         }
 
+        if (igMenuItem("batch surfaces", NULL, OPTION_batch_surfaces, 1)) {
+          OPTION_batch_surfaces = !OPTION_batch_surfaces;
+        }
+
+        if (igMenuItem("texture atlas", NULL, OPTION_texture_atlas, 1)) {
+          OPTION_texture_atlas = !OPTION_texture_atlas;
+        }
+
+        if (igMenuItem("modifier volumes", NULL, OPTION_modifier_volumes, 1)) {
+          OPTION_modifier_volumes = !OPTION_modifier_volumes;
+        }
+
+        if (igMenuItem("frameskip", NULL, OPTION_frameskip, 1)) {
+          OPTION_frameskip = !OPTION_frameskip;
+        }
+
         igEndMenu();
       }
 
@@ -491,6 +1550,7 @@ static void emu_paint(struct emu *emu) {
     holly_debug_menu(emu->dc->holly);
     aica_debug_menu(emu->dc->aica);
     sh4_debug_menu(emu->dc->sh4);
+    memory_debug_menu(emu->dc->memory);
 
     /* add status */
     if (igBeginMainMenuBar()) {
@@ -498,13 +1558,19 @@ static void emu_paint(struct emu *emu) {
       int frames = (int)prof_counter_load(COUNTER_frames);
       int ta_renders = (int)prof_counter_load(COUNTER_ta_renders);
       int pvr_vblanks = (int)prof_counter_load(COUNTER_pvr_vblanks);
+      float ta_data =
+          prof_counter_load(COUNTER_ta_data) / (1024.0f * 1024.0f);
+      float g2_data =
+          prof_counter_load(COUNTER_g2_data) / (1024.0f * 1024.0f);
       int sh4_instrs =
           (int)(prof_counter_load(COUNTER_sh4_instrs) / 1000000.0f);
       int arm7_instrs =
           (int)(prof_counter_load(COUNTER_arm7_instrs) / 1000000.0f);
 
-      snprintf(status, sizeof(status), "FPS %3d RPS %3d VBS %3d SH4 %4d ARM %d",
-               frames, ta_renders, pvr_vblanks, sh4_instrs, arm7_instrs);
+      snprintf(status, sizeof(status),
+               "FPS %3d RPS %3d VBS %3d TA %5.2fMB G2 %5.2fMB SH4 %4d ARM %d",
+               frames, ta_renders, pvr_vblanks, ta_data, g2_data, sh4_instrs,
+               arm7_instrs);
 
       /* right align */
       struct ImVec2 content;
@@ -543,6 +1609,115 @@ static void emu_paint(struct emu *emu) {
                       graph_size, sizeof(float));
         }
 
+        /* average time the host takes to run and present each guest frame,
+           and the frames skipped per second because of it */
+        {
+          float host_time =
+              prof_counter_load(COUNTER_host_frame_time) / 1000000.0f;
+          igValueFloat("host frame time", host_time, "%.2f");
+          igValueInt("frames skipped",
+                     (int)prof_counter_load(COUNTER_frames_skipped));
+        }
+
+        /* time spent converting the context once it was rendered */
+        {
+          float latency =
+              prof_counter_load(COUNTER_convert_latency) / 1000000.0f;
+          igValueFloat("convert latency", latency, "%.2f");
+        }
+
+        /* time from the guest starting a render to it being presented, and
+           the number of frames still being converted or rendered */
+        {
+          float latency = prof_counter_load(COUNTER_frame_latency) / 1000000.0f;
+          igValueFloat("frame latency", latency, "%.2f");
+          igValueInt("frames queued",
+                     (int)prof_counter_load(COUNTER_frame_queue_depth));
+        }
+
+        /* estimated time the hardware took to render the last frame, and the
+           guest time per second freed by not waiting a fixed time instead */
+        {
+          float predicted =
+              prof_counter_load(COUNTER_ta_render_predicted) / 1000000.0f;
+          float saved = prof_counter_load(COUNTER_ta_render_saved) / 1000000.0f;
+          igValueFloat("render estimate", predicted, "%.2f");
+          igValueFloat("render time saved", saved, "%.2f");
+        }
+
+        /* textures converted for the last frame, and the time the video
+           thread spent waiting on the texture workers to finish them */
+        {
+          int converted = (int)prof_counter_load(COUNTER_textures_converted);
+          float wait = prof_counter_load(COUNTER_texture_wait) / 1000000.0f;
+          igValueInt("textures converted", converted);
+          igValueFloat("texture wait", wait, "%.2f");
+        }
+
+        /* how texture lookups were resolved for the last frame. hits were
+           clean, skips were dirtied without their data changing, and dedups
+           shared the backend texture of identical data */
+        {
+          int lookups = (int)prof_counter_load(COUNTER_texture_lookups);
+          float scale = lookups ? 100.0f / lookups : 0.0f;
+          igValueInt("texture lookups", lookups);
+          igValueFloat("texture hit %",
+                       prof_counter_load(COUNTER_texture_hits) * scale,
+                       "%.1f");
+          igValueFloat("texture skip %",
+                       prof_counter_load(COUNTER_texture_skips) * scale,
+                       "%.1f");
+          igValueFloat("texture dedup %",
+                       prof_counter_load(COUNTER_texture_dedups) * scale,
+                       "%.1f");
+        }
+
+        /* surfaces drawn for the last frame, and the draw calls and state
+           changes it took to draw them */
+        {
+          igValueInt("surfaces", (int)prof_counter_load(COUNTER_ta_surfaces));
+          igValueInt("draw calls", (int)prof_counter_load(COUNTER_ta_draws));
+          igValueInt("state changes",
+                     (int)prof_counter_load(COUNTER_ta_state_changes));
+        }
+
+        /* how full the atlas pages are, and the texture binds saved for the
+           last frame by merging surfaces sampling the same page */
+        {
+          igValueInt("atlas occupancy %",
+                     (int)prof_counter_load(COUNTER_tr_atlas_occupancy));
+          igValueInt("atlas binds saved",
+                     (int)prof_counter_load(COUNTER_tr_atlas_binds_saved));
+        }
+
+        /* how texture invalidations were detected for the last frame */
+        {
+          igValueInt("texture faults",
+                     (int)prof_counter_load(COUNTER_texture_faults));
+          igValueInt("vram dirty blocks",
+                     (int)prof_counter_load(COUNTER_vram_dirty_blocks));
+          igValueInt("palette banks updated",
+                     (int)prof_counter_load(COUNTER_palette_banks_updated));
+        }
+
+        /* high-water marks of the context storage, and the param storage
+           currently committed across all of the ta's contexts */
+        {
+          igValueFloat("params committed (KB)",
+                       prof_counter_load(COUNTER_ta_params_committed) /
+                           1024.0f,
+                       "%.0f");
+          igValueFloat("params peak (KB)",
+                       prof_counter_load(COUNTER_ta_params_peak) / 1024.0f,
+                       "%.0f");
+          igValueInt("surfaces peak",
+                     (int)prof_counter_load(COUNTER_tr_surfs_peak));
+          igValueInt("vertices peak",
+                     (int)prof_counter_load(COUNTER_tr_verts_peak));
+          igValueInt("indices peak",
+                     (int)prof_counter_load(COUNTER_tr_indices_peak));
+        }
+
         igEnd();
       }
     }
@@ -553,6 +1728,35 @@ static void emu_paint(struct emu *emu) {
   mp_render(emu->mp);
 }
 
+/*
+ * automatic frameskip
+ */
+static int emu_skip_context(struct emu *emu) {
+  /* every context is needed while tracing */
+  if (!OPTION_frameskip || emu->trace_writer) {
+    return 0;
+  }
+
+  int64_t period = pvr_vblank_period(emu->dc->pvr);
+
+  if (emu->host_frame_time <= period ||
+      emu->frames_skipped >= OPTION_max_frameskip) {
+    emu->frames_skipped = 0;
+    return 0;
+  }
+
+  emu->frames_skipped++;
+
+  return 1;
+}
+
+static void emu_update_frame_time(struct emu *emu, int64_t elapsed) {
+  /* average over the last several frames, so a single slow frame doesn't
+     start skipping */
+  emu->host_frame_time += (elapsed - emu->host_frame_time) / 8;
+  prof_counter_set(COUNTER_host_frame_time, emu->host_frame_time);
+}
+
 /*
  * dreamcast guest interface
  */
@@ -579,8 +1783,20 @@ static void emu_guest_finish_render(void *userdata) {
        the yet-to-be-uploaded texture memory */
     mutex_lock(emu->pending_mutex);
 
-    /* if pending_ctx is non-NULL here, a frame is being skipped */
-    emu->pending_ctx = NULL;
+    /* if pending_frame is non-NULL here, the video thread hasn't started on
+       it and the frame is being skipped. note, frames which have been
+       converted but are still being rendered don't block the guest */
+    struct emu_frame *frame = emu->pending_frame;
+
+    if (frame) {
+      if (frame->incremental) {
+        emu_convert_release(emu);
+      }
+      emu_finish_texture_jobs(emu);
+      emu_release_frame(emu, frame);
+    }
+
+    emu->pending_frame = NULL;
 
     mutex_unlock(emu->pending_mutex);
   }
@@ -589,9 +1805,39 @@ static void emu_guest_finish_render(void *userdata) {
 static void emu_guest_start_render(void *userdata, struct tile_context *ctx) {
   struct emu *emu = userdata;
 
+  /* when the host is falling behind, drop the context before acquiring a
+     frame, which may wait on the video thread. the texture cache is left
+     alone, writes to texture memory keep accumulating in the dirty bitmaps
+     and modified list, and are applied by the next context that is drawn.
+     the end of render interrupts are still raised by the ta on schedule */
+  if (emu_skip_context(emu)) {
+    if (emu->multi_threaded) {
+      if (emu->convert_ctx == ctx) {
+        emu_convert_push(emu, CONVERT_CANCEL, ctx, ctx->size);
+      }
+
+      emu->convert_ctx = NULL;
+      emu->convert_autosort = ctx->autosort;
+    }
+
+    prof_counter_add(COUNTER_frames_skipped, 1);
+    return;
+  }
+
   /* note, while the video thread is guaranteed to not to be touching texture
      memory from the previous frame at this point, it could still be actually
-     rendering the previous frame */
+     rendering the previous frame(s). a free frame is acquired before touching
+     the texture cache, as it may require waiting on the video thread */
+  struct emu_frame *frame = emu_acquire_frame(emu);
+  if (!frame) {
+    return;
+  }
+
+  /* the video thread may still be sharing the textures uploaded by the
+     previous frame */
+  if (emu->multi_threaded) {
+    mutex_lock(emu->pending_mutex);
+  }
 
   /* incement internal frame number. this frame number is assigned to the each
      texture source registered to assert synchronization between the emulator
@@ -599,8 +1845,13 @@ static void emu_guest_start_render(void *userdata, struct tile_context *ctx) {
   emu->pending_id++;
 
   /* now that the video thread is sure to not be accessing the texture data,
-     mark any textures dirty that were invalidated by a memory watch */
+     mark any textures dirty that were invalidated by a memory watch, and
+     stamp the blocks written since the last context */
   emu_dirty_modified_textures(emu);
+  emu_collect_dirty_blocks(emu);
+
+  prof_counter_set(COUNTER_texture_faults, emu->texture_faults);
+  emu->texture_faults = 0;
 
   /* register the source of each texture referenced by the context with the
      tile renderer. note, uploading the texture to the render backend happens
@@ -608,24 +1859,87 @@ static void emu_guest_start_render(void *userdata, struct tile_context *ctx) {
      backend know where the texture's source data is */
   emu_register_texture_sources(emu, ctx);
 
+  frame->ctx = ctx;
+  frame->incremental = 0;
+  frame->queued_time = time_nanoseconds();
+
   if (emu->trace_writer) {
     trace_writer_render_context(emu->trace_writer, ctx);
   }
 
   if (emu->multi_threaded) {
-    /* save off context and notify video thread that it's available */
-    mutex_lock(emu->pending_mutex);
+    /* send the convert thread the remainder of the context if it's been
+       parsing it. the autosort state of this context is used as the guess for
+       the next one */
+    int incremental = emu->convert_ctx == ctx;
+
+    if (incremental) {
+      emu_convert_push(emu, CONVERT_END, ctx, ctx->size);
+    }
+
+    emu->convert_ctx = NULL;
+    emu->convert_autosort = ctx->autosort;
+
+    /* replace any frame the video thread never started on */
+    struct emu_frame *skipped = emu->pending_frame;
+
+    if (skipped) {
+      if (skipped->incremental) {
+        emu_convert_release(emu);
+      }
+      emu_release_frame(emu, skipped);
+    }
 
-    emu->pending_ctx = ctx;
+    /* queue the frame and notify video thread that it's available */
+    frame->incremental = incremental;
+    emu->pending_frame = frame;
     cond_signal(emu->pending_cond);
 
     mutex_unlock(emu->pending_mutex);
   } else {
+    emu_reset_texture_stats(emu);
+    emu_update_palette(emu, ctx);
+
     /* convert the context and immediately render it */
-    tr_convert_context(emu->r, emu, &emu_find_texture, ctx, &emu->pending_rc);
+    tr_convert_context_parallel(emu->convert_workers, emu->r, emu->atlas, emu,
+                                &emu_find_texture, ctx, &frame->rc);
+    frame->ctx = NULL;
+
+    prof_counter_set(COUNTER_convert_latency,
+                     time_nanoseconds() - frame->queued_time);
+
+    emu_render_frame(emu, frame);
+
+    emu_share_uploaded_textures(emu);
+    emu_update_texture_stats(emu);
+
+    emu_push_frame(emu, frame);
+  }
+}
+
+static void emu_guest_write_context(void *userdata, struct tile_context *ctx) {
+  struct emu *emu = userdata;
+
+  if (!emu->multi_threaded || ctx != emu->convert_ctx) {
+    return;
+  }
+
+  emu_convert_push(emu, CONVERT_PARSE, ctx, ctx->cursor);
+}
 
-    emu_render_frame(emu);
+static void emu_guest_init_context(void *userdata, struct tile_context *ctx) {
+  struct emu *emu = userdata;
+
+  if (!emu->multi_threaded) {
+    return;
   }
+
+  /* the context's params are about to be overwritten, ensure the convert
+     thread isn't still reading them before starting on the new context */
+  emu_convert_drain(emu);
+
+  emu->convert_ctx = ctx;
+  emu_convert_push(emu, CONVERT_BEGIN, ctx, 0);
 }
 
 static void emu_guest_push_audio(void *userdata, const int16_t *data,
@@ -671,30 +1985,74 @@ static void emu_host_context_destroyed(void *userdata) {
 
   /* destroy the video thread */
   if (emu->multi_threaded) {
+    /* release the video context so the video thread can finish any frame
+       it's working on */
+    video_unbind_context(emu->host);
+    mutex_unlock(emu->context_mutex);
+
     mutex_lock(emu->pending_mutex);
     cond_signal(emu->pending_cond);
     mutex_unlock(emu->pending_mutex);
 
+    mutex_lock(emu->rendered_mutex);
+    cond_signal(emu->rendered_cond);
+    mutex_unlock(emu->rendered_mutex);
+
     void *result;
     thread_join(emu->video_thread, &result);
+
+    mutex_lock(emu->context_mutex);
+    video_bind_context(emu->host, emu->r);
+
+    emu_convert_signal(emu);
+    thread_join(emu->convert_thread, &result);
+
+    /* release the output of any jobs for a context that was never rendered */
+    emu_finish_texture_jobs(emu);
+
+    if (emu->texture_workers) {
+      worker_pool_destroy(emu->texture_workers);
+      emu->texture_workers = NULL;
+    }
   }
 
   /* destroy video renderer objects */
   rb_for_each_entry_safe(tex, &emu->live_textures, struct emu_texture,
                          live_it) {
-    r_destroy_texture(emu->r, tex->handle);
+    emu_release_texture(emu, tex);
     emu_free_texture(emu, tex);
   }
 
-  r_destroy_framebuffer(emu->r, emu->video_fb);
+  list_clear(&emu->uploaded_textures);
 
-  if (emu->video_sync) {
-    r_destroy_sync(emu->r, emu->video_sync);
-  }
+  r_destroy_texture(emu->r, emu->palette_texture);
+  emu->palette_texture = 0;
+
+  tr_atlas_destroy(emu->atlas);
+  emu->atlas = NULL;
+
+  tr_destroy_workers(emu->convert_workers);
+  emu->convert_workers = NULL;
+
+  emu_destroy_frames(emu);
 
   if (emu->multi_threaded) {
+    tr_destroy(emu->convert_tr);
+    ringbuf_destroy(emu->convert_queue);
+    cond_destroy(emu->convert_cond);
+    mutex_destroy(emu->convert_mutex);
+
+    cond_destroy(emu->texture_done_cond);
+    mutex_destroy(emu->texture_mutex);
+
+    cond_destroy(emu->rendered_cond);
+    mutex_destroy(emu->rendered_mutex);
+
     cond_destroy(emu->pending_cond);
     mutex_destroy(emu->pending_mutex);
+
+    mutex_unlock(emu->context_mutex);
+    mutex_destroy(emu->context_mutex);
   }
 
   mp_destroy(emu->mp);
@@ -713,20 +2071,59 @@ static void emu_host_context_reset(void *userdata) {
   emu->r = video_create_renderer(emu->host);
   emu->imgui = imgui_create(emu->r);
   emu->mp = mp_create(emu->r);
+  emu->atlas = tr_atlas_create(emu->r);
+  emu_create_palette(emu);
+  emu->convert_workers = tr_create_workers(OPTION_convert_workers);
 
   /* create video renderer */
   if (emu->multi_threaded) {
+    emu->context_mutex = mutex_create();
+
     emu->pending_mutex = mutex_create();
     emu->pending_cond = cond_create();
+    emu->pending_frame = NULL;
+
+    emu->rendered_mutex = mutex_create();
+    emu->rendered_cond = cond_create();
+
+    emu->convert_mutex = mutex_create();
+    emu->convert_cond = cond_create();
+    emu->convert_queue = ringbuf_create(CONVERT_QUEUE_SIZE);
+    emu->convert_tr =
+        tr_create(emu->r, emu->atlas, emu, &emu_find_texture);
+    emu->convert_ctx = NULL;
+    emu->convert_ended = 0;
+
+    emu->texture_mutex = mutex_create();
+    emu->texture_done_cond = cond_create();
+    emu->num_texture_jobs = 0;
   }
 
-  emu->video_fb = r_create_framebuffer(emu->r, emu->video_width,
-                                       emu->video_height, &emu->video_tex);
+  /* each frame's framebuffer is created the first time it's rendered to */
+  emu_init_frames(emu);
 
-  /* startup video thread */
+  /* startup video thread. the main thread starts out owning the video
+     context */
   if (emu->multi_threaded) {
+    mutex_lock(emu->context_mutex);
+
     emu->video_thread = thread_create(&emu_video_thread, NULL, emu);
     CHECK_NOTNULL(emu->video_thread);
+
+    emu->convert_thread = thread_create(&emu_convert_thread, NULL, emu);
+    CHECK_NOTNULL(emu->convert_thread);
+
+    /* the converters are selected before starting the workers, as they
+       don't select them themselves */
+    pixel_convert_init();
+
+    int num_texture_workers =
+        MIN(MAX(OPTION_texture_workers, 0), MAX_TEXTURE_WORKERS);
+
+    if (num_texture_workers) {
+      emu->texture_workers = worker_pool_create(num_texture_workers);
+      worker_pool_begin(emu->texture_workers, &emu_texture_job, emu);
+    }
   }
 }
 
@@ -735,15 +2132,17 @@ static void emu_host_resized(void *userdata) {
 
   emu->video_width = video_width(emu->host);
   emu->video_height = video_height(emu->host);
-  emu->video_resized = 1;
 }
 
 void emu_run_frame(struct emu *emu) {
   static const int64_t MACHINE_STEP = HZ_TO_NANO(1000);
 
+  int64_t start = time_nanoseconds();
+
   /* unbind the video context, making it available for the video thread */
   if (emu->multi_threaded) {
     video_unbind_context(emu->host);
+    mutex_unlock(emu->context_mutex);
   }
 
   /* run dreamcast up until its next vblank */
@@ -752,19 +2151,17 @@ void emu_run_frame(struct emu *emu) {
     dc_tick(emu->dc, MACHINE_STEP);
   }
 
-  /* ensure the video thread is done rendering */
+  /* take back the video context to present the latest rendered frame. this
+     only waits for the video thread if it's in the middle of rendering, it
+     doesn't wait for the most recent frame to be rendered */
   if (emu->multi_threaded) {
-    mutex_lock(emu->pending_mutex);
-    mutex_unlock(emu->pending_mutex);
+    mutex_lock(emu->context_mutex);
+    video_bind_context(emu->host, emu->r);
   }
 
   /* render the latest frame */
   int64_t now = time_nanoseconds();
 
-  if (emu->multi_threaded) {
-    video_bind_context(emu->host, emu->r);
-  }
-
   prof_update(now);
   emu_paint(emu);
 
@@ -775,6 +2172,8 @@ void emu_run_frame(struct emu *emu) {
   }
 
   emu->last_paint = now;
+
+  emu_update_frame_time(emu, time_nanoseconds() - start);
 }
 
 int emu_load_game(struct emu *emu, const char *path) {
@@ -792,6 +2191,12 @@ void emu_destroy(struct emu *emu) {
 
   dc_destroy(emu->dc);
 
+  for (int i = 0; i < MAX_FRAMES; i++) {
+    tr_free_context(&emu->frames[i].rc);
+    r_destroy_cmdbuf(emu->frames[i].cmds);
+  }
+  tr_free_context(&emu->convert_rc);
+
   free(emu);
 }
 
@@ -815,6 +2220,8 @@ struct emu *emu_create(struct host *host) {
   emu->dc = dc_create();
   emu->dc->userdata = emu;
   emu->dc->push_audio = &emu_guest_push_audio;
+  emu->dc->init_context = &emu_guest_init_context;
+  emu->dc->write_context = &emu_guest_write_context;
   emu->dc->start_render = &emu_guest_start_render;
   emu->dc->finish_render = &emu_guest_finish_render;
   emu->dc->vertical_blank = &emu_guest_vertical_blank;
@@ -823,6 +2230,10 @@ struct emu *emu_create(struct host *host) {
   /* start up secondary video thread */
   emu->multi_threaded = video_supports_multiple_threads(emu->host);
 
+  for (int i = 0; i < MAX_FRAMES; i++) {
+    emu->frames[i].cmds = r_create_cmdbuf();
+  }
+
   /* enable debug menu by default */
   emu->debug_menu = 1;
 
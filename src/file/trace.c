@@ -3,6 +3,7 @@
 #include "core/assert.h"
 #include "core/filesystem.h"
 #include "core/math.h"
+#include "guest/pvr/ta.h"
 #include "guest/pvr/tr.h"
 
 void trace_writer_close(struct trace_writer *writer) {
@@ -175,6 +176,7 @@ void trace_copy_context(const struct trace_cmd *cmd, struct tile_context *ctx) {
   ctx->video_height = cmd->context.video_height;
   memcpy(ctx->bg_vertices, cmd->context.bg_vertices,
          cmd->context.bg_vertices_size);
+  ta_reserve_params(ctx, cmd->context.params_size);
   memcpy(ctx->params, cmd->context.params, cmd->context.params_size);
   ctx->size = cmd->context.params_size;
 }
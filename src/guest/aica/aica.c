@@ -537,22 +537,34 @@ static int32_t aica_channel_update(struct aica *aica, struct aica_channel *ch) {
   uint32_t next_frac = AICA_OFFSET_FRAC(next_offset);
   uint32_t pos = AICA_OFFSET_POS(ch->offset);
 
-  while (pos < next_pos) {
+  if (pos < next_pos) {
     switch (ch->data->PCMS) {
+      /* pcm samples don't depend on one another, so only the last sample in
+         the step needs to be fetched */
       case AICA_FMT_PCMS16: {
-        next_sample = *(int16_t *)&ch->base[pos << 1];
+        const int16_t *samples = (const int16_t *)ch->base;
+        next_sample = samples[next_pos - 1];
       } break;
 
       case AICA_FMT_PCMS8: {
-        next_sample = *(int8_t *)&ch->base[pos] << 8;
+        const int8_t *samples = (const int8_t *)ch->base;
+        next_sample = samples[next_pos - 1] << 8;
       } break;
 
       case AICA_FMT_ADPCM:
       case AICA_FMT_ADPCM_STREAM: {
-        int shift = (pos & 1) << 2;
-        int32_t data = (ch->base[pos >> 1] >> shift) & 0xf;
-        aica_decode_adpcm(data, ch->prev_sample, ch->prev_quant, &next_sample,
-                          &next_quant);
+        const uint8_t *samples = ch->base;
+        int32_t prev_sample = ch->prev_sample;
+        int32_t prev_quant = ch->prev_quant;
+
+        for (; pos < next_pos; pos++) {
+          int shift = (pos & 1) << 2;
+          int32_t data = (samples[pos >> 1] >> shift) & 0xf;
+          aica_decode_adpcm(data, prev_sample, prev_quant, &next_sample,
+                            &next_quant);
+          prev_sample = next_sample;
+          prev_quant = next_quant;
+        }
       } break;
 
       default:
@@ -562,7 +574,6 @@ static int32_t aica_channel_update(struct aica *aica, struct aica_channel *ch) {
 
     ch->prev_sample = next_sample;
     ch->prev_quant = next_quant;
-    pos++;
   }
 
   ch->offset = next_offset;
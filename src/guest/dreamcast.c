@@ -40,6 +40,22 @@ void dc_finish_render(struct dreamcast *dc) {
   dc->finish_render(dc->userdata);
 }
 
+void dc_write_context(struct dreamcast *dc, struct tile_context *ctx) {
+  if (!dc->write_context) {
+    return;
+  }
+
+  dc->write_context(dc->userdata, ctx);
+}
+
+void dc_init_context(struct dreamcast *dc, struct tile_context *ctx) {
+  if (!dc->init_context) {
+    return;
+  }
+
+  dc->init_context(dc->userdata, ctx);
+}
+
 void dc_start_render(struct dreamcast *dc, struct tile_context *ctx) {
   if (!dc->start_render) {
     return;
@@ -86,6 +102,15 @@ static int dc_load_disc(struct dreamcast *dc, const char *path) {
   }
 
   gdrom_set_disc(dc->gdrom, disc);
+
+  /* select the render time model for the title */
+  struct disc_meta meta;
+  disc_get_meta(disc, &meta);
+
+  char id[16];
+  strncpy_trim_spaces(id, meta.id, sizeof(meta.id));
+  ta_set_title(dc->ta, id);
+
   sh4_reset(dc->sh4, 0xa0000000);
   dc_resume(dc);
 
@@ -95,6 +120,7 @@ static int dc_load_disc(struct dreamcast *dc, const char *path) {
 int dc_load(struct dreamcast *dc, const char *path) {
   if (!path) {
     /* boot to main menu of no path specified */
+    ta_set_title(dc->ta, NULL);
     sh4_reset(dc->sh4, 0xa0000000);
     dc_resume(dc);
     return 1;
@@ -123,6 +123,8 @@ struct device {
  * machine
  */
 typedef void (*push_audio_cb)(void *, const int16_t *, int);
+typedef void (*init_context_cb)(void *, struct tile_context *);
+typedef void (*write_context_cb)(void *, struct tile_context *);
 typedef void (*start_render_cb)(void *, struct tile_context *);
 typedef void (*finish_render_cb)(void *);
 typedef void (*vertical_blank_cb)(void *);
@@ -153,6 +155,8 @@ struct dreamcast {
   /* client callbacks */
   void *userdata;
   push_audio_cb push_audio;
+  init_context_cb init_context;
+  write_context_cb write_context;
   start_render_cb start_render;
   finish_render_cb finish_render;
   vertical_blank_cb vertical_blank;
@@ -192,6 +196,8 @@ void dc_input(struct dreamcast *dc, int port, int button, int16_t value);
 
 /* client functionality */
 void dc_push_audio(struct dreamcast *dc, const int16_t *data, int frames);
+void dc_init_context(struct dreamcast *dc, struct tile_context *ctx);
+void dc_write_context(struct dreamcast *dc, struct tile_context *ctx);
 void dc_start_render(struct dreamcast *dc, struct tile_context *ctx);
 void dc_finish_render(struct dreamcast *dc);
 void dc_vertical_blank(struct dreamcast *dc);
@@ -653,7 +653,7 @@ void gdrom_dma_end(struct gdrom *gd) {
   LOG_GDROM("gd_dma_end");
 }
 
-int gdrom_dma_read(struct gdrom *gd, uint8_t *data, int n) {
+int gdrom_dma_read(struct gdrom *gd, const uint8_t **data, int n) {
   /* try to read more if the current dma buffer has been completely read */
   if (gd->dma_head >= gd->dma_size) {
     gdrom_spi_cdread(gd);
@@ -664,7 +664,9 @@ int gdrom_dma_read(struct gdrom *gd, uint8_t *data, int n) {
   CHECK_GT(n, 0);
 
   LOG_GDROM("gdrom_dma_read %d / %d bytes", gd->dma_head + n, gd->dma_size);
-  memcpy(data, &gd->dma_buffer[gd->dma_head], n);
+  /* hand out the internal buffer directly, it remains valid until the next
+     call refills it */
+  *data = &gd->dma_buffer[gd->dma_head];
   gd->dma_head += n;
 
   if (gd->dma_head >= gd->dma_size) {
@@ -13,7 +13,7 @@ void gdrom_destroy(struct gdrom *gd);
 
 void gdrom_set_disc(struct gdrom *gd, struct disc *disc);
 void gdrom_dma_begin(struct gdrom *gd);
-int gdrom_dma_read(struct gdrom *gd, uint8_t *data, int n);
+int gdrom_dma_read(struct gdrom *gd, const uint8_t **data, int n);
 void gdrom_dma_end(struct gdrom *gd);
 
 void gdrom_get_drive_mode(struct gdrom *gd, struct gd_hw_info *info);
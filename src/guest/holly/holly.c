@@ -6,6 +6,8 @@
 #include "guest/sh4/sh4.h"
 #include "render/imgui.h"
 
+DEFINE_AGGREGATE_COUNTER(g2_data);
+
 struct reg_cb holly_cb[NUM_HOLLY_REGS];
 
 /*
@@ -46,21 +48,19 @@ static void holly_gdrom_dma(struct holly *hl) {
   int transfer_size = *hl->SB_GDLEN;
   int remaining = transfer_size;
   uint32_t addr = *hl->SB_GDSTAR;
-  uint8_t sector_data[DISC_MAX_SECTOR_SIZE];
 
   gdrom_dma_begin(gd);
 
-  /* TODO give callback to ddt interface to call instead of data? */
-
   while (remaining) {
-    /* read a single sector at a time from the gdrom */
-    int n = MIN(remaining, (int)sizeof(sector_data));
-    n = gdrom_dma_read(gd, sector_data, n);
+    /* copy as many sectors as the gdrom has buffered at once, straight out of
+       its dma buffer */
+    const uint8_t *data = NULL;
+    int n = gdrom_dma_read(gd, &data, remaining);
 
     struct sh4_dtr dtr = {0};
     dtr.channel = 0;
     dtr.dir = SH4_DMA_TO_ADDR;
-    dtr.data = sector_data;
+    dtr.data = (uint8_t *)data;
     dtr.addr = addr;
     dtr.size = n;
     sh4_dmac_ddt(sh4, &dtr);
@@ -203,7 +203,6 @@ static void holly_g2_dma(struct holly *hl, int channel) {
   uint32_t len = hl->reg[desc->LEN];
   int restart = (len >> 31) == 0;
   int transfer_size = len & 0x7fffffff;
-  int remaining = transfer_size;
   uint32_t src = hl->reg[desc->STAR];
   uint32_t dst = hl->reg[desc->STAG];
 
@@ -213,13 +212,11 @@ static void holly_g2_dma(struct holly *hl, int channel) {
   /* perform the DMA immediately, but don't raise the end of DMA interrupt until
      the DMA should actually end. this hopefully fixes issues in games which
      break when DMAs end immediately, without having to actually emulate the
-     16-bit x 25mhz g2 bus transfer */
-  while (remaining) {
-    as_write32(space, dst, as_read32(space, src));
-    remaining -= 4;
-    src += 4;
-    dst += 4;
-  }
+     16-bit x 25mhz g2 bus transfer. the copy itself is done as a single
+     batched as_memcpy, which moves whole page runs between system and wave
+     ram at once */
+  as_memcpy(space, dst, src, transfer_size);
+  prof_counter_add(COUNTER_g2_data, transfer_size);
 
   /* the status registers need to be updated immediately as well. if they're not
      updated until the interrupt is raised, the DMA functions used by games will
@@ -1,6 +1,7 @@
 #ifndef HOLLY_H
 #define HOLLY_H
 
+#include "core/profiler.h"
 #include "guest/dreamcast.h"
 #include "guest/holly/holly_types.h"
 #include "guest/memory.h"
@@ -9,6 +10,8 @@ struct gdrom;
 struct maple;
 struct sh4;
 
+DECLARE_COUNTER(g2_data);
+
 struct holly {
   struct device;
   uint32_t reg[NUM_HOLLY_REGS];
@@ -1,8 +1,11 @@
+#include <inttypes.h>
 #include "guest/memory.h"
 #include "core/exception_handler.h"
+#include "core/filesystem.h"
 #include "core/math.h"
 #include "core/string.h"
 #include "guest/dreamcast.h"
+#include "render/imgui.h"
 
 /*
  * address maps
@@ -83,6 +86,16 @@ enum region_type {
   REGION_MMIO,
 };
 
+/* access profiling. registers are tracked at 32-bit granularity for the first
+   MEMPROF_MAX_REGS words of each mmio region, accesses past that are only
+   tracked at the region level */
+#define MEMPROF_MAX_REGS 0x4000
+
+struct memprof_counts {
+  uint64_t reads;
+  uint64_t writes;
+};
+
 struct memory_region {
   enum region_type type;
 
@@ -93,6 +106,10 @@ struct memory_region {
   union {
     struct {
       uint32_t shmem_offset;
+      /* optional bitmap of blocks written through the address space
+         accessors, see memory_track_writes */
+      uint64_t *dirty;
+      int dirty_shift;
     } physical;
 
     struct {
@@ -103,6 +120,11 @@ struct memory_region {
       mmio_write_string_cb write_string;
     } mmio;
   };
+
+#if ENABLE_MEMPROF
+  struct memprof_counts total;
+  struct memprof_counts *regs;
+#endif
 };
 
 struct memory {
@@ -114,8 +136,21 @@ struct memory {
 
   struct memory_region regions[MAX_REGIONS];
   int num_regions;
+  int num_tracked_regions;
+
+#if ENABLE_MEMPROF
+  int show_profile;
+#endif
 };
 
+#if ENABLE_MEMPROF
+#define MEMPROF_READ(region, offset) memprof_count(region, offset, 1, 0)
+#define MEMPROF_WRITE(region, offset) memprof_count(region, offset, 0, 1)
+#else
+#define MEMPROF_READ(region, offset)
+#define MEMPROF_WRITE(region, offset)
+#endif
+
 static inline int is_page_aligned(uint32_t start, uint32_t size) {
   return (start & ((1 << VIRT_PAGE_OFFSET_BITS) - 1)) == 0 &&
          ((start + size) & ((1 << VIRT_PAGE_OFFSET_BITS) - 1)) == 0;
@@ -148,6 +183,138 @@ static inline int get_region_handle(page_entry_t page) {
   return page & REGION_HANDLE_MASK;
 }
 
+#if ENABLE_MEMPROF
+static void memprof_count(struct memory_region *region, uint32_t offset,
+                          int reads, int writes) {
+  region->total.reads += reads;
+  region->total.writes += writes;
+
+  /* physical regions are only profiled as a whole, most of their accesses are
+     made directly by the jit's fastmem path and never show up here anyway */
+  if (region->type != REGION_MMIO) {
+    return;
+  }
+
+  uint32_t reg = offset >> 2;
+  if (reg >= MEMPROF_MAX_REGS) {
+    return;
+  }
+
+  if (!region->regs) {
+    region->regs = calloc(MEMPROF_MAX_REGS, sizeof(struct memprof_counts));
+  }
+
+  region->regs[reg].reads += reads;
+  region->regs[reg].writes += writes;
+}
+
+/* when profiling, as_lookup hands out these in place of the region's own
+   callbacks so accesses the jit makes to constant addresses are counted */
+static uint32_t memprof_mmio_read(void *userdata, uint32_t addr,
+                                  uint32_t data_mask) {
+  struct memory_region *region = userdata;
+  MEMPROF_READ(region, addr);
+  return region->mmio.read(region->mmio.data, addr, data_mask);
+}
+
+static void memprof_mmio_write(void *userdata, uint32_t addr, uint32_t data,
+                               uint32_t data_mask) {
+  struct memory_region *region = userdata;
+  MEMPROF_WRITE(region, addr);
+  region->mmio.write(region->mmio.data, addr, data, data_mask);
+}
+
+static int memprof_total(const struct memprof_counts *counts) {
+  return counts->reads || counts->writes;
+}
+
+static int memprof_region_cmp(const void *a, const void *b) {
+  const struct memory_region *ra = *(const struct memory_region **)a;
+  const struct memory_region *rb = *(const struct memory_region **)b;
+  uint64_t ta = ra->total.reads + ra->total.writes;
+  uint64_t tb = rb->total.reads + rb->total.writes;
+  return (ta < tb) - (ta > tb);
+}
+
+/* fill regions with each region that has been accessed, sorted by its total
+   number of accesses */
+static int memprof_sorted_regions(struct memory *memory,
+                                  struct memory_region **regions) {
+  int num_regions = 0;
+
+  for (int i = 0; i < memory->num_regions; i++) {
+    struct memory_region *region = &memory->regions[i];
+
+    if (memprof_total(&region->total)) {
+      regions[num_regions++] = region;
+    }
+  }
+
+  qsort(regions, num_regions, sizeof(regions[0]), &memprof_region_cmp);
+
+  return num_regions;
+}
+
+static void memprof_reset(struct memory *memory) {
+  for (int i = 0; i < memory->num_regions; i++) {
+    struct memory_region *region = &memory->regions[i];
+
+    memset(&region->total, 0, sizeof(region->total));
+
+    if (region->regs) {
+      memset(region->regs, 0, MEMPROF_MAX_REGS * sizeof(region->regs[0]));
+    }
+  }
+}
+
+static void memprof_dump(struct memory *memory) {
+  const char *appdir = fs_appdir();
+
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "memprof.csv",
+           appdir);
+
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    LOG_WARNING("failed to open %s", filename);
+    return;
+  }
+
+  struct memory_region *regions[MAX_REGIONS];
+  int num_regions = memprof_sorted_regions(memory, regions);
+
+  /* each region gets a summary row with an empty offset, followed by a row for
+     each of its registers that were accessed */
+  fprintf(file, "region,offset,reads,writes\n");
+
+  for (int i = 0; i < num_regions; i++) {
+    struct memory_region *region = regions[i];
+
+    fprintf(file, "%s,,%" PRIu64 ",%" PRIu64 "\n", region->name,
+            region->total.reads, region->total.writes);
+
+    if (!region->regs) {
+      continue;
+    }
+
+    for (int j = 0; j < MEMPROF_MAX_REGS; j++) {
+      struct memprof_counts *reg = &region->regs[j];
+
+      if (!memprof_total(reg)) {
+        continue;
+      }
+
+      fprintf(file, "%s,0x%08x,%" PRIu64 ",%" PRIu64 "\n", region->name,
+              j << 2, reg->reads, reg->writes);
+    }
+  }
+
+  fclose(file);
+
+  LOG_INFO("wrote memory access profile to %s", filename);
+}
+#endif
+
 /* iterate mirrors for a given address and mask */
 struct mirror_iterator {
   uint32_t base, mask, imask, step;
@@ -307,6 +474,57 @@ struct memory_region *memory_create_mmio_region(
   return region;
 }
 
+struct memory_region *memory_track_writes(struct memory *memory,
+                                          const char *name, int block_shift) {
+  struct memory_region *region = memory_get_region(memory, name);
+  CHECK_NOTNULL(region);
+  CHECK_EQ(region->type, REGION_PHYSICAL);
+
+  if (!region->physical.dirty) {
+    int num_blocks = region->size >> block_shift;
+    int num_words = (num_blocks + 63) / 64;
+
+    region->physical.dirty = calloc(num_words, sizeof(uint64_t));
+    region->physical.dirty_shift = block_shift;
+    memory->num_tracked_regions++;
+  }
+
+  return region;
+}
+
+void memory_mark_dirty(struct memory_region *region, uint32_t offset,
+                       int size) {
+  uint64_t *dirty = region->physical.dirty;
+  int shift = region->physical.dirty_shift;
+
+  if (!dirty || size <= 0) {
+    return;
+  }
+
+  uint32_t first = offset >> shift;
+  uint32_t last = (MIN(offset + (uint32_t)size, region->size) - 1) >> shift;
+
+  for (uint32_t i = first; i <= last; i++) {
+    dirty[i >> 6] |= UINT64_C(1) << (i & 63);
+  }
+}
+
+int memory_collect_dirty(struct memory_region *region, uint64_t *dirty,
+                         int num_words) {
+  int num_blocks = region->size >> region->physical.dirty_shift;
+  CHECK_EQ(num_words, (num_blocks + 63) / 64);
+
+  int num_dirty = 0;
+
+  for (int i = 0; i < num_words; i++) {
+    dirty[i] = region->physical.dirty[i];
+    region->physical.dirty[i] = 0;
+    num_dirty += popcnt32((uint32_t)dirty[i]) + popcnt32(dirty[i] >> 32);
+  }
+
+  return num_dirty;
+}
+
 uint8_t *memory_translate(struct memory *memory, const char *name,
                           uint32_t offset) {
   struct memory_region *region = memory_get_region(memory, name);
@@ -363,7 +581,103 @@ int memory_init(struct memory *memory) {
   return 1;
 }
 
+#if ENABLE_IMGUI
+void memory_debug_menu(struct memory *memory) {
+#if ENABLE_MEMPROF
+  if (igBeginMainMenuBar()) {
+    if (igBeginMenu("MEMORY", 1)) {
+      if (igMenuItem("access profile", NULL, memory->show_profile, 1)) {
+        memory->show_profile = !memory->show_profile;
+      }
+
+      if (igMenuItem("reset access profile", NULL, 0, 1)) {
+        memprof_reset(memory);
+      }
+
+      igEndMenu();
+    }
+
+    igEndMainMenuBar();
+  }
+
+  if (memory->show_profile) {
+    if (igBegin("memory access profile", NULL,
+                ImGuiWindowFlags_AlwaysAutoResize)) {
+      struct memory_region *regions[MAX_REGIONS];
+      int num_regions = memprof_sorted_regions(memory, regions);
+
+      igColumns(3, "regions", 0);
+      igText("region");
+      igNextColumn();
+      igText("reads");
+      igNextColumn();
+      igText("writes");
+      igNextColumn();
+
+      for (int i = 0; i < num_regions; i++) {
+        struct memory_region *region = regions[i];
+        igText("%s", region->name);
+        igNextColumn();
+        igText("%" PRIu64, region->total.reads);
+        igNextColumn();
+        igText("%" PRIu64, region->total.writes);
+        igNextColumn();
+      }
+
+      igColumns(1, NULL, 0);
+
+      /* break down the individual registers of each mmio region */
+      for (int i = 0; i < num_regions; i++) {
+        struct memory_region *region = regions[i];
+
+        if (!region->regs || !igCollapsingHeader(region->name, 0)) {
+          continue;
+        }
+
+        igColumns(3, region->name, 0);
+
+        for (int j = 0; j < MEMPROF_MAX_REGS; j++) {
+          struct memprof_counts *reg = &region->regs[j];
+
+          if (!memprof_total(reg)) {
+            continue;
+          }
+
+          igText("0x%08x", j << 2);
+          igNextColumn();
+          igText("%" PRIu64, reg->reads);
+          igNextColumn();
+          igText("%" PRIu64, reg->writes);
+          igNextColumn();
+        }
+
+        igColumns(1, NULL, 0);
+      }
+
+      igEnd();
+    }
+  }
+#endif
+}
+#endif
+
 void memory_destroy(struct memory *memory) {
+  for (int i = 0; i < memory->num_regions; i++) {
+    struct memory_region *region = &memory->regions[i];
+
+    if (region->type == REGION_PHYSICAL) {
+      free(region->physical.dirty);
+    }
+  }
+
+#if ENABLE_MEMPROF
+  memprof_dump(memory);
+
+  for (int i = 0; i < memory->num_regions; i++) {
+    free(memory->regions[i].regs);
+  }
+#endif
+
   memory_destroy_shmem(memory);
   free(memory);
 }
@@ -430,7 +744,6 @@ void am_physical(struct address_map *am, struct memory_region *region,
 }
 
 static void as_lookup_region(struct address_space *space, uint32_t addr,
-
                              struct memory_region **region, uint32_t *offset) {
   page_entry_t page = space->pages[get_page_index(addr)];
   DCHECK(page);
@@ -439,61 +752,173 @@ static void as_lookup_region(struct address_space *space, uint32_t addr,
   *offset = get_region_offset(page) + get_page_offset(addr);
 }
 
+/* mark the physical pages written to by a run of size bytes at addr in the
+   dirty bitmaps of any regions tracking their writes */
+static void as_mark_dirty(struct address_space *space, uint32_t addr,
+                          int size) {
+  if (!space->dc->memory->num_tracked_regions) {
+    return;
+  }
+
+  while (size > 0) {
+    struct memory_region *region;
+    uint32_t offset;
+    as_lookup_region(space, addr, &region, &offset);
+
+    int n = MIN(size, (int)(VIRT_PAGE_SIZE - get_page_offset(addr)));
+
+    if (region->physical.dirty) {
+      memory_mark_dirty(region, offset, n);
+    }
+
+    addr += n;
+    size -= n;
+  }
+}
+
+/* find the length of the run starting at addr, up to size bytes, that can be
+   serviced by a single copy. physical pages are all mapped contiguously at the
+   address space's base, so any run of them can be coalesced into a single
+   memcpy. mmio pages are only coalesced while they map to contiguous offsets of
+   the same region */
+static int as_lookup_run(struct address_space *space, uint32_t addr, int size,
+                         struct memory_region **region, uint32_t *offset) {
+  as_lookup_region(space, addr, region, offset);
+
+  int run = MIN(size, (int)(VIRT_PAGE_SIZE - get_page_offset(addr)));
+  uint32_t next_offset = *offset + run;
+
+  while (run < size) {
+    page_entry_t page = space->pages[get_page_index(addr + run)];
+    int region_handle = get_region_handle(page);
+    struct memory_region *next = &space->dc->memory->regions[region_handle];
+
+    if ((*region)->type == REGION_PHYSICAL) {
+      if (next->type != REGION_PHYSICAL) {
+        break;
+      }
+    } else if (next != *region ||
+               (uint32_t)get_region_offset(page) != next_offset) {
+      break;
+    }
+
+    int n = MIN(size - run, VIRT_PAGE_SIZE);
+    run += n;
+    next_offset += n;
+  }
+
+  return run;
+}
+
+static void as_read_run(struct address_space *space,
+                        struct memory_region *region, uint32_t offset,
+                        uint32_t addr, void *ptr, int size) {
+  /* string accesses are profiled as a single access to their first word */
+  MEMPROF_READ(region, offset);
+
+  if (region->type == REGION_PHYSICAL) {
+    memcpy(ptr, space->base + addr, size);
+  } else if (region->mmio.read_string) {
+    region->mmio.read_string(region->mmio.data, ptr, offset, size);
+  } else {
+    /* fall back to reading a word at a time for regions which don't provide a
+       string handler */
+    CHECK_EQ(size % 4, 0);
+
+    uint32_t *dst = ptr;
+    for (int i = 0; i < size; i += 4) {
+      *(dst++) = region->mmio.read(region->mmio.data, offset + i, 0xffffffff);
+    }
+  }
+}
+
+static void as_write_run(struct address_space *space,
+                         struct memory_region *region, uint32_t offset,
+                         uint32_t addr, const void *ptr, int size) {
+  MEMPROF_WRITE(region, offset);
+
+  if (region->type == REGION_PHYSICAL) {
+    memcpy(space->base + addr, ptr, size);
+    as_mark_dirty(space, addr, size);
+  } else if (region->mmio.write_string) {
+    region->mmio.write_string(region->mmio.data, offset, ptr, size);
+  } else {
+    CHECK_EQ(size % 4, 0);
+
+    const uint32_t *src = ptr;
+    for (int i = 0; i < size; i += 4) {
+      region->mmio.write(region->mmio.data, offset + i, *(src++), 0xffffffff);
+    }
+  }
+}
+
 void as_memcpy(struct address_space *space, uint32_t dst, uint32_t src,
                int size) {
-  struct memory_region *dst_region;
-  uint32_t dst_offset;
-  as_lookup_region(space, dst, &dst_region, &dst_offset);
-
-  struct memory_region *src_region;
-  uint32_t src_offset;
-  as_lookup_region(space, src, &src_region, &src_offset);
-
-  if (dst_region->type == REGION_PHYSICAL &&
-      src_region->type == REGION_PHYSICAL) {
-    memcpy(space->base + dst, space->base + src, size);
-  } else if (dst_region->type == REGION_PHYSICAL) {
-    src_region->mmio.read_string(src_region->mmio.data, space->base + dst,
-                                 src_offset, size);
-  } else if (src_region->type == REGION_PHYSICAL) {
-    dst_region->mmio.write_string(dst_region->mmio.data, dst_offset,
-                                  space->base + src, size);
-  } else {
-    /* the case where both regions are MMIO and both support read_string /
-       write_string could be further optimized with a fixed buffer, but it
-       currently never occurs */
-    CHECK(
-        "as_memcpy doesn't currently support copying between two MMIO regions");
+  while (size > 0) {
+    struct memory_region *dst_region;
+    uint32_t dst_offset;
+    int dst_run = as_lookup_run(space, dst, size, &dst_region, &dst_offset);
+
+    struct memory_region *src_region;
+    uint32_t src_offset;
+    int src_run = as_lookup_run(space, src, size, &src_region, &src_offset);
+
+    int n = MIN(dst_run, src_run);
+
+    if (dst_region->type == REGION_PHYSICAL &&
+        src_region->type == REGION_PHYSICAL) {
+      memcpy(space->base + dst, space->base + src, n);
+      as_mark_dirty(space, dst, n);
+    } else if (dst_region->type == REGION_PHYSICAL) {
+      as_read_run(space, src_region, src_offset, src, space->base + dst, n);
+      as_mark_dirty(space, dst, n);
+    } else if (src_region->type == REGION_PHYSICAL) {
+      as_write_run(space, dst_region, dst_offset, dst, space->base + src, n);
+    } else {
+      /* both regions are mmio, bounce the run through a fixed buffer */
+      uint8_t tmp[VIRT_PAGE_SIZE];
+      n = MIN(n, (int)sizeof(tmp));
+      as_read_run(space, src_region, src_offset, src, tmp, n);
+      as_write_run(space, dst_region, dst_offset, dst, tmp, n);
+    }
+
+    dst += n;
+    src += n;
+    size -= n;
   }
 }
 
 void as_memcpy_to_host(struct address_space *space, void *ptr, uint32_t src,
                        int size) {
-  struct memory_region *src_region;
-  uint32_t src_offset;
-  as_lookup_region(space, src, &src_region, &src_offset);
-
-  /* optimize copy under the assumption that the data being copied doesn't
-     cross multiple regions */
-  if (src_region->type == REGION_PHYSICAL) {
-    memcpy(ptr, space->base + src, size);
-  } else {
-    src_region->mmio.read_string(src_region->mmio.data, ptr, src_offset, size);
+  uint8_t *dst = ptr;
+
+  while (size > 0) {
+    struct memory_region *src_region;
+    uint32_t src_offset;
+    int n = as_lookup_run(space, src, size, &src_region, &src_offset);
+
+    as_read_run(space, src_region, src_offset, src, dst, n);
+
+    dst += n;
+    src += n;
+    size -= n;
   }
 }
 
 void as_memcpy_to_guest(struct address_space *space, uint32_t dst,
                         const void *ptr, int size) {
-  struct memory_region *dst_region;
-  uint32_t dst_offset;
-  as_lookup_region(space, dst, &dst_region, &dst_offset);
-
-  /* optimize copy under the assumption that the data being copied doesn't
-     cross multiple regions */
-  if (dst_region->type == REGION_PHYSICAL) {
-    memcpy(space->base + dst, ptr, size);
-  } else {
-    dst_region->mmio.write_string(dst_region->mmio.data, dst_offset, ptr, size);
+  const uint8_t *src = ptr;
+
+  while (size > 0) {
+    struct memory_region *dst_region;
+    uint32_t dst_offset;
+    int n = as_lookup_run(space, dst, size, &dst_region, &dst_offset);
+
+    as_write_run(space, dst_region, dst_offset, dst, src, n);
+
+    dst += n;
+    src += n;
+    size -= n;
   }
 }
 
@@ -502,12 +927,13 @@ void as_memcpy_to_guest(struct address_space *space, uint32_t dst,
     page_entry_t page = space->pages[get_page_index(addr)];                    \
     int region_handle = get_region_handle(page);                               \
     struct memory_region *region = &space->dc->memory->regions[region_handle]; \
+    uint32_t region_offset = get_region_offset(page);                          \
+    uint32_t page_offset = get_page_offset(addr);                              \
+    MEMPROF_READ(region, region_offset + page_offset);                         \
     if (region->type == REGION_PHYSICAL) {                                     \
       return *(data_type *)(space->base + addr);                               \
     }                                                                          \
     static const uint32_t data_mask = (1ull << (sizeof(data_type) * 8)) - 1;   \
-    uint32_t region_offset = get_region_offset(page);                          \
-    uint32_t page_offset = get_page_offset(addr);                              \
     return region->mmio.read(region->mmio.data, region_offset + page_offset,   \
                              data_mask);                                       \
   }
@@ -521,13 +947,18 @@ define_read_bytes(read32, uint32_t);
     page_entry_t page = space->pages[get_page_index(addr)];                    \
     int region_handle = get_region_handle(page);                               \
     struct memory_region *region = &space->dc->memory->regions[region_handle]; \
+    uint32_t region_offset = get_region_offset(page);                          \
+    uint32_t page_offset = get_page_offset(addr);                              \
+    MEMPROF_WRITE(region, region_offset + page_offset);                        \
     if (region->type == REGION_PHYSICAL) {                                     \
       *(data_type *)(space->base + addr) = data;                               \
+      if (region->physical.dirty) {                                            \
+        memory_mark_dirty(region, region_offset + page_offset,                 \
+                          sizeof(data_type));                                  \
+      }                                                                        \
       return;                                                                  \
     }                                                                          \
     static const uint32_t data_mask = (1ull << (sizeof(data_type) * 8)) - 1;   \
-    uint32_t region_offset = get_region_offset(page);                          \
-    uint32_t page_offset = get_page_offset(addr);                              \
     region->mmio.write(region->mmio.data, region_offset + page_offset, data,   \
                        data_mask);                                             \
   }
@@ -567,6 +998,17 @@ void as_lookup(struct address_space *space, uint32_t addr, void **ptr,
     if (ptr) {
       *ptr = NULL;
     }
+#if ENABLE_MEMPROF
+    if (userdata) {
+      *userdata = region;
+    }
+    if (read) {
+      *read = &memprof_mmio_read;
+    }
+    if (write) {
+      *write = &memprof_mmio_write;
+    }
+#else
     if (userdata) {
       *userdata = region->mmio.data;
     }
@@ -576,6 +1018,7 @@ void as_lookup(struct address_space *space, uint32_t addr, void **ptr,
     if (write) {
       *write = region->mmio.write;
     }
+#endif
     if (offset) {
       *offset = mmio_offset;
     }
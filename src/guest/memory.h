@@ -69,12 +69,25 @@ struct memory *memory_create(struct dreamcast *dc);
 void memory_destroy(struct memory *memory);
 int memory_init(struct memory *memory);
 
+void memory_debug_menu(struct memory *memory);
+
 uint8_t *memory_translate(struct memory *memory, const char *name,
                           uint32_t offset);
 
 struct memory_region *memory_create_physical_region(struct memory *memory,
                                                     const char *name,
                                                     uint32_t size);
+/* physical regions can optionally track the writes made to them through the
+   address space accessors in a bitmap of (1 << block_shift) byte blocks. note,
+   writes made directly through a translated pointer, including the jit's
+   fastmem path, aren't tracked and must be marked manually */
+struct memory_region *memory_track_writes(struct memory *memory,
+                                          const char *name, int block_shift);
+void memory_mark_dirty(struct memory_region *region, uint32_t offset,
+                       int size);
+int memory_collect_dirty(struct memory_region *region, uint64_t *dirty,
+                         int num_words);
+
 struct memory_region *memory_create_mmio_region(
     struct memory *memory, const char *name, uint32_t size, void *data,
     mmio_read_cb read, mmio_write_cb write, mmio_read_string_cb read_string,
@@ -0,0 +1,717 @@
+#include "guest/pvr/pixel_convert.h"
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/cpu.h"
+
+#if ARCH_X64
+#include <immintrin.h>
+#endif
+
+const char *pixel_convert_names[PIXEL_CONVERT_NUM_IMPLS] = {
+    "scalar", "sse2", "avx2",
+};
+
+static enum pixel_convert_impl pixel_convert_impl = PIXEL_CONVERT_SCALAR;
+
+/* each supported swizzle is a 16-bit rotate left:
+   ARGB1555 -> RGBA5551 moves the alpha bit from the top to the bottom
+   RGB565 -> RGB565 is a copy
+   ARGB4444 -> RGBA4444 moves the alpha nibble from the top to the bottom */
+static const int swizzle_rotations[PIXEL_NUM_SWIZZLES] = {1, 0, 4};
+
+/* the simd implementations convert twiddled data in 4x4 blocks, and the avx2
+   implementation converts a pair of horizontally adjacent blocks at once */
+#define BLOCK_SIZE 4
+
+/* data sources for the block based conversions */
+struct block_src {
+  const uint8_t *data;
+  const uint8_t *index;
+  const uint16_t *palette;
+};
+
+static inline uint16_t rotl16(uint16_t v, int n) {
+  return (uint16_t)((v << n) | (v >> (16 - n)));
+}
+
+/* YUV420 macroblocks are made up of an 8x8 block of U samples, followed by an
+   8x8 block of V samples, followed by four 8x8 blocks of Y samples for the
+   top left, top right, bottom left and bottom right quarters. each pair of
+   output rows shares a row of U and V samples */
+#define YUV_MACROBLOCK_U 0
+#define YUV_MACROBLOCK_V 64
+#define YUV_MACROBLOCK_Y 128
+
+static inline const uint8_t *yuv_macroblock_y(const uint8_t *src, int row) {
+  return &src[YUV_MACROBLOCK_Y + (row >> 3) * 128 + (row & 7) * 8];
+}
+
+/*
+ * scalar implementation
+ */
+static void scalar_convert_planar(enum pixel_swizzle swizzle,
+                                  const uint16_t *src, uint16_t *dst,
+                                  int width, int height, int stride) {
+  switch (swizzle) {
+    case PIXEL_SWIZZLE_ARGB1555_RGBA5551:
+      convert_ARGB1555_RGBA5551(src, dst, width, height, stride);
+      break;
+    case PIXEL_SWIZZLE_RGB565_RGB565:
+      convert_RGB565_RGB565(src, dst, width, height, stride);
+      break;
+    case PIXEL_SWIZZLE_ARGB4444_RGBA4444:
+      convert_ARGB4444_RGBA4444(src, dst, width, height, stride);
+      break;
+    default:
+      LOG_FATAL("unsupported pixel swizzle %d", swizzle);
+      break;
+  }
+}
+
+static void scalar_convert_twiddled(enum pixel_swizzle swizzle,
+                                    const uint16_t *src, uint16_t *dst,
+                                    int width, int height) {
+  switch (swizzle) {
+    case PIXEL_SWIZZLE_ARGB1555_RGBA5551:
+      convert_twiddled_ARGB1555_RGBA5551(src, dst, width, height);
+      break;
+    case PIXEL_SWIZZLE_RGB565_RGB565:
+      convert_twiddled_RGB565_RGB565(src, dst, width, height);
+      break;
+    case PIXEL_SWIZZLE_ARGB4444_RGBA4444:
+      convert_twiddled_ARGB4444_RGBA4444(src, dst, width, height);
+      break;
+    default:
+      LOG_FATAL("unsupported pixel swizzle %d", swizzle);
+      break;
+  }
+}
+
+static void scalar_convert_vq(enum pixel_swizzle swizzle,
+                              const uint8_t *codebook, const uint8_t *index,
+                              uint16_t *dst, int width, int height) {
+  switch (swizzle) {
+    case PIXEL_SWIZZLE_ARGB1555_RGBA5551:
+      convert_vq_ARGB1555_RGBA5551(codebook, index, dst, width, height);
+      break;
+    case PIXEL_SWIZZLE_RGB565_RGB565:
+      convert_vq_RGB565_RGB565(codebook, index, dst, width, height);
+      break;
+    case PIXEL_SWIZZLE_ARGB4444_RGBA4444:
+      convert_vq_ARGB4444_RGBA4444(codebook, index, dst, width, height);
+      break;
+    default:
+      LOG_FATAL("unsupported pixel swizzle %d", swizzle);
+      break;
+  }
+}
+
+static void scalar_convert_pal4(const uint16_t *palette, const uint8_t *src,
+                                uint16_t *dst, int width, int height) {
+  int min = MIN(width, height);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int twid_idx = TWIDIDX(x, y, min);
+      int pal_idx = src[twid_idx >> 1];
+      pal_idx = (twid_idx & 1) ? (pal_idx >> 4) : (pal_idx & 0xf);
+      *(dst++) = palette[pal_idx];
+    }
+  }
+}
+
+static void scalar_convert_pal8(const uint16_t *palette, const uint8_t *src,
+                                uint16_t *dst, int width, int height) {
+  int min = MIN(width, height);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      *(dst++) = palette[src[TWIDIDX(x, y, min)]];
+    }
+  }
+}
+
+/* reencodes an 8x8 subblock of the macroblock, two rows at a time */
+static void scalar_convert_yuv420_block(const uint8_t *in_uv,
+                                        const uint8_t *in_y, uint8_t *dst,
+                                        int stride) {
+  uint8_t *out_row0 = dst;
+  uint8_t *out_row1 = dst + stride;
+
+  for (int j = 0; j < 8; j += 2) {
+    for (int i = 0; i < 8; i += 2) {
+      uint8_t u = in_uv[YUV_MACROBLOCK_U];
+      uint8_t v = in_uv[YUV_MACROBLOCK_V];
+
+      out_row0[0] = u;
+      out_row0[1] = in_y[0];
+      out_row0[2] = v;
+      out_row0[3] = in_y[1];
+
+      out_row1[0] = u;
+      out_row1[1] = in_y[8];
+      out_row1[2] = v;
+      out_row1[3] = in_y[9];
+
+      in_uv += 1;
+      in_y += 2;
+      out_row0 += 4;
+      out_row1 += 4;
+    }
+
+    /* skip past the adjacent subblock */
+    in_uv += 4;
+    in_y += 8;
+    out_row0 += (stride << 1) - 16;
+    out_row1 += (stride << 1) - 16;
+  }
+}
+
+static void scalar_convert_yuv420(const uint8_t *src, uint8_t *dst,
+                                  int stride) {
+  scalar_convert_yuv420_block(&src[0], yuv_macroblock_y(src, 0), &dst[0],
+                              stride);
+  scalar_convert_yuv420_block(&src[4], yuv_macroblock_y(src, 0) + 64,
+                              &dst[16], stride);
+  scalar_convert_yuv420_block(&src[32], yuv_macroblock_y(src, 8),
+                              &dst[stride * 8], stride);
+  scalar_convert_yuv420_block(&src[36], yuv_macroblock_y(src, 8) + 64,
+                              &dst[stride * 8 + 16], stride);
+}
+
+#if ARCH_X64
+
+/*
+ * sse2 implementation
+ */
+static inline __m128i sse2_rotl16(__m128i v, int n) {
+  return _mm_or_si128(_mm_sll_epi16(v, _mm_cvtsi32_si128(n)),
+                      _mm_srl_epi16(v, _mm_cvtsi32_si128(16 - n)));
+}
+
+/* the 16 pixels of a twiddled 4x4 block are ordered by the interleaved bits
+   x1 y1 x0 y0. deinterleave them into rows and write them out */
+static inline void sse2_transpose_block(__m128i v0, __m128i v1, __m128i *r01,
+                                        __m128i *r23) {
+  __m128i t0 = _mm_unpacklo_epi16(v0, v1);
+  __m128i t1 = _mm_unpackhi_epi16(v0, v1);
+  __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+  __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+
+  /* rows 0 and 2 are in the even words, 1 and 3 in the odd words */
+  __m128i w0 = _mm_unpacklo_epi16(u0, u1);
+  __m128i w1 = _mm_unpackhi_epi16(u0, u1);
+  w0 = _mm_shuffle_epi32(w0, _MM_SHUFFLE(3, 1, 2, 0));
+  w1 = _mm_shuffle_epi32(w1, _MM_SHUFFLE(3, 1, 2, 0));
+
+  /* return rows 0 and 1 in the first register, 2 and 3 in the second */
+  *r01 = _mm_unpacklo_epi64(w0, w1);
+  *r23 = _mm_unpackhi_epi64(w0, w1);
+}
+
+static inline void sse2_store_block(uint16_t *dst, int width, __m128i v0,
+                                    __m128i v1) {
+  __m128i r01, r23;
+  sse2_transpose_block(v0, v1, &r01, &r23);
+  _mm_storel_epi64((__m128i *)&dst[0], r01);
+  _mm_storel_epi64((__m128i *)&dst[width], _mm_unpackhi_epi64(r01, r01));
+  _mm_storel_epi64((__m128i *)&dst[width * 2], r23);
+  _mm_storel_epi64((__m128i *)&dst[width * 3], _mm_unpackhi_epi64(r23, r23));
+}
+
+/* loaders returning the 16 pixels of the block starting at the twiddled
+   index base, in twiddled order */
+static inline void sse2_load_twiddled(const struct block_src *src, int base,
+                                      __m128i *v0, __m128i *v1) {
+  const uint16_t *data = (const uint16_t *)src->data + base;
+  *v0 = _mm_loadu_si128((const __m128i *)&data[0]);
+  *v1 = _mm_loadu_si128((const __m128i *)&data[8]);
+}
+
+static inline void sse2_load_vq(const struct block_src *src, int base,
+                                __m128i *v0, __m128i *v1) {
+  /* each index selects a 2x2 block of pixels from the codebook */
+  const uint8_t *index = src->index + base / 4;
+  const uint8_t *codebook = src->data;
+  __m128i c0 = _mm_loadl_epi64((const __m128i *)&codebook[index[0] * 8]);
+  __m128i c1 = _mm_loadl_epi64((const __m128i *)&codebook[index[1] * 8]);
+  __m128i c2 = _mm_loadl_epi64((const __m128i *)&codebook[index[2] * 8]);
+  __m128i c3 = _mm_loadl_epi64((const __m128i *)&codebook[index[3] * 8]);
+  *v0 = _mm_unpacklo_epi64(c0, c1);
+  *v1 = _mm_unpacklo_epi64(c2, c3);
+}
+
+static inline void sse2_load_pal4(const struct block_src *src, int base,
+                                  __m128i *v0, __m128i *v1) {
+  const uint8_t *data = src->data + base / 2;
+  const uint16_t *pal = src->palette;
+  *v0 = _mm_setr_epi16(pal[data[0] & 0xf], pal[data[0] >> 4],
+                       pal[data[1] & 0xf], pal[data[1] >> 4],
+                       pal[data[2] & 0xf], pal[data[2] >> 4],
+                       pal[data[3] & 0xf], pal[data[3] >> 4]);
+  *v1 = _mm_setr_epi16(pal[data[4] & 0xf], pal[data[4] >> 4],
+                       pal[data[5] & 0xf], pal[data[5] >> 4],
+                       pal[data[6] & 0xf], pal[data[6] >> 4],
+                       pal[data[7] & 0xf], pal[data[7] >> 4]);
+}
+
+static inline void sse2_load_pal8(const struct block_src *src, int base,
+                                  __m128i *v0, __m128i *v1) {
+  const uint8_t *data = src->data + base;
+  const uint16_t *pal = src->palette;
+  *v0 = _mm_setr_epi16(pal[data[0]], pal[data[1]], pal[data[2]], pal[data[3]],
+                       pal[data[4]], pal[data[5]], pal[data[6]], pal[data[7]]);
+  *v1 = _mm_setr_epi16(pal[data[8]], pal[data[9]], pal[data[10]],
+                       pal[data[11]], pal[data[12]], pal[data[13]],
+                       pal[data[14]], pal[data[15]]);
+}
+
+typedef void (*sse2_load_block_cb)(const struct block_src *, int, __m128i *,
+                                   __m128i *);
+
+static inline void sse2_convert_blocks(sse2_load_block_cb load_block,
+                                       const struct block_src *src, int rot,
+                                       uint16_t *dst, int width, int height) {
+  int min = MIN(width, height);
+
+  for (int by = 0; by < height; by += BLOCK_SIZE) {
+    for (int bx = 0; bx < width; bx += BLOCK_SIZE) {
+      __m128i v0, v1;
+      load_block(src, TWIDIDX(bx, by, min), &v0, &v1);
+      if (rot) {
+        v0 = sse2_rotl16(v0, rot);
+        v1 = sse2_rotl16(v1, rot);
+      }
+      sse2_store_block(&dst[by * width + bx], width, v0, v1);
+    }
+  }
+}
+
+static void sse2_convert_planar(int rot, const uint16_t *src, uint16_t *dst,
+                                int width, int height, int stride) {
+  for (int y = 0; y < height; y++) {
+    const uint16_t *in = &src[y * stride];
+    uint16_t *out = &dst[y * width];
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)&in[x]);
+      _mm_storeu_si128((__m128i *)&out[x], sse2_rotl16(v, rot));
+    }
+
+    for (; x < width; x++) {
+      out[x] = rotl16(in[x], rot);
+    }
+  }
+}
+
+/* interleaves each row 16 bytes at a time, the interleaved U and V samples
+   are shared by the left and right halves of the row */
+static void sse2_convert_yuv420(const uint8_t *src, uint8_t *dst, int stride) {
+  for (int row = 0; row < 16; row++) {
+    __m128i u = _mm_loadl_epi64(
+        (const __m128i *)&src[YUV_MACROBLOCK_U + (row >> 1) * 8]);
+    __m128i v = _mm_loadl_epi64(
+        (const __m128i *)&src[YUV_MACROBLOCK_V + (row >> 1) * 8]);
+    const uint8_t *y = yuv_macroblock_y(src, row);
+    __m128i yl = _mm_loadl_epi64((const __m128i *)&y[0]);
+    __m128i yr = _mm_loadl_epi64((const __m128i *)&y[64]);
+
+    __m128i uv = _mm_unpacklo_epi8(u, v);
+    __m128i ys = _mm_unpacklo_epi64(yl, yr);
+    uint8_t *out = &dst[row * stride];
+
+    _mm_storeu_si128((__m128i *)&out[0], _mm_unpacklo_epi8(uv, ys));
+    _mm_storeu_si128((__m128i *)&out[16], _mm_unpackhi_epi8(uv, ys));
+  }
+}
+
+static void sse2_convert_twiddled(int rot, const struct block_src *src,
+                                  uint16_t *dst, int width, int height) {
+  sse2_convert_blocks(&sse2_load_twiddled, src, rot, dst, width, height);
+}
+
+static void sse2_convert_vq(int rot, const struct block_src *src,
+                            uint16_t *dst, int width, int height) {
+  sse2_convert_blocks(&sse2_load_vq, src, rot, dst, width, height);
+}
+
+static void sse2_convert_pal4(const struct block_src *src, uint16_t *dst,
+                              int width, int height) {
+  sse2_convert_blocks(&sse2_load_pal4, src, 0, dst, width, height);
+}
+
+static void sse2_convert_pal8(const struct block_src *src, uint16_t *dst,
+                              int width, int height) {
+  sse2_convert_blocks(&sse2_load_pal8, src, 0, dst, width, height);
+}
+
+/*
+ * avx2 implementation
+ */
+TARGET_AVX2 static inline __m256i avx2_rotl16(__m256i v, int n) {
+  return _mm256_or_si256(_mm256_sll_epi16(v, _mm_cvtsi32_si128(n)),
+                         _mm256_srl_epi16(v, _mm_cvtsi32_si128(16 - n)));
+}
+
+/* transposes a pair of horizontally adjacent blocks, one per 128-bit lane,
+   writing out four rows of eight pixels */
+TARGET_AVX2 static inline void avx2_store_blocks(uint16_t *dst, int width,
+                                                 __m256i v0, __m256i v1) {
+  __m256i t0 = _mm256_unpacklo_epi16(v0, v1);
+  __m256i t1 = _mm256_unpackhi_epi16(v0, v1);
+  __m256i u0 = _mm256_unpacklo_epi16(t0, t1);
+  __m256i u1 = _mm256_unpackhi_epi16(t0, t1);
+  __m256i w0 = _mm256_unpacklo_epi16(u0, u1);
+  __m256i w1 = _mm256_unpackhi_epi16(u0, u1);
+
+  /* gather each row of the left and right blocks together */
+  w0 = _mm256_shuffle_epi32(w0, _MM_SHUFFLE(3, 1, 2, 0));
+  w1 = _mm256_shuffle_epi32(w1, _MM_SHUFFLE(3, 1, 2, 0));
+  w0 = _mm256_permute4x64_epi64(w0, _MM_SHUFFLE(3, 1, 2, 0));
+  w1 = _mm256_permute4x64_epi64(w1, _MM_SHUFFLE(3, 1, 2, 0));
+
+  _mm_storeu_si128((__m128i *)&dst[0], _mm256_castsi256_si128(w0));
+  _mm_storeu_si128((__m128i *)&dst[width], _mm256_castsi256_si128(w1));
+  _mm_storeu_si128((__m128i *)&dst[width * 2],
+                   _mm256_extracti128_si256(w0, 1));
+  _mm_storeu_si128((__m128i *)&dst[width * 3],
+                   _mm256_extracti128_si256(w1, 1));
+}
+
+/* loaders returning the pixels of a pair of blocks, one block per 128-bit
+   lane. these are separate from the sse2 loaders to avoid mixing legacy sse
+   and vex encoded instructions */
+TARGET_AVX2 static inline void avx2_load_twiddled(const struct block_src *src,
+                                                  int base_a, int base_b,
+                                                  __m256i *v0, __m256i *v1) {
+  const uint16_t *data = (const uint16_t *)src->data;
+  __m256i a = _mm256_loadu_si256((const __m256i *)&data[base_a]);
+  __m256i b = _mm256_loadu_si256((const __m256i *)&data[base_b]);
+  *v0 = _mm256_permute2x128_si256(a, b, 0x20);
+  *v1 = _mm256_permute2x128_si256(a, b, 0x31);
+}
+
+TARGET_AVX2 static inline void avx2_load_vq(const struct block_src *src,
+                                            int base_a, int base_b,
+                                            __m256i *v0, __m256i *v1) {
+  const uint8_t *ia = src->index + base_a / 4;
+  const uint8_t *ib = src->index + base_b / 4;
+  const uint64_t *codebook = (const uint64_t *)src->data;
+  *v0 = _mm256_setr_epi64x(codebook[ia[0]], codebook[ia[1]], codebook[ib[0]],
+                           codebook[ib[1]]);
+  *v1 = _mm256_setr_epi64x(codebook[ia[2]], codebook[ia[3]], codebook[ib[2]],
+                           codebook[ib[3]]);
+}
+
+#define PAL4_LO(d, i) pal[d[i] & 0xf]
+#define PAL4_HI(d, i) pal[d[i] >> 4]
+
+TARGET_AVX2 static inline void avx2_load_pal4(const struct block_src *src,
+                                              int base_a, int base_b,
+                                              __m256i *v0, __m256i *v1) {
+  const uint8_t *a = src->data + base_a / 2;
+  const uint8_t *b = src->data + base_b / 2;
+  const uint16_t *pal = src->palette;
+  *v0 = _mm256_setr_epi16(
+      PAL4_LO(a, 0), PAL4_HI(a, 0), PAL4_LO(a, 1), PAL4_HI(a, 1), PAL4_LO(a, 2),
+      PAL4_HI(a, 2), PAL4_LO(a, 3), PAL4_HI(a, 3), PAL4_LO(b, 0), PAL4_HI(b, 0),
+      PAL4_LO(b, 1), PAL4_HI(b, 1), PAL4_LO(b, 2), PAL4_HI(b, 2), PAL4_LO(b, 3),
+      PAL4_HI(b, 3));
+  *v1 = _mm256_setr_epi16(
+      PAL4_LO(a, 4), PAL4_HI(a, 4), PAL4_LO(a, 5), PAL4_HI(a, 5), PAL4_LO(a, 6),
+      PAL4_HI(a, 6), PAL4_LO(a, 7), PAL4_HI(a, 7), PAL4_LO(b, 4), PAL4_HI(b, 4),
+      PAL4_LO(b, 5), PAL4_HI(b, 5), PAL4_LO(b, 6), PAL4_HI(b, 6), PAL4_LO(b, 7),
+      PAL4_HI(b, 7));
+}
+
+#undef PAL4_LO
+#undef PAL4_HI
+
+TARGET_AVX2 static inline void avx2_load_pal8(const struct block_src *src,
+                                              int base_a, int base_b,
+                                              __m256i *v0, __m256i *v1) {
+  const uint8_t *a = src->data + base_a;
+  const uint8_t *b = src->data + base_b;
+  const uint16_t *pal = src->palette;
+  *v0 = _mm256_setr_epi16(pal[a[0]], pal[a[1]], pal[a[2]], pal[a[3]],
+                          pal[a[4]], pal[a[5]], pal[a[6]], pal[a[7]],
+                          pal[b[0]], pal[b[1]], pal[b[2]], pal[b[3]],
+                          pal[b[4]], pal[b[5]], pal[b[6]], pal[b[7]]);
+  *v1 = _mm256_setr_epi16(pal[a[8]], pal[a[9]], pal[a[10]], pal[a[11]],
+                          pal[a[12]], pal[a[13]], pal[a[14]], pal[a[15]],
+                          pal[b[8]], pal[b[9]], pal[b[10]], pal[b[11]],
+                          pal[b[12]], pal[b[13]], pal[b[14]], pal[b[15]]);
+}
+
+typedef void (*avx2_load_blocks_cb)(const struct block_src *, int, int,
+                                    __m256i *, __m256i *);
+
+TARGET_AVX2 static inline void avx2_convert_blocks(
+    avx2_load_blocks_cb load_blocks, const struct block_src *src, int rot,
+    uint16_t *dst, int width, int height) {
+  int min = MIN(width, height);
+
+  for (int by = 0; by < height; by += BLOCK_SIZE) {
+    for (int bx = 0; bx < width; bx += BLOCK_SIZE * 2) {
+      __m256i v0, v1;
+      load_blocks(src, TWIDIDX(bx, by, min), TWIDIDX(bx + BLOCK_SIZE, by, min),
+                  &v0, &v1);
+      if (rot) {
+        v0 = avx2_rotl16(v0, rot);
+        v1 = avx2_rotl16(v1, rot);
+      }
+      avx2_store_blocks(&dst[by * width + bx], width, v0, v1);
+    }
+  }
+}
+
+TARGET_AVX2 static void avx2_convert_planar(int rot, const uint16_t *src,
+                                            uint16_t *dst, int width,
+                                            int height, int stride) {
+  for (int y = 0; y < height; y++) {
+    const uint16_t *in = &src[y * stride];
+    uint16_t *out = &dst[y * width];
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)&in[x]);
+      _mm256_storeu_si256((__m256i *)&out[x], avx2_rotl16(v, rot));
+    }
+
+    for (; x < width; x++) {
+      out[x] = rotl16(in[x], rot);
+    }
+  }
+}
+
+/* interleaves a pair of rows 32 bytes at a time, one row per 128-bit lane.
+   both rows of the pair share the same U and V samples */
+TARGET_AVX2 static void avx2_convert_yuv420(const uint8_t *src, uint8_t *dst,
+                                            int stride) {
+  for (int row = 0; row < 16; row += 2) {
+    __m128i u = _mm_loadl_epi64(
+        (const __m128i *)&src[YUV_MACROBLOCK_U + (row >> 1) * 8]);
+    __m128i v = _mm_loadl_epi64(
+        (const __m128i *)&src[YUV_MACROBLOCK_V + (row >> 1) * 8]);
+    __m256i uv = _mm256_broadcastsi128_si256(_mm_unpacklo_epi8(u, v));
+
+    /* the rows are adjacent inside of each block of Y samples */
+    const uint8_t *y = yuv_macroblock_y(src, row);
+    __m128i yl = _mm_loadu_si128((const __m128i *)&y[0]);
+    __m128i yr = _mm_loadu_si128((const __m128i *)&y[64]);
+    __m256i ys = _mm256_castsi128_si256(_mm_unpacklo_epi64(yl, yr));
+    ys = _mm256_inserti128_si256(ys, _mm_unpackhi_epi64(yl, yr), 1);
+
+    __m256i lo = _mm256_unpacklo_epi8(uv, ys);
+    __m256i hi = _mm256_unpackhi_epi8(uv, ys);
+    uint8_t *out = &dst[row * stride];
+
+    _mm256_storeu_si256((__m256i *)&out[0],
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)&out[stride],
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+}
+
+TARGET_AVX2 static void avx2_convert_twiddled(int rot,
+                                              const struct block_src *src,
+                                              uint16_t *dst, int width,
+                                              int height) {
+  avx2_convert_blocks(&avx2_load_twiddled, src, rot, dst, width, height);
+}
+
+TARGET_AVX2 static void avx2_convert_vq(int rot, const struct block_src *src,
+                                        uint16_t *dst, int width, int height) {
+  avx2_convert_blocks(&avx2_load_vq, src, rot, dst, width, height);
+}
+
+TARGET_AVX2 static void avx2_convert_pal4(const struct block_src *src,
+                                          uint16_t *dst, int width,
+                                          int height) {
+  avx2_convert_blocks(&avx2_load_pal4, src, 0, dst, width, height);
+}
+
+TARGET_AVX2 static void avx2_convert_pal8(const struct block_src *src,
+                                          uint16_t *dst, int width,
+                                          int height) {
+  avx2_convert_blocks(&avx2_load_pal8, src, 0, dst, width, height);
+}
+
+#endif
+
+/* the block based conversions require at least a pair of blocks in each
+   dimension */
+static inline int pixel_convert_blocks_valid(int width, int height) {
+  return width >= BLOCK_SIZE * 2 && height >= BLOCK_SIZE * 2;
+}
+
+void pixel_convert_planar(enum pixel_convert_impl impl,
+                          enum pixel_swizzle swizzle, const uint16_t *src,
+                          uint16_t *dst, int width, int height, int stride) {
+  switch (impl) {
+#if ARCH_X64
+    case PIXEL_CONVERT_SSE2:
+      sse2_convert_planar(swizzle_rotations[swizzle], src, dst, width, height,
+                          stride);
+      break;
+    case PIXEL_CONVERT_AVX2:
+      avx2_convert_planar(swizzle_rotations[swizzle], src, dst, width, height,
+                          stride);
+      break;
+#endif
+    default:
+      scalar_convert_planar(swizzle, src, dst, width, height, stride);
+      break;
+  }
+}
+
+void pixel_convert_twiddled(enum pixel_convert_impl impl,
+                            enum pixel_swizzle swizzle, const uint16_t *src,
+                            uint16_t *dst, int width, int height) {
+  struct block_src bsrc = {(const uint8_t *)src, NULL, NULL};
+
+  if (!pixel_convert_blocks_valid(width, height)) {
+    impl = PIXEL_CONVERT_SCALAR;
+  }
+
+  switch (impl) {
+#if ARCH_X64
+    case PIXEL_CONVERT_SSE2:
+      sse2_convert_twiddled(swizzle_rotations[swizzle], &bsrc, dst, width,
+                            height);
+      break;
+    case PIXEL_CONVERT_AVX2:
+      avx2_convert_twiddled(swizzle_rotations[swizzle], &bsrc, dst, width,
+                            height);
+      break;
+#endif
+    default:
+      scalar_convert_twiddled(swizzle, src, dst, width, height);
+      break;
+  }
+}
+
+void pixel_convert_vq(enum pixel_convert_impl impl, enum pixel_swizzle swizzle,
+                      const uint8_t *codebook, const uint8_t *index,
+                      uint16_t *dst, int width, int height) {
+  struct block_src bsrc = {codebook, index, NULL};
+
+  if (!pixel_convert_blocks_valid(width, height)) {
+    impl = PIXEL_CONVERT_SCALAR;
+  }
+
+  switch (impl) {
+#if ARCH_X64
+    case PIXEL_CONVERT_SSE2:
+      sse2_convert_vq(swizzle_rotations[swizzle], &bsrc, dst, width, height);
+      break;
+    case PIXEL_CONVERT_AVX2:
+      avx2_convert_vq(swizzle_rotations[swizzle], &bsrc, dst, width, height);
+      break;
+#endif
+    default:
+      scalar_convert_vq(swizzle, codebook, index, dst, width, height);
+      break;
+  }
+}
+
+void pixel_convert_pal4(enum pixel_convert_impl impl, const uint16_t *palette,
+                        const uint8_t *src, uint16_t *dst, int width,
+                        int height) {
+  struct block_src bsrc = {src, NULL, palette};
+
+  if (!pixel_convert_blocks_valid(width, height)) {
+    impl = PIXEL_CONVERT_SCALAR;
+  }
+
+  switch (impl) {
+#if ARCH_X64
+    case PIXEL_CONVERT_SSE2:
+      sse2_convert_pal4(&bsrc, dst, width, height);
+      break;
+    case PIXEL_CONVERT_AVX2:
+      avx2_convert_pal4(&bsrc, dst, width, height);
+      break;
+#endif
+    default:
+      scalar_convert_pal4(palette, src, dst, width, height);
+      break;
+  }
+}
+
+void pixel_convert_pal8(enum pixel_convert_impl impl, const uint16_t *palette,
+                        const uint8_t *src, uint16_t *dst, int width,
+                        int height) {
+  struct block_src bsrc = {src, NULL, palette};
+
+  if (!pixel_convert_blocks_valid(width, height)) {
+    impl = PIXEL_CONVERT_SCALAR;
+  }
+
+  switch (impl) {
+#if ARCH_X64
+    case PIXEL_CONVERT_SSE2:
+      sse2_convert_pal8(&bsrc, dst, width, height);
+      break;
+    case PIXEL_CONVERT_AVX2:
+      avx2_convert_pal8(&bsrc, dst, width, height);
+      break;
+#endif
+    default:
+      scalar_convert_pal8(palette, src, dst, width, height);
+      break;
+  }
+}
+
+void pixel_convert_yuv420(enum pixel_convert_impl impl, const uint8_t *src,
+                          uint8_t *dst, int stride) {
+  switch (impl) {
+#if ARCH_X64
+    case PIXEL_CONVERT_SSE2:
+      sse2_convert_yuv420(src, dst, stride);
+      break;
+    case PIXEL_CONVERT_AVX2:
+      avx2_convert_yuv420(src, dst, stride);
+      break;
+#endif
+    default:
+      scalar_convert_yuv420(src, dst, stride);
+      break;
+  }
+}
+
+int pixel_convert_supported(enum pixel_convert_impl impl) {
+  switch (impl) {
+    case PIXEL_CONVERT_SCALAR:
+      return 1;
+    case PIXEL_CONVERT_SSE2:
+      return cpu_has_sse2();
+    case PIXEL_CONVERT_AVX2:
+      return cpu_has_avx2();
+    default:
+      return 0;
+  }
+}
+
+enum pixel_convert_impl pixel_convert_selected() {
+  return pixel_convert_impl;
+}
+
+void pixel_convert_init() {
+  static int initialized = 0;
+
+  if (initialized) {
+    return;
+  }
+
+  /* pick the widest implementation supported by the host */
+  for (int i = PIXEL_CONVERT_NUM_IMPLS - 1; i >= 0; i--) {
+    if (pixel_convert_supported(i)) {
+      pixel_convert_impl = i;
+      break;
+    }
+  }
+
+  initialized = 1;
+}
@@ -1,6 +1,7 @@
 #ifndef PIXEL_CONVERT_H
 #define PIXEL_CONVERT_H
 
+#include "core/log.h"
 #include "core/math.h"
 
 /* helper functions for converting between different pixel formats */
@@ -276,6 +277,51 @@ static inline void RGBA8888_write(RGBA8888_type *dst, uint8_t r, uint8_t g,
     }                                                                       \
   }
 
+#define define_convert_palette(FROM, TO)                               \
+  static inline void convert_palette_##FROM##_##TO(                    \
+      const uint32_t *palette, TO##_type *dst, int num_entries) {      \
+    uint8_t r, g, b, a;                                                \
+                                                                       \
+    for (int i = 0; i < num_entries; i++) {                            \
+      const FROM##_type *entry = (const FROM##_type *)&palette[i];     \
+      FROM##_read(entry, &r, &g, &b, &a);                              \
+      TO##_write(&dst[i], r, g, b, a);                                 \
+    }                                                                  \
+  }
+
+/* untwiddle the indices of a paletted texture without looking them up,
+   leaving the lookup to the render backend */
+static inline void convert_idx4(const uint8_t *src, uint8_t *dst, int width,
+                                int height) {
+  int min = MIN(width, height);
+
+  /* always twiddled */
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int twid_idx = TWIDIDX(x, y, min);
+      int pal_idx = src[twid_idx >> 1];
+      if (twid_idx & 1) {
+        pal_idx >>= 4;
+      } else {
+        pal_idx &= 0xf;
+      }
+      *(dst++) = (uint8_t)pal_idx;
+    }
+  }
+}
+
+static inline void convert_idx8(const uint8_t *src, uint8_t *dst, int width,
+                                int height) {
+  int min = MIN(width, height);
+
+  /* always twiddled */
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      *(dst++) = src[TWIDIDX(x, y, min)];
+    }
+  }
+}
+
 define_convert(ARGB1555, RGBA5551);
 define_convert(RGB565, RGB565);
 define_convert(UYVY422, RGB565);
@@ -300,4 +346,60 @@ define_convert_vq(ARGB1555, RGBA5551);
 define_convert_vq(RGB565, RGB565);
 define_convert_vq(ARGB4444, RGBA4444);
 
+define_convert_palette(ARGB1555, RGBA5551);
+define_convert_palette(RGB565, RGB565);
+define_convert_palette(ARGB4444, RGBA4444);
+define_convert_palette(ARGB8888, RGBA4444);
+
+/*
+ * runtime dispatched conversion routines
+ *
+ * the 16-bit texture formats are each converted to the render backend's
+ * format with a simple swizzle, letting the simd implementations convert
+ * many pixels at once. twiddled data is converted in 4x4 blocks, which are
+ * contiguous in memory. paletted textures expect the palette to have already
+ * been converted to the output format with one of the convert_palette_*
+ * functions
+ */
+enum pixel_convert_impl {
+  PIXEL_CONVERT_SCALAR,
+  PIXEL_CONVERT_SSE2,
+  PIXEL_CONVERT_AVX2,
+  PIXEL_CONVERT_NUM_IMPLS,
+};
+
+enum pixel_swizzle {
+  PIXEL_SWIZZLE_ARGB1555_RGBA5551,
+  PIXEL_SWIZZLE_RGB565_RGB565,
+  PIXEL_SWIZZLE_ARGB4444_RGBA4444,
+  PIXEL_NUM_SWIZZLES,
+};
+
+extern const char *pixel_convert_names[PIXEL_CONVERT_NUM_IMPLS];
+
+void pixel_convert_init();
+int pixel_convert_supported(enum pixel_convert_impl impl);
+enum pixel_convert_impl pixel_convert_selected();
+
+void pixel_convert_planar(enum pixel_convert_impl impl,
+                          enum pixel_swizzle swizzle, const uint16_t *src,
+                          uint16_t *dst, int width, int height, int stride);
+void pixel_convert_twiddled(enum pixel_convert_impl impl,
+                            enum pixel_swizzle swizzle, const uint16_t *src,
+                            uint16_t *dst, int width, int height);
+void pixel_convert_vq(enum pixel_convert_impl impl, enum pixel_swizzle swizzle,
+                      const uint8_t *codebook, const uint8_t *index,
+                      uint16_t *dst, int width, int height);
+void pixel_convert_pal4(enum pixel_convert_impl impl, const uint16_t *palette,
+                        const uint8_t *src, uint16_t *dst, int width,
+                        int height);
+void pixel_convert_pal8(enum pixel_convert_impl impl, const uint16_t *palette,
+                        const uint8_t *src, uint16_t *dst, int width,
+                        int height);
+
+/* convert a 16x16 macroblock of YUV420 data, as written to the ta's yuv
+   fifo, to UYVY422. stride is the distance in bytes between output rows */
+void pixel_convert_yuv420(enum pixel_convert_impl impl, const uint8_t *src,
+                          uint8_t *dst, int stride);
+
 #endif
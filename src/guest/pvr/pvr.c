@@ -127,6 +127,7 @@ static uint32_t pvr_palette_read(struct pvr *pvr, uint32_t addr,
 static void pvr_palette_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                               uint32_t data_mask) {
   WRITE_DATA(&pvr->palette_ram[addr]);
+  pvr->palette_dirty |= UINT64_C(1) << (addr >> PVR_PALETTE_BLOCK_SHIFT);
 }
 
 static uint32_t MAP64(uint32_t addr) {
@@ -150,6 +151,23 @@ static uint32_t MAP64(uint32_t addr) {
           (addr & 0x3));
 }
 
+static void pvr_vram_interleaved_mark_dirty(struct pvr *pvr, uint32_t addr,
+                                            int size) {
+  /* each 4MB bank of the interleaved range maps to every other word of the
+     same contiguous range of video ram, conservatively mark the whole range */
+  uint32_t end = addr + size;
+
+  while (addr < end) {
+    uint32_t bank_end = MIN(end, (addr & ~0x3fffff) + 0x400000);
+    uint32_t first = MAP64(addr);
+    uint32_t last = MAP64(bank_end - 1);
+
+    memory_mark_dirty(pvr->vram_region, first, last - first + 1);
+
+    addr = bank_end;
+  }
+}
+
 static uint32_t pvr_vram_interleaved_read(struct pvr *pvr, uint32_t addr,
                                           uint32_t data_mask) {
   addr = MAP64(addr);
@@ -160,6 +178,7 @@ static void pvr_vram_interleaved_write(struct pvr *pvr, uint32_t addr,
                                        uint32_t data, uint32_t data_mask) {
   addr = MAP64(addr);
   WRITE_DATA(&pvr->video_ram[addr]);
+  memory_mark_dirty(pvr->vram_region, addr, DATA_SIZE());
 }
 
 static void pvr_vram_interleaved_read_string(struct pvr *pvr, void *ptr,
@@ -179,6 +198,8 @@ static void pvr_vram_interleaved_write_string(struct pvr *pvr, uint32_t dst,
                                               void *ptr, int size) {
   CHECK(size % 4 == 0);
 
+  pvr_vram_interleaved_mark_dirty(pvr, dst, size);
+
   uint8_t *src = ptr;
   uint8_t *end = src + size;
   while (src < end) {
@@ -201,6 +222,8 @@ static int pvr_init(struct device *dev) {
 
   pvr->palette_ram = (uint8_t *)pvr->PALETTE_RAM000;
   pvr->video_ram = memory_translate(dc->memory, "video ram", 0x00000000);
+  pvr->vram_region =
+      memory_track_writes(dc->memory, "video ram", PVR_VRAM_BLOCK_SHIFT);
 
   /* configure initial vsync interval */
   pvr_reconfigure_spg(pvr);
@@ -208,6 +231,20 @@ static int pvr_init(struct device *dev) {
   return 1;
 }
 
+int pvr_collect_dirty(struct pvr *pvr, uint64_t *vram_dirty,
+                      uint64_t *palette_dirty) {
+  *palette_dirty = pvr->palette_dirty;
+  pvr->palette_dirty = 0;
+
+  return memory_collect_dirty(pvr->vram_region, vram_dirty,
+                              PVR_VRAM_DIRTY_WORDS);
+}
+
+int64_t pvr_vblank_period(struct pvr *pvr) {
+  /* vblank in is raised once every vcount + 1 lines */
+  return (int64_t)(pvr->SPG_LOAD->vcount + 1) * NS_PER_SEC / pvr->line_clock;
+}
+
 void pvr_destroy(struct pvr *pvr) {
   dc_destroy_device((struct device *)pvr);
 }
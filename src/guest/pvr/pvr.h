@@ -10,10 +10,22 @@ struct dreamcast;
 struct holly;
 struct timer;
 
+/* writes to video ram and palette ram are tracked in bitmaps of dirty blocks,
+   letting the texture cache find out which textures have been modified */
+#define PVR_VRAM_SIZE 0x800000
+#define PVR_VRAM_BLOCK_SHIFT 10
+#define PVR_VRAM_NUM_BLOCKS (PVR_VRAM_SIZE >> PVR_VRAM_BLOCK_SHIFT)
+#define PVR_VRAM_DIRTY_WORDS (PVR_VRAM_NUM_BLOCKS / 64)
+#define PVR_PALETTE_SIZE 0x1000
+#define PVR_PALETTE_BLOCK_SHIFT 6
+#define PVR_PALETTE_NUM_BLOCKS (PVR_PALETTE_SIZE >> PVR_PALETTE_BLOCK_SHIFT)
+
 struct pvr {
   struct device;
   uint8_t *palette_ram;
   uint8_t *video_ram;
+  struct memory_region *vram_region;
+  uint64_t palette_dirty;
   uint32_t reg[PVR_NUM_REGS];
 
   /* raster progress */
@@ -36,4 +48,13 @@ extern struct reg_cb pvr_cb[PVR_NUM_REGS];
 struct pvr *pvr_create(struct dreamcast *dc);
 void pvr_destroy(struct pvr *pvr);
 
+/* copies the blocks of video ram and palette ram written to since the last
+   call into the supplied bitmaps, returning the number of dirty video ram
+   blocks */
+int pvr_collect_dirty(struct pvr *pvr, uint64_t *vram_dirty,
+                      uint64_t *palette_dirty);
+
+/* time between vblanks in nanoseconds, for the current video mode */
+int64_t pvr_vblank_period(struct pvr *pvr);
+
 #endif
@@ -2,7 +2,11 @@
 #include "core/exception_handler.h"
 #include "core/filesystem.h"
 #include "core/list.h"
+#include "core/math.h"
+#include "core/memory.h"
+#include "core/option.h"
 #include "core/string.h"
+#include "core/time.h"
 #include "guest/holly/holly.h"
 #include "guest/pvr/pixel_convert.h"
 #include "guest/pvr/pvr.h"
@@ -12,13 +16,48 @@
 
 DEFINE_AGGREGATE_COUNTER(ta_data);
 DEFINE_AGGREGATE_COUNTER(ta_renders);
+/* bytes of param storage committed across all contexts, and the largest param
+   stream rendered so far */
+DEFINE_COUNTER(ta_params_committed);
+DEFINE_COUNTER(ta_params_peak);
+/* estimated render time of the last context in nanoseconds, and the guest
+   time saved per second by scheduling renders to finish at the estimate
+   instead of the fixed time */
+DEFINE_COUNTER(ta_render_predicted);
+DEFINE_AGGREGATE_COUNTER(ta_render_saved);
+
+/* the coefficients were derived from the hardware's documented rates, a
+   100 MHz isp depth testing 32 pixels per cycle and a tsp shading one pixel
+   per cycle, not fit to measured render times. until they are (see retrace's
+   timing command), renders default to the fixed model */
+#define TA_DEFAULT_RENDER_COEFS "200000,10000,1000,20000,100000,312,10000"
+
+DEFINE_PERSISTENT_OPTION_STRING(
+    render_time, "fixed",
+    "How long renders take to finish. fixed gives each one 10 ms, estimate "
+    "predicts it from the render's contents");
+DEFINE_PERSISTENT_OPTION_STRING(
+    render_time_coefs, TA_DEFAULT_RENDER_COEFS,
+    "Comma separated coefficients of the render time estimate, in "
+    "picoseconds per unit of each feature");
+DEFINE_PERSISTENT_OPTION_STRING(
+    render_time_titles, "",
+    "Comma separated list of id=model pairs, overriding render_time for the "
+    "titles with those product ids");
 
 #define TA_MAX_CONTEXTS 8
+#define TA_WRITE_BATCH_SIZE 0x1000
 #define TA_YUV420_MACROBLOCK_SIZE 384
 #define TA_YUV422_MACROBLOCK_SIZE 512
 #define TA_MAX_MACROBLOCK_SIZE \
   MAX(TA_YUV420_MACROBLOCK_SIZE, TA_YUV422_MACROBLOCK_SIZE)
 
+/* time given to every render by the fixed model, and the bounds estimates
+   are clamped to so a badly fit model can't stall or race the guest */
+#define TA_FIXED_RENDER_TIME INT64_C(10000000)
+#define TA_MIN_RENDER_TIME INT64_C(1000000)
+#define TA_MAX_RENDER_TIME INT64_C(20000000)
+
 struct ta_texture {
   struct tr_texture;
   struct ta *ta;
@@ -47,6 +86,10 @@ struct ta {
   struct list free_contexts;
   struct list live_contexts;
   struct tile_context *curr_context;
+
+  /* render time model for the current title */
+  int render_fixed;
+  float render_coefs[TA_NUM_FEATURES];
 };
 
 int g_param_sizes[0x100 * TA_NUM_PARAMS * TA_NUM_VERTS];
@@ -234,6 +277,7 @@ static void ta_free_context(struct ta *ta, struct tile_context *ctx) {
 static void ta_cont_context(struct ta *ta, struct tile_context *ctx) {
   ctx->list_type = TA_NUM_LISTS;
   ctx->vertex_type = TA_NUM_VERTS;
+  ctx->strip_verts = 0;
 }
 
 static void ta_init_context(struct ta *ta, struct tile_context *ctx) {
@@ -241,11 +285,98 @@ static void ta_init_context(struct ta *ta, struct tile_context *ctx) {
   ctx->size = 0;
   ctx->list_type = TA_NUM_LISTS;
   ctx->vertex_type = TA_NUM_VERTS;
+  ctx->strip_verts = 0;
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
+void ta_release_params(struct tile_context *ctx) {
+  if (!ctx->params) {
+    return;
+  }
+
+  prof_counter_add(COUNTER_ta_params_committed, -ctx->params_committed);
+
+  CHECK(release_pages(ctx->params, TA_MAX_PARAMS_SIZE));
+  ctx->params = NULL;
+  ctx->params_committed = 0;
+}
+
+void ta_reserve_params(struct tile_context *ctx, int size) {
+  if (size <= ctx->params_committed) {
+    return;
+  }
+
+  CHECK_LE(size, TA_MAX_PARAMS_SIZE, "param stream overflowed");
+
+  if (!ctx->params) {
+    ctx->params = reserve_pages(NULL, TA_MAX_PARAMS_SIZE);
+    CHECK_NOTNULL(ctx->params, "failed to reserve param storage");
+  }
+
+  int committed = align_up(size, TA_PARAMS_CHUNK_SIZE);
+  CHECK(commit_pages(ctx->params + ctx->params_committed,
+                     committed - ctx->params_committed));
+
+  prof_counter_add(COUNTER_ta_params_committed,
+                   committed - ctx->params_committed);
+  ctx->params_committed = committed;
 }
 
-static void ta_write_context(struct ta *ta, struct tile_context *ctx, void *ptr,
-                             int size) {
-  CHECK_LT(ctx->size + size, (int)sizeof(ctx->params));
+static inline float ta_tri_area(const float *a, const float *b,
+                                const float *c) {
+  return fabsf((b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1])) *
+         0.5f;
+}
+
+static void ta_update_stats(struct tile_context *ctx,
+                            const union vert_param *param) {
+  struct ta_stats *stats = &ctx->stats;
+  int list = ctx->list_type;
+
+  if (list == TA_NUM_LISTS) {
+    return;
+  }
+
+  /* sprites and modifier volume triangles are each sent as a single param
+     holding all of their vertices */
+  if (ctx->vertex_type >= 15) {
+    float area = ta_tri_area(param->sprite0.xyz[0], param->sprite0.xyz[1],
+                             param->sprite0.xyz[2]);
+
+    if (ctx->vertex_type == 17) {
+      stats->verts[list] += 3;
+      stats->tris[list] += 1;
+      stats->area[list] += area;
+    } else {
+      stats->verts[list] += 4;
+      stats->tris[list] += 2;
+      stats->area[list] += area * 2.0f;
+    }
+    return;
+  }
+
+  /* everything else is sent as strips, with each vertex after the first two
+     forming a triangle with the two before it */
+  const float *xyz = param->type0.xyz;
+
+  if (ctx->strip_verts >= 2) {
+    stats->tris[list]++;
+    stats->area[list] += ta_tri_area(ctx->strip_xy[0], ctx->strip_xy[1], xyz);
+  }
+  stats->verts[list]++;
+
+  ctx->strip_xy[0][0] = ctx->strip_xy[1][0];
+  ctx->strip_xy[0][1] = ctx->strip_xy[1][1];
+  ctx->strip_xy[1][0] = xyz[0];
+  ctx->strip_xy[1][1] = xyz[1];
+  ctx->strip_verts =
+      param->type0.pcw.end_of_strip ? 0 : ctx->strip_verts + 1;
+}
+
+int ta_write_context(struct tile_context *ctx, const void *ptr, int size) {
+  if (ctx->size + size > ctx->params_committed) {
+    ta_reserve_params(ctx, ctx->size + size);
+  }
   memcpy(&ctx->params[ctx->size], ptr, size);
   ctx->size += size;
 
@@ -255,6 +386,8 @@ static void ta_write_context(struct ta *ta, struct tile_context *ctx, void *ptr,
   /* each TA command is either 32 or 64 bytes, with the pcw being in the first
      32 bytes always. check every 32 bytes to see if the command has been
      completely received or not */
+  int ended_list = TA_NUM_LISTS;
+
   if (ctx->size % 32 == 0) {
     void *param = &ctx->params[ctx->cursor];
     union pcw pcw = *(union pcw *)param;
@@ -264,7 +397,7 @@ static void ta_write_context(struct ta *ta, struct tile_context *ctx, void *ptr,
 
     if (recv < size) {
       /* wait for the entire command */
-      return;
+      return ended_list;
     }
 
     if (ta_pcw_list_type_valid(pcw, ctx->list_type)) {
@@ -276,11 +409,10 @@ static void ta_write_context(struct ta *ta, struct tile_context *ctx, void *ptr,
       case TA_PARAM_END_OF_LIST:
         /* it's common that a TA_PARAM_END_OF_LIST is sent before a valid list
            type has been set */
-        if (ctx->list_type != TA_NUM_LISTS) {
-          holly_raise_interrupt(ta->holly, list_interrupts[ctx->list_type]);
-        }
+        ended_list = ctx->list_type;
         ctx->list_type = TA_NUM_LISTS;
         ctx->vertex_type = TA_NUM_VERTS;
+        ctx->strip_verts = 0;
         break;
 
       case TA_PARAM_USER_TILE_CLIP:
@@ -294,10 +426,15 @@ static void ta_write_context(struct ta *ta, struct tile_context *ctx, void *ptr,
       case TA_PARAM_POLY_OR_VOL:
       case TA_PARAM_SPRITE:
         ctx->vertex_type = ta_get_vert_type(pcw);
+        ctx->strip_verts = 0;
+        if (ctx->list_type != TA_NUM_LISTS) {
+          ctx->stats.polys[ctx->list_type]++;
+        }
         break;
 
       /* vertex params */
       case TA_PARAM_VERTEX:
+        ta_update_stats(ctx, param);
         break;
 
       default:
@@ -307,6 +444,29 @@ static void ta_write_context(struct ta *ta, struct tile_context *ctx, void *ptr,
 
     ctx->cursor += recv;
   }
+
+  return ended_list;
+}
+
+static void ta_write_poly(struct ta *ta, const void *ptr, int size) {
+  struct tile_context *ctx = ta->curr_context;
+  int prev_cursor = ctx->cursor;
+  int ended_list = ta_write_context(ctx, ptr, size);
+
+  if (ended_list != TA_NUM_LISTS) {
+    holly_raise_interrupt(ta->holly, list_interrupts[ended_list]);
+  }
+
+  /* let the client know each time another batch of complete params has been
+     received, or a list has ended */
+  if (ended_list != TA_NUM_LISTS ||
+      ((prev_cursor ^ ctx->cursor) & ~(TA_WRITE_BATCH_SIZE - 1))) {
+    dc_write_context(ta->dc, ctx);
+  }
+}
+
+void ta_sq_write(struct ta *ta, const void *data) {
+  ta_write_poly(ta, data, 32);
 }
 
 void ta_texture_info(struct ta *ta, union tsp tsp, union tcw tcw,
@@ -417,6 +577,9 @@ static void ta_save_state(struct ta *ta, struct tile_context *ctx) {
   /* get the punch through polygon alpha test value */
   ctx->pt_alpha_ref = *pvr->PT_ALPHA_REF;
 
+  /* get the modifier volume mode and shadow scale */
+  ctx->shad_scale = pvr->FPU_SHAD_SCALE->full;
+
   /* get the byte size for each vertex. normally, the byte size is
      ISP_BACKGND_T.skip + 3, but if parameter selection volume mode is in
      effect and the shadow bit is 1, then the byte size is
@@ -459,9 +622,117 @@ static void ta_finish_render(void *data) {
   holly_raise_interrupt(ta->holly, HOLLY_INT_PCEOTINT);
 }
 
+int ta_parse_render_coefs(const char *str, float *coefs) {
+  const char *ptr = str;
+
+  for (int i = 0; i < TA_NUM_FEATURES; i++) {
+    char *end = NULL;
+    coefs[i] = strtof(ptr, &end);
+
+    if (end == ptr) {
+      return 0;
+    }
+
+    ptr = end;
+
+    if (i < TA_NUM_FEATURES - 1) {
+      if (*ptr != ',') {
+        return 0;
+      }
+      ptr++;
+    }
+  }
+
+  return *ptr == 0;
+}
+
+void ta_render_features(const struct tile_context *ctx, float *features) {
+  const struct ta_stats *stats = &ctx->stats;
+  int polys = 0;
+  int verts = 0;
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    polys += stats->polys[i];
+    verts += stats->verts[i];
+  }
+
+  features[TA_FEATURE_BASE] = 1.0f;
+  features[TA_FEATURE_PIXELS] = (float)(ctx->video_width * ctx->video_height);
+  features[TA_FEATURE_BYTES] = (float)ctx->size;
+  features[TA_FEATURE_POLYS] = (float)polys;
+  features[TA_FEATURE_VERTS] = (float)verts;
+  features[TA_FEATURE_OPAQUE_AREA] =
+      stats->area[TA_LIST_OPAQUE] + stats->area[TA_LIST_OPAQUE_MODVOL] +
+      stats->area[TA_LIST_TRANSLUCENT_MODVOL];
+  features[TA_FEATURE_BLENDED_AREA] =
+      stats->area[TA_LIST_TRANSLUCENT] + stats->area[TA_LIST_PUNCH_THROUGH];
+}
+
+int64_t ta_estimate_render_time(const float *features, const float *coefs) {
+  double ps = 0.0;
+
+  for (int i = 0; i < TA_NUM_FEATURES; i++) {
+    ps += (double)features[i] * (double)coefs[i];
+  }
+
+  /* degenerate vertices can produce infinite or nan areas */
+  if (!(ps > 0.0)) {
+    return 0;
+  }
+
+  return (int64_t)MIN(ps / 1000.0, (double)NS_PER_SEC);
+}
+
+void ta_set_title(struct ta *ta, const char *id) {
+  const char *model = OPTION_render_time;
+
+  /* look for an override of the model for this title */
+  char override[OPTION_MAX_LENGTH];
+  const char *pair = OPTION_render_time_titles;
+  int id_len = id ? (int)strlen(id) : 0;
+
+  while (id && *pair) {
+    const char *end = strchr(pair, ',');
+    if (!end) {
+      end = pair + strlen(pair);
+    }
+
+    const char *sep = memchr(pair, '=', end - pair);
+
+    if (sep && sep - pair == id_len && !strncmp(pair, id, id_len)) {
+      int len = (int)(end - sep - 1);
+      memcpy(override, sep + 1, len);
+      override[len] = 0;
+      model = override;
+      break;
+    }
+
+    pair = *end ? end + 1 : end;
+  }
+
+  ta->render_fixed = !strcmp(model, "fixed");
+
+  if (!ta->render_fixed && strcmp(model, "estimate")) {
+    LOG_WARNING("ta_set_title unknown render time model '%s'", model);
+  }
+
+  if (!ta_parse_render_coefs(OPTION_render_time_coefs, ta->render_coefs)) {
+    LOG_WARNING("ta_set_title failed to parse render time coefficients '%s'",
+                OPTION_render_time_coefs);
+    CHECK(ta_parse_render_coefs(TA_DEFAULT_RENDER_COEFS, ta->render_coefs));
+  }
+
+  LOG_INFO("ta_set_title using %s render time model for %s",
+           ta->render_fixed ? "fixed" : "estimate", id ? id : "bios");
+}
+
 static void ta_start_render(struct ta *ta, struct tile_context *ctx) {
   prof_counter_add(COUNTER_ta_renders, 1);
 
+  if (ctx->size > prof_counter_load(COUNTER_ta_params_peak)) {
+    prof_counter_set(COUNTER_ta_params_peak, ctx->size);
+  }
+
   /* remove context from pool */
   ta_unlink_context(ta, ctx);
 
@@ -472,9 +743,19 @@ static void ta_start_render(struct ta *ta, struct tile_context *ctx) {
   /* let the client know to start rendering the context */
   dc_start_render(ta->dc, ctx);
 
-  /* give each frame 10 ms to finish rendering
-     TODO figure out a heuristic involving the number of polygons rendered */
-  int64_t end = INT64_C(10000000);
+  /* schedule the render to finish when the real hardware would, estimated
+     from the context's contents. the estimate is always made so it can be
+     compared against the fixed time */
+  float features[TA_NUM_FEATURES];
+  ta_render_features(ctx, features);
+
+  int64_t predicted = ta_estimate_render_time(features, ta->render_coefs);
+  predicted = CLAMP(predicted, TA_MIN_RENDER_TIME, TA_MAX_RENDER_TIME);
+  prof_counter_set(COUNTER_ta_render_predicted, predicted);
+
+  int64_t end = ta->render_fixed ? TA_FIXED_RENDER_TIME : predicted;
+  prof_counter_add(COUNTER_ta_render_saved, TA_FIXED_RENDER_TIME - end);
+
   ctx->userdata = ta;
   scheduler_start_timer(ta->scheduler, &ta_finish_render, ctx, end);
 }
@@ -502,45 +783,6 @@ static void ta_yuv_init(struct ta *ta) {
   pvr->TA_YUV_TEX_CNT->num = 0;
 }
 
-static void ta_yuv_process_block(struct ta *ta, const uint8_t *in_uv,
-                                 const uint8_t *in_y, uint8_t *out_uyvy) {
-  uint8_t *out_row0 = out_uyvy;
-  uint8_t *out_row1 = out_uyvy + (ta->yuv_width << 1);
-
-  /* reencode 8x8 subblock of YUV420 data as UYVY422 */
-  for (int j = 0; j < 8; j += 2) {
-    for (int i = 0; i < 8; i += 2) {
-      uint8_t u = in_uv[0];
-      uint8_t v = in_uv[64];
-      uint8_t y0 = in_y[0];
-      uint8_t y1 = in_y[1];
-      uint8_t y2 = in_y[8];
-      uint8_t y3 = in_y[9];
-
-      out_row0[0] = u;
-      out_row0[1] = y0;
-      out_row0[2] = v;
-      out_row0[3] = y1;
-
-      out_row1[0] = u;
-      out_row1[1] = y2;
-      out_row1[2] = v;
-      out_row1[3] = y3;
-
-      in_uv += 1;
-      in_y += 2;
-      out_row0 += 4;
-      out_row1 += 4;
-    }
-
-    /* skip past adjacent 8x8 subblock */
-    in_uv += 4;
-    in_y += 8;
-    out_row0 += (ta->yuv_width << 2) - 16;
-    out_row1 += (ta->yuv_width << 2) - 16;
-  }
-}
-
 static void ta_yuv_process_macroblock(struct ta *ta, void *data) {
   struct pvr *pvr = ta->pvr;
   struct address_space *space = ta->sh4->memory_if->space;
@@ -553,16 +795,13 @@ static void ta_yuv_process_macroblock(struct ta *ta, void *data) {
   uint32_t out_y =
       (pvr->TA_YUV_TEX_CNT->num / (pvr->TA_YUV_TEX_CTRL->u_size + 1)) * 16;
   uint8_t *out = &ta->yuv_data[(out_y * ta->yuv_width + out_x) << 1];
+  int out_stride = ta->yuv_width << 1;
 
-  /* process each 8x8 subblock individually */
-  /* (0, 0) */
-  ta_yuv_process_block(ta, &in[0], &in[128], &out[0]);
-  /* (8, 0) */
-  ta_yuv_process_block(ta, &in[4], &in[192], &out[16]);
-  /* (0, 8) */
-  ta_yuv_process_block(ta, &in[32], &in[256], &out[ta->yuv_width * 16]);
-  /* (8, 8) */
-  ta_yuv_process_block(ta, &in[36], &in[320], &out[ta->yuv_width * 16 + 16]);
+  pixel_convert_yuv420(pixel_convert_selected(), in, out, out_stride);
+
+  /* the macroblock's 16 rows of 16 UYVY pixels */
+  memory_mark_dirty(pvr->vram_region, (uint32_t)(out - ta->video_ram),
+                    out_stride * 15 + 32);
 
   /* reset state once all macroblocks have been processed */
   pvr->TA_YUV_TEX_CNT->num++;
@@ -584,7 +823,7 @@ static void ta_poly_fifo_write(struct ta *ta, uint32_t dst, void *ptr,
   uint8_t *src = ptr;
   uint8_t *end = src + size;
   while (src < end) {
-    ta_write_context(ta, ta->curr_context, src, 32);
+    ta_write_poly(ta, src, 32);
     src += 32;
   }
 
@@ -617,6 +856,7 @@ static void ta_texture_fifo_write(struct ta *ta, uint32_t dst, void *ptr,
   uint8_t *src = ptr;
   dst &= 0xeeffffff;
   memcpy(&ta->video_ram[dst], src, size);
+  memory_mark_dirty(ta->pvr->vram_region, dst, size);
 
   PROF_LEAVE();
 }
@@ -632,6 +872,9 @@ static int ta_init(struct device *dev) {
     list_add(&ta->free_contexts, &ctx->it);
   }
 
+  /* use the default model until a disc is loaded */
+  ta_set_title(ta, NULL);
+
   return 1;
 }
 
@@ -676,11 +919,16 @@ void ta_init_tables() {
 }
 
 void ta_destroy(struct ta *ta) {
+  for (int i = 0; i < array_size(ta->contexts); i++) {
+    ta_release_params(&ta->contexts[i]);
+  }
+
   dc_destroy_device((struct device *)ta);
 }
 
 struct ta *ta_create(struct dreamcast *dc) {
   ta_init_tables();
+  pixel_convert_init();
 
   struct ta *ta = dc_create_device(dc, sizeof(struct ta), "ta", &ta_init);
 
@@ -721,6 +969,8 @@ REG_W32(pvr_cb, TA_LIST_INIT) {
       ta_demand_context(ta, ta->pvr->TA_ISP_BASE->base_address);
   ta_init_context(ta, ctx);
   ta->curr_context = ctx;
+
+  dc_init_context(ta->dc, ctx);
 }
 
 REG_W32(pvr_cb, TA_LIST_CONT) {
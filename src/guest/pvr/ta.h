@@ -1,6 +1,7 @@
 #ifndef TA_H
 #define TA_H
 
+#include "core/option.h"
 #include "core/profiler.h"
 #include "guest/memory.h"
 #include "guest/pvr/ta_types.h"
@@ -9,12 +10,40 @@ struct dreamcast;
 struct ta;
 struct tr_provider;
 
+DECLARE_COUNTER(ta_data);
 DECLARE_COUNTER(ta_renders);
+DECLARE_COUNTER(ta_params_committed);
+DECLARE_COUNTER(ta_params_peak);
+DECLARE_COUNTER(ta_render_predicted);
+DECLARE_COUNTER(ta_render_saved);
+
+DECLARE_OPTION_STRING(render_time_coefs);
 
 AM_DECLARE(ta_fifo_map);
 
 #define TA_CODEBOOK_SIZE (256 * 8)
 
+/* features of a context its render time is estimated from. the estimate is
+   linear in each of them, with a coefficient in picoseconds per unit */
+enum {
+  /* constant cost of every render */
+  TA_FEATURE_BASE,
+  /* pixels in the output, each is shaded at least once */
+  TA_FEATURE_PIXELS,
+  /* bytes in the param stream */
+  TA_FEATURE_BYTES,
+  /* global params, each one being a state change */
+  TA_FEATURE_POLYS,
+  TA_FEATURE_VERTS,
+  /* area covered by the opaque and modifier volume lists, which are only
+     depth tested per-pixel */
+  TA_FEATURE_OPAQUE_AREA,
+  /* area covered by the translucent and punch-through lists, which are
+     shaded per-pixel as well */
+  TA_FEATURE_BLENDED_AREA,
+  TA_NUM_FEATURES,
+};
+
 extern int g_param_sizes[0x100 * TA_NUM_PARAMS * TA_NUM_VERTS];
 extern int g_poly_types[0x100 * TA_NUM_PARAMS * TA_NUM_LISTS];
 extern int g_vertex_types[0x100 * TA_NUM_PARAMS * TA_NUM_LISTS];
@@ -104,6 +133,24 @@ void ta_init_tables();
 struct ta *ta_create(struct dreamcast *dc);
 void ta_destroy(struct ta *ta);
 
+/* ensure storage for the first size bytes of the context's param stream is
+   committed. storage is retained once committed, so contexts recycled between
+   frames only grow until they've seen the largest frame */
+void ta_reserve_params(struct tile_context *ctx, int size);
+void ta_release_params(struct tile_context *ctx);
+
+int ta_write_context(struct tile_context *ctx, const void *ptr, int size);
+void ta_sq_write(struct ta *ta, const void *data);
+
+/* render time estimation. the coefficients are parsed from a comma separated
+   list, one per feature in order */
+int ta_parse_render_coefs(const char *str, float *coefs);
+void ta_render_features(const struct tile_context *ctx, float *features);
+int64_t ta_estimate_render_time(const float *features, const float *coefs);
+
+/* select the render time model for the title with the given product id */
+void ta_set_title(struct ta *ta, const char *id);
+
 void ta_texture_info(struct ta *ta, union tsp tsp, union tcw tcw,
                      const uint8_t **texture, int *texture_size,
                      const uint8_t **palette, int *palette_size);
@@ -91,6 +91,12 @@ union isp {
     uint32_t culling_mode : 2;
     uint32_t depth_compare_mode : 3;
   };
+  /* modifier volume params use the depth compare mode bits to specify the
+     last polygon of each volume */
+  struct {
+    uint32_t : 29;
+    uint32_t volume_instr : 3;
+  };
   uint32_t full;
 };
 
@@ -428,12 +434,40 @@ union vert_param {
     float xyz[4][3];
     uint32_t uv[3];
   } sprite1;
+
+  struct {
+    union pcw pcw;
+    float xyz[3][3];
+    uint32_t ignore_0;
+    uint32_t ignore_1;
+    uint32_t ignore_2;
+    uint32_t ignore_3;
+    uint32_t ignore_4;
+    uint32_t ignore_5;
+  } modvol;
+};
+
+/* stats on a context's contents, gathered as its params are written. these
+   drive the estimate of how long the real hardware takes to render it */
+struct ta_stats {
+  /* global params, vertices and triangles written to each list */
+  int polys[TA_NUM_LISTS];
+  int verts[TA_NUM_LISTS];
+  int tris[TA_NUM_LISTS];
+  /* screen area in pixels covered by each list's triangles, overlapping
+     triangles are each counted */
+  float area[TA_NUM_LISTS];
 };
 
-/* shared by tracer */
-#define TA_MAX_SURFS (1024 * 16)
+/* vertices are referenced by 16-bit indices */
 #define TA_MAX_VERTS (1024 * 64)
-#define TA_MAX_PARAMS 0x10000
+
+/* address space reserved for each context's param stream. the ta writes its
+   object lists into video ram, so no context can be larger than it */
+#define TA_MAX_PARAMS_SIZE (8 * 1024 * 1024)
+
+/* granularity the param stream's storage is committed at as it grows */
+#define TA_PARAMS_CHUNK_SIZE (64 * 1024)
 
 /* worst case background vertex size, see ISP_BACKGND_T field */
 #define TA_BG_VERTEX_SIZE ((0b111 * 2 + 3) * 4 * 3)
@@ -454,10 +488,14 @@ struct tile_context {
   union tcw bg_tcw;
   float bg_depth;
   uint32_t pt_alpha_ref;
+  uint32_t shad_scale;
   uint8_t bg_vertices[TA_BG_VERTEX_SIZE];
 
-  /* parameter buffer */
-  uint8_t params[TA_MAX_PARAMS * 32];
+  /* parameter buffer. address space for the largest possible stream is
+     reserved the first time the context is written to, and committed in
+     chunks as it grows, so params never move once they've been written */
+  uint8_t *params;
+  int params_committed;
   int cursor;
   int size;
 
@@ -465,6 +503,12 @@ struct tile_context {
   int list_type;
   int vertex_type;
 
+  /* render stats, along with the screen position of the last two vertices
+     of the current strip needed to measure the area of its next triangle */
+  struct ta_stats stats;
+  int strip_verts;
+  float strip_xy[2][2];
+
   struct list_node it;
 };
 
@@ -1,14 +1,64 @@
+#include <limits.h>
 #include "guest/pvr/tr.h"
 #include "core/assert.h"
 #include "core/core.h"
 #include "core/math.h"
+#include "core/option.h"
 #include "core/profiler.h"
 #include "core/sort.h"
+#include "core/worker_pool.h"
 #include "guest/pvr/pixel_convert.h"
+#include "guest/pvr/pvr_types.h"
 #include "guest/pvr/ta.h"
+#include "guest/pvr/tr_atlas.h"
+#include "guest/pvr/vert_decode.h"
+
+DEFINE_OPTION_INT(triangle_sort, 0,
+                  "Sort translucent polygons per triangle instead of per "
+                  "surface when autosorting");
+
+DEFINE_OPTION_INT(batch_surfaces, 1,
+                  "Group opaque and punch-through surfaces by state, drawing "
+                  "each group with a single draw call");
+
+DEFINE_OPTION_INT(texture_atlas, 1,
+                  "Pack small textures into shared atlas pages, letting "
+                  "surfaces using different textures be drawn together");
+
+DEFINE_OPTION_INT(modifier_volumes, 1,
+                  "Darken the shadowed surfaces covered by modifier volumes");
+
+/* high-water marks of the converted contexts, used to size context storage */
+DEFINE_COUNTER(tr_surfs_peak);
+DEFINE_COUNTER(tr_verts_peak);
+DEFINE_COUNTER(tr_indices_peak);
+
+/* surfaces merged into the previous surface of their list after their
+   textures were packed into the same atlas page, each saving a draw and a
+   texture bind */
+DEFINE_COUNTER(tr_atlas_binds_saved);
+
+const char *tr_sort_names[TR_NUM_SORTS] = {"merge", "radix", "triangles"};
+
+/* granularity context storage grows at */
+#define TR_SURFS_CHUNK 1024
+#define TR_VERTS_CHUNK 4096
+#define TR_PARAMS_CHUNK 4096
+#define TR_VOLUMES_CHUNK 256
+#define TR_VOLUME_TRIS_CHUNK 4096
+
+#define TR_MAX_WORKERS 8
+
+/* parallel conversion splits the param stream into about this many chunks
+   per thread, giving the threads something to pick up while the largest
+   chunks are still being parsed */
+#define TR_CHUNKS_PER_THREAD 4
+#define TR_MIN_CHUNK_SIZE (16 * 1024)
+#define TR_MAX_CHUNKS 64
 
 struct tr {
   struct render_backend *r;
+  struct tr_atlas *atlas;
   void *userdata;
   tr_find_texture_cb find_texture;
 
@@ -20,8 +70,33 @@ struct tr {
   float face_color[4];
   float face_offset_color[4];
   int merged_surfs;
+  int atlas_merges;
+
+  /* context state that isn't known until the context is rendered. when
+     converting incrementally, the punch-through alpha reference is patched in
+     by tr_end_context, while autosort is guessed up front. textures are
+     always resolved once the entire context has been parsed, as packing them
+     into the atlas depends on the uvs of the surfaces using them */
+  int autosort;
+  float pt_alpha_ref;
+
+  /* offset of the next param to parse in the context's param stream */
+  int offset;
+
+  /* surfaces before this index are never merged into */
+  int merge_base;
+
+  /* modifier volume being parsed. a volume is open from the first global
+     param following the last volume until the triangles following the global
+     param specifying its last polygon */
+  int volume_open;
+  int volume_ending;
 };
 
+/* placeholder handle for textured surfaces whose texture hasn't been resolved
+   yet */
+#define TR_DEFERRED_TEXTURE ((texture_handle_t)-1)
+
 static int compressed_mipmap_offsets[] = {
     0x00006, /* 8 x 8 */
     0x00016, /* 16 x 16 */
@@ -103,228 +178,331 @@ static inline enum shade_mode translate_shade_mode(uint32_t shade_mode) {
   return shade_modes[shade_mode];
 }
 
-static inline uint32_t abgr_to_rgba(uint32_t v) {
-  return (v & 0xff000000) | ((v & 0xff) << 16) | (v & 0xff00) |
-         ((v & 0xff0000) >> 16);
+static int tr_texture_paletted(union tcw tcw) {
+  return tcw.pixel_format == TA_PIXEL_4BPP || tcw.pixel_format == TA_PIXEL_8BPP;
 }
 
-static inline uint8_t float_to_u8(float x) {
-  return MIN(MAX((uint32_t)(x * 255.0f), 0u), 255u);
+/* paletted textures are uploaded as indices when the texture provider
+   maintains a palette texture for them to be looked up in */
+static int tr_texture_indexed(const struct tr_texture *entry) {
+  return entry->palette_texture && tr_texture_paletted(entry->tcw);
 }
 
-static inline uint32_t float_to_rgba(float r, float g, float b, float a) {
-  return (float_to_u8(a) << 24) | (float_to_u8(b) << 16) |
-         (float_to_u8(g) << 8) | float_to_u8(r);
+/* first palette entry of the bank a paletted texture indexes into. 4bpp
+   textures select one of 64 banks of 16 entries, 8bpp textures one of 4 banks
+   of 256 entries with the upper bits of the selector */
+static int tr_palette_base(union tcw tcw) {
+  if (tcw.pixel_format == TA_PIXEL_4BPP) {
+    return tcw.p.palette_selector << 4;
+  }
+  return (tcw.p.palette_selector & 0x30) << 4;
 }
 
-static texture_handle_t tr_convert_texture(struct tr *tr,
-                                           const struct tile_context *ctx,
-                                           union tsp tsp, union tcw tcw) {
-  PROF_ENTER("gpu", "tr_convert_texture");
+static enum pxl_format tr_texture_format(union tcw tcw, int pal_pxl_format,
+                                         int indexed) {
+  if (indexed) {
+    return PXL_INDEX8;
+  }
 
-  /* TODO it's bad that textures are only cached based off tsp / tcw yet the
-     TEXT_CONTROL registers and PAL_RAM_CTRL registers are used here to control
-     texture generation */
+  switch (tcw.pixel_format) {
+    case TA_PIXEL_1555:
+    case TA_PIXEL_RESERVED:
+      return PXL_RGBA5551;
+    case TA_PIXEL_565:
+    case TA_PIXEL_YUV422:
+      return PXL_RGB565;
+    case TA_PIXEL_4444:
+      return PXL_RGBA4444;
+    case TA_PIXEL_4BPP:
+    case TA_PIXEL_8BPP:
+      switch (pal_pxl_format) {
+        case TA_PAL_ARGB1555:
+          return PXL_RGBA5551;
+        case TA_PAL_RGB565:
+          return PXL_RGB565;
+        case TA_PAL_ARGB4444:
+        case TA_PAL_ARGB8888:
+          return PXL_RGBA4444;
+        default:
+          LOG_FATAL("unsupported palette pixel format %d", pal_pxl_format);
+          break;
+      }
+      break;
+    default:
+      LOG_FATAL("unsupported tcw pixel format %d", tcw.pixel_format);
+      break;
+  }
+  return PXL_INVALID;
+}
 
-  struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
-  CHECK_NOTNULL(entry);
+static int tr_texture_stride(union tcw tcw, int width, int ctx_stride) {
+  if (!ta_texture_twiddled(tcw) && tcw.stride_select) {
+    return ctx_stride;
+  }
+  return width;
+}
 
-  /* if there's a non-dirty handle, return it */
-  if (entry->handle && !entry->dirty) {
-    PROF_LEAVE();
-    return entry->handle;
+int tr_texture_converted_size(union tsp tsp, union tcw tcw, int stride) {
+  int width = ta_texture_width(tsp, tcw);
+  int height = ta_texture_height(tsp, tcw);
+
+  /* the planar converters write out an entire stride for each row */
+  return height * MAX(width, tr_texture_stride(tcw, width, stride)) *
+         (int)sizeof(uint16_t);
+}
+
+const uint8_t *tr_texture_source(union tsp tsp, union tcw tcw,
+                                 const uint8_t *texture) {
+  if (!ta_texture_mipmaps(tcw)) {
+    return texture;
   }
 
-  /* if there's a dirty handle, destroy it before creating the new one */
-  if (entry->handle && entry->dirty) {
-    r_destroy_texture(tr->r, entry->handle);
-    entry->handle = 0;
+  /* mipmap textures contain data for 1 x 1 up to width x height. skip to the
+     highest res and let the renderer backend generate its own mipmaps */
+  if (ta_texture_compressed(tcw)) {
+    /* for vq compressed textures the offset is only for the index data, the
+       codebook is the same for all levels */
+    return texture + compressed_mipmap_offsets[tsp.texture_u_size];
+  } else if (tcw.pixel_format == TA_PIXEL_4BPP) {
+    return texture + paletted_4bpp_mipmap_offsets[tsp.texture_u_size];
+  } else if (tcw.pixel_format == TA_PIXEL_8BPP) {
+    return texture + paletted_8bpp_mipmap_offsets[tsp.texture_u_size];
   }
+  return texture + nonpaletted_mipmap_offsets[tsp.texture_u_size];
+}
 
-  static uint8_t converted[1024 * 1024 * 4];
+void tr_texture_convert(const struct tr_texture *entry, int pal_pxl_format,
+                        int stride, uint8_t *output) {
+  tr_texture_convert_impl(pixel_convert_selected(), entry, pal_pxl_format,
+                          stride, output);
+}
+
+void tr_texture_convert_impl(enum pixel_convert_impl impl,
+                             const struct tr_texture *entry,
+                             int pal_pxl_format, int stride, uint8_t *output) {
+  union tsp tsp = entry->tsp;
+  union tcw tcw = entry->tcw;
   const uint8_t *palette = entry->palette;
   const uint8_t *texture = entry->texture;
-  const uint8_t *input = texture;
-  const uint8_t *output = texture;
+  const uint8_t *input = tr_texture_source(tsp, tcw, texture);
 
   /* textures are either twiddled and vq compressed, twiddled and uncompressed
      or planar */
   int twiddled = ta_texture_twiddled(tcw);
   int compressed = ta_texture_compressed(tcw);
-  int mipmaps = ta_texture_mipmaps(tcw);
 
   /* get texture dimensions */
   int width = ta_texture_width(tsp, tcw);
   int height = ta_texture_height(tsp, tcw);
-  int stride = width;
-  if (!twiddled && tcw.stride_select) {
-    stride = ctx->stride;
-  }
-
-  /* mipmap textures contain data for 1 x 1 up to width x height. skip to the
-     highest res and let the renderer backend generate its own mipmaps */
-  if (mipmaps) {
-    if (compressed) {
-      /* for vq compressed textures the offset is only for the index data, the
-         codebook is the same for all levels */
-      input += compressed_mipmap_offsets[tsp.texture_u_size];
-    } else if (tcw.pixel_format == TA_PIXEL_4BPP) {
-      input += paletted_4bpp_mipmap_offsets[tsp.texture_u_size];
-    } else if (tcw.pixel_format == TA_PIXEL_8BPP) {
-      input += paletted_8bpp_mipmap_offsets[tsp.texture_u_size];
-    } else {
-      input += nonpaletted_mipmap_offsets[tsp.texture_u_size];
-    }
-  }
+  stride = tr_texture_stride(tcw, width, stride);
 
   /* used by vq compressed textures */
   const uint8_t *codebook = texture;
   const uint8_t *index = input + TA_CODEBOOK_SIZE;
 
-  enum pxl_format pixel_fmt = PXL_INVALID;
+  enum pixel_swizzle swizzle = PIXEL_NUM_SWIZZLES;
+  uint16_t *converted = (uint16_t *)output;
+
+  /* palettes are converted to the output format up front, leaving only a
+     lookup per pixel */
+  uint16_t converted_palette[256];
+  int num_palette_entries = tcw.pixel_format == TA_PIXEL_4BPP ? 16 : 256;
+
   switch (tcw.pixel_format) {
     case TA_PIXEL_1555:
     case TA_PIXEL_RESERVED:
-      output = converted;
-      pixel_fmt = PXL_RGBA5551;
-      if (compressed) {
-        convert_vq_ARGB1555_RGBA5551(codebook, index, (uint16_t *)converted,
-                                     width, height);
-      } else if (twiddled) {
-        convert_twiddled_ARGB1555_RGBA5551(
-            (const uint16_t *)input, (uint16_t *)converted, width, height);
-      } else {
-        convert_ARGB1555_RGBA5551((const uint16_t *)input,
-                                  (uint16_t *)converted, width, height, stride);
-      }
-      break;
-
     case TA_PIXEL_565:
-      output = converted;
-      pixel_fmt = PXL_RGB565;
-      if (compressed) {
-        convert_vq_RGB565_RGB565(codebook, index, (uint16_t *)converted, width,
-                                 height);
-      } else if (twiddled) {
-        convert_twiddled_RGB565_RGB565((const uint16_t *)input,
-                                       (uint16_t *)converted, width, height);
+    case TA_PIXEL_4444:
+      if (tcw.pixel_format == TA_PIXEL_565) {
+        swizzle = PIXEL_SWIZZLE_RGB565_RGB565;
+      } else if (tcw.pixel_format == TA_PIXEL_4444) {
+        swizzle = PIXEL_SWIZZLE_ARGB4444_RGBA4444;
       } else {
-        convert_RGB565_RGB565((const uint16_t *)input, (uint16_t *)converted,
-                              width, height, stride);
+        swizzle = PIXEL_SWIZZLE_ARGB1555_RGBA5551;
       }
-      break;
-
-    case TA_PIXEL_4444:
-      output = converted;
-      pixel_fmt = PXL_RGBA4444;
       if (compressed) {
-        convert_vq_ARGB4444_RGBA4444(codebook, index, (uint16_t *)converted,
-                                     width, height);
+        pixel_convert_vq(impl, swizzle, codebook, index, converted, width,
+                         height);
       } else if (twiddled) {
-        convert_twiddled_ARGB4444_RGBA4444(
-            (const uint16_t *)input, (uint16_t *)converted, width, height);
+        pixel_convert_twiddled(impl, swizzle, (const uint16_t *)input,
+                               converted, width, height);
       } else {
-        convert_ARGB4444_RGBA4444((const uint16_t *)input,
-                                  (uint16_t *)converted, width, height, stride);
+        pixel_convert_planar(impl, swizzle, (const uint16_t *)input,
+                             converted, width, height, stride);
       }
       break;
 
     case TA_PIXEL_YUV422:
-      output = converted;
-      pixel_fmt = PXL_RGB565;
       CHECK(!compressed);
       if (twiddled) {
-        convert_twiddled_UYVY422_RGB565((const uint16_t *)input,
-                                        (uint16_t *)converted, width, height);
+        convert_twiddled_UYVY422_RGB565((const uint16_t *)input, converted,
+                                        width, height);
 
       } else {
-        convert_UYVY422_RGB565((const uint16_t *)input, (uint16_t *)converted,
-                               width, height, stride);
+        convert_UYVY422_RGB565((const uint16_t *)input, converted, width,
+                               height, stride);
       }
       break;
 
     case TA_PIXEL_4BPP:
+    case TA_PIXEL_8BPP:
       CHECK(!compressed);
-      output = converted;
-      switch (ctx->pal_pxl_format) {
+      if (tr_texture_indexed(entry)) {
+        if (tcw.pixel_format == TA_PIXEL_4BPP) {
+          convert_idx4(input, output, width, height);
+        } else {
+          convert_idx8(input, output, width, height);
+        }
+        break;
+      }
+      switch (pal_pxl_format) {
         case TA_PAL_ARGB1555:
-          pixel_fmt = PXL_RGBA5551;
-          convert_pal4_ARGB1555_RGBA5551(input, (uint16_t *)converted,
-                                         (const uint32_t *)palette, width,
-                                         height);
+          convert_palette_ARGB1555_RGBA5551((const uint32_t *)palette,
+                                            converted_palette,
+                                            num_palette_entries);
           break;
 
         case TA_PAL_RGB565:
-          pixel_fmt = PXL_RGB565;
-          convert_pal4_RGB565_RGB565(input, (uint16_t *)converted,
-                                     (const uint32_t *)palette, width, height);
+          convert_palette_RGB565_RGB565((const uint32_t *)palette,
+                                        converted_palette,
+                                        num_palette_entries);
           break;
 
         case TA_PAL_ARGB4444:
-          pixel_fmt = PXL_RGBA4444;
-          convert_pal4_ARGB4444_RGBA4444(input, (uint16_t *)converted,
-                                         (const uint32_t *)palette, width,
-                                         height);
+          convert_palette_ARGB4444_RGBA4444((const uint32_t *)palette,
+                                            converted_palette,
+                                            num_palette_entries);
           break;
 
         case TA_PAL_ARGB8888:
-          pixel_fmt = PXL_RGBA4444;
-          convert_pal4_ARGB8888_RGBA4444(input, (uint16_t *)converted,
-                                         (const uint32_t *)palette, width,
-                                         height);
-
+          convert_palette_ARGB8888_RGBA4444((const uint32_t *)palette,
+                                            converted_palette,
+                                            num_palette_entries);
           break;
 
         default:
-          LOG_FATAL("unsupported 4bpp palette pixel format %d",
-                    ctx->pal_pxl_format);
+          LOG_FATAL("unsupported palette pixel format %d", pal_pxl_format);
           break;
       }
+      if (tcw.pixel_format == TA_PIXEL_4BPP) {
+        pixel_convert_pal4(impl, converted_palette, input, converted, width,
+                           height);
+      } else {
+        pixel_convert_pal8(impl, converted_palette, input, converted, width,
+                           height);
+      }
       break;
 
-    case TA_PIXEL_8BPP:
-      CHECK(!compressed);
-      output = converted;
-      switch (ctx->pal_pxl_format) {
-        case TA_PAL_ARGB1555:
-          pixel_fmt = PXL_RGBA5551;
-          convert_pal8_ARGB1555_RGBA5551(input, (uint16_t *)converted,
-                                         (const uint32_t *)palette, width,
-                                         height);
-          break;
+    default:
+      LOG_FATAL("unsupported tcw pixel format %d", tcw.pixel_format);
+      break;
+  }
+}
 
-        case TA_PAL_RGB565:
-          pixel_fmt = PXL_RGB565;
-          convert_pal8_RGB565_RGB565(input, (uint16_t *)converted,
-                                     (const uint32_t *)palette, width, height);
-          break;
+void tr_palette_convert(int pal_pxl_format, const uint8_t *palette,
+                        int num_entries, uint8_t *output) {
+  const uint32_t *src = (const uint32_t *)palette;
+  uint8_t *dst = output;
+
+  /* the 16-bit formats are expanded the same as the render backends expand
+     the 16-bit texture formats, so the looked up colors match those of
+     expanded textures */
+  for (int i = 0; i < num_entries; i++, dst += 4) {
+    uint32_t px = src[i];
+    uint32_t r, g, b, a;
+
+    switch (pal_pxl_format) {
+      case TA_PAL_ARGB1555:
+        r = (px >> 10) & 0x1f;
+        g = (px >> 5) & 0x1f;
+        b = px & 0x1f;
+        r = (r << 3) | (r >> 2);
+        g = (g << 3) | (g >> 2);
+        b = (b << 3) | (b >> 2);
+        a = (px & 0x8000) ? 0xff : 0;
+        break;
 
-        case TA_PAL_ARGB4444:
-          pixel_fmt = PXL_RGBA4444;
-          convert_pal8_ARGB4444_RGBA4444(input, (uint16_t *)converted,
-                                         (const uint32_t *)palette, width,
-                                         height);
-          break;
+      case TA_PAL_RGB565:
+        r = (px >> 11) & 0x1f;
+        g = (px >> 5) & 0x3f;
+        b = px & 0x1f;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        a = 0xff;
+        break;
 
-        case TA_PAL_ARGB8888:
-          pixel_fmt = PXL_RGBA4444;
-          convert_pal8_ARGB8888_RGBA4444(input, (uint16_t *)converted,
-                                         (const uint32_t *)palette, width,
-                                         height);
-          break;
+      case TA_PAL_ARGB4444:
+        a = ((px >> 12) & 0xf) * 0x11;
+        r = ((px >> 8) & 0xf) * 0x11;
+        g = ((px >> 4) & 0xf) * 0x11;
+        b = (px & 0xf) * 0x11;
+        break;
 
-        default:
-          LOG_FATAL("unsupported 8bpp palette pixel format %d",
-                    ctx->pal_pxl_format);
-          break;
-      }
-      break;
+      case TA_PAL_ARGB8888:
+        a = (px >> 24) & 0xff;
+        r = (px >> 16) & 0xff;
+        g = (px >> 8) & 0xff;
+        b = px & 0xff;
+        break;
 
-    default:
-      LOG_FATAL("unsupported tcw pixel format %d", tcw.pixel_format);
-      break;
+      default:
+        LOG_FATAL("unsupported palette pixel format %d", pal_pxl_format);
+        break;
+    }
+
+    dst[0] = (uint8_t)r;
+    dst[1] = (uint8_t)g;
+    dst[2] = (uint8_t)b;
+    dst[3] = (uint8_t)a;
+  }
+}
+
+static struct tr_texture *tr_convert_texture(struct tr *tr,
+                                             const struct tile_context *ctx,
+                                             union tsp tsp, union tcw tcw) {
+  PROF_ENTER("gpu", "tr_convert_texture");
+
+  /* TODO it's bad that textures are only cached based off tsp / tcw yet the
+     TEXT_CONTROL registers and PAL_RAM_CTRL registers are used here to control
+     texture generation */
+
+  struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
+  CHECK_NOTNULL(entry);
+
+  /* if there's a non-dirty handle, return it */
+  if (entry->handle && !entry->dirty) {
+    PROF_LEAVE();
+    return entry;
+  }
+
+  /* if there's a dirty handle, destroy it before creating the new one */
+  if (entry->handle && entry->dirty) {
+    r_destroy_texture(tr->r, entry->handle);
+    entry->handle = 0;
+  }
+
+  if (entry->atlas_handle) {
+    tr_atlas_release(tr->atlas, entry);
+  }
+
+  /* upload the data converted ahead of time by the texture provider, else
+     convert it now */
+  static uint8_t converted[1024 * 1024 * 4];
+  const uint8_t *output = entry->converted;
+
+  if (!output) {
+    tr_texture_convert(entry, ctx->pal_pxl_format, ctx->stride, converted);
+    output = converted;
   }
 
+  int mipmaps = ta_texture_mipmaps(tcw);
+  int width = ta_texture_width(tsp, tcw);
+  int height = ta_texture_height(tsp, tcw);
+  int indexed = tr_texture_indexed(entry);
+  enum pxl_format pixel_fmt =
+      tr_texture_format(tcw, ctx->pal_pxl_format, indexed);
+
   /* ignore trilinear filtering for now */
   enum filter_mode filter =
       tsp.filter_mode == 0 ? FILTER_NEAREST : FILTER_BILINEAR;
@@ -335,8 +513,16 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
       tsp.clamp_v ? WRAP_CLAMP_TO_EDGE
                   : (tsp.flip_v ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
 
-  entry->handle = r_create_texture(tr->r, pixel_fmt, filter, wrap_u, wrap_v,
-                                   mipmaps, width, height, output);
+  /* indices can't be filtered or averaged into mipmaps, the filtering is
+     instead done by the backend after looking them up. only the base level
+     is used */
+  if (indexed) {
+    entry->handle = r_create_texture(tr->r, pixel_fmt, FILTER_NEAREST, wrap_u,
+                                     wrap_v, 0, width, height, output);
+  } else {
+    entry->handle = r_create_texture(tr->r, pixel_fmt, filter, wrap_u, wrap_v,
+                                     mipmaps, width, height, output);
+  }
   entry->format = pixel_fmt;
   entry->filter = filter;
   entry->wrap_u = wrap_u;
@@ -345,23 +531,131 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
   entry->height = height;
   entry->dirty = 0;
 
+  /* pack a copy of small textures into the atlas as well. the standalone
+     texture is still needed for surfaces whose uvs wrap. indexed textures
+     aren't packed, as surfaces looking up different palette banks couldn't
+     share a page anyway */
+  if (tr->atlas && OPTION_texture_atlas && !mipmaps && !indexed) {
+    tr_atlas_pack(tr->atlas, entry, output);
+  }
+
   PROF_LEAVE();
 
-  return entry->handle;
+  return entry;
+}
+
+/* storage is grown by at least a chunk, and at least doubled to keep the
+   number of reallocations logarithmic while warming up */
+static int tr_grow_size(int max, int size, int chunk) {
+  return MAX(max * 2, align_up(size, chunk));
+}
+
+static void tr_grow_surfs(struct tr_context *rc, int num_surfs) {
+  if (num_surfs <= rc->max_surfs) {
+    return;
+  }
+
+  rc->max_surfs = tr_grow_size(rc->max_surfs, num_surfs, TR_SURFS_CHUNK);
+  rc->surfs = realloc(rc->surfs, rc->max_surfs * sizeof(rc->surfs[0]));
+  rc->surf_textures = realloc(rc->surf_textures,
+                              rc->max_surfs * sizeof(rc->surf_textures[0]));
+  CHECK(rc->surfs && rc->surf_textures);
+}
+
+static void tr_grow_verts(struct tr_context *rc, int num_verts) {
+  if (num_verts <= rc->max_verts) {
+    return;
+  }
+
+  CHECK_LE(num_verts, TA_MAX_VERTS, "vertices overflowed 16-bit indices");
+
+  rc->max_verts = tr_grow_size(rc->max_verts, num_verts, TR_VERTS_CHUNK);
+  rc->max_verts = MIN(rc->max_verts, TA_MAX_VERTS);
+  rc->verts = realloc(rc->verts, rc->max_verts * sizeof(rc->verts[0]));
+  CHECK_NOTNULL(rc->verts);
+}
+
+static void tr_grow_indices(struct tr_context *rc, int num_indices) {
+  if (num_indices <= rc->max_indices) {
+    return;
+  }
+
+  rc->max_indices =
+      tr_grow_size(rc->max_indices, num_indices, TR_VERTS_CHUNK * 3);
+  rc->indices = realloc(rc->indices, rc->max_indices * sizeof(rc->indices[0]));
+  CHECK_NOTNULL(rc->indices);
+}
+
+static void tr_grow_list(struct tr_list *list, int num_surfs) {
+  if (num_surfs <= list->max_surfs) {
+    return;
+  }
+
+  list->max_surfs = tr_grow_size(list->max_surfs, num_surfs, TR_SURFS_CHUNK);
+  list->surfs = realloc(list->surfs, list->max_surfs * sizeof(list->surfs[0]));
+  CHECK_NOTNULL(list->surfs);
+}
+
+static void tr_grow_params(struct tr_context *rc, int num_params) {
+  if (num_params <= rc->max_params) {
+    return;
+  }
+
+  rc->max_params = tr_grow_size(rc->max_params, num_params, TR_PARAMS_CHUNK);
+  rc->params = realloc(rc->params, rc->max_params * sizeof(rc->params[0]));
+  CHECK_NOTNULL(rc->params);
+}
+
+static void tr_grow_volumes(struct tr_context *rc, int num_volumes) {
+  if (num_volumes <= rc->max_volumes) {
+    return;
+  }
+
+  rc->max_volumes =
+      tr_grow_size(rc->max_volumes, num_volumes, TR_VOLUMES_CHUNK);
+  rc->volumes =
+      realloc(rc->volumes, rc->max_volumes * sizeof(rc->volumes[0]));
+  CHECK_NOTNULL(rc->volumes);
+}
+
+static void tr_grow_volume_tris(struct tr_context *rc, int num_tris) {
+  if (num_tris <= rc->max_volume_tris) {
+    return;
+  }
+
+  rc->max_volume_tris =
+      tr_grow_size(rc->max_volume_tris, num_tris, TR_VOLUME_TRIS_CHUNK);
+  rc->volume_tris = realloc(rc->volume_tris,
+                            rc->max_volume_tris * sizeof(rc->volume_tris[0]));
+  CHECK_NOTNULL(rc->volume_tris);
+}
+
+static void tr_grow_list_volumes(struct tr_list *list, int num_volumes) {
+  if (num_volumes <= list->max_volumes) {
+    return;
+  }
+
+  list->max_volumes =
+      tr_grow_size(list->max_volumes, num_volumes, TR_VOLUMES_CHUNK);
+  list->volumes =
+      realloc(list->volumes, list->max_volumes * sizeof(list->volumes[0]));
+  CHECK_NOTNULL(list->volumes);
 }
 
 static struct ta_surface *tr_reserve_surf(struct tr *tr, struct tr_context *rc,
                                           int copy_from_prev) {
   int surf_index = rc->num_surfs;
 
-  CHECK_LT(surf_index, array_size(rc->surfs));
+  tr_grow_surfs(rc, surf_index + 1);
   struct ta_surface *surf = &rc->surfs[surf_index];
 
   if (copy_from_prev) {
     CHECK(rc->num_surfs);
     *surf = rc->surfs[rc->num_surfs - 1];
+    rc->surf_textures[surf_index] = rc->surf_textures[rc->num_surfs - 1];
   } else {
     memset(surf, 0, sizeof(*surf));
+    rc->surf_textures[surf_index] = 0;
   }
 
   surf->first_vert = rc->num_indices;
@@ -375,11 +669,11 @@ static struct ta_vertex *tr_reserve_vert(struct tr *tr, struct tr_context *rc) {
   int curr_surf_vert = curr_surf->num_verts / 3;
 
   int vert_index = rc->num_verts + curr_surf_vert;
-  CHECK_LT(vert_index, array_size(rc->verts));
+  tr_grow_verts(rc, vert_index + 1);
   struct ta_vertex *vert = &rc->verts[vert_index];
 
   int index = rc->num_indices + curr_surf->num_verts;
-  CHECK_LT(index + 2, array_size(rc->indices));
+  tr_grow_indices(rc, index + 3);
   uint16_t *indices = &rc->indices[index];
 
   memset(vert, 0, sizeof(*vert));
@@ -420,7 +714,9 @@ static inline int tr_can_merge_surfs(struct ta_surface *a,
          a->ignore_texture_alpha == b->ignore_texture_alpha &&
          a->offset_color == b->offset_color &&
          a->pt_alpha_test == b->pt_alpha_test &&
-         a->pt_alpha_ref == b->pt_alpha_ref;
+         a->pt_alpha_ref == b->pt_alpha_ref && a->shadow == b->shadow &&
+         a->palette == b->palette && a->palette_base == b->palette_base &&
+         a->palette_filter == b->palette_filter;
 }
 
 static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
@@ -434,11 +730,16 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
   /* check to see if this surface can be merged with the previous surface */
   struct ta_surface *prev_surf = NULL;
 
-  if (rc->num_surfs) {
+  if (rc->num_surfs > tr->merge_base) {
     prev_surf = &rc->surfs[rc->num_surfs - 1];
   }
 
-  if (prev_surf && tr_can_merge_surfs(prev_surf, new_surf)) {
+  /* textures may not have been converted yet, so compare their keys as well
+     as their handles */
+  if (prev_surf &&
+      rc->surf_textures[rc->num_surfs - 1] ==
+          rc->surf_textures[rc->num_surfs] &&
+      tr_can_merge_surfs(prev_surf, new_surf)) {
     /* merge the new verts into the prev surface */
     prev_surf->num_verts += new_surf->num_verts;
 
@@ -446,6 +747,7 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
   } else {
     /* default sort the new surface */
     struct tr_list *list = &rc->lists[tr->list_type];
+    tr_grow_list(list, list->num_surfs + 1);
     list->surfs[list->num_surfs] = rc->num_surfs;
     list->num_surfs++;
 
@@ -468,34 +770,12 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
     xyz[2] = (z);               \
   }
 
-#define PARSE_COLOR(base_color, color) \
-  { *color = abgr_to_rgba(base_color); }
-
 #define PARSE_COLOR_RGBA(r, g, b, a, color) \
   { *color = float_to_rgba(r, g, b, a); }
 
-#define PARSE_COLOR_INTENSITY(base_intensity, color)                          \
-  {                                                                           \
-    *color =                                                                  \
-        float_to_rgba(tr->face_color[0] * base_intensity,                     \
-                      tr->face_color[1] * base_intensity,                     \
-                      tr->face_color[2] * base_intensity, tr->face_color[3]); \
-  }
-
-#define PARSE_OFFSET_COLOR(offset_color, color) \
-  { *color = abgr_to_rgba(offset_color); }
-
 #define PARSE_OFFSET_COLOR_RGBA(r, g, b, a, color) \
   { *color = float_to_rgba(r, g, b, a); }
 
-#define PARSE_OFFSET_COLOR_INTENSITY(offset_intensity, color)           \
-  {                                                                     \
-    *color = float_to_rgba(tr->face_offset_color[0] * offset_intensity, \
-                           tr->face_offset_color[1] * offset_intensity, \
-                           tr->face_offset_color[2] * offset_intensity, \
-                           tr->face_offset_color[3]);                   \
-  }
-
 static int tr_parse_bg_vert(const struct tile_context *ctx,
                             struct tr_context *rc, int offset,
                             struct ta_vertex *v) {
@@ -528,12 +808,12 @@ static int tr_parse_bg_vert(const struct tile_context *ctx,
   return offset;
 }
 
-static void tr_parse_bg(struct tr *tr, const struct tile_context *ctx,
-                        struct tr_context *rc) {
-  tr->list_type = TA_LIST_OPAQUE;
-
+/* the background is always the first surface and its vertices the first four
+   vertices of the context. fill them in from the state saved when the context
+   was rendered */
+static void tr_fill_bg(const struct tile_context *ctx, struct tr_context *rc) {
   /* translate the surface */
-  struct ta_surface *surf = tr_reserve_surf(tr, rc, 0);
+  struct ta_surface *surf = &rc->surfs[0];
   surf->texture = 0;
   surf->depth_write = !ctx->bg_isp.z_write_disable;
   surf->depth_func = translate_depth_func(ctx->bg_isp.depth_compare_mode);
@@ -542,10 +822,10 @@ static void tr_parse_bg(struct tr *tr, const struct tile_context *ctx,
   surf->dst_blend = BLEND_NONE;
 
   /* translate the first 3 vertices */
-  struct ta_vertex *v0 = tr_reserve_vert(tr, rc);
-  struct ta_vertex *v1 = tr_reserve_vert(tr, rc);
-  struct ta_vertex *v2 = tr_reserve_vert(tr, rc);
-  struct ta_vertex *v3 = tr_reserve_vert(tr, rc);
+  struct ta_vertex *v0 = &rc->verts[0];
+  struct ta_vertex *v1 = &rc->verts[1];
+  struct ta_vertex *v2 = &rc->verts[2];
+  struct ta_vertex *v3 = &rc->verts[3];
 
   int offset = 0;
   offset = tr_parse_bg_vert(ctx, rc, offset, v0);
@@ -565,30 +845,32 @@ static void tr_parse_bg(struct tr *tr, const struct tile_context *ctx,
   v3->offset_color = v0->offset_color;
   v3->uv[0] = v2->uv[0];
   v3->uv[1] = v1->uv[1];
-
-  tr_commit_surf(tr, rc);
-
-  tr->list_type = TA_NUM_LISTS;
 }
 
-/* this offset color implementation is not correct at all, see the
-   Texture/Shading Instruction in the union tsp instruction word */
-static void tr_parse_poly_param(struct tr *tr, const struct tile_context *ctx,
-                                struct tr_context *rc, const uint8_t *data) {
-  const union poly_param *param = (const union poly_param *)data;
-
-  /* reset state */
-  tr->last_poly = param;
-  tr->last_vertex = NULL;
-  tr->vertex_type = ta_get_vert_type(param->type0.pcw);
+static void tr_parse_bg(struct tr *tr, const struct tile_context *ctx,
+                        struct tr_context *rc) {
+  tr->list_type = TA_LIST_OPAQUE;
 
-  int poly_type = ta_get_poly_type(param->type0.pcw);
+  tr_reserve_surf(tr, rc, 0);
+  for (int i = 0; i < 4; i++) {
+    tr_reserve_vert(tr, rc);
+  }
 
-  if (poly_type == 6) {
-    /* FIXME handle modifier volumes */
-    return;
+  /* when converting incrementally the background state isn't available yet,
+     the reserved surface is filled in later on by tr_end_context */
+  if (ctx) {
+    tr_fill_bg(ctx, rc);
   }
 
+  tr_commit_surf(tr, rc);
+
+  tr->list_type = TA_NUM_LISTS;
+}
+
+/* the face colors carry over between global params, polygons using the
+   second intensity mode reuse the colors of the last one specifying them */
+static void tr_parse_face_color(struct tr *tr, const union poly_param *param,
+                                int poly_type) {
   switch (poly_type) {
     case 0: {
       /*uint32_t sdma_data_size;
@@ -631,38 +913,121 @@ static void tr_parse_poly_param(struct tr *tr, const struct tile_context *ctx,
       LOG_FATAL("unsupported poly type %d", poly_type);
       break;
   }
+}
 
-  /* setup the new surface */
-  struct ta_surface *surf = tr_reserve_surf(tr, rc, 0);
-  surf->depth_write = !param->type0.isp_tsp.z_write_disable;
-  surf->depth_func =
-      translate_depth_func(param->type0.isp_tsp.depth_compare_mode);
-  surf->cull = translate_cull(param->type0.isp_tsp.culling_mode);
-  surf->src_blend = translate_src_blend_func(param->type0.tsp.src_alpha_instr);
-  surf->dst_blend = translate_dst_blend_func(param->type0.tsp.dst_alpha_instr);
-  surf->shade = translate_shade_mode(param->type0.tsp.texture_shading_instr);
-  surf->ignore_alpha = !param->type0.tsp.use_alpha;
-  surf->ignore_texture_alpha = param->type0.tsp.ignore_tex_alpha;
-  surf->offset_color = param->type0.isp_tsp.offset;
-  surf->pt_alpha_test = tr->list_type == TA_LIST_PUNCH_THROUGH;
-  surf->pt_alpha_ref = (float)ctx->pt_alpha_ref / 0xff;
+/* add the open modifier volume to the current list. volumes without any
+   triangles don't modify anything and are dropped */
+static void tr_commit_volume(struct tr *tr, struct tr_context *rc) {
+  if (!tr->volume_open) {
+    return;
+  }
 
-  /* override a few surface parameters based on the list type */
-  if (tr->list_type != TA_LIST_TRANSLUCENT &&
-      tr->list_type != TA_LIST_TRANSLUCENT_MODVOL) {
-    surf->src_blend = BLEND_NONE;
-    surf->dst_blend = BLEND_NONE;
-  } else if ((tr->list_type == TA_LIST_TRANSLUCENT ||
-              tr->list_type == TA_LIST_TRANSLUCENT_MODVOL) &&
-             ctx->autosort) {
+  struct ta_volume *volume = &rc->volumes[rc->num_volumes];
+
+  if (volume->num_tris && tr->list_type < TA_NUM_LISTS) {
+    struct tr_list *list = &rc->lists[tr->list_type];
+    tr_grow_list_volumes(list, list->num_volumes + 1);
+    list->volumes[list->num_volumes++] = rc->num_volumes;
+    rc->num_volumes++;
+  }
+
+  tr->volume_open = 0;
+  tr->volume_ending = 0;
+}
+
+/* the polygons of a volume are each specified by their own global param,
+   with the last one specifying whether the volume modifies what's inside or
+   outside of it */
+static void tr_parse_volume_param(struct tr *tr, struct tr_context *rc,
+                                  const union poly_param *param) {
+  if (tr->volume_ending) {
+    tr_commit_volume(tr, rc);
+  }
+
+  if (!tr->volume_open) {
+    tr_grow_volumes(rc, rc->num_volumes + 1);
+    struct ta_volume *volume = &rc->volumes[rc->num_volumes];
+    volume->outside = 0;
+    volume->first_tri = rc->num_volume_tris;
+    volume->num_tris = 0;
+    tr->volume_open = 1;
+  }
+
+  uint32_t instr = param->modvol.isp_tsp.volume_instr;
+
+  if (instr == 1 || instr == 2) {
+    rc->volumes[rc->num_volumes].outside = instr == 2;
+    tr->volume_ending = 1;
+  }
+}
+
+static void tr_parse_volume_tri(struct tr *tr, struct tr_context *rc,
+                                const union vert_param *param) {
+  /* triangles outside of a volume have nothing to modify */
+  if (!tr->volume_open) {
+    return;
+  }
+
+  tr_grow_volume_tris(rc, rc->num_volume_tris + 1);
+  struct ta_volume_tri *tri = &rc->volume_tris[rc->num_volume_tris++];
+  memcpy(tri->xyz, param->modvol.xyz, sizeof(tri->xyz));
+
+  rc->volumes[rc->num_volumes].num_tris++;
+}
+
+/* this offset color implementation is not correct at all, see the
+   Texture/Shading Instruction in the union tsp instruction word */
+static void tr_parse_poly_param(struct tr *tr, const struct tile_context *ctx,
+                                struct tr_context *rc, const uint8_t *data) {
+  const union poly_param *param = (const union poly_param *)data;
+
+  /* reset state */
+  tr->last_poly = param;
+  tr->last_vertex = NULL;
+  tr->vertex_type = ta_get_vert_type(param->type0.pcw);
+
+  int poly_type = ta_get_poly_type(param->type0.pcw);
+
+  if (poly_type == 6) {
+    tr_parse_volume_param(tr, rc, param);
+    return;
+  }
+
+  tr_parse_face_color(tr, param, poly_type);
+
+  /* setup the new surface */
+  struct ta_surface *surf = tr_reserve_surf(tr, rc, 0);
+  surf->depth_write = !param->type0.isp_tsp.z_write_disable;
+  surf->depth_func =
+      translate_depth_func(param->type0.isp_tsp.depth_compare_mode);
+  surf->cull = translate_cull(param->type0.isp_tsp.culling_mode);
+  surf->src_blend = translate_src_blend_func(param->type0.tsp.src_alpha_instr);
+  surf->dst_blend = translate_dst_blend_func(param->type0.tsp.dst_alpha_instr);
+  surf->shade = translate_shade_mode(param->type0.tsp.texture_shading_instr);
+  surf->ignore_alpha = !param->type0.tsp.use_alpha;
+  surf->ignore_texture_alpha = param->type0.tsp.ignore_tex_alpha;
+  surf->offset_color = param->type0.isp_tsp.offset;
+  surf->pt_alpha_test = tr->list_type == TA_LIST_PUNCH_THROUGH;
+  surf->pt_alpha_ref = tr->pt_alpha_ref;
+  surf->shadow = param->type0.pcw.shadow;
+
+  /* override a few surface parameters based on the list type */
+  if (tr->list_type != TA_LIST_TRANSLUCENT &&
+      tr->list_type != TA_LIST_TRANSLUCENT_MODVOL) {
+    surf->src_blend = BLEND_NONE;
+    surf->dst_blend = BLEND_NONE;
+  } else if ((tr->list_type == TA_LIST_TRANSLUCENT ||
+              tr->list_type == TA_LIST_TRANSLUCENT_MODVOL) &&
+             tr->autosort) {
     surf->depth_func = DEPTH_LEQUAL;
   } else if (tr->list_type == TA_LIST_PUNCH_THROUGH) {
     surf->depth_func = DEPTH_GEQUAL;
   }
 
   if (param->type0.pcw.texture) {
-    surf->texture =
-        tr_convert_texture(tr, ctx, param->type0.tsp, param->type0.tcw);
+    rc->surf_textures[rc->num_surfs] =
+        tr_texture_key(param->type0.tsp, param->type0.tcw);
+    surf->texture = TR_DEFERRED_TEXTURE;
   } else {
     surf->texture = 0;
   }
@@ -673,7 +1038,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct tile_context *ctx,
   const union vert_param *param = (const union vert_param *)data;
 
   if (tr->vertex_type == 17) {
-    /* FIXME handle modifier volumes */
+    tr_parse_volume_tri(tr, rc, param);
     return;
   }
 
@@ -686,116 +1051,6 @@ static void tr_parse_vert_param(struct tr *tr, const struct tile_context *ctx,
   tr->last_vertex = param;
 
   switch (tr->vertex_type) {
-    case 0: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type0.xyz[0], param->type0.xyz[1], param->type0.xyz[2],
-                vert->xyz);
-      PARSE_COLOR(param->type0.base_color, &vert->color);
-      vert->offset_color = 0;
-      vert->uv[0] = 0.0f;
-      vert->uv[1] = 0.0f;
-    } break;
-
-    case 1: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type1.xyz[0], param->type1.xyz[1], param->type1.xyz[2],
-                vert->xyz);
-      PARSE_COLOR_RGBA(param->type1.base_color_r, param->type1.base_color_g,
-                       param->type1.base_color_b, param->type1.base_color_a,
-                       &vert->color);
-      vert->offset_color = 0;
-      vert->uv[0] = 0.0f;
-      vert->uv[1] = 0.0f;
-    } break;
-
-    case 2: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type2.xyz[0], param->type2.xyz[1], param->type2.xyz[2],
-                vert->xyz);
-      PARSE_COLOR_INTENSITY(param->type2.base_intensity, &vert->color);
-      vert->offset_color = 0;
-      vert->uv[0] = 0.0f;
-      vert->uv[1] = 0.0f;
-    } break;
-
-    case 3: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type3.xyz[0], param->type3.xyz[1], param->type3.xyz[2],
-                vert->xyz);
-      PARSE_COLOR(param->type3.base_color, &vert->color);
-      PARSE_OFFSET_COLOR(param->type3.offset_color, &vert->offset_color);
-      vert->uv[0] = param->type3.uv[0];
-      vert->uv[1] = param->type3.uv[1];
-    } break;
-
-    case 4: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type4.xyz[0], param->type4.xyz[1], param->type4.xyz[2],
-                vert->xyz);
-      PARSE_COLOR(param->type4.base_color, &vert->color);
-      PARSE_OFFSET_COLOR(param->type4.offset_color, &vert->offset_color);
-      uint32_t u = param->type4.vu[1] << 16;
-      uint32_t v = param->type4.vu[0] << 16;
-      vert->uv[0] = *(float *)&u;
-      vert->uv[1] = *(float *)&v;
-    } break;
-
-    case 5: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type5.xyz[0], param->type5.xyz[1], param->type5.xyz[2],
-                vert->xyz);
-      PARSE_COLOR_RGBA(param->type5.base_color_r, param->type5.base_color_g,
-                       param->type5.base_color_b, param->type5.base_color_a,
-                       &vert->color);
-      PARSE_OFFSET_COLOR_RGBA(param->type5.offset_color_r,
-                              param->type5.offset_color_g,
-                              param->type5.offset_color_b,
-                              param->type5.offset_color_a, &vert->offset_color);
-      vert->uv[0] = param->type5.uv[0];
-      vert->uv[1] = param->type5.uv[1];
-    } break;
-
-    case 6: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type6.xyz[0], param->type6.xyz[1], param->type6.xyz[2],
-                vert->xyz);
-      PARSE_COLOR_RGBA(param->type6.base_color_r, param->type6.base_color_g,
-                       param->type6.base_color_b, param->type6.base_color_a,
-                       &vert->color);
-      PARSE_OFFSET_COLOR_RGBA(param->type6.offset_color_r,
-                              param->type6.offset_color_g,
-                              param->type6.offset_color_b,
-                              param->type6.offset_color_a, &vert->offset_color);
-      uint32_t u = param->type6.vu[1] << 16;
-      uint32_t v = param->type6.vu[0] << 16;
-      vert->uv[0] = *(float *)&u;
-      vert->uv[1] = *(float *)&v;
-    } break;
-
-    case 7: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type7.xyz[0], param->type7.xyz[1], param->type7.xyz[2],
-                vert->xyz);
-      PARSE_COLOR_INTENSITY(param->type7.base_intensity, &vert->color);
-      PARSE_OFFSET_COLOR_INTENSITY(param->type7.offset_intensity,
-                                   &vert->offset_color);
-      vert->uv[0] = param->type7.uv[0];
-      vert->uv[1] = param->type7.uv[1];
-    } break;
-
-    case 8: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type8.xyz[0], param->type8.xyz[1], param->type8.xyz[2],
-                vert->xyz);
-      PARSE_COLOR_INTENSITY(param->type8.base_intensity, &vert->color);
-      PARSE_OFFSET_COLOR_INTENSITY(param->type8.offset_intensity,
-                                   &vert->offset_color);
-      uint32_t u = param->type8.vu[1] << 16;
-      uint32_t v = param->type8.vu[0] << 16;
-      vert->uv[0] = *(float *)&u;
-      vert->uv[1] = *(float *)&v;
-    } break;
-
     case 15: {
       CHECK(param->type0.pcw.end_of_strip);
 
@@ -863,9 +1118,115 @@ static void tr_parse_vert_param(struct tr *tr, const struct tile_context *ctx,
   }
 }
 
-/* scratch buffers used by surface merge sort */
-static int sort_tmp[TA_MAX_SURFS];
-static float sort_minz[TA_MAX_SURFS];
+/* track info about the parse state for tracer debugging */
+static void tr_track_param(struct tr *tr, struct tr_context *rc) {
+  tr_grow_params(rc, rc->num_params + 1);
+  struct tr_param *rp = &rc->params[rc->num_params++];
+  rp->offset = tr->offset;
+  rp->list_type = tr->list_type;
+  rp->vertex_type = tr->list_type;
+  rp->last_surf = rc->num_surfs - 1;
+  rp->last_vert = rc->num_verts - 1;
+}
+
+/* parses a run of consecutive polygon vertex params. the surfaces and vertices
+   for each param are reserved as the run is walked, after which the vertex
+   attributes for the entire run are decoded at once */
+static void tr_parse_vert_run(struct tr *tr, const struct tile_context *ctx,
+                              struct tr_context *rc, int end) {
+  const union vert_param *params[VERT_DECODE_BATCH_SIZE];
+  struct ta_vertex *verts[VERT_DECODE_BATCH_SIZE];
+  int num_verts = 0;
+
+  /* each param in the run reserves the vertex following the last, grow the
+     storage for the entire run up front so the vertex pointers gathered
+     remain valid until the run is decoded. if the last strip ended, the
+     surface it was added to has been committed and the next vertex starts a
+     new one */
+  int first_vert = rc->num_verts;
+  if (!tr->last_vertex || !tr->last_vertex->type0.pcw.end_of_strip) {
+    first_vert += rc->surfs[rc->num_surfs].num_verts / 3;
+  }
+  tr_grow_verts(rc, MIN(first_vert + VERT_DECODE_BATCH_SIZE, TA_MAX_VERTS));
+
+  while (tr->offset < end && num_verts < VERT_DECODE_BATCH_SIZE) {
+    const uint8_t *data = ctx->params + tr->offset;
+    union pcw pcw = *(union pcw *)data;
+
+    if (pcw.para_type != TA_PARAM_VERTEX) {
+      break;
+    }
+
+    const union vert_param *param = (const union vert_param *)data;
+
+    if (tr->last_vertex && tr->last_vertex->type0.pcw.end_of_strip) {
+      tr_reserve_surf(tr, rc, 1);
+    }
+    tr->last_vertex = param;
+
+    /* committing a surface never moves the vertices already reserved */
+    params[num_verts] = param;
+    verts[num_verts] = tr_reserve_vert(tr, rc);
+    num_verts++;
+
+    if (param->type0.pcw.end_of_strip) {
+      tr_commit_surf(tr, rc);
+    }
+
+    tr_track_param(tr, rc);
+
+    tr->offset += ta_get_param_size(pcw, tr->vertex_type);
+  }
+
+  vert_decode(tr->vertex_type, params, verts, num_verts, tr->face_color,
+              tr->face_offset_color);
+}
+
+/* scratch buffers used by the surface and triangle sorts, grown to fit the
+   largest context sorted. the keys are shared by both sorts, and are sized to
+   fit whichever of the surfaces or triangles is larger */
+static int *sort_tmp;
+static float *sort_minz;
+static int sort_max_surfs;
+static uint32_t *sort_keys;
+static uint32_t *sort_tmp_keys;
+static int sort_max_keys;
+static int *sort_tris;
+static int *sort_tmp_tris;
+static int *sort_tri_surfs;
+static int *sort_tri_indices;
+static int sort_max_tris;
+
+static void tr_grow_sort_scratch(int num_surfs, int num_tris) {
+  if (num_surfs > sort_max_surfs) {
+    sort_max_surfs = tr_grow_size(sort_max_surfs, num_surfs, TR_SURFS_CHUNK);
+    sort_tmp = realloc(sort_tmp, sort_max_surfs * sizeof(sort_tmp[0]));
+    sort_minz = realloc(sort_minz, sort_max_surfs * sizeof(sort_minz[0]));
+    CHECK(sort_tmp && sort_minz);
+  }
+
+  int num_keys = MAX(num_surfs, num_tris);
+
+  if (num_keys > sort_max_keys) {
+    sort_max_keys = tr_grow_size(sort_max_keys, num_keys, TR_VERTS_CHUNK);
+    sort_keys = realloc(sort_keys, sort_max_keys * sizeof(sort_keys[0]));
+    sort_tmp_keys =
+        realloc(sort_tmp_keys, sort_max_keys * sizeof(sort_tmp_keys[0]));
+    CHECK(sort_keys && sort_tmp_keys);
+  }
+
+  if (num_tris > sort_max_tris) {
+    sort_max_tris = tr_grow_size(sort_max_tris, num_tris, TR_VERTS_CHUNK);
+    sort_tris = realloc(sort_tris, sort_max_tris * sizeof(sort_tris[0]));
+    sort_tmp_tris =
+        realloc(sort_tmp_tris, sort_max_tris * sizeof(sort_tmp_tris[0]));
+    sort_tri_surfs =
+        realloc(sort_tri_surfs, sort_max_tris * sizeof(sort_tri_surfs[0]));
+    sort_tri_indices =
+        realloc(sort_tri_indices, sort_max_tris * sizeof(sort_tri_indices[0]));
+    CHECK(sort_tris && sort_tmp_tris && sort_tri_surfs && sort_tri_indices);
+  }
+}
 
 static int tr_compare_surf(const void *a, const void *b) {
   int i = *(const int *)a;
@@ -873,37 +1234,159 @@ static int tr_compare_surf(const void *a, const void *b) {
   return sort_minz[i] <= sort_minz[j];
 }
 
-static void tr_sort_render_list(struct tr *tr, struct tr_context *rc,
-                                int list_type) {
-  PROF_ENTER("gpu", "tr_sort_render_list");
+static float tr_tri_minz(const struct tr_context *rc, int first_index) {
+  /* the surf coordinates have 1/w for z, so smaller values are further away
+     from the camera */
+  const uint16_t *indices = &rc->indices[first_index];
+  float z0 = rc->verts[indices[0]].xyz[2];
+  float z1 = rc->verts[indices[1]].xyz[2];
+  float z2 = rc->verts[indices[2]].xyz[2];
+  return MIN(z0, MIN(z1, z2));
+}
+
+static void tr_sort_surfs(struct tr_context *rc, struct tr_list *list,
+                          enum tr_sort sort) {
+  /* empty lists are common, and the scratch buffers may not exist yet */
+  if (!list->num_surfs) {
+    return;
+  }
+
+  /* sort_minz is indexed by surface, not by list position */
+  tr_grow_sort_scratch(rc->num_surfs, 0);
 
   /* sort each surface from back to front based on its minz */
-  struct tr_list *list = &rc->lists[list_type];
+  for (int i = 0; i < list->num_surfs; i++) {
+    int surf_index = list->surfs[i];
+    struct ta_surface *surf = &rc->surfs[surf_index];
+    float minz = FLT_MAX;
+
+    for (int j = 0; j < surf->num_verts; j += 3) {
+      minz = MIN(minz, tr_tri_minz(rc, surf->first_vert + j));
+    }
+
+    sort_minz[surf_index] = minz;
+    sort_keys[i] = rsort_float_key(minz);
+  }
+
+  if (sort == TR_SORT_SURFS_MERGE) {
+    msort_noalloc(list->surfs, sort_tmp, list->num_surfs, sizeof(int),
+                  &tr_compare_surf);
+  } else {
+    rsort_noalloc(sort_keys, list->surfs, sort_tmp_keys, sort_tmp,
+                  list->num_surfs);
+  }
+}
+
+static int tr_can_merge_sorted_tris(struct tr_context *rc, int a, int b) {
+  return a == b || (rc->surf_textures[a] == rc->surf_textures[b] &&
+                    tr_can_merge_surfs(&rc->surfs[a], &rc->surfs[b]));
+}
+
+static void tr_sort_tris(struct tr_context *rc, struct tr_list *list) {
+  int num_tris = 0;
+
+  for (int i = 0; i < list->num_surfs; i++) {
+    num_tris += rc->surfs[list->surfs[i]].num_verts / 3;
+  }
+
+  if (!num_tris) {
+    return;
+  }
+
+  tr_grow_sort_scratch(0, num_tris);
+
+  /* sort each triangle from back to front based on its minz */
+  num_tris = 0;
 
   for (int i = 0; i < list->num_surfs; i++) {
     int surf_index = list->surfs[i];
     struct ta_surface *surf = &rc->surfs[surf_index];
-    float *minz = &sort_minz[surf_index];
 
-    /* the surf coordinates have 1/w for z, so smaller values are
-      further away from the camera */
-    *minz = FLT_MAX;
+    for (int j = 0; j < surf->num_verts; j += 3) {
+      int first_index = surf->first_vert + j;
+      sort_keys[num_tris] = rsort_float_key(tr_tri_minz(rc, first_index));
+      sort_tris[num_tris] = num_tris;
+      sort_tri_surfs[num_tris] = surf_index;
+      sort_tri_indices[num_tris] = first_index;
+      num_tris++;
+    }
+  }
+
+  rsort_noalloc(sort_keys, sort_tris, sort_tmp_keys, sort_tmp_tris, num_tris);
 
-    for (int j = 0; j < surf->num_verts; j++) {
-      int vert_index = rc->indices[surf->first_vert + j];
-      struct ta_vertex *vert = &rc->verts[vert_index];
-      *minz = MIN(*minz, vert->xyz[2]);
+  /* consecutive triangles that can be drawn with the same state are merged
+     back into a single surface. make room for all of the new surfaces and
+     their indices before modifying the context */
+  int num_runs = 0;
+
+  for (int i = 0; i < num_tris; i++) {
+    int surf_index = sort_tri_surfs[sort_tris[i]];
+
+    if (!i ||
+        !tr_can_merge_sorted_tris(rc, sort_tri_surfs[sort_tris[i - 1]],
+                                  surf_index)) {
+      num_runs++;
+    }
+  }
+
+  tr_grow_surfs(rc, rc->num_surfs + num_runs);
+  tr_grow_indices(rc, rc->num_indices + num_tris * 3);
+  tr_grow_list(list, num_runs);
+
+  struct ta_surface *run = NULL;
+  int run_surf = -1;
+  list->num_surfs = 0;
+
+  for (int i = 0; i < num_tris; i++) {
+    int tri = sort_tris[i];
+    int surf_index = sort_tri_surfs[tri];
+
+    if (!run || !tr_can_merge_sorted_tris(rc, run_surf, surf_index)) {
+      run_surf = rc->num_surfs++;
+      run = &rc->surfs[run_surf];
+      *run = rc->surfs[surf_index];
+      run->first_vert = rc->num_indices;
+      run->num_verts = 0;
+      rc->surf_textures[run_surf] = rc->surf_textures[surf_index];
+
+      list->surfs[list->num_surfs++] = run_surf;
     }
+
+    uint16_t *indices = &rc->indices[sort_tri_indices[tri]];
+    rc->indices[rc->num_indices++] = indices[0];
+    rc->indices[rc->num_indices++] = indices[1];
+    rc->indices[rc->num_indices++] = indices[2];
+    run->num_verts += 3;
   }
+}
+
+void tr_sort_render_list(struct tr_context *rc, int list_type,
+                         enum tr_sort sort) {
+  PROF_ENTER("gpu", "tr_sort_render_list");
+
+  struct tr_list *list = &rc->lists[list_type];
 
-  msort_noalloc(list->surfs, sort_tmp, list->num_surfs, sizeof(int),
-                &tr_compare_surf);
+  if (sort == TR_SORT_TRIANGLES) {
+    tr_sort_tris(rc, list);
+  } else {
+    tr_sort_surfs(rc, list, sort);
+  }
 
   PROF_LEAVE();
 }
 
+static void tr_sort_render_lists(struct tr_context *rc) {
+  enum tr_sort sort =
+      OPTION_triangle_sort ? TR_SORT_TRIANGLES : TR_SORT_SURFS_RADIX;
+
+  tr_sort_render_list(rc, TA_LIST_TRANSLUCENT, sort);
+  tr_sort_render_list(rc, TA_LIST_PUNCH_THROUGH, sort);
+}
+
 static void tr_parse_eol(struct tr *tr, const struct tile_context *ctx,
                          struct tr_context *rc, const uint8_t *data) {
+  tr_commit_volume(tr, rc);
+
   tr->last_poly = NULL;
   tr->last_vertex = NULL;
   tr->list_type = TA_NUM_LISTS;
@@ -917,33 +1400,175 @@ static void tr_reset(struct tr *tr, struct tr_context *rc) {
   tr->list_type = TA_NUM_LISTS;
   tr->vertex_type = TA_NUM_VERTS;
   tr->merged_surfs = 0;
+  tr->atlas_merges = 0;
+  tr->autosort = 0;
+  tr->pt_alpha_ref = 0.0f;
+  tr->offset = 0;
+  tr->merge_base = 0;
+  tr->volume_open = 0;
+  tr->volume_ending = 0;
 
   /* reset render context state */
   rc->num_params = 0;
   rc->num_surfs = 0;
   rc->num_verts = 0;
   rc->num_indices = 0;
+  rc->num_volumes = 0;
+  rc->num_volume_tris = 0;
+  rc->shadow_scale = 1.0f;
   for (int i = 0; i < TA_NUM_LISTS; i++) {
     struct tr_list *list = &rc->lists[i];
     list->num_surfs = 0;
+    list->num_volumes = 0;
+  }
+}
+
+/* scratch buffers used by surface batching, grown to fit the largest list
+   rendered */
+static uint32_t *batch_keys;
+static uint32_t *batch_tmp_keys;
+static int *batch_surfs;
+static int *batch_tmp_surfs;
+static const struct ta_surface **batch_draws;
+static int batch_max_surfs;
+
+static void tr_grow_batch_scratch(int num_surfs) {
+  if (num_surfs <= batch_max_surfs) {
+    return;
+  }
+
+  batch_max_surfs = tr_grow_size(batch_max_surfs, num_surfs, TR_SURFS_CHUNK);
+  batch_keys = realloc(batch_keys, batch_max_surfs * sizeof(batch_keys[0]));
+  batch_tmp_keys =
+      realloc(batch_tmp_keys, batch_max_surfs * sizeof(batch_tmp_keys[0]));
+  batch_surfs = realloc(batch_surfs, batch_max_surfs * sizeof(batch_surfs[0]));
+  batch_tmp_surfs =
+      realloc(batch_tmp_surfs, batch_max_surfs * sizeof(batch_tmp_surfs[0]));
+  batch_draws = realloc(batch_draws, batch_max_surfs * sizeof(batch_draws[0]));
+  CHECK(batch_keys && batch_tmp_keys && batch_surfs && batch_tmp_surfs &&
+        batch_draws);
+}
+
+/* surfaces which write depth and are depth tested against an ordering
+   produce the same output regardless of the order they're drawn in, so long
+   as they aren't blended. the exception being fragments of equal depth from
+   surfaces in different batches, which may resolve differently */
+static int tr_can_batch_surf(const struct ta_surface *surf) {
+  int ordered =
+      surf->depth_func == DEPTH_LESS || surf->depth_func == DEPTH_LEQUAL ||
+      surf->depth_func == DEPTH_GREATER || surf->depth_func == DEPTH_GEQUAL;
+  int blended = surf->src_blend != BLEND_NONE &&
+                surf->dst_blend != BLEND_NONE &&
+                (surf->src_blend != BLEND_ONE || surf->dst_blend != BLEND_ZERO);
+  return surf->depth_write && ordered && !blended;
+}
+
+/* pack the state of a surface besides its texture into a sort key. the
+   punch-through alpha reference is constant for an entire context */
+static uint32_t tr_batch_state_key(const struct ta_surface *surf) {
+  return (uint32_t)surf->depth_func | ((uint32_t)surf->cull << 4) |
+         ((uint32_t)surf->src_blend << 6) | ((uint32_t)surf->dst_blend << 10) |
+         ((uint32_t)surf->shade << 14) | (!!surf->ignore_alpha << 16) |
+         (!!surf->ignore_texture_alpha << 17) | (!!surf->offset_color << 18) |
+         (!!surf->pt_alpha_test << 19) | (!!surf->debug_depth << 20) |
+         (!!surf->shadow << 21) | ((uint32_t)surf->palette_filter << 22) |
+         ((uint32_t)(surf->palette_base >> 4) << 23);
+}
+
+static void tr_record_batch(struct r_cmdbuf *cb, const struct tr_context *rc,
+                            int num_surfs) {
+  /* sort the surfaces by state, and then by texture. both sorts are stable,
+     so surfaces with the same state and texture stay in list order */
+  for (int i = 0; i < num_surfs; i++) {
+    batch_keys[i] = tr_batch_state_key(&rc->surfs[batch_surfs[i]]);
+  }
+  rsort_noalloc(batch_keys, batch_surfs, batch_tmp_keys, batch_tmp_surfs,
+                num_surfs);
+
+  for (int i = 0; i < num_surfs; i++) {
+    batch_keys[i] = (uint32_t)rc->surfs[batch_surfs[i]].texture;
+  }
+  rsort_noalloc(batch_keys, batch_surfs, batch_tmp_keys, batch_tmp_surfs,
+                num_surfs);
+
+  /* draw each group of surfaces sharing the same state together */
+  int first = 0;
+  uint32_t first_key = 0;
+
+  for (int i = 0; i < num_surfs; i++) {
+    const struct ta_surface *surf = &rc->surfs[batch_surfs[i]];
+    uint32_t key = tr_batch_state_key(surf);
+
+    if (i > first &&
+        (key != first_key || surf->texture != batch_draws[first]->texture)) {
+      r_cmd_draw_ta_surfaces(cb, &batch_draws[first], i - first);
+      first = i;
+    }
+
+    if (i == first) {
+      first_key = key;
+    }
+
+    batch_draws[i] = surf;
+  }
+
+  if (num_surfs > first) {
+    r_cmd_draw_ta_surfaces(cb, &batch_draws[first], num_surfs - first);
+  }
+}
+
+static void tr_record_batched_list(struct r_cmdbuf *cb,
+                                   const struct tr_context *rc,
+                                   const struct tr_list *list) {
+  tr_grow_batch_scratch(list->num_surfs);
+
+  int i = 0;
+
+  while (i < list->num_surfs) {
+    const struct ta_surface *surf = &rc->surfs[list->surfs[i]];
+
+    /* surfaces which can't be reordered are drawn in place, splitting the
+       list into separate batches */
+    if (!tr_can_batch_surf(surf)) {
+      r_cmd_draw_ta_surface(cb, surf);
+      i++;
+      continue;
+    }
+
+    int num_surfs = 0;
+
+    while (i < list->num_surfs &&
+           tr_can_batch_surf(&rc->surfs[list->surfs[i]])) {
+      batch_surfs[num_surfs++] = list->surfs[i++];
+    }
+
+    tr_record_batch(cb, rc, num_surfs);
   }
 }
 
-static void tr_render_list(struct render_backend *r,
-                           const struct tr_context *rc, int list_type,
-                           int end_surf, int *stopped) {
+static void tr_record_list(struct r_cmdbuf *cb, const struct tr_context *rc,
+                           int list_type, int end_surf, int *stopped) {
   if (*stopped) {
     return;
   }
 
   const struct tr_list *list = &rc->lists[list_type];
+
+  /* the translucent list must be drawn in order for blending to work, and
+     stepping through the surfaces needs them drawn in order as well */
+  if (OPTION_batch_surfaces && list_type != TA_LIST_TRANSLUCENT &&
+      end_surf < 0) {
+    tr_record_batched_list(cb, rc, list);
+    return;
+  }
+
   const int *sorted_surf = list->surfs;
   const int *sorted_surf_end = list->surfs + list->num_surfs;
 
   while (sorted_surf < sorted_surf_end) {
     int surf = *(sorted_surf++);
 
-    r_draw_ta_surface(r, &rc->surfs[surf]);
+    r_cmd_draw_ta_surface(cb, &rc->surfs[surf]);
 
     if (surf == end_surf) {
       *stopped = 1;
@@ -952,61 +1577,241 @@ static void tr_render_list(struct render_backend *r,
   }
 }
 
-void tr_render_context_until(struct render_backend *r,
-                             const struct tr_context *rc, int end_surf) {
-  PROF_ENTER("gpu", "tr_render_context_until");
+/* scratch volumes passed to the render backend, rebased onto the range of
+   triangles used by a single list */
+static struct ta_volume *record_volumes;
+static int record_max_volumes;
+
+static void tr_record_volumes(struct r_cmdbuf *cb, const struct tr_context *rc,
+                              int list_type, int stopped) {
+  const struct tr_list *list = &rc->lists[list_type];
+
+  /* in parameter selection mode the volumes select between two sets of
+     surface params, which aren't supported, leaving nothing to modify */
+  if (stopped || !list->num_volumes || !OPTION_modifier_volumes ||
+      rc->shadow_scale >= 1.0f) {
+    return;
+  }
+
+  if (list->num_volumes > record_max_volumes) {
+    record_max_volumes =
+        tr_grow_size(record_max_volumes, list->num_volumes, TR_VOLUMES_CHUNK);
+    record_volumes = realloc(record_volumes,
+                             record_max_volumes * sizeof(record_volumes[0]));
+    CHECK_NOTNULL(record_volumes);
+  }
+
+  /* the volumes of a list are contiguous unless the list was continued after
+     another list, only pass the triangles spanning them */
+  int first_tri = INT_MAX;
+  int end_tri = 0;
+
+  for (int i = 0; i < list->num_volumes; i++) {
+    const struct ta_volume *volume = &rc->volumes[list->volumes[i]];
+    first_tri = MIN(first_tri, volume->first_tri);
+    end_tri = MAX(end_tri, volume->first_tri + volume->num_tris);
+  }
+
+  for (int i = 0; i < list->num_volumes; i++) {
+    record_volumes[i] = rc->volumes[list->volumes[i]];
+    record_volumes[i].first_tri -= first_tri;
+  }
+
+  r_cmd_draw_ta_volumes(cb, rc->volume_tris + first_tri, end_tri - first_tri,
+                        record_volumes, list->num_volumes, rc->shadow_scale);
+}
+
+void tr_record_context_until(struct r_cmdbuf *cb, const struct tr_context *rc,
+                             int end_surf) {
+  PROF_ENTER("gpu", "tr_record_context_until");
 
   int stopped = 0;
 
-  r_begin_ta_surfaces(r, rc->width, rc->height, rc->verts, rc->num_verts,
-                      rc->indices, rc->num_indices);
+  r_cmd_begin_ta_surfaces(cb, rc->width, rc->height, rc->verts, rc->num_verts,
+                          rc->indices, rc->num_indices);
 
-  tr_render_list(r, rc, TA_LIST_OPAQUE, end_surf, &stopped);
-  tr_render_list(r, rc, TA_LIST_PUNCH_THROUGH, end_surf, &stopped);
-  tr_render_list(r, rc, TA_LIST_TRANSLUCENT, end_surf, &stopped);
+  tr_record_list(cb, rc, TA_LIST_OPAQUE, end_surf, &stopped);
+  tr_record_list(cb, rc, TA_LIST_PUNCH_THROUGH, end_surf, &stopped);
+  tr_record_volumes(cb, rc, TA_LIST_OPAQUE_MODVOL, stopped);
+  tr_record_list(cb, rc, TA_LIST_TRANSLUCENT, end_surf, &stopped);
+  tr_record_volumes(cb, rc, TA_LIST_TRANSLUCENT_MODVOL, stopped);
 
-  r_end_ta_surfaces(r);
+  r_cmd_end_ta_surfaces(cb);
 
   PROF_LEAVE();
 }
 
-void tr_render_context(struct render_backend *r, const struct tr_context *rc) {
-  tr_render_context_until(r, rc, -1);
+void tr_record_context(struct r_cmdbuf *cb, const struct tr_context *rc) {
+  tr_record_context_until(cb, rc, -1);
 }
 
-void tr_convert_context(struct render_backend *r, void *userdata,
-                        tr_find_texture_cb find_texture,
-                        const struct tile_context *ctx, struct tr_context *rc) {
-  PROF_ENTER("gpu", "tr_convert_context");
+static void tr_update_peaks(const struct tr_context *rc) {
+  if (rc->num_surfs > prof_counter_load(COUNTER_tr_surfs_peak)) {
+    prof_counter_set(COUNTER_tr_surfs_peak, rc->num_surfs);
+  }
+  if (rc->num_verts > prof_counter_load(COUNTER_tr_verts_peak)) {
+    prof_counter_set(COUNTER_tr_verts_peak, rc->num_verts);
+  }
+  if (rc->num_indices > prof_counter_load(COUNTER_tr_indices_peak)) {
+    prof_counter_set(COUNTER_tr_indices_peak, rc->num_indices);
+  }
+}
 
-  struct tr tr;
-  tr.r = r;
-  tr.userdata = userdata;
-  tr.find_texture = find_texture;
+/* remap the uvs of a surface onto the atlas page its texture is packed into.
+   the page doesn't wrap the way the texture does, so this is only possible
+   for surfaces whose uvs stay within the texture */
+static int tr_atlas_surf(struct tr_context *rc, struct ta_surface *surf,
+                         const struct tr_texture *entry) {
+  if (!surf->num_verts) {
+    return 0;
+  }
 
-  const uint8_t *data = ctx->params;
-  const uint8_t *end = ctx->params + ctx->size;
+  /* the vertices of each surface are contiguous, and aren't shared with any
+     other surface until the lists are sorted */
+  int first = rc->num_verts;
+  int last = 0;
 
-  ta_init_tables();
+  for (int i = 0; i < surf->num_verts; i++) {
+    int index = rc->indices[surf->first_vert + i];
+    first = MIN(first, index);
+    last = MAX(last, index);
+  }
 
-  tr_reset(&tr, rc);
+  for (int i = first; i <= last; i++) {
+    const float *uv = rc->verts[i].uv;
 
-  rc->width = ctx->video_width;
-  rc->height = ctx->video_height;
+    if (!(uv[0] >= 0.0f && uv[0] <= 1.0f && uv[1] >= 0.0f && uv[1] <= 1.0f)) {
+      return 0;
+    }
+  }
 
-  tr_parse_bg(&tr, ctx, rc);
+  for (int i = first; i <= last; i++) {
+    float *uv = rc->verts[i].uv;
+    uv[0] = entry->atlas_uv[0] + uv[0] * entry->atlas_uv[2];
+    uv[1] = entry->atlas_uv[1] + uv[1] * entry->atlas_uv[3];
+  }
+
+  surf->texture = entry->atlas_handle;
+
+  return 1;
+}
+
+/* surfaces using different textures packed into the same atlas page can now
+   be merged. merge those which are adjacent in both their list and the index
+   buffer, the same as tr_commit_surf would have had their textures matched */
+static void tr_merge_atlas_surfs(struct tr *tr, struct tr_context *rc) {
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    struct tr_list *list = &rc->lists[i];
+    int num_surfs = 0;
+
+    for (int j = 0; j < list->num_surfs; j++) {
+      int surf_index = list->surfs[j];
+      struct ta_surface *surf = &rc->surfs[surf_index];
+
+      if (num_surfs) {
+        struct ta_surface *prev = &rc->surfs[list->surfs[num_surfs - 1]];
+
+        if (prev->texture == surf->texture &&
+            prev->first_vert + prev->num_verts == surf->first_vert &&
+            tr_can_merge_surfs(prev, surf) &&
+            tr_atlas_owns(tr->atlas, surf->texture)) {
+          prev->num_verts += surf->num_verts;
+          surf->num_verts = 0;
+          tr->atlas_merges++;
+          continue;
+        }
+      }
+
+      list->surfs[num_surfs++] = surf_index;
+    }
+
+    list->num_surfs = num_surfs;
+  }
+}
+
+/* the color of shadowed surfaces inside of a modifier volume is scaled when
+   in intensity volume mode */
+static float tr_shadow_scale(const struct tile_context *ctx) {
+  union fpu_shad_scale shad_scale = {ctx->shad_scale};
+
+  if (!shad_scale.intensity_volume_mode) {
+    return 1.0f;
+  }
+
+  return shad_scale.scale_factor / 256.0f;
+}
+
+/* patch in the state that was deferred while parsing */
+static void tr_resolve_surfs(struct tr *tr, const struct tile_context *ctx,
+                             struct tr_context *rc) {
+  float pt_alpha_ref = (float)ctx->pt_alpha_ref / 0xff;
+  tr_texture_key_t last_key = 0;
+  struct tr_texture *last_entry = NULL;
+  int atlas = tr->atlas && OPTION_texture_atlas;
+  int num_atlased = 0;
+
+  /* the background is always the first surface, and is filled in separately
+     by tr_fill_bg */
+  for (int i = 1; i < rc->num_surfs; i++) {
+    struct ta_surface *surf = &rc->surfs[i];
+
+    surf->pt_alpha_ref = pt_alpha_ref;
+
+    if (surf->texture != TR_DEFERRED_TEXTURE) {
+      continue;
+    }
+
+    /* consecutive surfaces commonly share the same texture */
+    tr_texture_key_t key = rc->surf_textures[i];
+
+    if (!last_entry || key != last_key) {
+      union tsp tsp;
+      union tcw tcw;
+      tsp.full = (uint32_t)(key >> 32);
+      tcw.full = (uint32_t)key;
+      last_key = key;
+      last_entry = tr_convert_texture(tr, ctx, tsp, tcw);
+    }
+
+    surf->texture = last_entry->handle;
+
+    if (tr_texture_indexed(last_entry)) {
+      union tcw tcw;
+      tcw.full = (uint32_t)key;
+      surf->palette = last_entry->palette_texture;
+      surf->palette_base = tr_palette_base(tcw);
+      surf->palette_filter = last_entry->filter;
+    }
+
+    if (atlas && last_entry->atlas_handle &&
+        tr_atlas_surf(rc, surf, last_entry)) {
+      num_atlased++;
+    }
+  }
+
+  if (num_atlased) {
+    tr_merge_atlas_surfs(tr, rc);
+  }
 
-  while (data < end) {
+  if (tr->atlas) {
+    prof_counter_set(COUNTER_tr_atlas_binds_saved, tr->atlas_merges);
+  }
+}
+
+static void tr_parse_params(struct tr *tr, const struct tile_context *ctx,
+                            struct tr_context *rc, int end) {
+  while (tr->offset < end) {
+    const uint8_t *data = ctx->params + tr->offset;
     union pcw pcw = *(union pcw *)data;
 
-    if (ta_pcw_list_type_valid(pcw, tr.list_type)) {
-      tr.list_type = pcw.list_type;
+    if (ta_pcw_list_type_valid(pcw, tr->list_type)) {
+      tr->list_type = pcw.list_type;
     }
 
     switch (pcw.para_type) {
       /* control params */
       case TA_PARAM_END_OF_LIST:
-        tr_parse_eol(&tr, ctx, rc, data);
+        tr_parse_eol(tr, ctx, rc, data);
         break;
 
       case TA_PARAM_USER_TILE_CLIP:
@@ -1019,36 +1824,554 @@ void tr_convert_context(struct render_backend *r, void *userdata,
       /* global params */
       case TA_PARAM_POLY_OR_VOL:
       case TA_PARAM_SPRITE:
-        tr_parse_poly_param(&tr, ctx, rc, data);
+        tr_parse_poly_param(tr, ctx, rc, data);
         break;
 
       /* vertex params */
       case TA_PARAM_VERTEX:
-        tr_parse_vert_param(&tr, ctx, rc, data);
+        if (vert_decode_batched(tr->vertex_type)) {
+          tr_parse_vert_run(tr, ctx, rc, end);
+          continue;
+        }
+        tr_parse_vert_param(tr, ctx, rc, data);
         break;
     }
 
-    /* track info about the parse state for tracer debugging */
-    struct tr_param *rp = &rc->params[rc->num_params++];
-    rp->offset = (int)(data - ctx->params);
-    rp->list_type = tr.list_type;
-    rp->vertex_type = tr.list_type;
-    rp->last_surf = rc->num_surfs - 1;
-    rp->last_vert = rc->num_verts - 1;
+    tr_track_param(tr, rc);
+
+    tr->offset += ta_get_param_size(pcw, tr->vertex_type);
+  }
+}
+
+void tr_parse_context(struct tr *tr, const struct tile_context *ctx,
+                      struct tr_context *rc, int end) {
+  PROF_ENTER("gpu", "tr_parse_context");
+
+  tr_parse_params(tr, ctx, rc, end);
+
+  PROF_LEAVE();
+}
+
+void tr_begin_context(struct tr *tr, struct tr_context *rc, int autosort) {
+  ta_init_tables();
+  vert_decode_init();
+  pixel_convert_init();
+
+  tr_reset(tr, rc);
+
+  tr->autosort = autosort;
+
+  /* reserve the background surface up front, it's filled in once the context
+     is rendered and its state is known. it must not be merged into, as its
+     state is unknown until then */
+  tr_parse_bg(tr, NULL, rc);
+  tr->merge_base = rc->num_surfs;
+}
+
+int tr_end_context(struct tr *tr, const struct tile_context *ctx,
+                   struct tr_context *rc) {
+  PROF_ENTER("gpu", "tr_end_context");
 
-    data += ta_get_param_size(pcw, tr.vertex_type);
+  /* the surfaces parsed so far are only valid if the autosort guess made when
+     the context began was correct */
+  if (ctx->autosort != tr->autosort) {
+    PROF_LEAVE();
+    return 0;
   }
 
+  /* parse any remaining params */
+  tr_parse_params(tr, ctx, rc, ctx->size);
+  tr_commit_volume(tr, rc);
+
+  rc->width = ctx->video_width;
+  rc->height = ctx->video_height;
+  rc->shadow_scale = tr_shadow_scale(ctx);
+
+  tr_fill_bg(ctx, rc);
+
+  tr_resolve_surfs(tr, ctx, rc);
+
   /* sort blended surface lists if requested */
   if (ctx->autosort) {
-    tr_sort_render_list(&tr, rc, TA_LIST_TRANSLUCENT);
-    tr_sort_render_list(&tr, rc, TA_LIST_PUNCH_THROUGH);
+    tr_sort_render_lists(rc);
+  }
+
+  tr_update_peaks(rc);
+
+  PROF_LEAVE();
+
+  return 1;
+}
+
+/*
+ * parallel conversion
+ */
+struct tr_chunk {
+  /* range of the param stream parsed by the chunk, along with the global
+     state it starts out with */
+  int begin;
+  int end;
+  int list_type;
+  int face_param;
+  int offset_param;
+
+  /* storage the chunk is parsed into */
+  struct tr tr;
+  struct tr_context rc;
+
+  /* where the chunk's storage lands in the final context. when the first
+     surface of a chunk can be merged into the last surface before it, it's
+     merged the same as it would have been when parsing serially */
+  int merged;
+  int merged_list;
+  int surf_base;
+  int vert_base;
+  int index_base;
+  int param_base;
+  int volume_base;
+  int volume_tri_base;
+  int list_bases[TA_NUM_LISTS];
+  int list_volume_bases[TA_NUM_LISTS];
+
+  /* indices merged into the chunk's last surface from the chunks after it */
+  int tail_verts;
+};
+
+struct tr_workers {
+  /* context being converted */
+  const struct tile_context *ctx;
+  struct tr_context *rc;
+
+  struct tr_chunk chunks[TR_MAX_CHUNKS];
+  int num_chunks;
+
+  /* each pass over the chunks is ran as a batch of jobs on the pool */
+  struct worker_pool *pool;
+};
+
+/* quick scan over the param stream, splitting it into chunks at the start of
+   each list and at global params once a chunk is large enough. the global
+   state parsing depends on is all reset by a global param, except for the
+   list type and the face colors, which are recorded for each chunk as the
+   offsets of the global params last specifying them */
+static int tr_split_chunks(struct tr_workers *w,
+                           const struct tile_context *ctx) {
+  int num_threads = worker_pool_num_workers(w->pool) + 1;
+  int target = MAX(ctx->size / (num_threads * TR_CHUNKS_PER_THREAD),
+                   TR_MIN_CHUNK_SIZE);
+  int list_type = TA_NUM_LISTS;
+  int vertex_type = TA_NUM_VERTS;
+  int face_param = -1;
+  int offset_param = -1;
+  int offset = 0;
+
+  struct tr_chunk *chunk = &w->chunks[0];
+  chunk->begin = 0;
+  chunk->list_type = list_type;
+  chunk->face_param = face_param;
+  chunk->offset_param = offset_param;
+  w->num_chunks = 1;
+
+  while (offset < ctx->size) {
+    const uint8_t *data = ctx->params + offset;
+    union pcw pcw = *(union pcw *)data;
+    int global = pcw.para_type == TA_PARAM_POLY_OR_VOL ||
+                 pcw.para_type == TA_PARAM_SPRITE;
+
+    /* the global params of a modifier volume list don't reset the volume
+       being parsed, the list is only split at its start */
+    int volume_list = list_type == TA_LIST_OPAQUE_MODVOL ||
+                      list_type == TA_LIST_TRANSLUCENT_MODVOL;
+
+    if (global && !volume_list && w->num_chunks < TR_MAX_CHUNKS) {
+      int size = offset - chunk->begin;
+      int list_start = list_type == TA_NUM_LISTS;
+
+      if (size >= target || (list_start && size >= TR_MIN_CHUNK_SIZE)) {
+        chunk->end = offset;
+        chunk = &w->chunks[w->num_chunks++];
+        chunk->begin = offset;
+        chunk->list_type = list_type;
+        chunk->face_param = face_param;
+        chunk->offset_param = offset_param;
+      }
+    }
+
+    if (ta_pcw_list_type_valid(pcw, list_type)) {
+      list_type = pcw.list_type;
+    }
+
+    if (pcw.para_type == TA_PARAM_END_OF_LIST) {
+      list_type = TA_NUM_LISTS;
+      vertex_type = TA_NUM_VERTS;
+    } else if (global) {
+      int poly_type = ta_get_poly_type(pcw);
+      vertex_type = ta_get_vert_type(pcw);
+
+      if (poly_type == 1 || poly_type == 2 || poly_type == 5) {
+        face_param = offset;
+      }
+      if (poly_type == 2 || poly_type == 5) {
+        offset_param = offset;
+      }
+    }
+
+    offset += ta_get_param_size(pcw, vertex_type);
+
+    /* vertex params make up the bulk of the stream, skip over each run of
+       them without making the next offset depend on the last param read */
+    if (global) {
+      union pcw vert_pcw = {0};
+      vert_pcw.para_type = TA_PARAM_VERTEX;
+      int vert_size = ta_get_param_size(vert_pcw, vertex_type);
+
+      while (offset < ctx->size &&
+             ((const union pcw *)(ctx->params + offset))->para_type ==
+                 TA_PARAM_VERTEX) {
+        offset += vert_size;
+      }
+    }
   }
 
+  chunk->end = ctx->size;
+
+  return w->num_chunks;
+}
+
+static void tr_parse_chunk(void *data, int n) {
+  struct tr_workers *w = data;
+  const struct tile_context *ctx = w->ctx;
+  struct tr_chunk *chunk = &w->chunks[n];
+  struct tr *tr = &chunk->tr;
+  struct tr_context *rc = &chunk->rc;
+
+  tr_reset(tr, rc);
+
+  tr->autosort = ctx->autosort;
+  tr->pt_alpha_ref = (float)ctx->pt_alpha_ref / 0xff;
+  tr->list_type = chunk->list_type;
+  tr->offset = chunk->begin;
+
+  /* the offset color may have been specified before the face color */
+  memset(tr->face_color, 0, sizeof(tr->face_color));
+  memset(tr->face_offset_color, 0, sizeof(tr->face_offset_color));
+
+  if (chunk->offset_param >= 0 && chunk->offset_param != chunk->face_param) {
+    const union poly_param *param =
+        (const union poly_param *)(ctx->params + chunk->offset_param);
+    tr_parse_face_color(tr, param, ta_get_poly_type(param->type0.pcw));
+  }
+
+  if (chunk->face_param >= 0) {
+    const union poly_param *param =
+        (const union poly_param *)(ctx->params + chunk->face_param);
+    tr_parse_face_color(tr, param, ta_get_poly_type(param->type0.pcw));
+  }
+
+  tr_parse_params(tr, ctx, rc, chunk->end);
+  tr_commit_volume(tr, rc);
+}
+
+static void tr_copy_chunk(void *data, int n) {
+  struct tr_workers *w = data;
+  struct tr_chunk *chunk = &w->chunks[n];
+  const struct tr_context *src = &chunk->rc;
+  struct tr_context *rc = w->rc;
+  int surf_offset = chunk->surf_base - chunk->merged;
+
+  for (int i = chunk->merged; i < src->num_surfs; i++) {
+    struct ta_surface *surf = &rc->surfs[surf_offset + i];
+    *surf = src->surfs[i];
+    surf->first_vert += chunk->index_base;
+    rc->surf_textures[surf_offset + i] = src->surf_textures[i];
+  }
+
+  if (src->num_surfs > chunk->merged) {
+    rc->surfs[surf_offset + src->num_surfs - 1].num_verts += chunk->tail_verts;
+  }
+
+  memcpy(&rc->verts[chunk->vert_base], src->verts,
+         src->num_verts * sizeof(src->verts[0]));
+
+  for (int i = 0; i < src->num_indices; i++) {
+    rc->indices[chunk->index_base + i] = src->indices[i] + chunk->vert_base;
+  }
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    const struct tr_list *src_list = &src->lists[i];
+    struct tr_list *list = &rc->lists[i];
+    int skip = chunk->merged && chunk->merged_list == i;
+
+    for (int j = skip; j < src_list->num_surfs; j++) {
+      list->surfs[chunk->list_bases[i] + j - skip] =
+          src_list->surfs[j] + surf_offset;
+    }
+
+    for (int j = 0; j < src_list->num_volumes; j++) {
+      list->volumes[chunk->list_volume_bases[i] + j] =
+          src_list->volumes[j] + chunk->volume_base;
+    }
+  }
+
+  for (int i = 0; i < src->num_volumes; i++) {
+    struct ta_volume *volume = &rc->volumes[chunk->volume_base + i];
+    *volume = src->volumes[i];
+    volume->first_tri += chunk->volume_tri_base;
+  }
+
+  memcpy(&rc->volume_tris[chunk->volume_tri_base], src->volume_tris,
+         src->num_volume_tris * sizeof(src->volume_tris[0]));
+
+  /* params tracked before the chunk's first surface refer to the last
+     surface before the chunk */
+  for (int i = 0; i < src->num_params; i++) {
+    struct tr_param *rp = &rc->params[chunk->param_base + i];
+    *rp = src->params[i];
+    rp->last_surf = rp->last_surf < 0 ? chunk->surf_base - 1
+                                      : rp->last_surf + surf_offset;
+    rp->last_vert += chunk->vert_base;
+  }
+}
+
+/* lay out the parsed chunks back to back after the storage already in the
+   context, merging surfaces across chunk boundaries the same as tr_commit_surf
+   would have */
+static void tr_layout_chunks(struct tr *tr, struct tr_workers *w,
+                             struct tr_context *rc) {
+  int num_surfs = rc->num_surfs;
+  int num_verts = rc->num_verts;
+  int num_indices = rc->num_indices;
+  int num_params = rc->num_params;
+  int num_volumes = rc->num_volumes;
+  int num_volume_tris = rc->num_volume_tris;
+  int list_sizes[TA_NUM_LISTS];
+  int list_volumes[TA_NUM_LISTS];
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    list_sizes[i] = rc->lists[i].num_surfs;
+    list_volumes[i] = rc->lists[i].num_volumes;
+  }
+
+  /* last surface laid out so far, and the chunk owning it */
+  struct ta_surface *last = NULL;
+  tr_texture_key_t last_key = 0;
+  struct tr_chunk *last_chunk = NULL;
+
+  if (num_surfs > tr->merge_base) {
+    last = &rc->surfs[num_surfs - 1];
+    last_key = rc->surf_textures[num_surfs - 1];
+  }
+
+  for (int n = 0; n < w->num_chunks; n++) {
+    struct tr_chunk *chunk = &w->chunks[n];
+    const struct tr_context *src = &chunk->rc;
+
+    chunk->merged = 0;
+    chunk->merged_list = TA_NUM_LISTS;
+    chunk->tail_verts = 0;
+
+    if (src->num_surfs && last && last_key == src->surf_textures[0] &&
+        tr_can_merge_surfs(last, &src->surfs[0])) {
+      chunk->merged = 1;
+
+      /* the first surface is always the first entry of the list it was
+         committed to */
+      for (int i = 0; i < TA_NUM_LISTS; i++) {
+        if (src->lists[i].num_surfs && src->lists[i].surfs[0] == 0) {
+          chunk->merged_list = i;
+          break;
+        }
+      }
+
+      if (last_chunk) {
+        last_chunk->tail_verts += src->surfs[0].num_verts;
+      } else {
+        last->num_verts += src->surfs[0].num_verts;
+      }
+
+      tr->merged_surfs++;
+    }
+
+    chunk->surf_base = num_surfs;
+    chunk->vert_base = num_verts;
+    chunk->index_base = num_indices;
+    chunk->param_base = num_params;
+    chunk->volume_base = num_volumes;
+    chunk->volume_tri_base = num_volume_tris;
+
+    num_surfs += src->num_surfs - chunk->merged;
+    num_verts += src->num_verts;
+    num_indices += src->num_indices;
+    num_params += src->num_params;
+    num_volumes += src->num_volumes;
+    num_volume_tris += src->num_volume_tris;
+
+    for (int i = 0; i < TA_NUM_LISTS; i++) {
+      int skip = chunk->merged && chunk->merged_list == i;
+      chunk->list_bases[i] = list_sizes[i];
+      chunk->list_volume_bases[i] = list_volumes[i];
+      list_sizes[i] += src->lists[i].num_surfs - skip;
+      list_volumes[i] += src->lists[i].num_volumes;
+    }
+
+    if (src->num_surfs > chunk->merged) {
+      last = &src->surfs[src->num_surfs - 1];
+      last_key = src->surf_textures[src->num_surfs - 1];
+      last_chunk = chunk;
+    }
+  }
+
+  tr_grow_surfs(rc, num_surfs + 1);
+  tr_grow_verts(rc, num_verts);
+  tr_grow_indices(rc, num_indices);
+  tr_grow_params(rc, num_params);
+  tr_grow_volumes(rc, num_volumes);
+  tr_grow_volume_tris(rc, num_volume_tris);
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    tr_grow_list(&rc->lists[i], list_sizes[i]);
+    tr_grow_list_volumes(&rc->lists[i], list_volumes[i]);
+    rc->lists[i].num_surfs = list_sizes[i];
+    rc->lists[i].num_volumes = list_volumes[i];
+  }
+
+  rc->num_surfs = num_surfs;
+  rc->num_verts = num_verts;
+  rc->num_indices = num_indices;
+  rc->num_params = num_params;
+  rc->num_volumes = num_volumes;
+  rc->num_volume_tris = num_volume_tris;
+}
+
+static void tr_parse_params_parallel(struct tr *tr, struct tr_workers *w,
+                                     const struct tile_context *ctx,
+                                     struct tr_context *rc) {
+  w->ctx = ctx;
+  w->rc = rc;
+
+  worker_pool_run(w->pool, &tr_parse_chunk, w, w->num_chunks);
+  tr_layout_chunks(tr, w, rc);
+  worker_pool_run(w->pool, &tr_copy_chunk, w, w->num_chunks);
+
+  w->ctx = NULL;
+  w->rc = NULL;
+}
+
+void tr_destroy_workers(struct tr_workers *w) {
+  worker_pool_destroy(w->pool);
+
+  for (int i = 0; i < TR_MAX_CHUNKS; i++) {
+    tr_free_context(&w->chunks[i].rc);
+  }
+
+  free(w);
+}
+
+struct tr_workers *tr_create_workers(int num_workers) {
+  struct tr_workers *w = calloc(1, sizeof(struct tr_workers));
+
+  w->pool = worker_pool_create(CLAMP(num_workers, 0, TR_MAX_WORKERS));
+
+  return w;
+}
+
+static void tr_convert(struct tr_workers *w, struct render_backend *r,
+                       struct tr_atlas *atlas, void *userdata,
+                       tr_find_texture_cb find_texture,
+                       const struct tile_context *ctx,
+                       struct tr_context *rc) {
+  struct tr tr = {0};
+  tr.r = r;
+  tr.atlas = atlas;
+  tr.userdata = userdata;
+  tr.find_texture = find_texture;
+
+  ta_init_tables();
+  vert_decode_init();
+  pixel_convert_init();
+
+  tr_reset(&tr, rc);
+
+  tr.autosort = ctx->autosort;
+  tr.pt_alpha_ref = (float)ctx->pt_alpha_ref / 0xff;
+
+  rc->width = ctx->video_width;
+  rc->height = ctx->video_height;
+  rc->shadow_scale = tr_shadow_scale(ctx);
+
+  tr_parse_bg(&tr, ctx, rc);
+
+  /* small contexts aren't worth splitting up */
+  if (w && worker_pool_num_workers(w->pool) &&
+      tr_split_chunks(w, ctx) > 1) {
+    tr_parse_params_parallel(&tr, w, ctx, rc);
+  } else {
+    tr_parse_params(&tr, ctx, rc, ctx->size);
+    tr_commit_volume(&tr, rc);
+  }
+
+  tr_resolve_surfs(&tr, ctx, rc);
+
+  /* sort blended surface lists if requested */
+  if (ctx->autosort) {
+    tr_sort_render_lists(rc);
+  }
+
+  tr_update_peaks(rc);
+
 #if 0
   LOG_INFO("tr_convert_convext merged %d / %d surfaces", tr.merged_surfs,
            tr.merged_surfs + rc->num_surfs);
 #endif
+}
+
+void tr_convert_context_parallel(struct tr_workers *w, struct render_backend *r,
+                                 struct tr_atlas *atlas, void *userdata,
+                                 tr_find_texture_cb find_texture,
+                                 const struct tile_context *ctx,
+                                 struct tr_context *rc) {
+  PROF_ENTER("gpu", "tr_convert_context_parallel");
+
+  tr_convert(w, r, atlas, userdata, find_texture, ctx, rc);
 
   PROF_LEAVE();
 }
+
+void tr_convert_context(struct render_backend *r, struct tr_atlas *atlas,
+                        void *userdata, tr_find_texture_cb find_texture,
+                        const struct tile_context *ctx, struct tr_context *rc) {
+  PROF_ENTER("gpu", "tr_convert_context");
+
+  tr_convert(NULL, r, atlas, userdata, find_texture, ctx, rc);
+
+  PROF_LEAVE();
+}
+
+void tr_free_context(struct tr_context *rc) {
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    free(rc->lists[i].surfs);
+    free(rc->lists[i].volumes);
+  }
+  free(rc->volume_tris);
+  free(rc->volumes);
+  free(rc->params);
+  free(rc->surf_textures);
+  free(rc->indices);
+  free(rc->verts);
+  free(rc->surfs);
+  memset(rc, 0, sizeof(*rc));
+}
+
+void tr_destroy(struct tr *tr) {
+  free(tr);
+}
+
+struct tr *tr_create(struct render_backend *r, struct tr_atlas *atlas,
+                     void *userdata, tr_find_texture_cb find_texture) {
+  struct tr *tr = calloc(1, sizeof(struct tr));
+  tr->r = r;
+  tr->atlas = atlas;
+  tr->userdata = userdata;
+  tr->find_texture = find_texture;
+  return tr;
+}
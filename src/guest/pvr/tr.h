@@ -4,15 +4,33 @@
 /* tile renderer code. responsible for parsing a raw tile_context into
    draw commands to be passed to the supplied render backend */
 
+#include "core/option.h"
+#include "core/profiler.h"
 #include "core/rb_tree.h"
+#include "guest/pvr/pixel_convert.h"
 #include "guest/pvr/ta_types.h"
 #include "render/render_backend.h"
 
 struct tr;
+struct tr_atlas;
 struct tr_texture;
+struct tr_workers;
+
+DECLARE_OPTION_INT(batch_surfaces);
+DECLARE_OPTION_INT(texture_atlas);
+DECLARE_OPTION_INT(modifier_volumes);
+
+DECLARE_COUNTER(tr_surfs_peak);
+DECLARE_COUNTER(tr_verts_peak);
+DECLARE_COUNTER(tr_indices_peak);
+DECLARE_COUNTER(tr_atlas_binds_saved);
 
 typedef uint64_t tr_texture_key_t;
 
+/* number of entries in palette ram, each paletted texture indexes into a
+   bank of 16 or 256 of them */
+#define TR_PALETTE_ENTRIES 1024
+
 struct tr_texture {
   union tsp tsp;
   union tcw tcw;
@@ -25,6 +43,16 @@ struct tr_texture {
   const uint8_t *palette;
   int palette_size;
 
+  /* source data converted ahead of time by the texture provider. when set,
+     it's uploaded as is instead of converting the source data again */
+  const uint8_t *converted;
+
+  /* palette texture maintained by the texture provider, with an entry for
+     each of TR_PALETTE_ENTRIES. when set, paletted textures are uploaded as
+     indices looked up in it while drawing, instead of being expanded with the
+     palette they reference, so they no longer depend on palette ram */
+  texture_handle_t palette_texture;
+
   /* backend info */
   enum pxl_format format;
   enum filter_mode filter;
@@ -33,6 +61,13 @@ struct tr_texture {
   int width;
   int height;
   texture_handle_t handle;
+
+  /* copy of the texture packed into an atlas page, the handle is zero if it
+     isn't packed. the uv offset and scale map the texture onto the page */
+  texture_handle_t atlas_handle;
+  int atlas_page;
+  int atlas_cell;
+  float atlas_uv[4];
 };
 
 struct tr_param {
@@ -47,8 +82,14 @@ struct tr_param {
 };
 
 struct tr_list {
-  int surfs[TA_MAX_SURFS];
+  int *surfs;
   int num_surfs;
+  int max_surfs;
+
+  /* modifier volumes of the list, as indices into the context's volumes */
+  int *volumes;
+  int num_volumes;
+  int max_volumes;
 };
 
 struct tr_context {
@@ -56,22 +97,45 @@ struct tr_context {
   int width;
   int height;
 
-  /* parsed surfaces and vertices, ready to be passed to the render backend */
-  struct ta_surface surfs[TA_MAX_SURFS];
+  /* parsed surfaces and vertices, ready to be passed to the render backend.
+     the storage for each array grows as it's needed and is retained when the
+     context is reset, so it's only reallocated while warming up to the
+     largest frame converted with it */
+  struct ta_surface *surfs;
   int num_surfs;
+  int max_surfs;
 
-  struct ta_vertex verts[TA_MAX_VERTS];
+  struct ta_vertex *verts;
   int num_verts;
+  int max_verts;
 
-  uint16_t indices[TA_MAX_VERTS * 3];
+  uint16_t *indices;
   int num_indices;
+  int max_indices;
+
+  /* texture key for each surface, zero for untextured surfaces. sized to
+     max_surfs */
+  tr_texture_key_t *surf_textures;
 
   /* sorted list of surfaces corresponding to each of the ta's polygon lists */
   struct tr_list lists[TA_NUM_LISTS];
 
+  /* modifier volumes and the triangles making them up. the color of the
+     shadowed surfaces they modify is scaled by the shadow scale */
+  struct ta_volume *volumes;
+  int num_volumes;
+  int max_volumes;
+
+  struct ta_volume_tri *volume_tris;
+  int num_volume_tris;
+  int max_volume_tris;
+
+  float shadow_scale;
+
   /* debug structures for stepping through the param stream in the tracer */
-  struct tr_param params[TA_MAX_PARAMS];
+  struct tr_param *params;
   int num_params;
+  int max_params;
 };
 
 static inline tr_texture_key_t tr_texture_key(union tsp tsp, union tcw tcw) {
@@ -80,11 +144,89 @@ static inline tr_texture_key_t tr_texture_key(union tsp tsp, union tcw tcw) {
 
 typedef struct tr_texture *(*tr_find_texture_cb)(void *, union tsp, union tcw);
 
-void tr_convert_context(struct render_backend *r, void *userdata,
-                        tr_find_texture_cb find_texture,
+/* methods of sorting autosorted lists from back to front. the surface sorts
+   order each surface by its minimum z, while the triangle sort orders each
+   individual triangle, splitting surfaces which overlap in depth */
+enum tr_sort {
+  TR_SORT_SURFS_MERGE,
+  TR_SORT_SURFS_RADIX,
+  TR_SORT_TRIANGLES,
+  TR_NUM_SORTS,
+};
+
+extern const char *tr_sort_names[TR_NUM_SORTS];
+
+/* the atlas is optional, small textures are only packed into it when one is
+   provided */
+struct tr *tr_create(struct render_backend *r, struct tr_atlas *atlas,
+                     void *userdata, tr_find_texture_cb find_texture);
+void tr_destroy(struct tr *tr);
+
+/* convert a texture's source data into the format uploaded to the render
+   backend. this doesn't touch the render backend or the texture entry, so
+   it's safe to call from any thread once pixel_convert_init has been called */
+int tr_texture_converted_size(union tsp tsp, union tcw tcw, int stride);
+void tr_texture_convert(const struct tr_texture *entry, int pal_pxl_format,
+                        int stride, uint8_t *output);
+
+/* same as tr_texture_convert, but with the given implementation instead of
+   the selected one. used to compare the implementations */
+void tr_texture_convert_impl(enum pixel_convert_impl impl,
+                             const struct tr_texture *entry,
+                             int pal_pxl_format, int stride, uint8_t *output);
+
+/* highest resolution level of a texture's source data */
+const uint8_t *tr_texture_source(union tsp tsp, union tcw tcw,
+                                 const uint8_t *texture);
+
+/* convert a run of palette ram entries to the PXL_RGBA format of the palette
+   texture */
+void tr_palette_convert(int pal_pxl_format, const uint8_t *palette,
+                        int num_entries, uint8_t *output);
+
+/* incremental conversion. tr_begin_context starts converting a new context,
+   tr_parse_context parses its params as they're received from the ta, and
+   tr_end_context finishes the conversion once the context is rendered. the
+   render backend is only accessed by tr_end_context, enabling the first two
+   to be ran on a thread without a video context. tr_end_context returns 0 if
+   the context needs to be converted again from scratch */
+void tr_begin_context(struct tr *tr, struct tr_context *rc, int autosort);
+void tr_parse_context(struct tr *tr, const struct tile_context *ctx,
+                      struct tr_context *rc, int end);
+int tr_end_context(struct tr *tr, const struct tile_context *ctx,
+                   struct tr_context *rc);
+
+/* free the storage owned by a context */
+void tr_free_context(struct tr_context *rc);
+
+void tr_convert_context(struct render_backend *r, struct tr_atlas *atlas,
+                        void *userdata, tr_find_texture_cb find_texture,
                         const struct tile_context *ctx, struct tr_context *rc);
-void tr_render_context(struct render_backend *r, const struct tr_context *rc);
-void tr_render_context_until(struct render_backend *r,
-                             const struct tr_context *rc, int end_surf);
+
+/* parallel conversion. after a quick scan splitting the param stream into
+   chunks at list and global param boundaries, the chunks are parsed into
+   separate storage by a pool of worker threads and concatenated, producing
+   the same context as tr_convert_context. textures are still resolved and
+   lists sorted on the calling thread, which also parses chunks while the
+   workers are busy */
+struct tr_workers *tr_create_workers(int num_workers);
+void tr_destroy_workers(struct tr_workers *w);
+
+void tr_convert_context_parallel(struct tr_workers *w, struct render_backend *r,
+                                 struct tr_atlas *atlas, void *userdata,
+                                 tr_find_texture_cb find_texture,
+                                 const struct tile_context *ctx,
+                                 struct tr_context *rc);
+
+/* record the drawing of a converted context to a command buffer, which can be
+   done without the video context being bound */
+void tr_record_context(struct r_cmdbuf *cb, const struct tr_context *rc);
+
+/* sort a list of a converted context. the triangle sort appends the surfaces
+   and indices for the sorted triangles to the context */
+void tr_sort_render_list(struct tr_context *rc, int list_type,
+                         enum tr_sort sort);
+void tr_record_context_until(struct r_cmdbuf *cb, const struct tr_context *rc,
+                             int end_surf);
 
 #endif
@@ -0,0 +1,230 @@
+#include "guest/pvr/tr_atlas.h"
+#include "core/assert.h"
+#include "core/core.h"
+#include "guest/pvr/tr.h"
+
+DEFINE_COUNTER(tr_atlas_occupancy);
+
+#define TR_ATLAS_PAGE_SIZE 512
+#define TR_ATLAS_MAX_PAGES 64
+#define TR_ATLAS_MIN_TEXTURE_SIZE 8
+
+/* each texture is packed with a border of texels matching its wrap mode, so
+   filtering at its edges doesn't sample its neighbours */
+#define TR_ATLAS_BORDER 1
+
+/* pages are split into a grid of equally sized cells, one texture per cell */
+#define TR_ATLAS_MAX_CELL_SIZE \
+  (TR_ATLAS_MAX_TEXTURE_SIZE + TR_ATLAS_BORDER * 2)
+#define TR_ATLAS_MAX_CELLS                                     \
+  ((TR_ATLAS_PAGE_SIZE /                                       \
+    (TR_ATLAS_MIN_TEXTURE_SIZE + TR_ATLAS_BORDER * 2)) *       \
+   (TR_ATLAS_PAGE_SIZE /                                       \
+    (TR_ATLAS_MIN_TEXTURE_SIZE + TR_ATLAS_BORDER * 2)))
+
+struct tr_atlas_page {
+  /* textures are only packed with others sharing the same format and
+     filtering, and of the same size class */
+  enum pxl_format format;
+  enum filter_mode filter;
+  int cell_size;
+  int cells_per_row;
+  int num_cells;
+  int used_cells;
+  int next_cell;
+  texture_handle_t handle;
+  uint8_t used[TR_ATLAS_MAX_CELLS];
+};
+
+struct tr_atlas {
+  struct render_backend *r;
+  struct tr_atlas_page pages[TR_ATLAS_MAX_PAGES];
+  int num_pages;
+  int64_t used_area;
+};
+
+static int tr_atlas_bpp(enum pxl_format format) {
+  return format == PXL_RGBA ? 4 : 2;
+}
+
+static void tr_atlas_update_stats(struct tr_atlas *atlas) {
+  int64_t page_area = (int64_t)TR_ATLAS_PAGE_SIZE * TR_ATLAS_PAGE_SIZE;
+  int64_t total_area = atlas->num_pages * page_area;
+  int64_t occupancy = total_area ? atlas->used_area * 100 / total_area : 0;
+  prof_counter_set(COUNTER_tr_atlas_occupancy, occupancy);
+}
+
+static struct tr_atlas_page *tr_atlas_alloc_page(struct tr_atlas *atlas,
+                                                 enum pxl_format format,
+                                                 enum filter_mode filter,
+                                                 int cell_size) {
+  if (atlas->num_pages == TR_ATLAS_MAX_PAGES) {
+    return NULL;
+  }
+
+  /* pages start out cleared, only the cells in use are ever sampled */
+  int bpp = tr_atlas_bpp(format);
+  uint8_t *data = calloc(TR_ATLAS_PAGE_SIZE * TR_ATLAS_PAGE_SIZE, bpp);
+  CHECK_NOTNULL(data);
+
+  struct tr_atlas_page *page = &atlas->pages[atlas->num_pages++];
+  memset(page, 0, sizeof(*page));
+  page->format = format;
+  page->filter = filter;
+  page->cell_size = cell_size;
+  page->cells_per_row = TR_ATLAS_PAGE_SIZE / cell_size;
+  page->num_cells = page->cells_per_row * page->cells_per_row;
+  page->handle = r_create_texture(
+      atlas->r, format, filter, WRAP_CLAMP_TO_EDGE, WRAP_CLAMP_TO_EDGE, 0,
+      TR_ATLAS_PAGE_SIZE, TR_ATLAS_PAGE_SIZE, data);
+
+  free(data);
+
+  return page;
+}
+
+static struct tr_atlas_page *tr_atlas_find_page(struct tr_atlas *atlas,
+                                                enum pxl_format format,
+                                                enum filter_mode filter,
+                                                int cell_size) {
+  for (int i = 0; i < atlas->num_pages; i++) {
+    struct tr_atlas_page *page = &atlas->pages[i];
+
+    if (page->format == format && page->filter == filter &&
+        page->cell_size == cell_size && page->used_cells < page->num_cells) {
+      return page;
+    }
+  }
+
+  return tr_atlas_alloc_page(atlas, format, filter, cell_size);
+}
+
+/* map a texel coordinate in the border around a texture back inside of it,
+   the same as the texture's wrap mode would when sampling past its edge */
+static int tr_atlas_wrap(int x, int size, enum wrap_mode wrap) {
+  if (x < 0) {
+    return wrap == WRAP_REPEAT ? size - 1 : 0;
+  } else if (x >= size) {
+    return wrap == WRAP_REPEAT ? 0 : size - 1;
+  }
+  return x;
+}
+
+int tr_atlas_owns(const struct tr_atlas *atlas, texture_handle_t handle) {
+  for (int i = 0; i < atlas->num_pages; i++) {
+    if (atlas->pages[i].handle == handle) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void tr_atlas_release(struct tr_atlas *atlas, struct tr_texture *entry) {
+  if (!entry->atlas_handle) {
+    return;
+  }
+
+  struct tr_atlas_page *page = &atlas->pages[entry->atlas_page];
+  CHECK_EQ(page->handle, entry->atlas_handle);
+  CHECK(page->used[entry->atlas_cell]);
+
+  page->used[entry->atlas_cell] = 0;
+  page->used_cells--;
+  page->next_cell = MIN(page->next_cell, entry->atlas_cell);
+  atlas->used_area -= page->cell_size * page->cell_size;
+
+  entry->atlas_handle = 0;
+  entry->atlas_page = 0;
+  entry->atlas_cell = 0;
+
+  tr_atlas_update_stats(atlas);
+}
+
+int tr_atlas_pack(struct tr_atlas *atlas, struct tr_texture *entry,
+                  const uint8_t *data) {
+  CHECK(!entry->atlas_handle);
+
+  int width = entry->width;
+  int height = entry->height;
+
+  if (width > TR_ATLAS_MAX_TEXTURE_SIZE ||
+      height > TR_ATLAS_MAX_TEXTURE_SIZE) {
+    return 0;
+  }
+
+  /* textures are sorted into size classes by their largest dimension */
+  int size = TR_ATLAS_MIN_TEXTURE_SIZE;
+  while (size < MAX(width, height)) {
+    size <<= 1;
+  }
+
+  int cell_size = size + TR_ATLAS_BORDER * 2;
+  struct tr_atlas_page *page =
+      tr_atlas_find_page(atlas, entry->format, entry->filter, cell_size);
+
+  if (!page) {
+    return 0;
+  }
+
+  int cell = page->next_cell;
+  while (page->used[cell]) {
+    cell++;
+  }
+  CHECK_LT(cell, page->num_cells);
+
+  page->used[cell] = 1;
+  page->used_cells++;
+  page->next_cell = cell + 1;
+  atlas->used_area += cell_size * cell_size;
+
+  /* copy the texture along with its border into the cell */
+  static uint8_t bordered[TR_ATLAS_MAX_CELL_SIZE * TR_ATLAS_MAX_CELL_SIZE * 4];
+  int bpp = tr_atlas_bpp(entry->format);
+  int bordered_width = width + TR_ATLAS_BORDER * 2;
+  int bordered_height = height + TR_ATLAS_BORDER * 2;
+  uint8_t *dst = bordered;
+
+  for (int y = -TR_ATLAS_BORDER; y < height + TR_ATLAS_BORDER; y++) {
+    int src_y = tr_atlas_wrap(y, height, entry->wrap_v);
+    const uint8_t *src = data + src_y * width * bpp;
+
+    for (int x = -TR_ATLAS_BORDER; x < width + TR_ATLAS_BORDER; x++) {
+      int src_x = tr_atlas_wrap(x, width, entry->wrap_u);
+      memcpy(dst, src + src_x * bpp, bpp);
+      dst += bpp;
+    }
+  }
+
+  int cell_x = (cell % page->cells_per_row) * cell_size;
+  int cell_y = (cell / page->cells_per_row) * cell_size;
+  r_update_texture(atlas->r, page->handle, cell_x, cell_y, bordered_width,
+                   bordered_height, bordered);
+
+  entry->atlas_handle = page->handle;
+  entry->atlas_page = (int)(page - atlas->pages);
+  entry->atlas_cell = cell;
+  entry->atlas_uv[0] =
+      (float)(cell_x + TR_ATLAS_BORDER) / (float)TR_ATLAS_PAGE_SIZE;
+  entry->atlas_uv[1] =
+      (float)(cell_y + TR_ATLAS_BORDER) / (float)TR_ATLAS_PAGE_SIZE;
+  entry->atlas_uv[2] = (float)width / (float)TR_ATLAS_PAGE_SIZE;
+  entry->atlas_uv[3] = (float)height / (float)TR_ATLAS_PAGE_SIZE;
+
+  tr_atlas_update_stats(atlas);
+
+  return 1;
+}
+
+void tr_atlas_destroy(struct tr_atlas *atlas) {
+  for (int i = 0; i < atlas->num_pages; i++) {
+    r_destroy_texture(atlas->r, atlas->pages[i].handle);
+  }
+
+  free(atlas);
+}
+
+struct tr_atlas *tr_atlas_create(struct render_backend *r) {
+  struct tr_atlas *atlas = calloc(1, sizeof(struct tr_atlas));
+  atlas->r = r;
+  return atlas;
+}
@@ -0,0 +1,33 @@
+#ifndef TR_ATLAS_H
+#define TR_ATLAS_H
+
+/* texture atlas. copies of small textures are packed into shared pages, so
+   surfaces sampling different small textures can be drawn together by
+   remapping their uvs onto the page */
+
+#include "core/profiler.h"
+#include "render/render_backend.h"
+
+struct tr_atlas;
+struct tr_texture;
+
+/* textures up to this size in each dimension are packed */
+#define TR_ATLAS_MAX_TEXTURE_SIZE 64
+
+/* percentage of the allocated page area in use */
+DECLARE_COUNTER(tr_atlas_occupancy);
+
+struct tr_atlas *tr_atlas_create(struct render_backend *r);
+void tr_atlas_destroy(struct tr_atlas *atlas);
+
+/* pack a copy of the texture's converted data into a page, filling in the
+   entry's atlas info. returns 0 if there's no room for it */
+int tr_atlas_pack(struct tr_atlas *atlas, struct tr_texture *entry,
+                  const uint8_t *data);
+/* free the entry's space in its page, if it was packed */
+void tr_atlas_release(struct tr_atlas *atlas, struct tr_texture *entry);
+
+/* check if a backend texture is one of the atlas' pages */
+int tr_atlas_owns(const struct tr_atlas *atlas, texture_handle_t handle);
+
+#endif
@@ -0,0 +1,649 @@
+#include <string.h>
+#include "guest/pvr/vert_decode.h"
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/cpu.h"
+
+#if ARCH_X64
+#include <immintrin.h>
+#endif
+
+typedef void (*vert_decode_cb)(const union vert_param **params,
+                               struct ta_vertex **verts, int num_verts,
+                               const float *face_color,
+                               const float *face_offset_color);
+
+const char *vert_decode_names[VERT_DECODE_NUM_IMPLS] = {
+    "scalar", "sse2", "avx2",
+};
+
+static enum vert_decode_impl vert_decode_impl = VERT_DECODE_SCALAR;
+
+/*
+ * helpers shared by each implementation
+ */
+static inline void decode_xyz(const union vert_param *param,
+                              struct ta_vertex *vert) {
+  vert->xyz[0] = param->type0.xyz[0];
+  vert->xyz[1] = param->type0.xyz[1];
+  vert->xyz[2] = param->type0.xyz[2];
+}
+
+static inline void decode_uv(const float *uv, struct ta_vertex *vert) {
+  vert->uv[0] = uv[0];
+  vert->uv[1] = uv[1];
+}
+
+static inline void decode_vu(const uint16_t *vu, struct ta_vertex *vert) {
+  /* packed uvs are the upper 16 bits of each float */
+  uint32_t u = (uint32_t)vu[1] << 16;
+  uint32_t v = (uint32_t)vu[0] << 16;
+  memcpy(&vert->uv[0], &u, sizeof(u));
+  memcpy(&vert->uv[1], &v, sizeof(v));
+}
+
+static inline void decode_no_uv(struct ta_vertex *vert) {
+  vert->uv[0] = 0.0f;
+  vert->uv[1] = 0.0f;
+}
+
+/* the packed color types only swizzle the color bytes, which is already cheap
+   to do with scalar code, so each implementation shares these */
+static void decode_type0(const union vert_param **params,
+                         struct ta_vertex **verts, int num_verts,
+                         const float *face_color,
+                         const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color = abgr_to_rgba(param->type0.base_color);
+    vert->offset_color = 0;
+    decode_no_uv(vert);
+  }
+}
+
+static void decode_type3(const union vert_param **params,
+                         struct ta_vertex **verts, int num_verts,
+                         const float *face_color,
+                         const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color = abgr_to_rgba(param->type3.base_color);
+    vert->offset_color = abgr_to_rgba(param->type3.offset_color);
+    decode_uv(param->type3.uv, vert);
+  }
+}
+
+static void decode_type4(const union vert_param **params,
+                         struct ta_vertex **verts, int num_verts,
+                         const float *face_color,
+                         const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color = abgr_to_rgba(param->type4.base_color);
+    vert->offset_color = abgr_to_rgba(param->type4.offset_color);
+    decode_vu(param->type4.vu, vert);
+  }
+}
+
+/*
+ * scalar implementation
+ */
+static inline uint32_t scalar_argb_to_rgba(const float *argb) {
+  return float_to_rgba(argb[1], argb[2], argb[3], argb[0]);
+}
+
+static inline uint32_t scalar_intensity_to_rgba(const float *rgba,
+                                                float intensity) {
+  return float_to_rgba(rgba[0] * intensity, rgba[1] * intensity,
+                       rgba[2] * intensity, rgba[3]);
+}
+
+static void scalar_decode_type1(const union vert_param **params,
+                                struct ta_vertex **verts, int num_verts,
+                                const float *face_color,
+                                const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color = scalar_argb_to_rgba(&param->type1.base_color_a);
+    vert->offset_color = 0;
+    decode_no_uv(vert);
+  }
+}
+
+static void scalar_decode_type2(const union vert_param **params,
+                                struct ta_vertex **verts, int num_verts,
+                                const float *face_color,
+                                const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color =
+        scalar_intensity_to_rgba(face_color, param->type2.base_intensity);
+    vert->offset_color = 0;
+    decode_no_uv(vert);
+  }
+}
+
+static void scalar_decode_type5(const union vert_param **params,
+                                struct ta_vertex **verts, int num_verts,
+                                const float *face_color,
+                                const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color = scalar_argb_to_rgba(&param->type5.base_color_a);
+    vert->offset_color = scalar_argb_to_rgba(&param->type5.offset_color_a);
+    decode_uv(param->type5.uv, vert);
+  }
+}
+
+static void scalar_decode_type6(const union vert_param **params,
+                                struct ta_vertex **verts, int num_verts,
+                                const float *face_color,
+                                const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color = scalar_argb_to_rgba(&param->type6.base_color_a);
+    vert->offset_color = scalar_argb_to_rgba(&param->type6.offset_color_a);
+    decode_vu(param->type6.vu, vert);
+  }
+}
+
+static void scalar_decode_type7(const union vert_param **params,
+                                struct ta_vertex **verts, int num_verts,
+                                const float *face_color,
+                                const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color =
+        scalar_intensity_to_rgba(face_color, param->type7.base_intensity);
+    vert->offset_color = scalar_intensity_to_rgba(
+        face_offset_color, param->type7.offset_intensity);
+    decode_uv(param->type7.uv, vert);
+  }
+}
+
+static void scalar_decode_type8(const union vert_param **params,
+                                struct ta_vertex **verts, int num_verts,
+                                const float *face_color,
+                                const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    const union vert_param *param = params[i];
+    struct ta_vertex *vert = verts[i];
+    decode_xyz(param, vert);
+    vert->color =
+        scalar_intensity_to_rgba(face_color, param->type8.base_intensity);
+    vert->offset_color = scalar_intensity_to_rgba(
+        face_offset_color, param->type8.offset_intensity);
+    decode_vu(param->type8.vu, vert);
+  }
+}
+
+static vert_decode_cb scalar_decoders[] = {
+    &decode_type0,        &scalar_decode_type1, &scalar_decode_type2,
+    &decode_type3,        &decode_type4,        &scalar_decode_type5,
+    &scalar_decode_type6, &scalar_decode_type7, &scalar_decode_type8,
+};
+
+#if ARCH_X64
+
+/*
+ * sse2 implementation
+ *
+ * each color's four components are converted at once. the float -> u8
+ * conversion is clamped in the float domain and saturated by the packs, which
+ * matches float_to_u8 for all non-negative inputs. unlike float_to_u8, whose
+ * behavior is undefined for them, negative inputs are clamped to 0
+ */
+static inline __m128i sse2_scale_rgba(__m128 rgba) {
+  const __m128 max = _mm_set1_ps(255.0f);
+  return _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(rgba, max), max));
+}
+
+/* float colors are stored as argb in the vertex params */
+static inline __m128 sse2_load_argb(const float *argb) {
+  __m128 v = _mm_loadu_ps(argb);
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+static inline __m128 sse2_intensity(__m128 rgba, float intensity) {
+  return _mm_mul_ps(rgba, _mm_set_ps(1.0f, intensity, intensity, intensity));
+}
+
+static inline uint32_t sse2_pack_rgba(__m128 rgba) {
+  __m128i c = sse2_scale_rgba(rgba);
+  c = _mm_packs_epi32(c, c);
+  c = _mm_packus_epi16(c, c);
+  return (uint32_t)_mm_cvtsi128_si32(c);
+}
+
+static inline void sse2_pack_rgba2(__m128 rgba0, __m128 rgba1, uint32_t *c0,
+                                   uint32_t *c1) {
+  __m128i c = _mm_packs_epi32(sse2_scale_rgba(rgba0), sse2_scale_rgba(rgba1));
+  c = _mm_packus_epi16(c, c);
+  *c0 = (uint32_t)_mm_cvtsi128_si32(c);
+  *c1 = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(c, 4));
+}
+
+static inline void sse2_decode_type1_vert(const union vert_param *param,
+                                          struct ta_vertex *vert) {
+  decode_xyz(param, vert);
+  vert->color = sse2_pack_rgba(sse2_load_argb(&param->type1.base_color_a));
+  vert->offset_color = 0;
+  decode_no_uv(vert);
+}
+
+static inline void sse2_decode_type2_vert(const union vert_param *param,
+                                          struct ta_vertex *vert,
+                                          __m128 face_color) {
+  decode_xyz(param, vert);
+  vert->color =
+      sse2_pack_rgba(sse2_intensity(face_color, param->type2.base_intensity));
+  vert->offset_color = 0;
+  decode_no_uv(vert);
+}
+
+static inline void sse2_decode_type5_vert(const union vert_param *param,
+                                          struct ta_vertex *vert) {
+  decode_xyz(param, vert);
+  sse2_pack_rgba2(sse2_load_argb(&param->type5.base_color_a),
+                  sse2_load_argb(&param->type5.offset_color_a), &vert->color,
+                  &vert->offset_color);
+  decode_uv(param->type5.uv, vert);
+}
+
+static inline void sse2_decode_type6_vert(const union vert_param *param,
+                                          struct ta_vertex *vert) {
+  decode_xyz(param, vert);
+  sse2_pack_rgba2(sse2_load_argb(&param->type6.base_color_a),
+                  sse2_load_argb(&param->type6.offset_color_a), &vert->color,
+                  &vert->offset_color);
+  decode_vu(param->type6.vu, vert);
+}
+
+static inline void sse2_decode_type7_vert(const union vert_param *param,
+                                          struct ta_vertex *vert,
+                                          __m128 face_color,
+                                          __m128 face_offset_color) {
+  decode_xyz(param, vert);
+  sse2_pack_rgba2(
+      sse2_intensity(face_color, param->type7.base_intensity),
+      sse2_intensity(face_offset_color, param->type7.offset_intensity),
+      &vert->color, &vert->offset_color);
+  decode_uv(param->type7.uv, vert);
+}
+
+static inline void sse2_decode_type8_vert(const union vert_param *param,
+                                          struct ta_vertex *vert,
+                                          __m128 face_color,
+                                          __m128 face_offset_color) {
+  decode_xyz(param, vert);
+  sse2_pack_rgba2(
+      sse2_intensity(face_color, param->type8.base_intensity),
+      sse2_intensity(face_offset_color, param->type8.offset_intensity),
+      &vert->color, &vert->offset_color);
+  decode_vu(param->type8.vu, vert);
+}
+
+static void sse2_decode_type1(const union vert_param **params,
+                              struct ta_vertex **verts, int num_verts,
+                              const float *face_color,
+                              const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    sse2_decode_type1_vert(params[i], verts[i]);
+  }
+}
+
+static void sse2_decode_type2(const union vert_param **params,
+                              struct ta_vertex **verts, int num_verts,
+                              const float *face_color,
+                              const float *face_offset_color) {
+  __m128 fc = _mm_loadu_ps(face_color);
+  for (int i = 0; i < num_verts; i++) {
+    sse2_decode_type2_vert(params[i], verts[i], fc);
+  }
+}
+
+static void sse2_decode_type5(const union vert_param **params,
+                              struct ta_vertex **verts, int num_verts,
+                              const float *face_color,
+                              const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    sse2_decode_type5_vert(params[i], verts[i]);
+  }
+}
+
+static void sse2_decode_type6(const union vert_param **params,
+                              struct ta_vertex **verts, int num_verts,
+                              const float *face_color,
+                              const float *face_offset_color) {
+  for (int i = 0; i < num_verts; i++) {
+    sse2_decode_type6_vert(params[i], verts[i]);
+  }
+}
+
+static void sse2_decode_type7(const union vert_param **params,
+                              struct ta_vertex **verts, int num_verts,
+                              const float *face_color,
+                              const float *face_offset_color) {
+  __m128 fc = _mm_loadu_ps(face_color);
+  __m128 foc = _mm_loadu_ps(face_offset_color);
+  for (int i = 0; i < num_verts; i++) {
+    sse2_decode_type7_vert(params[i], verts[i], fc, foc);
+  }
+}
+
+static void sse2_decode_type8(const union vert_param **params,
+                              struct ta_vertex **verts, int num_verts,
+                              const float *face_color,
+                              const float *face_offset_color) {
+  __m128 fc = _mm_loadu_ps(face_color);
+  __m128 foc = _mm_loadu_ps(face_offset_color);
+  for (int i = 0; i < num_verts; i++) {
+    sse2_decode_type8_vert(params[i], verts[i], fc, foc);
+  }
+}
+
+static vert_decode_cb sse2_decoders[] = {
+    &decode_type0,      &sse2_decode_type1, &sse2_decode_type2,
+    &decode_type3,      &decode_type4,      &sse2_decode_type5,
+    &sse2_decode_type6, &sse2_decode_type7, &sse2_decode_type8,
+};
+
+/*
+ * avx2 implementation
+ *
+ * the colors for a pair of vertices are converted at once, one vertex per
+ * 128-bit lane. an odd trailing vertex is handled by the sse2 code
+ */
+TARGET_AVX2 static inline __m256i avx2_scale_rgba(__m256 rgba) {
+  const __m256 max = _mm256_set1_ps(255.0f);
+  return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(rgba, max), max));
+}
+
+TARGET_AVX2 static inline __m256 avx2_load_argb2(const float *argb0,
+                                                 const float *argb1) {
+  __m256 v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(argb0)),
+                                  _mm_loadu_ps(argb1), 1);
+  return _mm256_permute_ps(v, _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+TARGET_AVX2 static inline __m256 avx2_intensity2(__m256 rgba, float i0,
+                                                 float i1) {
+  return _mm256_mul_ps(rgba, _mm256_set_ps(1.0f, i1, i1, i1, 1.0f, i0, i0, i0));
+}
+
+/* packs one color per lane */
+TARGET_AVX2 static inline void avx2_pack_rgba(__m256 rgba, uint32_t *c0,
+                                              uint32_t *c1) {
+  __m256i c = avx2_scale_rgba(rgba);
+  c = _mm256_packs_epi32(c, c);
+  c = _mm256_packus_epi16(c, c);
+  *c0 = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(c));
+  *c1 = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(c, 1));
+}
+
+/* packs a base and offset color per lane */
+TARGET_AVX2 static inline void avx2_pack_rgba2(__m256 base, __m256 offset,
+                                               struct ta_vertex *v0,
+                                               struct ta_vertex *v1) {
+  __m256i c = _mm256_packs_epi32(avx2_scale_rgba(base), avx2_scale_rgba(offset));
+  c = _mm256_packus_epi16(c, c);
+  __m128i lo = _mm256_castsi256_si128(c);
+  __m128i hi = _mm256_extracti128_si256(c, 1);
+  v0->color = (uint32_t)_mm_cvtsi128_si32(lo);
+  v0->offset_color = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(lo, 4));
+  v1->color = (uint32_t)_mm_cvtsi128_si32(hi);
+  v1->offset_color = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(hi, 4));
+}
+
+TARGET_AVX2 static void avx2_decode_type1(const union vert_param **params,
+                                          struct ta_vertex **verts,
+                                          int num_verts,
+                                          const float *face_color,
+                                          const float *face_offset_color) {
+  int i = 0;
+  for (; i + 1 < num_verts; i += 2) {
+    const union vert_param *p0 = params[i];
+    const union vert_param *p1 = params[i + 1];
+    struct ta_vertex *v0 = verts[i];
+    struct ta_vertex *v1 = verts[i + 1];
+    decode_xyz(p0, v0);
+    decode_xyz(p1, v1);
+    avx2_pack_rgba(
+        avx2_load_argb2(&p0->type1.base_color_a, &p1->type1.base_color_a),
+        &v0->color, &v1->color);
+    v0->offset_color = 0;
+    v1->offset_color = 0;
+    decode_no_uv(v0);
+    decode_no_uv(v1);
+  }
+  if (i < num_verts) {
+    sse2_decode_type1_vert(params[i], verts[i]);
+  }
+}
+
+TARGET_AVX2 static void avx2_decode_type2(const union vert_param **params,
+                                          struct ta_vertex **verts,
+                                          int num_verts,
+                                          const float *face_color,
+                                          const float *face_offset_color) {
+  __m128 fc = _mm_loadu_ps(face_color);
+  __m256 fc2 = _mm256_insertf128_ps(_mm256_castps128_ps256(fc), fc, 1);
+  int i = 0;
+  for (; i + 1 < num_verts; i += 2) {
+    const union vert_param *p0 = params[i];
+    const union vert_param *p1 = params[i + 1];
+    struct ta_vertex *v0 = verts[i];
+    struct ta_vertex *v1 = verts[i + 1];
+    decode_xyz(p0, v0);
+    decode_xyz(p1, v1);
+    avx2_pack_rgba(avx2_intensity2(fc2, p0->type2.base_intensity,
+                                   p1->type2.base_intensity),
+                   &v0->color, &v1->color);
+    v0->offset_color = 0;
+    v1->offset_color = 0;
+    decode_no_uv(v0);
+    decode_no_uv(v1);
+  }
+  if (i < num_verts) {
+    sse2_decode_type2_vert(params[i], verts[i], fc);
+  }
+}
+
+TARGET_AVX2 static void avx2_decode_type5(const union vert_param **params,
+                                          struct ta_vertex **verts,
+                                          int num_verts,
+                                          const float *face_color,
+                                          const float *face_offset_color) {
+  int i = 0;
+  for (; i + 1 < num_verts; i += 2) {
+    const union vert_param *p0 = params[i];
+    const union vert_param *p1 = params[i + 1];
+    struct ta_vertex *v0 = verts[i];
+    struct ta_vertex *v1 = verts[i + 1];
+    decode_xyz(p0, v0);
+    decode_xyz(p1, v1);
+    avx2_pack_rgba2(
+        avx2_load_argb2(&p0->type5.base_color_a, &p1->type5.base_color_a),
+        avx2_load_argb2(&p0->type5.offset_color_a, &p1->type5.offset_color_a),
+        v0, v1);
+    decode_uv(p0->type5.uv, v0);
+    decode_uv(p1->type5.uv, v1);
+  }
+  if (i < num_verts) {
+    sse2_decode_type5_vert(params[i], verts[i]);
+  }
+}
+
+TARGET_AVX2 static void avx2_decode_type6(const union vert_param **params,
+                                          struct ta_vertex **verts,
+                                          int num_verts,
+                                          const float *face_color,
+                                          const float *face_offset_color) {
+  int i = 0;
+  for (; i + 1 < num_verts; i += 2) {
+    const union vert_param *p0 = params[i];
+    const union vert_param *p1 = params[i + 1];
+    struct ta_vertex *v0 = verts[i];
+    struct ta_vertex *v1 = verts[i + 1];
+    decode_xyz(p0, v0);
+    decode_xyz(p1, v1);
+    avx2_pack_rgba2(
+        avx2_load_argb2(&p0->type6.base_color_a, &p1->type6.base_color_a),
+        avx2_load_argb2(&p0->type6.offset_color_a, &p1->type6.offset_color_a),
+        v0, v1);
+    decode_vu(p0->type6.vu, v0);
+    decode_vu(p1->type6.vu, v1);
+  }
+  if (i < num_verts) {
+    sse2_decode_type6_vert(params[i], verts[i]);
+  }
+}
+
+TARGET_AVX2 static void avx2_decode_type7(const union vert_param **params,
+                                          struct ta_vertex **verts,
+                                          int num_verts,
+                                          const float *face_color,
+                                          const float *face_offset_color) {
+  __m128 fc = _mm_loadu_ps(face_color);
+  __m128 foc = _mm_loadu_ps(face_offset_color);
+  __m256 fc2 = _mm256_insertf128_ps(_mm256_castps128_ps256(fc), fc, 1);
+  __m256 foc2 = _mm256_insertf128_ps(_mm256_castps128_ps256(foc), foc, 1);
+  int i = 0;
+  for (; i + 1 < num_verts; i += 2) {
+    const union vert_param *p0 = params[i];
+    const union vert_param *p1 = params[i + 1];
+    struct ta_vertex *v0 = verts[i];
+    struct ta_vertex *v1 = verts[i + 1];
+    decode_xyz(p0, v0);
+    decode_xyz(p1, v1);
+    avx2_pack_rgba2(avx2_intensity2(fc2, p0->type7.base_intensity,
+                                    p1->type7.base_intensity),
+                    avx2_intensity2(foc2, p0->type7.offset_intensity,
+                                    p1->type7.offset_intensity),
+                    v0, v1);
+    decode_uv(p0->type7.uv, v0);
+    decode_uv(p1->type7.uv, v1);
+  }
+  if (i < num_verts) {
+    sse2_decode_type7_vert(params[i], verts[i], fc, foc);
+  }
+}
+
+TARGET_AVX2 static void avx2_decode_type8(const union vert_param **params,
+                                          struct ta_vertex **verts,
+                                          int num_verts,
+                                          const float *face_color,
+                                          const float *face_offset_color) {
+  __m128 fc = _mm_loadu_ps(face_color);
+  __m128 foc = _mm_loadu_ps(face_offset_color);
+  __m256 fc2 = _mm256_insertf128_ps(_mm256_castps128_ps256(fc), fc, 1);
+  __m256 foc2 = _mm256_insertf128_ps(_mm256_castps128_ps256(foc), foc, 1);
+  int i = 0;
+  for (; i + 1 < num_verts; i += 2) {
+    const union vert_param *p0 = params[i];
+    const union vert_param *p1 = params[i + 1];
+    struct ta_vertex *v0 = verts[i];
+    struct ta_vertex *v1 = verts[i + 1];
+    decode_xyz(p0, v0);
+    decode_xyz(p1, v1);
+    avx2_pack_rgba2(avx2_intensity2(fc2, p0->type8.base_intensity,
+                                    p1->type8.base_intensity),
+                    avx2_intensity2(foc2, p0->type8.offset_intensity,
+                                    p1->type8.offset_intensity),
+                    v0, v1);
+    decode_vu(p0->type8.vu, v0);
+    decode_vu(p1->type8.vu, v1);
+  }
+  if (i < num_verts) {
+    sse2_decode_type8_vert(params[i], verts[i], fc, foc);
+  }
+}
+
+static vert_decode_cb avx2_decoders[] = {
+    &decode_type0,      &avx2_decode_type1, &avx2_decode_type2,
+    &decode_type3,      &decode_type4,      &avx2_decode_type5,
+    &avx2_decode_type6, &avx2_decode_type7, &avx2_decode_type8,
+};
+
+#endif
+
+static vert_decode_cb *vert_decode_table(enum vert_decode_impl impl) {
+  switch (impl) {
+#if ARCH_X64
+    case VERT_DECODE_SSE2:
+      return sse2_decoders;
+    case VERT_DECODE_AVX2:
+      return avx2_decoders;
+#endif
+    default:
+      return scalar_decoders;
+  }
+}
+
+int vert_decode_supported(enum vert_decode_impl impl) {
+  switch (impl) {
+    case VERT_DECODE_SCALAR:
+      return 1;
+    case VERT_DECODE_SSE2:
+      return cpu_has_sse2();
+    case VERT_DECODE_AVX2:
+      return cpu_has_avx2();
+    default:
+      return 0;
+  }
+}
+
+enum vert_decode_impl vert_decode_selected() {
+  return vert_decode_impl;
+}
+
+void vert_decode_with(enum vert_decode_impl impl, int vertex_type,
+                      const union vert_param **params, struct ta_vertex **verts,
+                      int num_verts, const float *face_color,
+                      const float *face_offset_color) {
+  DCHECK(vert_decode_batched(vertex_type));
+  vert_decode_cb *decoders = vert_decode_table(impl);
+  decoders[vertex_type](params, verts, num_verts, face_color,
+                        face_offset_color);
+}
+
+void vert_decode(int vertex_type, const union vert_param **params,
+                 struct ta_vertex **verts, int num_verts,
+                 const float *face_color, const float *face_offset_color) {
+  vert_decode_with(vert_decode_impl, vertex_type, params, verts, num_verts,
+                   face_color, face_offset_color);
+}
+
+void vert_decode_init() {
+  static int initialized = 0;
+
+  if (initialized) {
+    return;
+  }
+
+  /* pick the widest implementation supported by the host */
+  for (int i = VERT_DECODE_NUM_IMPLS - 1; i >= 0; i--) {
+    if (vert_decode_supported(i)) {
+      vert_decode_impl = i;
+      break;
+    }
+  }
+
+  initialized = 1;
+}
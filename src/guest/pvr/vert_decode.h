@@ -0,0 +1,61 @@
+#ifndef VERT_DECODE_H
+#define VERT_DECODE_H
+
+#include "core/math.h"
+#include "guest/pvr/ta_types.h"
+#include "render/render_backend.h"
+
+/*
+ * decoding of polygon vertex params into ta_vertex structures
+ *
+ * runs of vertex params sharing the same vertex type are decoded together,
+ * letting the simd implementations convert the colors of multiple vertices
+ * at once. the implementation is selected at runtime based on the host cpu
+ */
+
+/* max number of vertex params decoded in a single batch */
+#define VERT_DECODE_BATCH_SIZE 64
+
+enum vert_decode_impl {
+  VERT_DECODE_SCALAR,
+  VERT_DECODE_SSE2,
+  VERT_DECODE_AVX2,
+  VERT_DECODE_NUM_IMPLS,
+};
+
+extern const char *vert_decode_names[VERT_DECODE_NUM_IMPLS];
+
+static inline uint32_t abgr_to_rgba(uint32_t v) {
+  return (v & 0xff000000) | ((v & 0xff) << 16) | (v & 0xff00) |
+         ((v & 0xff0000) >> 16);
+}
+
+static inline uint8_t float_to_u8(float x) {
+  return MIN(MAX((uint32_t)(x * 255.0f), 0u), 255u);
+}
+
+static inline uint32_t float_to_rgba(float r, float g, float b, float a) {
+  return (float_to_u8(a) << 24) | (float_to_u8(b) << 16) |
+         (float_to_u8(g) << 8) | float_to_u8(r);
+}
+
+/* returns true if vertex params of the given type can be batch decoded */
+static inline int vert_decode_batched(int vertex_type) {
+  return vertex_type >= 0 && vertex_type <= 8;
+}
+
+void vert_decode_init();
+int vert_decode_supported(enum vert_decode_impl impl);
+enum vert_decode_impl vert_decode_selected();
+
+/* face_color and face_offset_color are the rgba colors from the last global
+   param, used by the intensity vertex types */
+void vert_decode_with(enum vert_decode_impl impl, int vertex_type,
+                      const union vert_param **params, struct ta_vertex **verts,
+                      int num_verts, const float *face_color,
+                      const float *face_offset_color);
+void vert_decode(int vertex_type, const union vert_param **params,
+                 struct ta_vertex **verts, int num_verts,
+                 const float *face_color, const float *face_offset_color);
+
+#endif
@@ -60,6 +60,13 @@ void sh4_sr_updated(void *data, uint32_t old_sr) {
       (ctx->sr & BL_MASK) != (old_sr & BL_MASK)) {
     sh4_intc_update_pending(sh4);
   }
+
+  /* cached translations have been checked against the current mode. anything
+     accessible in user mode is also accessible when privileged, so they only
+     need to be dropped when returning to user mode */
+  if (sh4->mmu_enabled && (old_sr & MD_MASK) && !(ctx->sr & MD_MASK)) {
+    sh4_mmu_flush_cache(sh4);
+  }
 }
 
 void sh4_fpscr_updated(void *data, uint32_t old_fpscr) {
@@ -160,6 +167,9 @@ static int sh4_init(struct device *dev) {
     sh4->guest->offset_interrupts =
         (int)offsetof(struct sh4_context, pending_interrupts);
     sh4->guest->interrupt_check = &sh4_intc_check_pending;
+    sh4->guest->offset_exception =
+        (int)offsetof(struct sh4_context, pending_exception);
+    sh4->guest->raise_exception = &sh4_mmu_raise_exception;
 
     sh4->guest->ctx = &sh4->ctx;
     sh4->guest->mem = as_translate(sh4->memory_if->space, 0x0);
@@ -177,6 +187,9 @@ static int sh4_init(struct device *dev) {
     sh4->guest->w8 = &as_write8;
     sh4->guest->w16 = &as_write16;
     sh4->guest->w32 = &as_write32;
+    sh4->guest->tlb_mask = SH4_TLB_CACHE_SIZE - 1;
+    sh4->guest->tlb_read = &sh4_mmu_read;
+    sh4->guest->tlb_write = &sh4_mmu_write;
   }
 
   sh4->jit = jit_create("sh4", sh4->frontend, sh4->backend,
@@ -214,8 +227,7 @@ void sh4_reset(struct sh4 *sh4, uint32_t pc) {
 #undef SH4_REG
 
   /* reset tlb */
-  memset(sh4->utlb_sq_map, 0, sizeof(sh4->utlb_sq_map));
-  memset(sh4->utlb, 0, sizeof(sh4->utlb));
+  sh4_mmu_reset(sh4);
 
   /* reset interrupts */
   sh4_intc_reprioritize(sh4);
@@ -16,6 +16,9 @@ struct sh4_guest;
 
 #define SH4_CLOCK_FREQ INT64_C(200000000)
 
+/* number of entries in the direct-mapped translation cache */
+#define SH4_TLB_CACHE_SIZE 4096
+
 enum {
   SH4_DMA_FROM_ADDR,
   SH4_DMA_TO_ADDR,
@@ -36,6 +39,15 @@ struct sh4_dtr {
   int size;
 };
 
+/* EXPEVT codes for the exceptions raised by address translation */
+enum {
+  SH4_EXC_TLB_MISS_READ = 0x040,
+  SH4_EXC_TLB_MISS_WRITE = 0x060,
+  SH4_EXC_INITIAL_PAGE_WRITE = 0x080,
+  SH4_EXC_TLB_PROT_READ = 0x0a0,
+  SH4_EXC_TLB_PROT_WRITE = 0x0c0,
+};
+
 struct sh4_tlb_entry {
   union pteh hi;
   union ptel lo;
@@ -69,6 +81,15 @@ struct sh4 {
   /* mmu */
   uint32_t utlb_sq_map[64];
   struct sh4_tlb_entry utlb[64];
+  struct sh4_tlb_entry itlb[4];
+  /* translations are enabled once MMUCR.AT is set and the utlb maps something
+     other than the store queues */
+  int mmu_enabled;
+  struct jit_tlb_entry tlb_cache[SH4_TLB_CACHE_SIZE];
+  /* registers as they were when a translated access faulted. the fallback
+     handlers run the faulting instruction to completion, so these are
+     restored before entering the exception handler */
+  uint8_t fault_regs[offsetof(struct sh4_context, pending_interrupts)];
 
   /* tmu */
   struct timer *tmu_timers[3];
@@ -116,6 +137,13 @@ void sh4_intc_check_pending(void *data);
 void sh4_intc_reprioritize(struct sh4 *sh4);
 
 /* mmu */
+void sh4_mmu_reset(struct sh4 *sh4);
+void sh4_mmu_update(struct sh4 *sh4);
+void sh4_mmu_flush_cache(struct sh4 *sh4);
+void sh4_mmu_raise_exception(void *data);
+uint32_t sh4_mmu_read(void *data, uint32_t addr, uint32_t data_mask);
+void sh4_mmu_write(void *data, uint32_t addr, uint32_t value,
+                   uint32_t data_mask);
 void sh4_mmu_load_tlb(void *data);
 uint32_t sh4_mmu_itlb_read(struct sh4 *sh4, uint32_t addr, uint32_t data_mask);
 uint32_t sh4_mmu_utlb_read(struct sh4 *sh4, uint32_t addr, uint32_t data_mask);
@@ -1,3 +1,4 @@
+#include "guest/pvr/ta.h"
 #include "guest/sh4/sh4.h"
 #include "jit/jit.h"
 
@@ -58,7 +59,14 @@ void sh4_ccn_sq_prefetch(void *data, uint32_t addr) {
     dst |= addr & 0x3ffffe0;
   }
 
-  as_memcpy_to_guest(sh4->memory_if->space, dst, sh4->ctx.sq[sqi], 32);
+  /* nearly all store queue traffic is display lists being streamed to the
+     ta's polygon fifo. write these directly into the current tile context,
+     avoiding the page lookup and mmio dispatch in as_memcpy_to_guest */
+  if ((dst & 0x1f800000) == 0x10000000) {
+    ta_sq_write(sh4->ta, sh4->ctx.sq[sqi]);
+  } else {
+    as_memcpy_to_guest(sh4->memory_if->space, dst, sh4->ctx.sq[sqi], 32);
+  }
 
   PROF_LEAVE();
 }
@@ -125,9 +133,21 @@ REG_W32(sh4_cb, MMUCR) {
 
   sh4->MMUCR->full = value;
 
-  if (sh4->MMUCR->AT) {
-    LOG_WARNING("MMU not fully supported");
+  /* invalidate all utlb / itlb entries */
+  if (sh4->MMUCR->TI) {
+    for (int i = 0; i < (int)array_size(sh4->utlb); i++) {
+      sh4->utlb[i].lo.V = 0;
+    }
+    for (int i = 0; i < (int)array_size(sh4->itlb); i++) {
+      sh4->itlb[i].lo.V = 0;
+    }
+    memset(sh4->utlb_sq_map, 0, sizeof(sh4->utlb_sq_map));
   }
+
+  /* TI is write-only */
+  sh4->MMUCR->TI = 0;
+
+  sh4_mmu_update(sh4);
 }
 
 REG_W32(sh4_cb, CCR) {
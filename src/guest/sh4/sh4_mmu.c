@@ -1,4 +1,5 @@
 #include "guest/sh4/sh4.h"
+#include "jit/frontend/sh4/sh4_guest.h"
 
 #if 0
 #define LOG_MMU LOG_INFO
@@ -7,6 +8,10 @@
 #endif
 
 #define TLB_INDEX(addr) (((addr) >> 8) & 0x3f)
+#define ITLB_INDEX(addr) (((addr) >> 8) & 0x3)
+
+/* itlb data array 1 only holds PPN, V, SZ, the upper bit of PR, C and SH */
+#define ITLB_DATA_MASK 0x1ffffdda
 
 /*#define PAGE_SIZE(entry) (((entry)->lo.SZ1 << 1) | (entry)->lo.SZ0)*/
 
@@ -17,11 +22,59 @@ enum {
   PAGE_SIZE_1MB,
 };
 
+/* page size in bytes for each SZ1:SZ0 setting */
+static const uint32_t page_sizes[] = {0x400, 0x1000, 0x10000, 0x100000};
+
+static uint32_t sh4_mmu_page_size(struct sh4_tlb_entry *entry) {
+  return page_sizes[(entry->lo.SZ1 << 1) | entry->lo.SZ0];
+}
+
+static int sh4_mmu_is_sq_entry(struct sh4_tlb_entry *entry) {
+  return (entry->hi.VPN & (0xfc000000 >> 10)) == (0xe0000000 >> 10);
+}
+
+static int sh4_mmu_translates(uint32_t addr) {
+  /* p1, p2 and p4 are never translated */
+  return addr < 0x80000000 || (addr >= 0xc0000000 && addr < 0xe0000000);
+}
+
+void sh4_mmu_flush_cache(struct sh4 *sh4) {
+  for (int i = 0; i < SH4_TLB_CACHE_SIZE; i++) {
+    sh4->tlb_cache[i].tag = JIT_TLB_INVALID_TAG;
+  }
+}
+
+static void sh4_mmu_invalidate_entry(struct sh4 *sh4,
+                                     struct sh4_tlb_entry *entry) {
+  if (!entry->lo.V || sh4_mmu_is_sq_entry(entry)) {
+    return;
+  }
+
+  uint32_t size = sh4_mmu_page_size(entry);
+  uint32_t begin = (entry->hi.VPN << 10) & ~(size - 1);
+  uint32_t end = begin + size;
+
+  /* drop any cached translations for the page. entries are direct-mapped by
+     address, so the page's entries are contiguous, wrapping around at most
+     once */
+  int num_pages = MIN((int)(size >> JIT_TLB_PAGE_BITS), SH4_TLB_CACHE_SIZE);
+  for (int i = 0; i < num_pages; i++) {
+    uint32_t page = (begin >> JIT_TLB_PAGE_BITS) + i;
+    sh4->tlb_cache[page & (SH4_TLB_CACHE_SIZE - 1)].tag = JIT_TLB_INVALID_TAG;
+  }
+
+  /* blocks are compiled from virtual addresses, any compiled from the page
+     are no longer valid */
+  if (sh4->mmu_enabled) {
+    jit_invalidate_range(sh4->jit, begin, end);
+  }
+}
+
 static void sh4_mmu_utlb_sync(struct sh4 *sh4, struct sh4_tlb_entry *entry) {
   int n = entry - sh4->utlb;
 
   /* check if entry maps to sq region [0xe0000000, 0xe3ffffff] */
-  if ((entry->hi.VPN & (0xfc000000 >> 10)) == (0xe0000000 >> 10)) {
+  if (sh4_mmu_is_sq_entry(entry)) {
     /* assume page size is 1MB
        FIXME support all page sizes */
     uint32_t vpn = entry->hi.VPN >> 10;
@@ -31,17 +84,267 @@ static void sh4_mmu_utlb_sync(struct sh4 *sh4, struct sh4_tlb_entry *entry) {
 
     LOG_INFO("sh4_mmu_utlb_sync sq map (%d) 0x%x -> 0x%x", n, vpn, ppn);
   } else {
-    LOG_FATAL("sh4_mmu_utlb_sync memory mapping not supported");
+    LOG_MMU("sh4_mmu_utlb_sync (%d) 0x%08x -> 0x%08x", n, entry->hi.VPN << 10,
+            entry->lo.PPN << 10);
+
+    sh4_mmu_invalidate_entry(sh4, entry);
+  }
+
+  sh4_mmu_update(sh4);
+}
+
+static struct sh4_tlb_entry *sh4_mmu_utlb_lookup(struct sh4 *sh4,
+                                                 uint32_t addr) {
+  uint32_t asid = sh4->PTEH->ASID;
+  int privileged = sh4->MMUCR->SV && (sh4->ctx.sr & MD_MASK);
+
+  for (int i = 0; i < (int)array_size(sh4->utlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->utlb[i];
+
+    if (!entry->lo.V) {
+      continue;
+    }
+
+    /* shared pages and privileged accesses in single virtual memory mode
+       ignore the asid */
+    if (!entry->lo.SH && !privileged && entry->hi.ASID != asid) {
+      continue;
+    }
+
+    uint32_t mask = ~(sh4_mmu_page_size(entry) - 1);
+    if (((entry->hi.VPN << 10) & mask) == (addr & mask)) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static uint32_t sh4_mmu_check_access(struct sh4 *sh4,
+                                     struct sh4_tlb_entry *entry, int write) {
+  /* PR 0-3 map pages as privileged read-only, privileged read / write,
+     read-only and read / write */
+  int privileged = sh4->ctx.sr & MD_MASK;
+  int pr = entry->lo.PR;
+
+  if (!privileged && pr < 2) {
+    return write ? SH4_EXC_TLB_PROT_WRITE : SH4_EXC_TLB_PROT_READ;
+  }
+
+  if (write && !(pr & 1)) {
+    return SH4_EXC_TLB_PROT_WRITE;
+  }
+
+  if (write && !entry->lo.D) {
+    return SH4_EXC_INITIAL_PAGE_WRITE;
+  }
+
+  return 0;
+}
+
+static void sh4_mmu_fault(struct sh4 *sh4, uint32_t addr, uint32_t expevt) {
+  LOG_MMU("sh4_mmu_fault 0x%03x at 0x%08x, pc 0x%08x", expevt, addr,
+          sh4->ctx.pc);
+
+  *sh4->TEA = addr;
+  sh4->PTEH->VPN = addr >> 10;
+
+  /* the exception is raised once the faulting instruction has been abandoned.
+     the pc already points at the instruction to restart, and nothing else
+     has been written by it yet */
+  sh4->ctx.pending_exception = expevt;
+  memcpy(sh4->fault_regs, &sh4->ctx, sizeof(sh4->fault_regs));
+}
+
+static void sh4_mmu_fill_cache(struct sh4 *sh4, uint32_t addr,
+                               uint32_t paddr) {
+  void *ptr;
+  as_lookup(sh4->memory_if->space, paddr, &ptr, NULL, NULL, NULL, NULL);
+
+  /* only cache pages backed by physical memory, mmio accesses always go
+     through the slow path */
+  if (!ptr) {
+    return;
   }
+
+  uint32_t page = addr >> JIT_TLB_PAGE_BITS;
+  struct jit_tlb_entry *entry =
+      &sh4->tlb_cache[page & (SH4_TLB_CACHE_SIZE - 1)];
+  entry->tag = page;
+  entry->base = (uint8_t *)((uintptr_t)ptr - addr);
 }
 
-static void sh4_mmu_translate(struct sh4 *sh4, uint32_t addr) {}
+static int sh4_mmu_translate(struct sh4 *sh4, uint32_t addr, int write,
+                             uint32_t *paddr) {
+  /* the fallback handlers keep issuing the faulting instruction's accesses,
+     ignore them until the exception has been raised */
+  if (sh4->ctx.pending_exception) {
+    return 0;
+  }
+
+  if (!sh4->mmu_enabled || !sh4_mmu_translates(addr)) {
+    *paddr = addr;
+    sh4_mmu_fill_cache(sh4, addr, *paddr);
+    return 1;
+  }
+
+  struct sh4_tlb_entry *entry = sh4_mmu_utlb_lookup(sh4, addr);
+
+  if (!entry) {
+    sh4_mmu_fault(sh4, addr,
+                  write ? SH4_EXC_TLB_MISS_WRITE : SH4_EXC_TLB_MISS_READ);
+    return 0;
+  }
+
+  uint32_t expevt = sh4_mmu_check_access(sh4, entry, write);
+
+  if (expevt) {
+    sh4_mmu_fault(sh4, addr, expevt);
+    return 0;
+  }
+
+  uint32_t size = sh4_mmu_page_size(entry);
+  *paddr = ((entry->lo.PPN << 10) & ~(size - 1)) | (addr & (size - 1));
+
+  /* the cache is shared by reads and writes, and hits skip the checks above.
+     only cache pages which can be both read and written in the current mode */
+  if (write || !sh4_mmu_check_access(sh4, entry, 1)) {
+    sh4_mmu_fill_cache(sh4, addr, *paddr);
+  }
+
+  return 1;
+}
+
+void sh4_mmu_raise_exception(void *data) {
+  struct sh4 *sh4 = data;
+  struct sh4_context *ctx = &sh4->ctx;
+  uint32_t expevt = ctx->pending_exception;
+
+  /* undo anything the fallback handlers did after the access faulted */
+  memcpy(ctx, sh4->fault_regs, sizeof(sh4->fault_regs));
+  ctx->pending_exception = 0;
+
+  /* an exception while exceptions are blocked resets the processor */
+  if (ctx->sr & BL_MASK) {
+    LOG_FATAL("sh4_mmu_raise_exception 0x%03x while blocked, pc 0x%08x",
+              expevt, ctx->pc);
+  }
+
+  /* tlb misses have their own vector, everything else is a general
+     exception */
+  int tlb_miss =
+      expevt == SH4_EXC_TLB_MISS_READ || expevt == SH4_EXC_TLB_MISS_WRITE;
+
+  /* ensure sr is up to date */
+  sh4_implode_sr(ctx);
+
+  *sh4->EXPEVT = expevt;
+  ctx->ssr = ctx->sr;
+  ctx->spc = ctx->pc;
+  ctx->sgr = ctx->r[15];
+  ctx->sr |= (BL_MASK | MD_MASK | RB_MASK);
+  ctx->pc = ctx->vbr + (tlb_miss ? 0x400 : 0x100);
+  sh4_sr_updated(sh4, ctx->ssr);
+}
+
+uint32_t sh4_mmu_read(void *data, uint32_t addr, uint32_t data_mask) {
+  struct sh4 *sh4 = data;
+  struct address_space *space = sh4->memory_if->space;
+
+  uint32_t paddr;
+  if (!sh4_mmu_translate(sh4, addr, 0, &paddr)) {
+    return 0;
+  }
+
+  switch (DATA_SIZE()) {
+    case 1:
+      return as_read8(space, paddr);
+    case 2:
+      return as_read16(space, paddr);
+    case 4:
+      return as_read32(space, paddr);
+    default:
+      LOG_FATAL("sh4_mmu_read unexpected size");
+      return 0;
+  }
+}
+
+void sh4_mmu_write(void *data, uint32_t addr, uint32_t value,
+                   uint32_t data_mask) {
+  struct sh4 *sh4 = data;
+  struct address_space *space = sh4->memory_if->space;
+
+  uint32_t paddr;
+  if (!sh4_mmu_translate(sh4, addr, 1, &paddr)) {
+    return;
+  }
+
+  switch (DATA_SIZE()) {
+    case 1:
+      as_write8(space, paddr, (uint8_t)value);
+      break;
+    case 2:
+      as_write16(space, paddr, (uint16_t)value);
+      break;
+    case 4:
+      as_write32(space, paddr, value);
+      break;
+    default:
+      LOG_FATAL("sh4_mmu_write unexpected size");
+      break;
+  }
+}
+
+void sh4_mmu_update(struct sh4 *sh4) {
+  /* many games only enable address translation to remap the store queues,
+     which is handled separately. avoid the cost of translating every other
+     access until something else is actually mapped */
+  int enabled = 0;
+
+  if (sh4->MMUCR->AT) {
+    for (int i = 0; i < (int)array_size(sh4->utlb); i++) {
+      struct sh4_tlb_entry *entry = &sh4->utlb[i];
+
+      if (entry->lo.V && !sh4_mmu_is_sq_entry(entry)) {
+        enabled = 1;
+        break;
+      }
+    }
+  }
+
+  if (enabled == sh4->mmu_enabled) {
+    return;
+  }
+
+  LOG_INFO("sh4_mmu_update translation %s", enabled ? "enabled" : "disabled");
+
+  sh4->mmu_enabled = enabled;
+  sh4->guest->tlb = enabled ? sh4->tlb_cache : NULL;
+  sh4_mmu_flush_cache(sh4);
+
+  /* existing code was compiled for the other addressing mode */
+  jit_invalidate_blocks(sh4->jit);
+}
+
+void sh4_mmu_reset(struct sh4 *sh4) {
+  memset(sh4->utlb_sq_map, 0, sizeof(sh4->utlb_sq_map));
+  memset(sh4->utlb, 0, sizeof(sh4->utlb));
+  memset(sh4->itlb, 0, sizeof(sh4->itlb));
+
+  sh4->mmu_enabled = 0;
+  sh4->guest->tlb = NULL;
+  sh4_mmu_flush_cache(sh4);
+}
 
 void sh4_mmu_load_tlb(void *data) {
   struct sh4 *sh4 = data;
 
   uint32_t n = sh4->MMUCR->URC;
   struct sh4_tlb_entry *entry = &sh4->utlb[n];
+
+  /* invalidate whatever the entry previously mapped before replacing it */
+  sh4_mmu_invalidate_entry(sh4, entry);
+
   entry->lo = *sh4->PTEL;
   entry->hi = *sh4->PTEH;
 
@@ -49,14 +352,23 @@ void sh4_mmu_load_tlb(void *data) {
 }
 
 uint32_t sh4_mmu_itlb_read(struct sh4 *sh4, uint32_t addr, uint32_t data_mask) {
+  struct sh4_tlb_entry *entry = &sh4->itlb[ITLB_INDEX(addr)];
+
   if (addr < 0x01000000) {
     LOG_MMU("sh4_mmu_itlb_read address array %08x", addr);
+
+    uint32_t data = entry->hi.full;
+    data |= entry->lo.V << 8;
+    return data;
   } else {
-    LOG_MMU("sh4_mmu_itlb_read data array %08x", addr);
-  }
+    if (addr & 0x800000) {
+      LOG_FATAL("sh4_mmu_itlb_read data array 2 %08x", addr);
+    } else {
+      LOG_MMU("sh4_mmu_itlb_read data array 1 %08x", addr);
 
-  /* return an invalid entry */
-  return 0;
+      return entry->lo.full & ITLB_DATA_MASK;
+    }
+  }
 }
 
 uint32_t sh4_mmu_utlb_read(struct sh4 *sh4, uint32_t addr, uint32_t data_mask) {
@@ -83,13 +395,30 @@ uint32_t sh4_mmu_utlb_read(struct sh4 *sh4, uint32_t addr, uint32_t data_mask) {
 
 void sh4_mmu_itlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                         uint32_t data_mask) {
+  struct sh4_tlb_entry *entry = &sh4->itlb[ITLB_INDEX(addr)];
+
+  /* instruction fetches are translated through the utlb, which the itlb
+     caches a subset of. the arrays are only backed so they can be read back,
+     but code compiled from the pages being replaced is dropped, as software
+     writes them to force instructions to be refetched */
+  sh4_mmu_invalidate_entry(sh4, entry);
+
   if (addr < 0x01000000) {
     LOG_MMU("sh4_mmu_itlb_write address array %08x %08x", addr, data);
+
+    entry->hi.full = data & 0xfffffcff;
+    entry->lo.V = (data >> 8) & 1;
   } else {
-    LOG_MMU("sh4_mmu_itlb_write data array %08x %08x", addr, data);
+    if (addr & 0x800000) {
+      LOG_FATAL("sh4_mmu_itlb_write data array 2 %08x %08x", addr, data);
+    } else {
+      LOG_MMU("sh4_mmu_itlb_write data array 1 %08x %08x", addr, data);
+
+      entry->lo.full = data & ITLB_DATA_MASK;
+    }
   }
 
-  /* ignore */
+  sh4_mmu_invalidate_entry(sh4, entry);
 }
 
 void sh4_mmu_utlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
@@ -102,6 +431,7 @@ void sh4_mmu_utlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
       LOG_MMU("sh4_mmu_utlb_write address array %08x %08x", addr, data);
 
       struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
+      sh4_mmu_invalidate_entry(sh4, entry);
       entry->hi.full = data & 0xfffffcff;
       entry->lo.D = (data >> 9) & 1;
       entry->lo.V = (data >> 8) & 1;
@@ -115,9 +445,24 @@ void sh4_mmu_utlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
       LOG_MMU("sh4_mmu_utlb_write data array 1 %08x %08x", addr, data);
 
       struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
+      sh4_mmu_invalidate_entry(sh4, entry);
       entry->lo.full = data;
 
       sh4_mmu_utlb_sync(sh4, entry);
     }
   }
 }
+
+REG_W32(sh4_cb, PTEH) {
+  struct sh4 *sh4 = dc->sh4;
+  union pteh old = *sh4->PTEH;
+
+  sh4->PTEH->full = value;
+
+  /* cached translations and compiled code are only valid for the asid they
+     were created with */
+  if (sh4->mmu_enabled && sh4->PTEH->ASID != old.ASID) {
+    sh4_mmu_flush_cache(sh4);
+    jit_invalidate_blocks(sh4->jit);
+  }
+}
@@ -1,5 +1,6 @@
 #include <stddef.h>
 #include "host/host.h"
+#include "render/render_backend.h"
 
 /*
  * audio
@@ -13,18 +14,17 @@ void video_unbind_context(struct host *base) {}
 
 void video_bind_context(struct host *base, struct render_backend *r) {}
 
-void video_destroy_renderer(struct host *base, struct render_backend *r) {}
-
-struct render_backend *video_create_renderer_from(struct host *base,
-                                                  struct render_backend *from) {
-  return NULL;
+void video_destroy_renderer(struct host *base, struct render_backend *r) {
+  r_destroy(r);
 }
 
+/* there's no video context, so this is only usable with render backends that
+   don't need one, e.g. the null render backend */
 struct render_backend *video_create_renderer(struct host *base) {
-  return NULL;
+  return r_create(NULL);
 }
 
-int video_supports_multiple_contexts(struct host *base) {
+int video_supports_multiple_threads(struct host *base) {
   return 0;
 }
 
@@ -249,6 +249,9 @@ static video_context_t video_gl_create_context(struct sdl_host *host) {
      coordinates to OpenGL */
   SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
+  /* modifier volumes are applied with the stencil buffer */
+  SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+
   SDL_GLContext ctx = SDL_GL_CreateContext(host->win);
   CHECK_NOTNULL(ctx, "video_gl_create_context failed: %s", SDL_GetError());
 
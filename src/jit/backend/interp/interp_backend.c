@@ -15,6 +15,7 @@ static void interp_backend_run_code(struct jit_backend *base, int cycles) {
   uint32_t *pc = (uint32_t *)(ctx + guest->offset_pc);
   int32_t *run_cycles = (int32_t *)(ctx + guest->offset_cycles);
   int32_t *ran_instrs = (int32_t *)(ctx + guest->offset_instrs);
+  uint32_t *exception = (uint32_t *)(ctx + guest->offset_exception);
 
   *run_cycles = cycles;
   *ran_instrs = 0;
@@ -26,10 +27,24 @@ static void interp_backend_run_code(struct jit_backend *base, int cycles) {
 
     do {
       uint32_t addr = *pc;
-      uint32_t data = guest->r32(guest->space, addr);
+      uint32_t data = guest->tlb
+                          ? guest->tlb_read(guest->data, addr, 0xffffffff)
+                          : guest->r32(guest->space, addr);
       const struct jit_opdef *def =
           jit->frontend->lookup_op(jit->frontend, &data);
-      def->fallback(guest, addr, data);
+
+      /* with address translation enabled, the fetch or the instruction's own
+         accesses may fault. the instruction is then abandoned, and the guest's
+         exception handler entered in its place */
+      int faulted = guest->tlb && *exception;
+      if (!faulted) {
+        def->fallback(guest, addr, data);
+        faulted = guest->tlb && *exception;
+      }
+      if (faulted) {
+        guest->raise_exception(guest->data);
+      }
+
       cycles += def->cycles;
       instrs += 1;
     } while (cycles < RUN_SLICE);
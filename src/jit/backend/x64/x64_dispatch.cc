@@ -151,6 +151,19 @@ void x64_dispatch_emit_thunks(struct x64_backend *backend) {
     e.jmp(backend->dispatch_dynamic);
   }
 
+  if (jit->guest->raise_exception) {
+    /* jumped to when a translated memory access faults, abandoning the rest of
+       the block. enters the guest's exception handler, and then jumps to it
+       through the dynamic dispatch thunk */
+    e.align(32);
+
+    backend->dispatch_exception = e.getCurr<void *>();
+
+    e.mov(arg0, (uint64_t)jit->guest->data);
+    e.call(jit->guest->raise_exception);
+    e.jmp(backend->dispatch_dynamic);
+  }
+
   {
     /* entry point to the compiled x64 code. sets up the stack frame, sets up
        fixed registers (context and memory base) and then jumps to the current
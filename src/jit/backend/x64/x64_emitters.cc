@@ -59,6 +59,36 @@ enum {
 
 struct jit_emitter x64_emitters[IR_NUM_OPS];
 
+/* probe the guest's software tlb for the 32-bit address in arg1. on a hit, rax
+   is left holding the page's host base such that rax + arg1 is the host
+   address. on a miss, control is transferred to the miss label */
+static void x64_emit_tlb_probe(struct x64_backend *backend,
+                               Xbyak::CodeGenerator &e,
+                               struct jit_guest *guest, Xbyak::Label &miss) {
+  static_assert(sizeof(struct jit_tlb_entry) == 16,
+                "tlb entry size must match the index scale");
+
+  e.mov(e.eax, arg1.cvt32());
+  e.shr(e.eax, JIT_TLB_PAGE_BITS);
+  e.mov(arg0.cvt32(), e.eax);
+  e.and_(e.eax, guest->tlb_mask);
+  e.shl(e.rax, 4);
+  e.mov(arg2, (uint64_t)guest->tlb);
+  e.add(e.rax, arg2);
+  e.cmp(arg0.cvt32(), e.dword[e.rax + offsetof(struct jit_tlb_entry, tag)]);
+  e.jne(miss);
+  e.mov(e.rax, e.qword[e.rax + offsetof(struct jit_tlb_entry, base)]);
+}
+
+/* the translating tlb_read / tlb_write callbacks may fault, in which case the
+   rest of the block is abandoned in favor of the guest's exception handler */
+static void x64_emit_exception_check(struct x64_backend *backend,
+                                     Xbyak::CodeGenerator &e,
+                                     struct jit_guest *guest) {
+  e.cmp(e.dword[guestctx + guest->offset_exception], 0);
+  e.jne(backend->dispatch_exception);
+}
+
 EMITTER(SOURCE_INFO, CONSTRAINTS(NONE, IMM_I32, IMM_I32)) {
   /*uint32_t addr = ARG0->i32;*/
   int index = ARG1->i32;
@@ -96,7 +126,30 @@ EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
   Xbyak::Reg dst = RES_REG;
   struct ir_value *addr = ARG0;
 
-  if (ir_is_constant(addr)) {
+  if (guest->tlb) {
+    /* addresses are virtual, and can't be resolved at compile time even when
+       constant. probe the software tlb inline, and only call out to the
+       translating handler on a miss */
+    CHECK_NE(RES->type, VALUE_I64);
+
+    int data_size = ir_type_size(RES->type);
+    uint32_t data_mask = (1 << (data_size * 8)) - 1;
+    Xbyak::Label miss, done;
+
+    x64_backend_mov_value(backend, arg1, addr);
+    x64_emit_tlb_probe(backend, e, guest, miss);
+    x64_backend_load_mem(backend, RES, e.rax + arg1);
+    e.jmp(done);
+
+    e.L(miss);
+    e.mov(arg0, (uint64_t)guest->data);
+    e.mov(arg2, data_mask);
+    e.call((void *)guest->tlb_read);
+    x64_emit_exception_check(backend, e, guest);
+    e.mov(dst, e.rax);
+
+    e.L(done);
+  } else if (ir_is_constant(addr)) {
     /* peel away one layer of abstraction and directly access the backing
        memory or directly invoke the callback when the address is constant */
     void *ptr;
@@ -153,7 +206,27 @@ EMITTER(STORE_GUEST, CONSTRAINTS(NONE, REG_I64 | IMM_I32, VAL_ALL)) {
   struct ir_value *addr = ARG0;
   struct ir_value *data = ARG1;
 
-  if (ir_is_constant(addr)) {
+  if (guest->tlb) {
+    CHECK_NE(data->type, VALUE_I64);
+
+    int data_size = ir_type_size(data->type);
+    uint32_t data_mask = (1 << (data_size * 8)) - 1;
+    Xbyak::Label miss, done;
+
+    x64_backend_mov_value(backend, arg1, addr);
+    x64_emit_tlb_probe(backend, e, guest, miss);
+    x64_backend_store_mem(backend, e.rax + arg1, data);
+    e.jmp(done);
+
+    e.L(miss);
+    e.mov(arg0, (uint64_t)guest->data);
+    x64_backend_mov_value(backend, arg2, data);
+    e.mov(arg3, data_mask);
+    e.call((void *)guest->tlb_write);
+    x64_emit_exception_check(backend, e, guest);
+
+    e.L(done);
+  } else if (ir_is_constant(addr)) {
     /* peel away one layer of abstraction and directly access the backing
        memory or directly invoke the callback when the address is constant */
     void *ptr;
@@ -37,6 +37,7 @@ struct x64_backend {
   void *dispatch_static;
   void *dispatch_compile;
   void *dispatch_interrupt;
+  void *dispatch_exception;
   void (*dispatch_enter)(int32_t);
   void *dispatch_exit;
   void (*load_thunk[16])();
@@ -112,6 +112,8 @@ struct sh4_context {
   uint32_t fpul, mach, macl;
   uint32_t sgr, spc, ssr;
   uint64_t pending_interrupts;
+  /* EXPEVT code of a faulting translated access, waiting to be raised */
+  uint32_t pending_exception;
   uint32_t sq[2][8];
 
   /* processor sleep state */
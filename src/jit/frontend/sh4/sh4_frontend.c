@@ -25,16 +25,22 @@ static const struct jit_opdef *sh4_frontend_lookup_op(struct jit_frontend *base,
   return sh4_get_opdef(*(const uint16_t *)instr);
 }
 
+static int sh4_frontend_same_page(uint32_t addr,
+                                  const struct jit_block *block) {
+  return (addr >> JIT_TLB_PAGE_BITS) ==
+         (block->guest_addr >> JIT_TLB_PAGE_BITS);
+}
+
 static void sh4_frontend_dump_code(struct jit_frontend *base,
                                    const struct jit_block *block) {
   struct sh4_frontend *frontend = (struct sh4_frontend *)base;
-  struct jit_guest *guest = frontend->jit->guest;
+  struct sh4_guest *guest = (struct sh4_guest *)frontend->jit->guest;
 
   char buffer[128];
 
   for (int offset = 0; offset < block->guest_size; offset += 2) {
     uint32_t addr = block->guest_addr + offset;
-    uint16_t data = guest->r16(guest->space, addr);
+    uint16_t data = sh4_guest_r16(guest, addr);
     union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
 
@@ -43,7 +49,7 @@ static void sh4_frontend_dump_code(struct jit_frontend *base,
 
     if (def->flags & SH4_FLAG_DELAYED) {
       uint32_t delay_addr = addr + 2;
-      uint16_t delay_data = guest->r16(guest->space, delay_addr);
+      uint16_t delay_data = sh4_guest_r16(guest, delay_addr);
       union sh4_instr delay_instr = {delay_data};
 
       sh4_format(addr, delay_instr, buffer, sizeof(buffer));
@@ -76,7 +82,7 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
 
   for (int offset = 0; offset < block->guest_size; offset += 2) {
     uint32_t addr = block->guest_addr + offset;
-    uint16_t data = guest->r16(guest->space, addr);
+    uint16_t data = sh4_guest_r16(guest, addr);
     union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
 
@@ -130,6 +136,7 @@ static void sh4_frontend_analyze_code(struct jit_frontend *base,
                                       struct jit_block *block) {
   struct sh4_frontend *frontend = (struct sh4_frontend *)base;
   struct sh4_guest *guest = (struct sh4_guest *)frontend->jit->guest;
+  struct sh4_context *ctx = (struct sh4_context *)guest->ctx;
 
   static int IDLE_MASK = SH4_FLAG_LOAD | SH4_FLAG_COND | SH4_FLAG_CMP;
   int idle_loop = 1;
@@ -142,10 +149,28 @@ static void sh4_frontend_analyze_code(struct jit_frontend *base,
 
   while (1) {
     uint32_t addr = block->guest_addr + offset;
-    uint32_t data = guest->r16(guest->space, addr);
+
+    /* with address translation enabled, blocks don't span multiple pages. the
+       only fetches that can fault are then the first instruction and its
+       delay slot, which restart from the block's address */
+    if (guest->tlb && offset && !sh4_frontend_same_page(addr, block)) {
+      break;
+    }
+
+    uint32_t data = sh4_guest_r16(guest, addr);
     union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
 
+    /* the fetch faulted, there's nothing to compile until it's handled */
+    if (ctx->pending_exception) {
+      break;
+    }
+
+    if (guest->tlb && offset && (def->flags & SH4_FLAG_DELAYED) &&
+        !sh4_frontend_same_page(addr + 2, block)) {
+      break;
+    }
+
     offset += 2;
     block->guest_size += 2;
     block->num_cycles += def->cycles;
@@ -156,9 +181,13 @@ static void sh4_frontend_analyze_code(struct jit_frontend *base,
     all_flags |= def->flags;
 
     if (def->flags & SH4_FLAG_DELAYED) {
-      uint32_t delay_data = guest->r16(guest->space, addr + 2);
+      uint32_t delay_data = sh4_guest_r16(guest, addr + 2);
       struct jit_opdef *delay_def = sh4_get_opdef(delay_data);
 
+      if (ctx->pending_exception) {
+        break;
+      }
+
       offset += 2;
       block->guest_size += 2;
       block->num_cycles += delay_def->cycles;
@@ -6,6 +6,8 @@
 enum {
   SH4_DOUBLE_PR = 0x1,
   SH4_DOUBLE_SZ = 0x2,
+  /* the instruction being translated is in a branch's delay slot */
+  SH4_DELAY_SLOT = 0x4,
 };
 
 extern uint32_t sh4_fsca_table[];
@@ -15,6 +15,57 @@ struct sh4_guest {
   void (*fpscr_updated)(void *, uint32_t);
 };
 
+/* accessors for memory reads / writes made outside of compiled code, such as
+   instruction fetches and fallback handlers. these honor the software tlb
+   when address translation is enabled */
+static inline uint8_t sh4_guest_r8(struct sh4_guest *guest, uint32_t addr) {
+  if (guest->tlb) {
+    return (uint8_t)guest->tlb_read(guest->data, addr, 0xff);
+  }
+  return guest->r8(guest->space, addr);
+}
+
+static inline uint16_t sh4_guest_r16(struct sh4_guest *guest, uint32_t addr) {
+  if (guest->tlb) {
+    return (uint16_t)guest->tlb_read(guest->data, addr, 0xffff);
+  }
+  return guest->r16(guest->space, addr);
+}
+
+static inline uint32_t sh4_guest_r32(struct sh4_guest *guest, uint32_t addr) {
+  if (guest->tlb) {
+    return guest->tlb_read(guest->data, addr, 0xffffffff);
+  }
+  return guest->r32(guest->space, addr);
+}
+
+static inline void sh4_guest_w8(struct sh4_guest *guest, uint32_t addr,
+                                uint8_t data) {
+  if (guest->tlb) {
+    guest->tlb_write(guest->data, addr, data, 0xff);
+    return;
+  }
+  guest->w8(guest->space, addr, data);
+}
+
+static inline void sh4_guest_w16(struct sh4_guest *guest, uint32_t addr,
+                                 uint16_t data) {
+  if (guest->tlb) {
+    guest->tlb_write(guest->data, addr, data, 0xffff);
+    return;
+  }
+  guest->w16(guest->space, addr, data);
+}
+
+static inline void sh4_guest_w32(struct sh4_guest *guest, uint32_t addr,
+                                 uint32_t data) {
+  if (guest->tlb) {
+    guest->tlb_write(guest->data, addr, data, 0xffffffff);
+    return;
+  }
+  guest->w32(guest->space, addr, data);
+}
+
 static inline struct sh4_guest *sh4_guest_create() {
   return calloc(1, sizeof(struct sh4_guest));
 }
@@ -7,26 +7,50 @@
 #include "jit/ir/ir.h"
 #include "jit/jit.h"
 
-static inline int use_fastmem(struct jit_block *block, uint32_t addr) {
+static inline int use_fastmem(struct sh4_guest *guest, struct jit_block *block,
+                              uint32_t addr) {
+  /* fastmem directly accesses physical addresses, it can't be used once
+     address translation is enabled */
+  if (guest->tlb) {
+    return 0;
+  }
   int index = (addr - block->guest_addr) / 2;
   return block->fastmem[index];
 }
 
-static struct ir_value *load_guest(struct ir *ir, struct ir_value *addr,
-                                   enum ir_type type, int fastmem) {
-  if (fastmem) {
-    return ir_load_fast(ir, addr, type);
+static void store_restart_pc(struct sh4_guest *guest, struct ir *ir,
+                             uint32_t addr, int flags) {
+  /* translated accesses may raise a tlb miss or protection exception. the pc
+     must point at the instruction to restart once the exception has been
+     handled, which for a delay slot is the branch before it */
+  if (!guest->tlb) {
+    return;
+  }
+  uint32_t restart_addr = (flags & SH4_DELAY_SLOT) ? addr - 2 : addr;
+  ir_store_context(ir, offsetof(struct sh4_context, pc),
+                   ir_alloc_i32(ir, restart_addr));
+}
+
+static struct ir_value *load_guest(struct sh4_guest *guest,
+                                   struct jit_block *block, struct ir *ir,
+                                   uint32_t addr, int flags,
+                                   struct ir_value *ea, enum ir_type type) {
+  if (use_fastmem(guest, block, addr)) {
+    return ir_load_fast(ir, ea, type);
   }
-  return ir_load_guest(ir, addr, type);
+  store_restart_pc(guest, ir, addr, flags);
+  return ir_load_guest(ir, ea, type);
 }
 
-static void store_guest(struct ir *ir, struct ir_value *addr,
-                        struct ir_value *v, int fastmem) {
-  if (fastmem) {
-    ir_store_fast(ir, addr, v);
+static void store_guest(struct sh4_guest *guest, struct jit_block *block,
+                        struct ir *ir, uint32_t addr, int flags,
+                        struct ir_value *ea, struct ir_value *v) {
+  if (use_fastmem(guest, block, addr)) {
+    ir_store_fast(ir, ea, v);
     return;
   }
-  ir_store_guest(ir, addr, v);
+  store_restart_pc(guest, ir, addr, flags);
+  ir_store_guest(ir, ea, v);
 }
 
 static struct ir_value *load_sr(struct ir *ir) {
@@ -100,12 +124,13 @@ static void store_fpscr(struct sh4_guest *guest, struct ir *ir,
 #define DELAY_INSTR()               {                                                             \
                                       uint32_t delay_addr = addr + 2;                             \
                                       uint32_t delay_offset = delay_addr - block->guest_addr;     \
-                                      uint16_t delay_data = guest->r16(guest->space, delay_addr); \
+                                      uint16_t delay_data = sh4_guest_r16(guest, delay_addr);     \
                                       union sh4_instr delay_instr = {delay_data};                 \
                                       sh4_translate_cb cb = sh4_get_translator(delay_data);       \
                                       CHECK_NOTNULL(cb);                                          \
                                       ir_source_info(ir, delay_addr, delay_offset / 2);           \
-                                      cb(guest, block, ir, delay_addr, delay_instr, flags);       \
+                                      cb(guest, block, ir, delay_addr, delay_instr,               \
+                                         flags | SH4_DELAY_SLOT);                                 \
                                     }
 #define NEXT_INSTR()               
 #define NEXT_NEXT_INSTR()               
@@ -220,16 +245,16 @@ static void store_fpscr(struct sh4_guest *guest, struct ir *ir,
 #define STORE_SSR_I32(v)            STORE_CTX_I32(ssr, v)
 #define STORE_SSR_IMM_I32(v)        STORE_CTX_IMM_I32(ssr, v)
 
-#define LOAD_I8(ea)                 load_guest(ir, ea, VALUE_I8, use_fastmem(block, addr))
-#define LOAD_I16(ea)                load_guest(ir, ea, VALUE_I16, use_fastmem(block, addr))
-#define LOAD_I32(ea)                load_guest(ir, ea, VALUE_I32, use_fastmem(block, addr))
-#define LOAD_I64(ea)                load_guest(ir, ea, VALUE_I64, use_fastmem(block, addr))
+#define LOAD_I8(ea)                 load_guest(guest, block, ir, addr, flags, ea, VALUE_I8)
+#define LOAD_I16(ea)                load_guest(guest, block, ir, addr, flags, ea, VALUE_I16)
+#define LOAD_I32(ea)                load_guest(guest, block, ir, addr, flags, ea, VALUE_I32)
+#define LOAD_I64(ea)                load_guest(guest, block, ir, addr, flags, ea, VALUE_I64)
 #define LOAD_IMM_I8(ea)             LOAD_I8(ir_alloc_i32(ir, ea))
 #define LOAD_IMM_I16(ea)            LOAD_I16(ir_alloc_i32(ir, ea))
 #define LOAD_IMM_I32(ea)            LOAD_I32(ir_alloc_i32(ir, ea))
 #define LOAD_IMM_I64(ea)            LOAD_I64(ir_alloc_i32(ir, ea))
 
-#define STORE_I8(ea, v)             store_guest(ir, ea, v, use_fastmem(block, addr))
+#define STORE_I8(ea, v)             store_guest(guest, block, ir, addr, flags, ea, v)
 #define STORE_I16                   STORE_I8
 #define STORE_I32                   STORE_I8
 #define STORE_I64                   STORE_I8
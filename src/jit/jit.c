@@ -238,6 +238,39 @@ void jit_invalidate_blocks(struct jit *jit) {
   /* don't reset backend code buffers, code is still running */
 }
 
+void jit_invalidate_range(struct jit *jit, uint32_t begin, uint32_t end) {
+  /* invalidate code for each block overlapping [begin, end). like
+     jit_invalidate_blocks, this is safe to call while code is executing */
+  struct jit_block search;
+  search.guest_addr = begin;
+
+  struct rb_node *it =
+      rb_upper_bound(&jit->blocks, &search.it, &block_map_cb);
+  struct rb_node *prev = it ? rb_prev(it) : rb_last(&jit->blocks);
+
+  /* the block preceding the upper bound may start at or before begin and
+     extend into the range */
+  if (prev) {
+    struct jit_block *block = container_of(prev, struct jit_block, it);
+
+    if (block->guest_addr + block->guest_size > begin) {
+      jit_invalidate_block(jit, block, JIT_REASON_UNKNOWN);
+    }
+  }
+
+  while (it) {
+    struct jit_block *block = container_of(it, struct jit_block, it);
+
+    if (block->guest_addr >= end) {
+      break;
+    }
+
+    jit_invalidate_block(jit, block, JIT_REASON_UNKNOWN);
+
+    it = rb_next(it);
+  }
+}
+
 void jit_add_edge(struct jit *jit, void *branch, uint32_t addr) {
   struct jit_block *src = jit_lookup_block_reverse(jit, branch);
   struct jit_block *dst = jit_get_block(jit, addr);
@@ -287,6 +320,21 @@ void jit_compile_block(struct jit *jit, uint32_t guest_addr) {
   /* analyze the guest code to get its extents */
   jit->frontend->analyze_code(jit->frontend, block);
 
+  /* with address translation enabled, fetching the code may have faulted.
+     there's nothing to compile in that case, enter the guest's exception
+     handler and let the caller dispatch to it */
+  if (jit->guest->tlb) {
+    uint8_t *ctx = jit->guest->ctx;
+    uint32_t *exception = (uint32_t *)(ctx + jit->guest->offset_exception);
+
+    if (*exception) {
+      jit->guest->raise_exception(jit->guest->data);
+      free(block);
+      PROF_LEAVE();
+      return;
+    }
+  }
+
   /* allocate meta data structs for the original guest code */
   block->source_map = calloc(block->num_instrs, sizeof(void *));
   block->fastmem = calloc(block->num_instrs, sizeof(int8_t));
@@ -17,6 +17,17 @@ struct val;
 typedef uint32_t (*mem_read_cb)(void *, uint32_t, uint32_t);
 typedef void (*mem_write_cb)(void *, uint32_t, uint32_t, uint32_t);
 
+/* software tlb used by guests with virtual memory. each entry caches the
+   translation for a single page, with a hit occurring when the entry's tag
+   matches the address' page. on a hit, the host address is base + addr */
+#define JIT_TLB_PAGE_BITS 10
+#define JIT_TLB_INVALID_TAG 0xffffffff
+
+struct jit_tlb_entry {
+  uint32_t tag;
+  uint8_t *base;
+};
+
 enum {
   JIT_BRANCH_STATIC,
   JIT_BRANCH_STATIC_TRUE,
@@ -102,6 +113,13 @@ struct jit_guest {
   int offset_interrupts;
   void (*interrupt_check)(void *);
 
+  /* set by the tlb_read / tlb_write callbacks when a translated access faults.
+     the rest of the faulting instruction is abandoned, and raise_exception is
+     called to enter the guest's handler, with the context's pc pointing at
+     the instruction to restart once the handler returns */
+  int offset_exception;
+  void (*raise_exception)(void *);
+
   /* memory interface */
   void *ctx;
   void *mem;
@@ -116,6 +134,14 @@ struct jit_guest {
   void (*w16)(struct address_space *, uint32_t, uint16_t);
   void (*w32)(struct address_space *, uint32_t, uint32_t);
   void (*w64)(struct address_space *, uint32_t, uint64_t);
+
+  /* when non-null, non-constant addresses are first probed in the software
+     tlb, falling back to the translating tlb_read / tlb_write callbacks on a
+     miss. blocks must be invalidated when this is toggled */
+  struct jit_tlb_entry *tlb;
+  uint32_t tlb_mask;
+  mem_read_cb tlb_read;
+  mem_write_cb tlb_write;
 };
 
 struct jit {
@@ -158,6 +184,7 @@ void jit_compile_block(struct jit *jit, uint32_t guest_addr);
 void jit_add_edge(struct jit *jit, void *code, uint32_t dst);
 
 void jit_invalidate_blocks(struct jit *jit);
+void jit_invalidate_range(struct jit *jit, uint32_t begin, uint32_t end);
 void jit_free_blocks(struct jit *jit);
 
 #endif
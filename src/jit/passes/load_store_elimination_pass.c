@@ -141,6 +141,10 @@ static void lse_eliminate_stores(struct lse *lse, struct ir *ir,
   list_for_each_entry_safe_reverse(instr, &block->instrs, struct ir_instr, it) {
     if (instr->op == OP_FALLBACK || instr->op == OP_CALL) {
       lse_clear_available(lse);
+    } else if (instr->op == OP_LOAD_GUEST || instr->op == OP_STORE_GUEST) {
+      /* guest accesses may fault and restart from the context as it was
+         stored up to this point, so earlier stores can't be eliminated */
+      lse_clear_available(lse);
     } else if (instr->op == OP_BRANCH) {
       if (instr->arg[0]->type != VALUE_BLOCK) {
         lse_clear_available(lse);
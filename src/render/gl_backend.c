@@ -1,5 +1,6 @@
 #include <glad/glad.h>
 #include "core/assert.h"
+#include "core/math.h"
 #include "core/profiler.h"
 #include "core/string.h"
 #include "host/host.h"
@@ -8,8 +9,32 @@
 #define MAX_FRAMEBUFFERS 8
 #define MAX_TEXTURES 8192
 
+/* max number of surfaces submitted by a single glMultiDrawElements call */
+#define MAX_MULTI_DRAWS 256
+
+/* max number of modifier volume passes timed each frame */
+#define MAX_VOLUME_QUERIES 4
+
+DEFINE_COUNTER(ta_surfaces);
+DEFINE_COUNTER(ta_draws);
+DEFINE_COUNTER(ta_state_changes);
+DEFINE_COUNTER(ta_volumes);
+DEFINE_COUNTER(ta_volume_tris);
+DEFINE_COUNTER(ta_volume_time);
+
+/* surfaces mark the pixels they cover as shadowed in the stencil buffer, the
+   modifier volumes drawn after them then flip the parity of the pixels they
+   cover an odd number of times in front of the surface. after each volume,
+   its parity is folded into the modified bit and cleared for the next one */
+enum stencil_bits {
+  STENCIL_SHADOW = 0x1,
+  STENCIL_PARITY = 0x2,
+  STENCIL_MODIFIED = 0x4,
+};
+
 enum texture_map {
   MAP_DIFFUSE,
+  MAP_PALETTE,
 };
 
 enum uniform_attr {
@@ -17,11 +42,15 @@ enum uniform_attr {
   UNIFORM_DIFFUSE,
   UNIFORM_VIDEO_SCALE,
   UNIFORM_PT_ALPHA_REF,
+  UNIFORM_SHADOW_SCALE,
+  UNIFORM_PALETTE,
+  UNIFORM_PALETTE_BASE,
   UNIFORM_NUM_UNIFORMS,
 };
 
 static const char *uniform_names[] = {
-    "u_proj", "u_diffuse", "u_video_scale", "u_pt_alpha_ref",
+    "u_proj",         "u_diffuse",      "u_video_scale",  "u_pt_alpha_ref",
+    "u_shadow_scale", "u_palette",      "u_palette_base",
 };
 
 enum shader_attr {
@@ -38,7 +67,9 @@ enum shader_attr {
   ATTR_OFFSET_COLOR = 0x20,
   ATTR_PT_ALPHA_TEST = 0x40,
   ATTR_DEBUG_DEPTH_BUFFER = 0x80,
-  ATTR_COUNT = 0x100
+  ATTR_PALETTE = 0x100,
+  ATTR_PALETTE_BILINEAR = 0x200,
+  ATTR_COUNT = 0x400
 };
 
 struct shader_program {
@@ -54,11 +85,16 @@ struct shader_program {
 struct framebuffer {
   GLuint fbo;
   GLuint color_texture;
-  GLuint depth_buffer;
+  GLuint depth_stencil_buffer;
 };
 
 struct texture {
   GLuint texture;
+  /* format of the data uploaded to the texture, needed to update it */
+  GLuint internal_fmt;
+  GLuint data_fmt;
+  GLuint pixel_fmt;
+  int mipmaps;
 };
 
 #define MAX_LISTENERS 8
@@ -72,6 +108,8 @@ struct render_backend {
   /* default assets created during intitialization */
   GLuint white_texture;
   struct shader_program ta_programs[ATTR_COUNT];
+  struct shader_program volume_program;
+  struct shader_program resolve_program;
   struct shader_program ui_program;
 
   /* note, in this backend framebuffer_handle_t and texture_handle_t are the
@@ -93,6 +131,8 @@ struct render_backend {
   GLuint ta_vao;
   GLuint ta_vbo;
   GLuint ta_ibo;
+  GLuint volume_vao;
+  GLuint volume_vbo;
   GLuint ui_vao;
   GLuint ui_vbo;
   GLuint ui_ibo;
@@ -102,6 +142,26 @@ struct render_backend {
      to begin_surfaces and end_surfaces */
   uint64_t uniform_token;
   float uniform_video_scale[4];
+
+  /* state of the last ta surface drawn, redundant state changes between
+     consecutive surfaces are skipped */
+  struct ta_surface ta_state;
+  int ta_state_valid;
+  GLsizei multi_counts[MAX_MULTI_DRAWS];
+  const GLvoid *multi_offsets[MAX_MULTI_DRAWS];
+
+  /* stats for the current frame */
+  int num_ta_surfaces;
+  int num_ta_draws;
+  int num_ta_state_changes;
+  int num_ta_volumes;
+  int num_ta_volume_tris;
+
+  /* timer queries around each modifier volume pass. they're read back when
+     the next frame begins, to avoid stalling on the results */
+  GLuint volume_queries[MAX_VOLUME_QUERIES];
+  int num_volume_queries;
+  int64_t volume_time;
 };
 
 #include "render/ta.glsl"
@@ -266,9 +326,10 @@ static int r_compile_program(struct render_backend *r,
     program->loc[i] = glGetUniformLocation(program->prog, uniform_names[i]);
   }
 
-  /* bind diffuse sampler once after compile, this currently never changes */
+  /* bind samplers once after compile, these currently never change */
   glUseProgram(program->prog);
   glUniform1i(program->loc[UNIFORM_DIFFUSE], MAP_DIFFUSE);
+  glUniform1i(program->loc[UNIFORM_PALETTE], MAP_PALETTE);
   glUseProgram(0);
 
   return 1;
@@ -279,6 +340,8 @@ static void r_destroy_shaders(struct render_backend *r) {
     r_destroy_program(&r->ta_programs[i]);
   }
 
+  r_destroy_program(&r->resolve_program);
+  r_destroy_program(&r->volume_program);
   r_destroy_program(&r->ui_program);
 }
 
@@ -288,6 +351,15 @@ static void r_create_shaders(struct render_backend *r) {
   if (!r_compile_program(r, &r->ui_program, NULL, ui_vp, ui_fp)) {
     LOG_FATAL("failed to compile ui shader");
   }
+
+  if (!r_compile_program(r, &r->volume_program, NULL, ta_vp, ta_volume_fp)) {
+    LOG_FATAL("failed to compile modifier volume shader");
+  }
+
+  if (!r_compile_program(r, &r->resolve_program, NULL, ta_resolve_vp,
+                         ta_resolve_fp)) {
+    LOG_FATAL("failed to compile modifier volume resolve shader");
+  }
 }
 
 static void r_destroy_textures(struct render_backend *r) {
@@ -323,6 +395,9 @@ static void r_destroy_vertex_arrays(struct render_backend *r) {
   glDeleteBuffers(1, &r->ui_vbo);
   glDeleteVertexArrays(1, &r->ui_vao);
 
+  glDeleteBuffers(1, &r->volume_vbo);
+  glDeleteVertexArrays(1, &r->volume_vao);
+
   glDeleteBuffers(1, &r->ta_ibo);
   glDeleteBuffers(1, &r->ta_vbo);
   glDeleteVertexArrays(1, &r->ta_vao);
@@ -397,6 +472,35 @@ static void r_create_vertex_arrays(struct render_backend *r) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
   }
+
+  /* modifier volume vao */
+  {
+    glGenVertexArrays(1, &r->volume_vao);
+    glBindVertexArray(r->volume_vao);
+
+    glGenBuffers(1, &r->volume_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, r->volume_vbo);
+
+    /* xyz */
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3,
+                          (void *)0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+}
+
+static void r_destroy_queries(struct render_backend *r) {
+#if !PLATFORM_ANDROID
+  glDeleteQueries(MAX_VOLUME_QUERIES, r->volume_queries);
+#endif
+}
+
+static void r_create_queries(struct render_backend *r) {
+#if !PLATFORM_ANDROID
+  glGenQueries(MAX_VOLUME_QUERIES, r->volume_queries);
+#endif
 }
 
 static void r_set_initial_state(struct render_backend *r) {
@@ -430,6 +534,13 @@ static struct shader_program *r_get_ta_program(struct render_backend *r,
   if (surf->debug_depth) {
     idx |= ATTR_DEBUG_DEPTH_BUFFER;
   }
+  if (surf->palette) {
+    idx |= ATTR_PALETTE;
+
+    if (surf->palette_filter == FILTER_BILINEAR) {
+      idx |= ATTR_PALETTE_BILINEAR;
+    }
+  }
 
   struct shader_program *program = &r->ta_programs[idx];
 
@@ -467,6 +578,12 @@ static struct shader_program *r_get_ta_program(struct render_backend *r,
     if (idx & ATTR_DEBUG_DEPTH_BUFFER) {
       strcat(header, "#define DEBUG_DEPTH_BUFFER\n");
     }
+    if (idx & ATTR_PALETTE) {
+      strcat(header, "#define PALETTE\n");
+    }
+    if (idx & ATTR_PALETTE_BILINEAR) {
+      strcat(header, "#define PALETTE_BILINEAR\n");
+    }
 
     int res = r_compile_program(r, program, header, ta_vp, ta_fp);
     CHECK(res, "failed to compile ta shader");
@@ -475,10 +592,31 @@ static struct shader_program *r_get_ta_program(struct render_backend *r,
   return program;
 }
 
-void r_end_ta_surfaces(struct render_backend *r) {}
+static int r_ta_state_equal(const struct ta_surface *a,
+                            const struct ta_surface *b) {
+  return a->texture == b->texture && a->depth_write == b->depth_write &&
+         a->depth_func == b->depth_func && a->cull == b->cull &&
+         a->src_blend == b->src_blend && a->dst_blend == b->dst_blend &&
+         a->shade == b->shade && a->ignore_alpha == b->ignore_alpha &&
+         a->ignore_texture_alpha == b->ignore_texture_alpha &&
+         a->offset_color == b->offset_color &&
+         a->pt_alpha_test == b->pt_alpha_test &&
+         a->pt_alpha_ref == b->pt_alpha_ref &&
+         a->debug_depth == b->debug_depth && a->shadow == b->shadow &&
+         a->palette == b->palette && a->palette_base == b->palette_base &&
+         a->palette_filter == b->palette_filter;
+}
+
+static void r_bind_ta_state(struct render_backend *r,
+                            const struct ta_surface *surf) {
+  if (r->ta_state_valid && r_ta_state_equal(&r->ta_state, surf)) {
+    return;
+  }
+
+  r->ta_state = *surf;
+  r->ta_state_valid = 1;
+  r->num_ta_state_changes++;
 
-void r_draw_ta_surface(struct render_backend *r,
-                       const struct ta_surface *surf) {
   glDepthMask(!!surf->depth_write);
 
   if (surf->depth_func == DEPTH_NONE) {
@@ -502,6 +640,8 @@ void r_draw_ta_surface(struct render_backend *r,
     glBlendFunc(blend_funcs[surf->src_blend], blend_funcs[surf->dst_blend]);
   }
 
+  glStencilFunc(GL_ALWAYS, surf->shadow ? STENCIL_SHADOW : 0, 0xff);
+
   struct shader_program *program = r_get_ta_program(r, surf);
 
   glUseProgram(program->prog);
@@ -515,12 +655,167 @@ void r_draw_ta_surface(struct render_backend *r,
   /* bind non-global uniforms every time */
   glUniform1f(program->loc[UNIFORM_PT_ALPHA_REF], surf->pt_alpha_ref);
 
+  /* the palette is bound first, leaving the diffuse map's unit active */
+  if (surf->palette) {
+    glUniform1i(program->loc[UNIFORM_PALETTE_BASE], surf->palette_base);
+    r_bind_texture(r, MAP_PALETTE, surf->palette);
+  }
+
   if (surf->texture) {
     r_bind_texture(r, MAP_DIFFUSE, surf->texture);
   }
+}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  glDisable(GL_STENCIL_TEST);
+  glStencilMask(0xff);
+
+  prof_counter_set(COUNTER_ta_surfaces, r->num_ta_surfaces);
+  prof_counter_set(COUNTER_ta_draws, r->num_ta_draws);
+  prof_counter_set(COUNTER_ta_state_changes, r->num_ta_state_changes);
+  prof_counter_set(COUNTER_ta_volumes, r->num_ta_volumes);
+  prof_counter_set(COUNTER_ta_volume_tris, r->num_ta_volume_tris);
+  prof_counter_set(COUNTER_ta_volume_time, r->volume_time);
+}
+
+/* each volume is resolved on its own like the soft backend does, so
+   overlapping volumes and lists mixing inside and outside volumes modify the
+   pixels inside of (or outside of) any of them */
+void r_draw_ta_volumes(struct render_backend *r,
+                       const struct ta_volume_tri *tris, int num_tris,
+                       const struct ta_volume *volumes, int num_volumes,
+                       float shadow_scale) {
+#if !PLATFORM_ANDROID
+  int query = r->num_volume_queries < MAX_VOLUME_QUERIES;
+  if (query) {
+    glBeginQuery(GL_TIME_ELAPSED, r->volume_queries[r->num_volume_queries++]);
+  }
+#endif
+
+  glBindVertexArray(r->volume_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, r->volume_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(tris[0]) * num_tris, tris,
+               GL_DYNAMIC_DRAW);
+
+  if (r->volume_program.uniform_token != r->uniform_token) {
+    glUseProgram(r->volume_program.prog);
+    glUniform4fv(r->volume_program.loc[UNIFORM_VIDEO_SCALE], 1,
+                 r->uniform_video_scale);
+    r->volume_program.uniform_token = r->uniform_token;
+  }
+
+  glColorMask(0, 0, 0, 0);
+  glDepthMask(0);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_BLEND);
+
+  for (int i = 0; i < num_volumes; i++) {
+    const struct ta_volume *volume = &volumes[i];
+    int first = volume->first_tri * 3;
+    int count = volume->num_tris * 3;
+
+    /* flip the parity of the pixels behind each of the volume's triangles */
+    glUseProgram(r->volume_program.prog);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(depth_funcs[DEPTH_LESS]);
+    glStencilMask(STENCIL_PARITY);
+    glStencilFunc(GL_ALWAYS, 0, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+
+    glDrawArrays(GL_TRIANGLES, first, count);
+
+    glDisable(GL_DEPTH_TEST);
+
+    if (!volume->outside) {
+      /* every pixel with the parity set is covered by one of the triangles,
+         so drawing them again folds the parity into the modified bit and
+         clears it in a single pass */
+      glStencilMask(STENCIL_PARITY | STENCIL_MODIFIED);
+      glStencilFunc(GL_NOTEQUAL, STENCIL_MODIFIED, STENCIL_PARITY);
+      glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+      glDrawArrays(GL_TRIANGLES, first, count);
+      continue;
+    }
+
+    /* an outside volume modifies every pixel without the parity set, which
+       needs a full screen pass. the parity is then cleared on its own */
+    glUseProgram(r->resolve_program.prog);
+    glStencilMask(STENCIL_MODIFIED);
+    glStencilFunc(GL_EQUAL, STENCIL_MODIFIED, STENCIL_PARITY);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glStencilMask(STENCIL_PARITY);
+    glClear(GL_STENCIL_BUFFER_BIT);
+  }
+
+  /* scale the color of the shadowed pixels modified by any of the volumes */
+  glUseProgram(r->resolve_program.prog);
+  glUniform1f(r->resolve_program.loc[UNIFORM_SHADOW_SCALE], shadow_scale);
+
+  glColorMask(1, 1, 1, 1);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+  glStencilFunc(GL_EQUAL, STENCIL_SHADOW | STENCIL_MODIFIED,
+                STENCIL_SHADOW | STENCIL_MODIFIED);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  /* reset the modified bit for the next list's volumes */
+  glStencilMask(STENCIL_MODIFIED);
+  glClear(GL_STENCIL_BUFFER_BIT);
+
+#if !PLATFORM_ANDROID
+  if (query) {
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+#endif
+
+  /* restore the state for the surfaces drawn after */
+  glBindVertexArray(r->ta_vao);
+  glStencilMask(STENCIL_SHADOW);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  r->ta_state_valid = 0;
+
+  r->num_ta_volumes += num_volumes;
+  r->num_ta_volume_tris += num_tris;
+}
+
+void r_draw_ta_surfaces(struct render_backend *r,
+                        const struct ta_surface **surfs, int num_surfs) {
+  r_bind_ta_state(r, surfs[0]);
+
+  while (num_surfs > 0) {
+    int n = MIN(num_surfs, MAX_MULTI_DRAWS);
+
+    for (int i = 0; i < n; i++) {
+      const struct ta_surface *surf = surfs[i];
+      r->multi_counts[i] = surf->num_verts;
+      r->multi_offsets[i] =
+          (const GLvoid *)(intptr_t)(sizeof(uint16_t) * surf->first_vert);
+    }
+
+    glMultiDrawElements(GL_TRIANGLES, r->multi_counts, GL_UNSIGNED_SHORT,
+                        r->multi_offsets, n);
+
+    r->num_ta_surfaces += n;
+    r->num_ta_draws++;
+
+    surfs += n;
+    num_surfs -= n;
+  }
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  r_bind_ta_state(r, surf);
 
   glDrawElements(GL_TRIANGLES, surf->num_verts, GL_UNSIGNED_SHORT,
                  (void *)(intptr_t)(sizeof(uint16_t) * surf->first_vert));
+
+  r->num_ta_surfaces++;
+  r->num_ta_draws++;
 }
 
 void r_begin_ta_surfaces(struct render_backend *r, int video_width,
@@ -534,6 +829,42 @@ void r_begin_ta_surfaces(struct render_backend *r, int video_width,
   r->uniform_video_scale[2] = -2.0f / (float)video_height;
   r->uniform_video_scale[3] = 1.0f;
 
+  r->ta_state_valid = 0;
+  r->num_ta_surfaces = 0;
+  r->num_ta_draws = 0;
+  r->num_ta_state_changes = 0;
+  r->num_ta_volumes = 0;
+  r->num_ta_volume_tris = 0;
+
+#if !PLATFORM_ANDROID
+  /* sum up the volume passes of the last frame, keeping the last time if
+     they haven't finished yet */
+  if (r->num_volume_queries) {
+    GLuint available = 0;
+    glGetQueryObjectuiv(r->volume_queries[r->num_volume_queries - 1],
+                        GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (available) {
+      r->volume_time = 0;
+
+      for (int i = 0; i < r->num_volume_queries; i++) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(r->volume_queries[i], GL_QUERY_RESULT, &elapsed);
+        r->volume_time += (int64_t)elapsed;
+      }
+    }
+  } else {
+    r->volume_time = 0;
+  }
+  r->num_volume_queries = 0;
+#endif
+
+  /* surfaces only write the shadow bit, leaving the parity bit cleared for
+     the modifier volumes */
+  glEnable(GL_STENCIL_TEST);
+  glStencilMask(STENCIL_SHADOW);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
   glBindVertexArray(r->ta_vao);
 
   glBindBuffer(GL_ARRAY_BUFFER, r->ta_vbo);
@@ -645,9 +976,10 @@ void r_viewport(struct render_backend *r, int width, int height) {
   r->viewport_height = height;
 
   glDepthMask(1);
+  glStencilMask(0xff);
   glViewport(0, 0, r->viewport_width, r->viewport_height);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 }
 
 void r_destroy_sync(struct render_backend *r, sync_handle_t handle) {
@@ -687,6 +1019,31 @@ void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
   tex->texture = 0;
 }
 
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      int x, int y, int width, int height,
+                      const uint8_t *buffer) {
+  /* lookup texture entry */
+  int entry;
+  for (entry = 0; entry < MAX_TEXTURES; entry++) {
+    struct texture *tex = &r->textures[entry];
+    if (tex->texture == handle) {
+      break;
+    }
+  }
+  CHECK_LT(entry, MAX_TEXTURES);
+
+  struct texture *tex = &r->textures[entry];
+  glBindTexture(GL_TEXTURE_2D, tex->texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, tex->data_fmt,
+                  tex->pixel_fmt, buffer);
+
+  if (tex->mipmaps) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 texture_handle_t r_create_texture(struct render_backend *r,
                                   enum pxl_format format,
                                   enum filter_mode filter,
@@ -704,30 +1061,44 @@ texture_handle_t r_create_texture(struct render_backend *r,
   CHECK_LT(entry, MAX_TEXTURES);
 
   GLuint internal_fmt;
+  GLuint data_fmt;
   GLuint pixel_fmt;
   switch (format) {
     case PXL_RGBA:
       internal_fmt = GL_RGBA;
+      data_fmt = GL_RGBA;
       pixel_fmt = GL_UNSIGNED_BYTE;
       break;
     case PXL_RGBA5551:
       internal_fmt = GL_RGBA;
+      data_fmt = GL_RGBA;
       pixel_fmt = GL_UNSIGNED_SHORT_5_5_5_1;
       break;
     case PXL_RGB565:
       internal_fmt = GL_RGB;
+      data_fmt = GL_RGB;
       pixel_fmt = GL_UNSIGNED_SHORT_5_6_5;
       break;
     case PXL_RGBA4444:
       internal_fmt = GL_RGBA;
+      data_fmt = GL_RGBA;
       pixel_fmt = GL_UNSIGNED_SHORT_4_4_4_4;
       break;
+    case PXL_INDEX8:
+      internal_fmt = GL_R8;
+      data_fmt = GL_RED;
+      pixel_fmt = GL_UNSIGNED_BYTE;
+      break;
     default:
       LOG_FATAL("unexpected pixel format %d", format);
       break;
   }
 
   struct texture *tex = &r->textures[entry];
+  tex->internal_fmt = internal_fmt;
+  tex->data_fmt = data_fmt;
+  tex->pixel_fmt = pixel_fmt;
+  tex->mipmaps = mipmaps;
   glGenTextures(1, &tex->texture);
   glBindTexture(GL_TEXTURE_2D, tex->texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
@@ -735,7 +1106,7 @@ texture_handle_t r_create_texture(struct render_backend *r,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter_funcs[filter]);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_modes[wrap_u]);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_modes[wrap_v]);
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_fmt, width, height, 0, internal_fmt,
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_fmt, width, height, 0, data_fmt,
                pixel_fmt, buffer);
 
   if (mipmaps) {
@@ -764,8 +1135,8 @@ void r_destroy_framebuffer(struct render_backend *r,
   glDeleteTextures(1, &fb->color_texture);
   fb->color_texture = 0;
 
-  glDeleteRenderbuffers(1, &fb->depth_buffer);
-  fb->depth_buffer = 0;
+  glDeleteRenderbuffers(1, &fb->depth_stencil_buffer);
+  fb->depth_stencil_buffer = 0;
 
   glDeleteFramebuffers(1, &fb->fbo);
   fb->fbo = 0;
@@ -799,10 +1170,11 @@ framebuffer_handle_t r_create_framebuffer(struct render_backend *r, int width,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glBindTexture(GL_TEXTURE_2D, 0);
 
-  /* create depth component */
-  glGenRenderbuffers(1, &fb->depth_buffer);
-  glBindRenderbuffer(GL_RENDERBUFFER, fb->depth_buffer);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  /* create depth and stencil components, the stencil buffer is used to apply
+     modifier volumes */
+  glGenRenderbuffers(1, &fb->depth_stencil_buffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, fb->depth_stencil_buffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
   glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
   /* create fbo */
@@ -810,8 +1182,8 @@ framebuffer_handle_t r_create_framebuffer(struct render_backend *r, int width,
   glBindFramebuffer(GL_FRAMEBUFFER, fb->fbo);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                          fb->color_texture, 0);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                            GL_RENDERBUFFER, fb->depth_buffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, fb->depth_stencil_buffer);
 
   GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
   CHECK_EQ(status, GL_FRAMEBUFFER_COMPLETE);
@@ -835,6 +1207,7 @@ video_context_t r_context(struct render_backend *r) {
 }
 
 void r_destroy(struct render_backend *r) {
+  r_destroy_queries(r);
   r_destroy_vertex_arrays(r);
   r_destroy_shaders(r);
   r_destroy_textures(r);
@@ -850,6 +1223,7 @@ struct render_backend *r_create(video_context_t ctx) {
   r_create_textures(r);
   r_create_shaders(r);
   r_create_vertex_arrays(r);
+  r_create_queries(r);
   r_set_initial_state(r);
 
   return r;
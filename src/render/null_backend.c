@@ -0,0 +1,371 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/hash.h"
+#include "core/option.h"
+#include "core/profiler.h"
+#include "render/render_backend.h"
+
+/*
+ * render backend which doesn't render anything, used to measure emulation
+ * throughput on headless machines. each frame's ta surfaces can optionally be
+ * hashed and written to a log, so runs can be diffed to detect changes in
+ * behavior
+ */
+
+DEFINE_OPTION_STRING(frame_hashes, "",
+                     "Path to write a log of each frame's surface hashes to");
+
+#define MAX_FRAMEBUFFERS 8
+#define MAX_TEXTURES 8192
+
+DEFINE_COUNTER(ta_surfaces);
+DEFINE_COUNTER(ta_draws);
+DEFINE_COUNTER(ta_state_changes);
+DEFINE_COUNTER(ta_volumes);
+DEFINE_COUNTER(ta_volume_tris);
+DEFINE_COUNTER(ta_volume_time);
+
+struct texture {
+  int used;
+  /* hash of the texture's contents, textures are identified by their content
+     in the frame hashes as handles vary between runs */
+  uint64_t hash;
+  /* bytes per pixel of the data uploaded to the texture */
+  int bpp;
+};
+
+struct render_backend {
+  video_context_t ctx;
+  int viewport_width;
+  int viewport_height;
+
+  /* handles are indexes into these arrays offset by one, leaving zero as the
+     invalid handle */
+  struct texture textures[MAX_TEXTURES];
+  /* color texture of each framebuffer, zero if the framebuffer is unused */
+  texture_handle_t framebuffers[MAX_FRAMEBUFFERS];
+  framebuffer_handle_t framebuffer;
+
+  /* frame hashing state */
+  FILE *hash_log;
+  int frame;
+  uint64_t frame_hash;
+  const struct ta_vertex *ta_verts;
+  int ta_num_verts;
+  const uint16_t *ta_indices;
+
+  /* stats for the current frame */
+  int num_ta_surfaces;
+  int num_ta_draws;
+  int num_ta_volumes;
+  int num_ta_volume_tris;
+};
+
+/* render state of a surface as hashed, with the texture handle replaced by
+   its content hash and without the vertex range */
+struct surface_hash {
+  uint64_t texture;
+  uint64_t palette;
+  int32_t palette_base;
+  int32_t palette_filter;
+  int32_t depth_write;
+  int32_t depth_func;
+  int32_t cull;
+  int32_t src_blend;
+  int32_t dst_blend;
+  int32_t shade;
+  int32_t ignore_alpha;
+  int32_t ignore_texture_alpha;
+  int32_t offset_color;
+  int32_t pt_alpha_test;
+  float pt_alpha_ref;
+  int32_t debug_depth;
+  int32_t shadow;
+  int32_t num_verts;
+};
+
+static void r_hash_ta_surface(struct render_backend *r,
+                              const struct ta_surface *surf) {
+  struct surface_hash desc;
+  memset(&desc, 0, sizeof(desc));
+
+  if (surf->texture) {
+    CHECK(surf->texture <= MAX_TEXTURES);
+    desc.texture = r->textures[surf->texture - 1].hash;
+  }
+  if (surf->palette) {
+    CHECK(surf->palette <= MAX_TEXTURES);
+    desc.palette = r->textures[surf->palette - 1].hash;
+    desc.palette_base = surf->palette_base;
+    desc.palette_filter = surf->palette_filter;
+  }
+  desc.depth_write = surf->depth_write;
+  desc.depth_func = surf->depth_func;
+  desc.cull = surf->cull;
+  desc.src_blend = surf->src_blend;
+  desc.dst_blend = surf->dst_blend;
+  desc.shade = surf->shade;
+  desc.ignore_alpha = surf->ignore_alpha;
+  desc.ignore_texture_alpha = surf->ignore_texture_alpha;
+  desc.offset_color = surf->offset_color;
+  desc.pt_alpha_test = surf->pt_alpha_test;
+  desc.pt_alpha_ref = surf->pt_alpha_ref;
+  desc.debug_depth = surf->debug_depth;
+  desc.shadow = surf->shadow;
+  desc.num_verts = surf->num_verts;
+
+  uint64_t hash = hash64(&desc, sizeof(desc), r->frame_hash);
+
+  /* hash the vertices referenced rather than the indices, so changes to how
+     the vertices are laid out don't change the hash */
+  for (int i = 0; i < surf->num_verts; i++) {
+    int idx = r->ta_indices[surf->first_vert + i];
+    CHECK_LT(idx, r->ta_num_verts);
+    hash = hash64(&r->ta_verts[idx], sizeof(struct ta_vertex), hash);
+  }
+
+  r->frame_hash = hash;
+}
+
+void r_end_ui_surfaces(struct render_backend *r) {}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  if (r->hash_log) {
+    fprintf(r->hash_log, "%d %d %016" PRIx64 "\n", r->frame,
+            r->num_ta_surfaces, r->frame_hash);
+  }
+
+  r->frame++;
+
+  prof_counter_set(COUNTER_ta_surfaces, r->num_ta_surfaces);
+  prof_counter_set(COUNTER_ta_draws, r->num_ta_draws);
+  prof_counter_set(COUNTER_ta_state_changes, 0);
+  prof_counter_set(COUNTER_ta_volumes, r->num_ta_volumes);
+  prof_counter_set(COUNTER_ta_volume_tris, r->num_ta_volume_tris);
+  prof_counter_set(COUNTER_ta_volume_time, 0);
+}
+
+void r_draw_ta_volumes(struct render_backend *r,
+                       const struct ta_volume_tri *tris, int num_tris,
+                       const struct ta_volume *volumes, int num_volumes,
+                       float shadow_scale) {
+  if (r->hash_log) {
+    uint64_t hash = hash64(&shadow_scale, sizeof(shadow_scale), r->frame_hash);
+    hash = hash64(volumes, num_volumes * sizeof(volumes[0]), hash);
+    hash = hash64(tris, num_tris * sizeof(tris[0]), hash);
+    r->frame_hash = hash;
+  }
+
+  r->num_ta_volumes += num_volumes;
+  r->num_ta_volume_tris += num_tris;
+}
+
+void r_draw_ta_surfaces(struct render_backend *r,
+                        const struct ta_surface **surfs, int num_surfs) {
+  if (r->hash_log) {
+    for (int i = 0; i < num_surfs; i++) {
+      r_hash_ta_surface(r, surfs[i]);
+    }
+  }
+
+  r->num_ta_surfaces += num_surfs;
+  r->num_ta_draws++;
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  if (r->hash_log) {
+    r_hash_ta_surface(r, surf);
+  }
+
+  r->num_ta_surfaces++;
+  r->num_ta_draws++;
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const uint16_t *indices,
+                         int num_indices) {
+  r->ta_verts = verts;
+  r->ta_num_verts = num_verts;
+  r->ta_indices = indices;
+  r->num_ta_surfaces = 0;
+  r->num_ta_draws = 0;
+  r->num_ta_volumes = 0;
+  r->num_ta_volume_tris = 0;
+
+  /* the video dimensions affect how the frame is projected */
+  int dims[2] = {video_width, video_height};
+  r->frame_hash = hash64(dims, sizeof(dims), 0);
+}
+
+int r_viewport_height(struct render_backend *r) {
+  return r->viewport_height;
+}
+
+int r_viewport_width(struct render_backend *r) {
+  return r->viewport_width;
+}
+
+void r_viewport(struct render_backend *r, int width, int height) {
+  r->viewport_width = width;
+  r->viewport_height = height;
+}
+
+void r_destroy_sync(struct render_backend *r, sync_handle_t handle) {}
+
+void r_wait_sync(struct render_backend *r, sync_handle_t handle) {}
+
+sync_handle_t r_insert_sync(struct render_backend *r) {
+  /* nothing is ever pending, return a non-null handle to satisfy the
+     caller */
+  return r;
+}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  CHECK(handle && handle <= MAX_TEXTURES);
+
+  struct texture *tex = &r->textures[handle - 1];
+  CHECK(tex->used);
+
+  memset(tex, 0, sizeof(*tex));
+}
+
+static int r_pixel_size(enum pxl_format format) {
+  switch (format) {
+    case PXL_RGBA:
+      return 4;
+    case PXL_INDEX8:
+      return 1;
+    default:
+      return 2;
+  }
+}
+
+static texture_handle_t r_alloc_texture(struct render_backend *r,
+                                        uint64_t hash) {
+  /* find next open texture entry */
+  int entry;
+  for (entry = 0; entry < MAX_TEXTURES; entry++) {
+    struct texture *tex = &r->textures[entry];
+    if (!tex->used) {
+      break;
+    }
+  }
+  CHECK_LT(entry, MAX_TEXTURES);
+
+  struct texture *tex = &r->textures[entry];
+  tex->used = 1;
+  tex->hash = hash;
+
+  return entry + 1;
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  uint64_t hash = 0;
+
+  if (r->hash_log) {
+    int desc[7] = {format, filter, wrap_u, wrap_v, mipmaps, width, height};
+
+    hash = hash64(desc, sizeof(desc), 0);
+    hash = hash64(buffer, width * height * r_pixel_size(format), hash);
+  }
+
+  texture_handle_t handle = r_alloc_texture(r, hash);
+  r->textures[handle - 1].bpp = r_pixel_size(format);
+  return handle;
+}
+
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      int x, int y, int width, int height,
+                      const uint8_t *buffer) {
+  CHECK(handle && handle <= MAX_TEXTURES);
+
+  struct texture *tex = &r->textures[handle - 1];
+  CHECK(tex->used);
+
+  /* chain the updated region onto the texture's existing hash */
+  if (r->hash_log) {
+    int desc[4] = {x, y, width, height};
+
+    tex->hash = hash64(desc, sizeof(desc), tex->hash);
+    tex->hash = hash64(buffer, width * height * tex->bpp, tex->hash);
+  }
+}
+
+void r_destroy_framebuffer(struct render_backend *r,
+                           framebuffer_handle_t handle) {
+  CHECK(handle && handle <= MAX_FRAMEBUFFERS);
+  CHECK(r->framebuffers[handle - 1]);
+
+  r_destroy_texture(r, r->framebuffers[handle - 1]);
+  r->framebuffers[handle - 1] = 0;
+}
+
+void r_bind_framebuffer(struct render_backend *r, framebuffer_handle_t handle) {
+  r->framebuffer = handle;
+}
+
+framebuffer_handle_t r_create_framebuffer(struct render_backend *r, int width,
+                                          int height,
+                                          texture_handle_t *color_texture) {
+  /* find next open framebuffer handle */
+  int entry;
+  for (entry = 0; entry < MAX_FRAMEBUFFERS; entry++) {
+    if (!r->framebuffers[entry]) {
+      break;
+    }
+  }
+  CHECK_LT(entry, MAX_FRAMEBUFFERS);
+
+  /* the color texture is never sampled by the ta surfaces, so it's left
+     without a content hash */
+  r->framebuffers[entry] = r_alloc_texture(r, 0);
+  *color_texture = r->framebuffers[entry];
+
+  return entry + 1;
+}
+
+framebuffer_handle_t r_get_framebuffer(struct render_backend *r) {
+  return r->framebuffer;
+}
+
+video_context_t r_context(struct render_backend *r) {
+  return r->ctx;
+}
+
+void r_destroy(struct render_backend *r) {
+  if (r->hash_log) {
+    fclose(r->hash_log);
+  }
+
+  free(r);
+}
+
+struct render_backend *r_create(video_context_t ctx) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->ctx = ctx;
+
+  if (OPTION_frame_hashes[0]) {
+    r->hash_log = fopen(OPTION_frame_hashes, "w");
+    CHECK_NOTNULL(r->hash_log, "failed to open %s", OPTION_frame_hashes);
+  }
+
+  return r;
+}
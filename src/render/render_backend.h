@@ -2,6 +2,8 @@
 #define RENDER_BACKEND_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include "core/profiler.h"
 
 struct host;
 
@@ -16,6 +18,9 @@ enum pxl_format {
   PXL_RGBA5551,
   PXL_RGB565,
   PXL_RGBA4444,
+  /* 8-bit palette indices, looked up in a palette texture by the surfaces
+     sampling them */
+  PXL_INDEX8,
 };
 
 enum filter_mode {
@@ -100,11 +105,32 @@ struct ta_surface {
   int pt_alpha_test;
   float pt_alpha_ref;
   int debug_depth;
+  /* modified by the modifier volumes covering it */
+  int shadow;
+  /* set when the texture holds palette indices. they're looked up in the
+     palette texture starting at palette_base, and filtered after the lookup
+     with palette_filter */
+  texture_handle_t palette;
+  int palette_base;
+  enum filter_mode palette_filter;
 
   int first_vert;
   int num_verts;
 };
 
+/* modifier volume triangle, only its position is needed */
+struct ta_volume_tri {
+  float xyz[3][3];
+};
+
+/* modifier volumes are closed meshes, modifying the surfaces inside of them,
+   or the surfaces outside of them for outside volumes */
+struct ta_volume {
+  int outside;
+  int first_tri;
+  int num_tris;
+};
+
 struct ui_vertex {
   float xy[2];
   float uv[2];
@@ -125,6 +151,18 @@ struct ui_surface {
 
 struct render_backend;
 
+/* per-frame stats for the ta surfaces, surfaces is the number of surfaces
+   drawn, which may be submitted together by fewer draw calls */
+DECLARE_COUNTER(ta_surfaces);
+DECLARE_COUNTER(ta_draws);
+DECLARE_COUNTER(ta_state_changes);
+
+/* per-frame stats for the modifier volumes, the time is that spent applying
+   them to the surfaces */
+DECLARE_COUNTER(ta_volumes);
+DECLARE_COUNTER(ta_volume_tris);
+DECLARE_COUNTER(ta_volume_time);
+
 struct render_backend *r_create(video_context_t ctx);
 void r_destroy(struct render_backend *r);
 
@@ -144,6 +182,11 @@ texture_handle_t r_create_texture(struct render_backend *r,
                                   enum wrap_mode wrap_u, enum wrap_mode wrap_v,
                                   int mipmaps, int width, int height,
                                   const uint8_t *buffer);
+/* update a region of a texture's base level. the buffer is in the format the
+   texture was created with */
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      int x, int y, int width, int height,
+                      const uint8_t *buffer);
 void r_destroy_texture(struct render_backend *r, texture_handle_t handle);
 
 sync_handle_t r_insert_sync(struct render_backend *r);
@@ -159,6 +202,16 @@ void r_begin_ta_surfaces(struct render_backend *r, int video_width,
                          int num_verts, const uint16_t *indices,
                          int num_indices);
 void r_draw_ta_surface(struct render_backend *r, const struct ta_surface *surf);
+/* draw multiple surfaces sharing the same state with a single draw call */
+void r_draw_ta_surfaces(struct render_backend *r,
+                        const struct ta_surface **surfs, int num_surfs);
+/* apply a list's modifier volumes to the surfaces drawn so far. the triangles
+   of every volume are drawn at once, followed by a single pass scaling the
+   color of each pixel modified by a volume whose surface has shadow set */
+void r_draw_ta_volumes(struct render_backend *r,
+                       const struct ta_volume_tri *tris, int num_tris,
+                       const struct ta_volume *volumes, int num_volumes,
+                       float shadow_scale);
 void r_end_ta_surfaces(struct render_backend *r);
 
 void r_begin_ui_surfaces(struct render_backend *r,
@@ -167,4 +220,55 @@ void r_begin_ui_surfaces(struct render_backend *r,
 void r_draw_ui_surface(struct render_backend *r, const struct ui_surface *surf);
 void r_end_ui_surfaces(struct render_backend *r);
 
+/*
+ * command buffers. the drawing calls can be recorded to a command buffer on
+ * any thread, without the video context being bound, and then replayed
+ * against the backend by the thread the context is bound to. any data passed
+ * to a call is copied into the buffer. resources are still created and
+ * destroyed directly through the backend, as their handles are needed as
+ * soon as they're created
+ */
+struct r_cmdbuf;
+
+typedef texture_handle_t (*r_remap_texture_cb)(void *, texture_handle_t);
+
+struct r_cmdbuf *r_create_cmdbuf();
+void r_destroy_cmdbuf(struct r_cmdbuf *cb);
+
+void r_reset_cmdbuf(struct r_cmdbuf *cb);
+int r_cmdbuf_size(const struct r_cmdbuf *cb);
+
+/* command buffers are serialized as-is, they can only be read back by a build
+   for the same architecture. the texture handles they reference are only
+   meaningful to the backend they were recorded for, and must be remapped
+   before being replayed elsewhere */
+void r_write_cmdbuf(const struct r_cmdbuf *cb, FILE *fp);
+int r_read_cmdbuf(struct r_cmdbuf *cb, FILE *fp);
+void r_remap_cmdbuf_textures(struct r_cmdbuf *cb, r_remap_texture_cb remap,
+                             void *userdata);
+
+void r_replay_cmdbuf(struct render_backend *r, struct r_cmdbuf *cb);
+
+void r_cmd_bind_framebuffer(struct r_cmdbuf *cb, framebuffer_handle_t handle);
+void r_cmd_viewport(struct r_cmdbuf *cb, int width, int height);
+
+void r_cmd_begin_ta_surfaces(struct r_cmdbuf *cb, int video_width,
+                             int video_height, const struct ta_vertex *verts,
+                             int num_verts, const uint16_t *indices,
+                             int num_indices);
+void r_cmd_draw_ta_surface(struct r_cmdbuf *cb, const struct ta_surface *surf);
+void r_cmd_draw_ta_surfaces(struct r_cmdbuf *cb,
+                            const struct ta_surface **surfs, int num_surfs);
+void r_cmd_draw_ta_volumes(struct r_cmdbuf *cb,
+                           const struct ta_volume_tri *tris, int num_tris,
+                           const struct ta_volume *volumes, int num_volumes,
+                           float shadow_scale);
+void r_cmd_end_ta_surfaces(struct r_cmdbuf *cb);
+
+void r_cmd_begin_ui_surfaces(struct r_cmdbuf *cb,
+                             const struct ui_vertex *verts, int num_verts,
+                             const uint16_t *indices, int num_indices);
+void r_cmd_draw_ui_surface(struct r_cmdbuf *cb, const struct ui_surface *surf);
+void r_cmd_end_ui_surfaces(struct r_cmdbuf *cb);
+
 #endif
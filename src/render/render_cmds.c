@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/math.h"
+#include "render/render_backend.h"
+
+/*
+ * command buffer implementation, shared by each backend. commands are stored
+ * back to back as a header followed by their payload. any data referenced by
+ * a call is copied into the payload, so a buffer doesn't depend on the
+ * recording thread's state once recorded
+ */
+
+#define CMDBUF_MAGIC 0x444d4352 /* RCMD */
+#define CMDBUF_VERSION 3
+
+/* payloads are aligned such that the vertices and surfaces they contain can
+   be passed to the backend in place */
+#define CMD_ALIGN 8
+
+enum r_cmd_type {
+  CMD_BIND_FRAMEBUFFER,
+  CMD_VIEWPORT,
+  CMD_BEGIN_TA_SURFACES,
+  CMD_DRAW_TA_SURFACE,
+  CMD_DRAW_TA_SURFACES,
+  CMD_DRAW_TA_VOLUMES,
+  CMD_END_TA_SURFACES,
+  CMD_BEGIN_UI_SURFACES,
+  CMD_DRAW_UI_SURFACE,
+  CMD_END_UI_SURFACES,
+};
+
+struct r_cmd {
+  uint32_t type;
+  /* size of the aligned payload following the header */
+  uint32_t size;
+};
+
+struct r_cmd_viewport {
+  int32_t width;
+  int32_t height;
+};
+
+/* followed by the vertices and then the indices */
+struct r_cmd_begin_ta {
+  int32_t video_width;
+  int32_t video_height;
+  int32_t num_verts;
+  int32_t num_indices;
+};
+
+/* followed by the surfaces */
+struct r_cmd_draw_ta {
+  int32_t num_surfs;
+  int32_t padding;
+};
+
+/* followed by the triangles and then the volumes */
+struct r_cmd_draw_volumes {
+  int32_t num_tris;
+  int32_t num_volumes;
+  float shadow_scale;
+  int32_t padding;
+};
+
+/* followed by the vertices and then the indices */
+struct r_cmd_begin_ui {
+  int32_t num_verts;
+  int32_t num_indices;
+};
+
+struct r_cmdbuf_header {
+  uint32_t magic;
+  uint32_t version;
+  int32_t size;
+  int32_t padding;
+};
+
+struct r_cmdbuf {
+  uint8_t *data;
+  int size;
+  int capacity;
+
+  /* scratch space for the surface pointers passed to r_draw_ta_surfaces */
+  const struct ta_surface **draws;
+  int max_draws;
+};
+
+static void r_reserve_cmdbuf(struct r_cmdbuf *cb, int size) {
+  if (size <= cb->capacity) {
+    return;
+  }
+
+  int capacity = MAX(cb->capacity * 2, 4096);
+  while (capacity < size) {
+    capacity *= 2;
+  }
+
+  cb->data = realloc(cb->data, capacity);
+  CHECK_NOTNULL(cb->data);
+  cb->capacity = capacity;
+}
+
+static void *r_push_cmd(struct r_cmdbuf *cb, enum r_cmd_type type, int size) {
+  size = align_up(size, CMD_ALIGN);
+
+  r_reserve_cmdbuf(cb, cb->size + (int)sizeof(struct r_cmd) + size);
+
+  struct r_cmd *cmd = (struct r_cmd *)(cb->data + cb->size);
+  cmd->type = type;
+  cmd->size = size;
+  cb->size += sizeof(struct r_cmd) + size;
+
+  return cmd + 1;
+}
+
+void r_cmd_end_ui_surfaces(struct r_cmdbuf *cb) {
+  r_push_cmd(cb, CMD_END_UI_SURFACES, 0);
+}
+
+void r_cmd_draw_ui_surface(struct r_cmdbuf *cb,
+                           const struct ui_surface *surf) {
+  struct ui_surface *payload =
+      r_push_cmd(cb, CMD_DRAW_UI_SURFACE, sizeof(*surf));
+  *payload = *surf;
+}
+
+void r_cmd_begin_ui_surfaces(struct r_cmdbuf *cb,
+                             const struct ui_vertex *verts, int num_verts,
+                             const uint16_t *indices, int num_indices) {
+  int verts_size = align_up(num_verts * (int)sizeof(*verts), CMD_ALIGN);
+  int indices_size = num_indices * (int)sizeof(*indices);
+
+  struct r_cmd_begin_ui *payload =
+      r_push_cmd(cb, CMD_BEGIN_UI_SURFACES,
+                 sizeof(*payload) + verts_size + indices_size);
+  payload->num_verts = num_verts;
+  payload->num_indices = indices ? num_indices : 0;
+
+  uint8_t *ptr = (uint8_t *)(payload + 1);
+  memcpy(ptr, verts, num_verts * sizeof(*verts));
+  if (indices) {
+    memcpy(ptr + verts_size, indices, indices_size);
+  }
+}
+
+void r_cmd_end_ta_surfaces(struct r_cmdbuf *cb) {
+  r_push_cmd(cb, CMD_END_TA_SURFACES, 0);
+}
+
+void r_cmd_draw_ta_volumes(struct r_cmdbuf *cb,
+                           const struct ta_volume_tri *tris, int num_tris,
+                           const struct ta_volume *volumes, int num_volumes,
+                           float shadow_scale) {
+  int tris_size = align_up(num_tris * (int)sizeof(*tris), CMD_ALIGN);
+  int volumes_size = num_volumes * (int)sizeof(*volumes);
+
+  struct r_cmd_draw_volumes *payload =
+      r_push_cmd(cb, CMD_DRAW_TA_VOLUMES,
+                 sizeof(*payload) + tris_size + volumes_size);
+  payload->num_tris = num_tris;
+  payload->num_volumes = num_volumes;
+  payload->shadow_scale = shadow_scale;
+  payload->padding = 0;
+
+  uint8_t *ptr = (uint8_t *)(payload + 1);
+  memcpy(ptr, tris, num_tris * sizeof(*tris));
+  memcpy(ptr + tris_size, volumes, volumes_size);
+}
+
+void r_cmd_draw_ta_surfaces(struct r_cmdbuf *cb,
+                            const struct ta_surface **surfs, int num_surfs) {
+  struct r_cmd_draw_ta *payload =
+      r_push_cmd(cb, CMD_DRAW_TA_SURFACES,
+                 sizeof(*payload) + num_surfs * sizeof(struct ta_surface));
+  payload->num_surfs = num_surfs;
+  payload->padding = 0;
+
+  struct ta_surface *dst = (struct ta_surface *)(payload + 1);
+  for (int i = 0; i < num_surfs; i++) {
+    dst[i] = *surfs[i];
+  }
+}
+
+void r_cmd_draw_ta_surface(struct r_cmdbuf *cb,
+                           const struct ta_surface *surf) {
+  struct ta_surface *payload =
+      r_push_cmd(cb, CMD_DRAW_TA_SURFACE, sizeof(*surf));
+  *payload = *surf;
+}
+
+void r_cmd_begin_ta_surfaces(struct r_cmdbuf *cb, int video_width,
+                             int video_height, const struct ta_vertex *verts,
+                             int num_verts, const uint16_t *indices,
+                             int num_indices) {
+  int verts_size = align_up(num_verts * (int)sizeof(*verts), CMD_ALIGN);
+  int indices_size = num_indices * (int)sizeof(*indices);
+
+  struct r_cmd_begin_ta *payload =
+      r_push_cmd(cb, CMD_BEGIN_TA_SURFACES,
+                 sizeof(*payload) + verts_size + indices_size);
+  payload->video_width = video_width;
+  payload->video_height = video_height;
+  payload->num_verts = num_verts;
+  payload->num_indices = num_indices;
+
+  uint8_t *ptr = (uint8_t *)(payload + 1);
+  memcpy(ptr, verts, num_verts * sizeof(*verts));
+  memcpy(ptr + verts_size, indices, indices_size);
+}
+
+void r_cmd_viewport(struct r_cmdbuf *cb, int width, int height) {
+  struct r_cmd_viewport *payload =
+      r_push_cmd(cb, CMD_VIEWPORT, sizeof(*payload));
+  payload->width = width;
+  payload->height = height;
+}
+
+void r_cmd_bind_framebuffer(struct r_cmdbuf *cb, framebuffer_handle_t handle) {
+  framebuffer_handle_t *payload =
+      r_push_cmd(cb, CMD_BIND_FRAMEBUFFER, sizeof(*payload));
+  *payload = handle;
+}
+
+static void r_replay_draw_ta_surfaces(struct render_backend *r,
+                                      struct r_cmdbuf *cb,
+                                      const struct r_cmd_draw_ta *payload) {
+  const struct ta_surface *surfs = (const struct ta_surface *)(payload + 1);
+  int num_surfs = payload->num_surfs;
+
+  if (num_surfs > cb->max_draws) {
+    cb->max_draws = MAX(num_surfs, cb->max_draws * 2);
+    cb->draws = realloc(cb->draws, cb->max_draws * sizeof(cb->draws[0]));
+    CHECK_NOTNULL(cb->draws);
+  }
+
+  for (int i = 0; i < num_surfs; i++) {
+    cb->draws[i] = &surfs[i];
+  }
+
+  r_draw_ta_surfaces(r, cb->draws, num_surfs);
+}
+
+void r_replay_cmdbuf(struct render_backend *r, struct r_cmdbuf *cb) {
+  const uint8_t *ptr = cb->data;
+  const uint8_t *end = cb->data + cb->size;
+
+  while (ptr < end) {
+    const struct r_cmd *cmd = (const struct r_cmd *)ptr;
+    const void *payload = cmd + 1;
+
+    switch (cmd->type) {
+      case CMD_BIND_FRAMEBUFFER: {
+        r_bind_framebuffer(r, *(const framebuffer_handle_t *)payload);
+      } break;
+
+      case CMD_VIEWPORT: {
+        const struct r_cmd_viewport *viewport = payload;
+        r_viewport(r, viewport->width, viewport->height);
+      } break;
+
+      case CMD_BEGIN_TA_SURFACES: {
+        const struct r_cmd_begin_ta *begin = payload;
+        const uint8_t *verts = (const uint8_t *)(begin + 1);
+        const uint8_t *indices =
+            verts +
+            align_up(begin->num_verts * (int)sizeof(struct ta_vertex),
+                     CMD_ALIGN);
+        r_begin_ta_surfaces(r, begin->video_width, begin->video_height,
+                            (const struct ta_vertex *)verts, begin->num_verts,
+                            (const uint16_t *)indices, begin->num_indices);
+      } break;
+
+      case CMD_DRAW_TA_SURFACE: {
+        r_draw_ta_surface(r, payload);
+      } break;
+
+      case CMD_DRAW_TA_SURFACES: {
+        r_replay_draw_ta_surfaces(r, cb, payload);
+      } break;
+
+      case CMD_DRAW_TA_VOLUMES: {
+        const struct r_cmd_draw_volumes *draw = payload;
+        const uint8_t *tris = (const uint8_t *)(draw + 1);
+        const uint8_t *volumes =
+            tris +
+            align_up(draw->num_tris * (int)sizeof(struct ta_volume_tri),
+                     CMD_ALIGN);
+        r_draw_ta_volumes(r, (const struct ta_volume_tri *)tris,
+                          draw->num_tris, (const struct ta_volume *)volumes,
+                          draw->num_volumes, draw->shadow_scale);
+      } break;
+
+      case CMD_END_TA_SURFACES: {
+        r_end_ta_surfaces(r);
+      } break;
+
+      case CMD_BEGIN_UI_SURFACES: {
+        const struct r_cmd_begin_ui *begin = payload;
+        const uint8_t *verts = (const uint8_t *)(begin + 1);
+        const uint8_t *indices =
+            verts +
+            align_up(begin->num_verts * (int)sizeof(struct ui_vertex),
+                     CMD_ALIGN);
+        r_begin_ui_surfaces(r, (const struct ui_vertex *)verts,
+                            begin->num_verts,
+                            begin->num_indices ? (const uint16_t *)indices
+                                               : NULL,
+                            begin->num_indices);
+      } break;
+
+      case CMD_DRAW_UI_SURFACE: {
+        r_draw_ui_surface(r, payload);
+      } break;
+
+      case CMD_END_UI_SURFACES: {
+        r_end_ui_surfaces(r);
+      } break;
+
+      default:
+        LOG_FATAL("unexpected command type %d", cmd->type);
+        break;
+    }
+
+    ptr += sizeof(*cmd) + cmd->size;
+  }
+}
+
+static void r_remap_ta_surface(struct ta_surface *surf,
+                               r_remap_texture_cb remap, void *userdata) {
+  if (surf->texture) {
+    surf->texture = remap(userdata, surf->texture);
+  }
+  if (surf->palette) {
+    surf->palette = remap(userdata, surf->palette);
+  }
+}
+
+void r_remap_cmdbuf_textures(struct r_cmdbuf *cb, r_remap_texture_cb remap,
+                             void *userdata) {
+  uint8_t *ptr = cb->data;
+  uint8_t *end = cb->data + cb->size;
+
+  while (ptr < end) {
+    struct r_cmd *cmd = (struct r_cmd *)ptr;
+    void *payload = cmd + 1;
+
+    switch (cmd->type) {
+      case CMD_DRAW_TA_SURFACE: {
+        r_remap_ta_surface(payload, remap, userdata);
+      } break;
+
+      case CMD_DRAW_TA_SURFACES: {
+        struct r_cmd_draw_ta *draw = payload;
+        struct ta_surface *surfs = (struct ta_surface *)(draw + 1);
+        for (int i = 0; i < draw->num_surfs; i++) {
+          r_remap_ta_surface(&surfs[i], remap, userdata);
+        }
+      } break;
+
+      case CMD_DRAW_UI_SURFACE: {
+        struct ui_surface *surf = payload;
+        if (surf->texture) {
+          surf->texture = remap(userdata, surf->texture);
+        }
+      } break;
+    }
+
+    ptr += sizeof(*cmd) + cmd->size;
+  }
+}
+
+int r_read_cmdbuf(struct r_cmdbuf *cb, FILE *fp) {
+  struct r_cmdbuf_header header;
+
+  if (fread(&header, sizeof(header), 1, fp) != 1) {
+    return 0;
+  }
+
+  if (header.magic != CMDBUF_MAGIC || header.version != CMDBUF_VERSION ||
+      header.size < 0) {
+    LOG_WARNING("r_read_cmdbuf unexpected header");
+    return 0;
+  }
+
+  r_reset_cmdbuf(cb);
+  r_reserve_cmdbuf(cb, header.size);
+
+  if (header.size && fread(cb->data, header.size, 1, fp) != 1) {
+    return 0;
+  }
+
+  cb->size = header.size;
+
+  return 1;
+}
+
+void r_write_cmdbuf(const struct r_cmdbuf *cb, FILE *fp) {
+  struct r_cmdbuf_header header = {CMDBUF_MAGIC, CMDBUF_VERSION, cb->size, 0};
+
+  CHECK_EQ(fwrite(&header, sizeof(header), 1, fp), 1);
+
+  if (cb->size) {
+    CHECK_EQ(fwrite(cb->data, cb->size, 1, fp), 1);
+  }
+}
+
+int r_cmdbuf_size(const struct r_cmdbuf *cb) {
+  return cb->size;
+}
+
+void r_reset_cmdbuf(struct r_cmdbuf *cb) {
+  cb->size = 0;
+}
+
+void r_destroy_cmdbuf(struct r_cmdbuf *cb) {
+  free(cb->draws);
+  free(cb->data);
+  free(cb);
+}
+
+struct r_cmdbuf *r_create_cmdbuf() {
+  struct r_cmdbuf *cb = calloc(1, sizeof(struct r_cmdbuf));
+  return cb;
+}
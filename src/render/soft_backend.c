@@ -0,0 +1,530 @@
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/math.h"
+#include "core/option.h"
+#include "core/profiler.h"
+#include "render/render_backend.h"
+#include "render/soft_raster.h"
+
+/*
+ * render backend rasterizing surfaces on the cpu with the tile-based software
+ * rasterizer. it's selected at build time in place of the gl backend
+ */
+
+DEFINE_OPTION_INT(raster_workers, 3,
+                  "Number of worker threads used by the software rasterizer");
+
+#define MAX_FRAMEBUFFERS 8
+#define MAX_TEXTURES 8192
+
+DEFINE_COUNTER(ta_surfaces);
+DEFINE_COUNTER(ta_draws);
+DEFINE_COUNTER(ta_state_changes);
+DEFINE_COUNTER(ta_volumes);
+DEFINE_COUNTER(ta_volume_tris);
+DEFINE_COUNTER(ta_volume_time);
+
+struct framebuffer {
+  int used;
+  struct sr_target target;
+  texture_handle_t color_texture;
+};
+
+struct texture {
+  int used;
+  /* set for framebuffer color textures, whose pixels are owned by the
+     framebuffer */
+  int framebuffer;
+  /* format of the data uploaded to the texture */
+  enum pxl_format format;
+  struct sr_texture tex;
+};
+
+struct render_backend {
+  video_context_t ctx;
+  int viewport_width;
+  int viewport_height;
+
+  struct sr *sr;
+
+  /* handles are indexes into these arrays offset by one, leaving zero as the
+     invalid handle. framebuffer zero is the default framebuffer */
+  struct texture textures[MAX_TEXTURES];
+  struct framebuffer framebuffers[MAX_FRAMEBUFFERS];
+  struct framebuffer default_framebuffer;
+  framebuffer_handle_t framebuffer;
+
+  /* surface render state */
+  const uint16_t *ta_indices;
+  const uint16_t *ui_indices;
+  struct ta_vertex *ui_verts;
+  int max_ui_verts;
+
+  /* state of the last ta surface drawn, used to count state changes */
+  struct ta_surface ta_state;
+  int ta_state_valid;
+
+  /* stats for the current frame */
+  int num_ta_surfaces;
+  int num_ta_draws;
+  int num_ta_state_changes;
+  int num_ta_volumes;
+  int num_ta_volume_tris;
+};
+
+static struct sr_target *r_bound_target(struct render_backend *r) {
+  if (!r->framebuffer) {
+    return &r->default_framebuffer.target;
+  }
+  return &r->framebuffers[r->framebuffer - 1].target;
+}
+
+static const struct sr_texture *r_lookup_texture(struct render_backend *r,
+                                                 texture_handle_t handle) {
+  if (!handle) {
+    return NULL;
+  }
+  CHECK(handle <= MAX_TEXTURES && r->textures[handle - 1].used);
+  return &r->textures[handle - 1].tex;
+}
+
+static void r_init_target(struct sr_target *target, int width, int height) {
+  target->width = width;
+  target->height = height;
+  target->color = calloc(width * height, sizeof(target->color[0]));
+  target->depth = calloc(width * height, sizeof(target->depth[0]));
+  target->stencil = calloc(width * height, sizeof(target->stencil[0]));
+  CHECK(width <= 0 || height <= 0 ||
+        (target->color && target->depth && target->stencil));
+  sr_clear(target, 0xff000000);
+}
+
+static void r_free_target(struct sr_target *target) {
+  free(target->color);
+  free(target->depth);
+  free(target->stencil);
+  memset(target, 0, sizeof(*target));
+}
+
+static int r_ta_state_equal(const struct ta_surface *a,
+                            const struct ta_surface *b) {
+  return a->texture == b->texture && a->depth_write == b->depth_write &&
+         a->depth_func == b->depth_func && a->cull == b->cull &&
+         a->src_blend == b->src_blend && a->dst_blend == b->dst_blend &&
+         a->shade == b->shade && a->ignore_alpha == b->ignore_alpha &&
+         a->ignore_texture_alpha == b->ignore_texture_alpha &&
+         a->offset_color == b->offset_color &&
+         a->pt_alpha_test == b->pt_alpha_test &&
+         a->pt_alpha_ref == b->pt_alpha_ref &&
+         a->debug_depth == b->debug_depth && a->shadow == b->shadow &&
+         a->palette == b->palette && a->palette_base == b->palette_base &&
+         a->palette_filter == b->palette_filter;
+}
+
+static void r_submit_ta_surface(struct render_backend *r,
+                                      const struct ta_surface *surf) {
+  if (!r->ta_state_valid || !r_ta_state_equal(&r->ta_state, surf)) {
+    r->ta_state = *surf;
+    r->ta_state_valid = 1;
+    r->num_ta_state_changes++;
+  }
+
+  struct sr_state state = {0};
+  state.surf = *surf;
+  state.texture = r_lookup_texture(r, surf->texture);
+
+  if (surf->palette) {
+    const struct sr_texture *palette = r_lookup_texture(r, surf->palette);
+    CHECK(surf->palette_base >= 0 && surf->palette_base < palette->width);
+    state.palette = palette->pixels + surf->palette_base;
+  }
+
+  sr_draw(r->sr, &state, r->ta_indices, surf->first_vert, surf->num_verts);
+
+  r->num_ta_surfaces++;
+}
+
+void r_end_ui_surfaces(struct render_backend *r) {
+  sr_end(r->sr);
+}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {
+  /* lines aren't used by any of the ui currently */
+  CHECK_EQ(surf->prim_type, PRIM_TRIANGLES);
+
+  /* ui surfaces are shaded by modulating the texture with the vertex color */
+  struct sr_state state = {0};
+  state.surf.depth_func = DEPTH_NONE;
+  state.surf.cull = CULL_NONE;
+  state.surf.src_blend = surf->src_blend;
+  state.surf.dst_blend = surf->dst_blend;
+  state.surf.shade = SHADE_MODULATE_ALPHA;
+  state.texture = r_lookup_texture(r, surf->texture);
+  state.scissor = surf->scissor;
+  for (int i = 0; i < 4; i++) {
+    state.scissor_rect[i] = (int)surf->scissor_rect[i];
+  }
+
+  sr_draw(r->sr, &state, r->ui_indices, surf->first_vert, surf->num_verts);
+}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {
+  if (num_verts > r->max_ui_verts) {
+    r->max_ui_verts = MAX(num_verts, r->max_ui_verts * 2);
+    r->ui_verts =
+        realloc(r->ui_verts, r->max_ui_verts * sizeof(r->ui_verts[0]));
+    CHECK_NOTNULL(r->ui_verts);
+  }
+
+  /* ui vertices are unprojected */
+  for (int i = 0; i < num_verts; i++) {
+    struct ta_vertex *vert = &r->ui_verts[i];
+    vert->xyz[0] = verts[i].xy[0];
+    vert->xyz[1] = verts[i].xy[1];
+    vert->xyz[2] = 1.0f;
+    vert->uv[0] = verts[i].uv[0];
+    vert->uv[1] = verts[i].uv[1];
+    vert->color = verts[i].color;
+    vert->offset_color = 0;
+  }
+
+  /* flip y so the origin is at the bottom left */
+  float xform[4] = {1.0f, 0.0f, -1.0f, (float)r->viewport_height};
+
+  r->ui_indices = indices;
+
+  sr_begin(r->sr, r_bound_target(r), r->viewport_width, r->viewport_height,
+           xform, r->ui_verts, num_verts);
+}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  sr_end(r->sr);
+
+  prof_counter_set(COUNTER_ta_surfaces, r->num_ta_surfaces);
+  prof_counter_set(COUNTER_ta_draws, r->num_ta_draws);
+  prof_counter_set(COUNTER_ta_state_changes, r->num_ta_state_changes);
+  prof_counter_set(COUNTER_ta_volumes, r->num_ta_volumes);
+  prof_counter_set(COUNTER_ta_volume_tris, r->num_ta_volume_tris);
+  prof_counter_set(COUNTER_ta_volume_time, sr_volume_time(r->sr));
+}
+
+void r_draw_ta_volumes(struct render_backend *r,
+                       const struct ta_volume_tri *tris, int num_tris,
+                       const struct ta_volume *volumes, int num_volumes,
+                       float shadow_scale) {
+  for (int i = 0; i < num_volumes; i++) {
+    const struct ta_volume *volume = &volumes[i];
+    sr_draw_volume(r->sr, &tris[volume->first_tri], volume->num_tris,
+                   volume->outside);
+  }
+
+  sr_resolve_volumes(r->sr, shadow_scale);
+
+  r->num_ta_volumes += num_volumes;
+  r->num_ta_volume_tris += num_tris;
+}
+
+void r_draw_ta_surfaces(struct render_backend *r,
+                        const struct ta_surface **surfs, int num_surfs) {
+  for (int i = 0; i < num_surfs; i++) {
+    r_submit_ta_surface(r, surfs[i]);
+  }
+
+  r->num_ta_draws++;
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  r_submit_ta_surface(r, surf);
+
+  r->num_ta_draws++;
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const uint16_t *indices,
+                         int num_indices) {
+  /* scale x from [0,video_width] to [0,viewport_width] and y from
+     [0,video_height] to [viewport_height,0] */
+  float xform[4];
+  xform[0] = (float)r->viewport_width / (float)video_width;
+  xform[1] = 0.0f;
+  xform[2] = -(float)r->viewport_height / (float)video_height;
+  xform[3] = (float)r->viewport_height;
+
+  r->ta_indices = indices;
+  r->ta_state_valid = 0;
+  r->num_ta_surfaces = 0;
+  r->num_ta_draws = 0;
+  r->num_ta_state_changes = 0;
+  r->num_ta_volumes = 0;
+  r->num_ta_volume_tris = 0;
+
+  sr_begin(r->sr, r_bound_target(r), r->viewport_width, r->viewport_height,
+           xform, verts, num_verts);
+}
+
+int r_viewport_height(struct render_backend *r) {
+  return r->viewport_height;
+}
+
+int r_viewport_width(struct render_backend *r) {
+  return r->viewport_width;
+}
+
+void r_viewport(struct render_backend *r, int width, int height) {
+  r->viewport_width = width;
+  r->viewport_height = height;
+
+  /* the default framebuffer is sized to the largest viewport set on it */
+  struct sr_target *target = r_bound_target(r);
+
+  if (!r->framebuffer &&
+      (target->width < width || target->height < height)) {
+    int new_width = MAX(target->width, width);
+    int new_height = MAX(target->height, height);
+    r_free_target(target);
+    r_init_target(target, new_width, new_height);
+  }
+
+  sr_clear(target, 0xff000000);
+}
+
+void r_destroy_sync(struct render_backend *r, sync_handle_t handle) {}
+
+void r_wait_sync(struct render_backend *r, sync_handle_t handle) {}
+
+sync_handle_t r_insert_sync(struct render_backend *r) {
+  /* surfaces have been completely rasterized by the time each pass ends,
+     return a non-null handle to satisfy the caller */
+  return r;
+}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  CHECK(handle && handle <= MAX_TEXTURES);
+
+  struct texture *entry = &r->textures[handle - 1];
+  CHECK(entry->used);
+
+  if (!entry->framebuffer) {
+    free(entry->tex.pixels);
+  }
+
+  memset(entry, 0, sizeof(*entry));
+}
+
+static texture_handle_t r_alloc_texture(struct render_backend *r) {
+  /* find next open texture entry */
+  int entry;
+  for (entry = 0; entry < MAX_TEXTURES; entry++) {
+    struct texture *tex = &r->textures[entry];
+    if (!tex->used) {
+      break;
+    }
+  }
+  CHECK_LT(entry, MAX_TEXTURES);
+
+  r->textures[entry].used = 1;
+
+  return entry + 1;
+}
+
+static int r_pixel_size(enum pxl_format format) {
+  switch (format) {
+    case PXL_RGBA:
+      return 4;
+    case PXL_INDEX8:
+      return 1;
+    default:
+      return 2;
+  }
+}
+
+/* convert a run of pixels to rgba8888, packed 16-bit formats store the red
+   component in the most significant bits. palette indices are stored as
+   is */
+static void r_convert_pixels(enum pxl_format format, const uint8_t *buffer,
+                             uint32_t *pixels, int num_pixels) {
+  const uint16_t *src16 = (const uint16_t *)buffer;
+
+  for (int i = 0; i < num_pixels; i++) {
+    uint32_t r8, g8, b8, a8;
+
+    switch (format) {
+      case PXL_RGBA:
+        memcpy(&pixels[i], buffer + i * 4, 4);
+        continue;
+      case PXL_INDEX8:
+        pixels[i] = buffer[i];
+        continue;
+      case PXL_RGBA5551:
+        r8 = (src16[i] >> 11) & 0x1f;
+        g8 = (src16[i] >> 6) & 0x1f;
+        b8 = (src16[i] >> 1) & 0x1f;
+        r8 = (r8 << 3) | (r8 >> 2);
+        g8 = (g8 << 3) | (g8 >> 2);
+        b8 = (b8 << 3) | (b8 >> 2);
+        a8 = (src16[i] & 0x1) * 0xff;
+        break;
+      case PXL_RGB565:
+        r8 = (src16[i] >> 11) & 0x1f;
+        g8 = (src16[i] >> 5) & 0x3f;
+        b8 = src16[i] & 0x1f;
+        r8 = (r8 << 3) | (r8 >> 2);
+        g8 = (g8 << 2) | (g8 >> 4);
+        b8 = (b8 << 3) | (b8 >> 2);
+        a8 = 0xff;
+        break;
+      case PXL_RGBA4444:
+        r8 = ((src16[i] >> 12) & 0xf) * 0x11;
+        g8 = ((src16[i] >> 8) & 0xf) * 0x11;
+        b8 = ((src16[i] >> 4) & 0xf) * 0x11;
+        a8 = (src16[i] & 0xf) * 0x11;
+        break;
+      default:
+        LOG_FATAL("unexpected pixel format %d", format);
+        break;
+    }
+
+    pixels[i] = r8 | (g8 << 8) | (b8 << 16) | (a8 << 24);
+  }
+}
+
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      int x, int y, int width, int height,
+                      const uint8_t *buffer) {
+  CHECK(handle && handle <= MAX_TEXTURES);
+
+  struct texture *entry = &r->textures[handle - 1];
+  CHECK(entry->used && !entry->framebuffer);
+
+  struct sr_texture *tex = &entry->tex;
+  CHECK(x >= 0 && y >= 0 && x + width <= tex->width &&
+        y + height <= tex->height);
+
+  int bpp = r_pixel_size(entry->format);
+
+  for (int i = 0; i < height; i++) {
+    r_convert_pixels(entry->format, buffer + i * width * bpp,
+                     &tex->pixels[(y + i) * tex->width + x], width);
+  }
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  texture_handle_t handle = r_alloc_texture(r);
+  struct texture *entry = &r->textures[handle - 1];
+  entry->format = format;
+
+  /* note, only the base level is sampled, mipmaps aren't generated */
+  struct sr_texture *tex = &entry->tex;
+  tex->width = width;
+  tex->height = height;
+  tex->filter = filter;
+  tex->wrap_u = wrap_u;
+  tex->wrap_v = wrap_v;
+  tex->pixels = malloc(width * height * sizeof(tex->pixels[0]));
+  CHECK_NOTNULL(tex->pixels);
+
+  r_convert_pixels(format, buffer, tex->pixels, width * height);
+
+  return handle;
+}
+
+void r_destroy_framebuffer(struct render_backend *r,
+                           framebuffer_handle_t handle) {
+  CHECK(handle && handle <= MAX_FRAMEBUFFERS);
+
+  struct framebuffer *fb = &r->framebuffers[handle - 1];
+  CHECK(fb->used);
+
+  r_destroy_texture(r, fb->color_texture);
+  r_free_target(&fb->target);
+
+  memset(fb, 0, sizeof(*fb));
+}
+
+void r_bind_framebuffer(struct render_backend *r, framebuffer_handle_t handle) {
+  CHECK(handle <= MAX_FRAMEBUFFERS);
+  r->framebuffer = handle;
+}
+
+framebuffer_handle_t r_create_framebuffer(struct render_backend *r, int width,
+                                          int height,
+                                          texture_handle_t *color_texture) {
+  /* find next open framebuffer handle */
+  int entry;
+  for (entry = 0; entry < MAX_FRAMEBUFFERS; entry++) {
+    struct framebuffer *fb = &r->framebuffers[entry];
+    if (!fb->used) {
+      break;
+    }
+  }
+  CHECK_LT(entry, MAX_FRAMEBUFFERS);
+
+  struct framebuffer *fb = &r->framebuffers[entry];
+  fb->used = 1;
+  r_init_target(&fb->target, width, height);
+
+  /* the color texture samples the framebuffer's pixels directly */
+  fb->color_texture = r_alloc_texture(r);
+
+  struct texture *tex = &r->textures[fb->color_texture - 1];
+  tex->framebuffer = 1;
+  tex->tex.width = width;
+  tex->tex.height = height;
+  tex->tex.filter = FILTER_NEAREST;
+  tex->tex.wrap_u = WRAP_CLAMP_TO_EDGE;
+  tex->tex.wrap_v = WRAP_CLAMP_TO_EDGE;
+  tex->tex.pixels = fb->target.color;
+
+  *color_texture = fb->color_texture;
+
+  return entry + 1;
+}
+
+framebuffer_handle_t r_get_framebuffer(struct render_backend *r) {
+  return r->framebuffer;
+}
+
+video_context_t r_context(struct render_backend *r) {
+  return r->ctx;
+}
+
+void r_destroy(struct render_backend *r) {
+  for (int i = 0; i < MAX_FRAMEBUFFERS; i++) {
+    if (r->framebuffers[i].used) {
+      r_destroy_framebuffer(r, i + 1);
+    }
+  }
+
+  for (int i = 0; i < MAX_TEXTURES; i++) {
+    if (r->textures[i].used) {
+      r_destroy_texture(r, i + 1);
+    }
+  }
+
+  r_free_target(&r->default_framebuffer.target);
+
+  sr_destroy(r->sr);
+
+  free(r->ui_verts);
+  free(r);
+}
+
+struct render_backend *r_create(video_context_t ctx) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->ctx = ctx;
+  r->sr = sr_create(OPTION_raster_workers, sr_selected());
+
+  return r;
+}
@@ -0,0 +1,938 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "render/soft_raster.h"
+#include "core/assert.h"
+#include "core/math.h"
+#include "core/time.h"
+#include "core/worker_pool.h"
+
+#if ARCH_X64
+#include <immintrin.h>
+#endif
+
+/* texture coordinates are clamped to this range before being converted to
+   texel coordinates, to keep the conversion to int well-defined */
+#define SR_MAX_TEXCOORD 65536.0f
+
+const char *sr_impl_names[SR_NUM_IMPLS] = {"scalar", "sse2"};
+
+/* modifier volume state of each pixel. the parity is toggled by each
+   triangle of the volume being drawn in front of the pixel, and is folded
+   into the modified bit once the volume has been drawn */
+enum {
+  SR_STENCIL_SHADOW = 0x1,
+  SR_STENCIL_PARITY = 0x2,
+  SR_STENCIL_MODIFIED = 0x4,
+};
+
+/* attributes interpolated across each triangle. all but the first are
+   premultiplied by 1/w for perspective-correct interpolation */
+enum {
+  SR_PLANE_IZ,
+  SR_PLANE_U,
+  SR_PLANE_V,
+  SR_PLANE_R,
+  SR_PLANE_G,
+  SR_PLANE_B,
+  SR_PLANE_A,
+  SR_PLANE_OFFSET_R,
+  SR_PLANE_OFFSET_G,
+  SR_PLANE_OFFSET_B,
+  SR_NUM_PLANES,
+};
+
+struct sr_tri {
+  int state;
+
+  /* window space bounds, clipped to the viewport and scissor rect */
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+
+  /* edge functions of the form a * x + b * y + c, each edge is positive on
+     the inside of the triangle */
+  float edges[3][3];
+  int topleft[3];
+
+  float planes[SR_NUM_PLANES][3];
+};
+
+struct sr_resolve {
+  float scale;
+  int num_outside;
+};
+
+/* each bin holds the triangles overlapping it in submission order, with
+   volume resolves stored as -1 - the resolve's index */
+struct sr_bin {
+  int *tris;
+  int num_tris;
+  int max_tris;
+  int64_t volume_time;
+};
+
+typedef void (*sr_raster_cb)(const struct sr *, const struct sr_tri *, int,
+                             int, int, int);
+
+struct sr {
+  enum sr_impl impl;
+  sr_raster_cb raster;
+
+  /* state of the current pass */
+  struct sr_target *target;
+  int clip_width;
+  int clip_height;
+  float xform[4];
+  const struct ta_vertex *verts;
+  int num_verts;
+
+  struct sr_state *states;
+  int num_states;
+  int max_states;
+
+  struct sr_tri *tris;
+  int num_tris;
+  int max_tris;
+
+  struct sr_resolve *resolves;
+  int num_resolves;
+  int max_resolves;
+  int num_outside;
+
+  struct sr_bin *bins;
+  int bins_x;
+  int bins_y;
+  int num_bins;
+  int max_bins;
+
+  /* each bin is rasterized as a job on the worker pool */
+  struct worker_pool *workers;
+};
+
+static inline float sr_plane(const float *p, float x, float y) {
+  return p[0] * x + (p[1] * y + p[2]);
+}
+
+static inline float sr_unpack(uint32_t c, int shift) {
+  return (float)((c >> shift) & 0xff) * (1.0f / 255.0f);
+}
+
+static inline uint32_t sr_pack(const float *c) {
+  return ((uint32_t)(c[0] * 255.0f + 0.5f)) |
+         ((uint32_t)(c[1] * 255.0f + 0.5f) << 8) |
+         ((uint32_t)(c[2] * 255.0f + 0.5f) << 16) |
+         ((uint32_t)(c[3] * 255.0f + 0.5f) << 24);
+}
+
+static inline void sr_unpack_rgba(uint32_t c, float *out) {
+  out[0] = sr_unpack(c, 0);
+  out[1] = sr_unpack(c, 8);
+  out[2] = sr_unpack(c, 16);
+  out[3] = sr_unpack(c, 24);
+}
+
+static inline int sr_wrap(enum wrap_mode mode, int i, int size) {
+  switch (mode) {
+    case WRAP_CLAMP_TO_EDGE:
+      return CLAMP(i, 0, size - 1);
+
+    case WRAP_MIRRORED_REPEAT: {
+      int period = size * 2;
+      i %= period;
+      i += i < 0 ? period : 0;
+      return i < size ? i : period - 1 - i;
+    }
+
+    default:
+      i %= size;
+      return i < 0 ? i + size : i;
+  }
+}
+
+static inline float sr_clamp_texcoord(float t) {
+  /* written to map nan to a valid coordinate as well */
+  return t > -SR_MAX_TEXCOORD ? (t < SR_MAX_TEXCOORD ? t : SR_MAX_TEXCOORD)
+                              : -SR_MAX_TEXCOORD;
+}
+
+static inline uint32_t sr_fetch(const struct sr_texture *tex,
+                                const uint32_t *palette, int x, int y) {
+  uint32_t texel = tex->pixels[y * tex->width + x];
+  return palette ? palette[texel] : texel;
+}
+
+/* paletted textures are filtered after looking up their indices, with the
+   filter mode of the surface rather than the texture */
+static void sr_sample(const struct sr_texture *tex, const uint32_t *palette,
+                      enum filter_mode filter, float u, float v, float *out) {
+  float fx = sr_clamp_texcoord(u) * tex->width;
+  float fy = sr_clamp_texcoord(v) * tex->height;
+
+  if (filter == FILTER_NEAREST) {
+    int x = sr_wrap(tex->wrap_u, (int)floorf(fx), tex->width);
+    int y = sr_wrap(tex->wrap_v, (int)floorf(fy), tex->height);
+    sr_unpack_rgba(sr_fetch(tex, palette, x, y), out);
+    return;
+  }
+
+  /* bilinear filter between the four texels surrounding the sample point */
+  fx -= 0.5f;
+  fy -= 0.5f;
+
+  float floorx = floorf(fx);
+  float floory = floorf(fy);
+  float ax = fx - floorx;
+  float ay = fy - floory;
+
+  int x0 = sr_wrap(tex->wrap_u, (int)floorx, tex->width);
+  int x1 = sr_wrap(tex->wrap_u, (int)floorx + 1, tex->width);
+  int y0 = sr_wrap(tex->wrap_v, (int)floory, tex->height);
+  int y1 = sr_wrap(tex->wrap_v, (int)floory + 1, tex->height);
+
+  uint32_t c00 = sr_fetch(tex, palette, x0, y0);
+  uint32_t c10 = sr_fetch(tex, palette, x1, y0);
+  uint32_t c01 = sr_fetch(tex, palette, x0, y1);
+  uint32_t c11 = sr_fetch(tex, palette, x1, y1);
+
+  for (int i = 0; i < 4; i++) {
+    int shift = i * 8;
+    float top = sr_unpack(c00, shift) +
+                (sr_unpack(c10, shift) - sr_unpack(c00, shift)) * ax;
+    float bottom = sr_unpack(c01, shift) +
+                   (sr_unpack(c11, shift) - sr_unpack(c01, shift)) * ax;
+    out[i] = top + (bottom - top) * ay;
+  }
+}
+
+static inline int sr_depth_test(enum depth_func func, float src, float dst) {
+  switch (func) {
+    case DEPTH_NEVER:
+      return 0;
+    case DEPTH_LESS:
+      return src < dst;
+    case DEPTH_EQUAL:
+      return src == dst;
+    case DEPTH_LEQUAL:
+      return src <= dst;
+    case DEPTH_GREATER:
+      return src > dst;
+    case DEPTH_NEQUAL:
+      return src != dst;
+    case DEPTH_GEQUAL:
+      return src >= dst;
+    default:
+      return 1;
+  }
+}
+
+static inline void sr_blend_factor(enum blend_func func, const float *src,
+                                   const float *dst, float *out) {
+  switch (func) {
+    case BLEND_ZERO:
+      out[0] = out[1] = out[2] = out[3] = 0.0f;
+      break;
+    case BLEND_SRC_COLOR:
+      memcpy(out, src, sizeof(float) * 4);
+      break;
+    case BLEND_ONE_MINUS_SRC_COLOR:
+      for (int i = 0; i < 4; i++) {
+        out[i] = 1.0f - src[i];
+      }
+      break;
+    case BLEND_SRC_ALPHA:
+      out[0] = out[1] = out[2] = out[3] = src[3];
+      break;
+    case BLEND_ONE_MINUS_SRC_ALPHA:
+      out[0] = out[1] = out[2] = out[3] = 1.0f - src[3];
+      break;
+    case BLEND_DST_ALPHA:
+      out[0] = out[1] = out[2] = out[3] = dst[3];
+      break;
+    case BLEND_ONE_MINUS_DST_ALPHA:
+      out[0] = out[1] = out[2] = out[3] = 1.0f - dst[3];
+      break;
+    case BLEND_DST_COLOR:
+      memcpy(out, dst, sizeof(float) * 4);
+      break;
+    case BLEND_ONE_MINUS_DST_COLOR:
+      for (int i = 0; i < 4; i++) {
+        out[i] = 1.0f - dst[i];
+      }
+      break;
+    default:
+      out[0] = out[1] = out[2] = out[3] = 1.0f;
+      break;
+  }
+}
+
+/* shade a single covered pixel, following the ta fragment shader */
+static void sr_shade(const struct sr_tri *tri, const struct sr_state *state,
+                     struct sr_target *target, int x, int y) {
+  const struct ta_surface *surf = &state->surf;
+  int idx = y * target->width + x;
+  float px = (float)x + 0.5f;
+  float py = (float)y + 0.5f;
+  float w = 1.0f / sr_plane(tri->planes[SR_PLANE_IZ], px, py);
+  float depth = MIN(w, SR_MAX_DEPTH);
+
+  if (state->volume) {
+    if (depth < target->depth[idx]) {
+      target->stencil[idx] ^= SR_STENCIL_PARITY;
+    }
+    return;
+  }
+
+  /* the depth test can be ran before shading, as failing it discards the
+     fragment regardless of the shading result */
+  int depth_test = surf->depth_func != DEPTH_NONE;
+
+  if (depth_test &&
+      !sr_depth_test(surf->depth_func, depth, target->depth[idx])) {
+    return;
+  }
+
+  float col[4];
+  for (int i = 0; i < 4; i++) {
+    col[i] = sr_plane(tri->planes[SR_PLANE_R + i], px, py) * w;
+  }
+
+  if (surf->ignore_alpha) {
+    col[3] = 1.0f;
+  }
+
+  float frag[4];
+
+  if (state->texture) {
+    float tex[4];
+    float u = sr_plane(tri->planes[SR_PLANE_U], px, py) * w;
+    float v = sr_plane(tri->planes[SR_PLANE_V], px, py) * w;
+    enum filter_mode filter =
+        state->palette ? surf->palette_filter : state->texture->filter;
+    sr_sample(state->texture, state->palette, filter, u, v, tex);
+
+    if (surf->ignore_texture_alpha) {
+      tex[3] = 1.0f;
+    }
+
+    if (surf->pt_alpha_test && tex[3] < surf->pt_alpha_ref) {
+      return;
+    }
+
+    switch (surf->shade) {
+      case SHADE_DECAL:
+        memcpy(frag, tex, sizeof(frag));
+        break;
+      case SHADE_MODULATE:
+        for (int i = 0; i < 3; i++) {
+          frag[i] = tex[i] * col[i];
+        }
+        frag[3] = tex[3];
+        break;
+      case SHADE_DECAL_ALPHA:
+        for (int i = 0; i < 3; i++) {
+          frag[i] = tex[i] * tex[3] + col[i] * (1.0f - tex[3]);
+        }
+        frag[3] = col[3];
+        break;
+      case SHADE_MODULATE_ALPHA:
+        for (int i = 0; i < 4; i++) {
+          frag[i] = tex[i] * col[i];
+        }
+        break;
+    }
+  } else {
+    memcpy(frag, col, sizeof(frag));
+  }
+
+  if (surf->offset_color) {
+    for (int i = 0; i < 3; i++) {
+      frag[i] += sr_plane(tri->planes[SR_PLANE_OFFSET_R + i], px, py) * w;
+    }
+  }
+
+  if (surf->debug_depth) {
+    frag[0] = frag[1] = frag[2] = log2f(1.0f + w) / 17.0f;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    frag[i] = CLAMP(frag[i], 0.0f, 1.0f);
+  }
+
+  if (surf->src_blend != BLEND_NONE && surf->dst_blend != BLEND_NONE) {
+    float dst[4], src_factor[4], dst_factor[4];
+    sr_unpack_rgba(target->color[idx], dst);
+    sr_blend_factor(surf->src_blend, frag, dst, src_factor);
+    sr_blend_factor(surf->dst_blend, frag, dst, dst_factor);
+
+    for (int i = 0; i < 4; i++) {
+      float c = frag[i] * src_factor[i] + dst[i] * dst_factor[i];
+      frag[i] = CLAMP(c, 0.0f, 1.0f);
+    }
+  }
+
+  target->color[idx] = sr_pack(frag);
+  target->stencil[idx] = surf->shadow ? SR_STENCIL_SHADOW : 0;
+
+  if (depth_test && surf->depth_write) {
+    target->depth[idx] = depth;
+  }
+}
+
+static inline int sr_edge_inside(const struct sr_tri *tri, int i, float px,
+                                 float py) {
+  float e = tri->edges[i][0] * px + (tri->edges[i][1] * py + tri->edges[i][2]);
+  return e > 0.0f || (e == 0.0f && tri->topleft[i]);
+}
+
+static void sr_raster_tri_scalar(const struct sr *sr, const struct sr_tri *tri,
+                                 int x0, int y0, int x1, int y1) {
+  const struct sr_state *state = &sr->states[tri->state];
+
+  for (int y = y0; y < y1; y++) {
+    float py = (float)y + 0.5f;
+
+    for (int x = x0; x < x1; x++) {
+      float px = (float)x + 0.5f;
+
+      if (sr_edge_inside(tri, 0, px, py) && sr_edge_inside(tri, 1, px, py) &&
+          sr_edge_inside(tri, 2, px, py)) {
+        sr_shade(tri, state, sr->target, x, y);
+      }
+    }
+  }
+}
+
+#if ARCH_X64
+/* evaluates the edge functions for 4 pixels at a time, only shading the
+   covered pixels */
+static void sr_raster_tri_sse2(const struct sr *sr, const struct sr_tri *tri,
+                               int x0, int y0, int x1, int y1) {
+  const struct sr_state *state = &sr->states[tri->state];
+  const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 end = _mm_set1_ps((float)x1);
+  __m128 a[3], topleft[3];
+
+  for (int i = 0; i < 3; i++) {
+    a[i] = _mm_set1_ps(tri->edges[i][0]);
+    topleft[i] = _mm_castsi128_ps(_mm_set1_epi32(tri->topleft[i] ? -1 : 0));
+  }
+
+  for (int y = y0; y < y1; y++) {
+    float py = (float)y + 0.5f;
+    __m128 row[3];
+
+    for (int i = 0; i < 3; i++) {
+      row[i] = _mm_set1_ps(tri->edges[i][1] * py + tri->edges[i][2]);
+    }
+
+    for (int x = x0; x < x1; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+      __m128 mask = _mm_cmplt_ps(px, end);
+
+      for (int i = 0; i < 3; i++) {
+        __m128 e = _mm_add_ps(_mm_mul_ps(a[i], px), row[i]);
+        __m128 inside = _mm_or_ps(
+            _mm_cmpgt_ps(e, zero),
+            _mm_and_ps(_mm_cmpeq_ps(e, zero), topleft[i]));
+        mask = _mm_and_ps(mask, inside);
+      }
+
+      uint32_t covered = (uint32_t)_mm_movemask_ps(mask);
+
+      while (covered) {
+        int i = ctz32(covered);
+        covered &= covered - 1;
+        sr_shade(tri, state, sr->target, x + i, y);
+      }
+    }
+  }
+}
+#endif
+
+/* fold the parity of the volume just drawn into the modified bit of each
+   pixel in the tile */
+static void sr_fold_volume(struct sr_target *target, int outside, int x0,
+                           int y0, int x1, int y1) {
+  for (int y = y0; y < y1; y++) {
+    uint8_t *stencil = &target->stencil[y * target->width];
+
+    for (int x = x0; x < x1; x++) {
+      int inside = (stencil[x] & SR_STENCIL_PARITY) != 0;
+
+      if (inside != outside) {
+        stencil[x] |= SR_STENCIL_MODIFIED;
+      }
+      stencil[x] &= ~SR_STENCIL_PARITY;
+    }
+  }
+}
+
+static void sr_resolve_tile(struct sr_target *target,
+                            const struct sr_resolve *resolve, int modified,
+                            int x0, int y0, int x1, int y1) {
+  uint32_t scale = (uint32_t)(CLAMP(resolve->scale, 0.0f, 1.0f) * 256.0f);
+
+  for (int y = y0; y < y1; y++) {
+    uint32_t *color = &target->color[y * target->width];
+    uint8_t *stencil = &target->stencil[y * target->width];
+
+    for (int x = x0; x < x1; x++) {
+      if ((stencil[x] & SR_STENCIL_SHADOW) &&
+          (modified || (stencil[x] & SR_STENCIL_MODIFIED))) {
+        uint32_t c = color[x];
+        uint32_t r = ((c & 0xff) * scale) >> 8;
+        uint32_t g = (((c >> 8) & 0xff) * scale) >> 8;
+        uint32_t b = (((c >> 16) & 0xff) * scale) >> 8;
+        color[x] = (c & 0xff000000) | (b << 16) | (g << 8) | r;
+      }
+      stencil[x] &= ~SR_STENCIL_MODIFIED;
+    }
+  }
+}
+
+static void sr_raster_bin(struct sr *sr, int n) {
+  struct sr_bin *bin = &sr->bins[n];
+  int tx0 = (n % sr->bins_x) * SR_TILE_SIZE;
+  int ty0 = (n / sr->bins_x) * SR_TILE_SIZE;
+  int tx1 = tx0 + SR_TILE_SIZE;
+  int ty1 = ty0 + SR_TILE_SIZE;
+
+  /* state of the volume being drawn in the tile, along with the number of
+     outside volumes drawn in it since the last resolve. outside volumes
+     which weren't drawn in the tile modify every pixel in it */
+  int volume = -1;
+  int outside = 0;
+  int num_outside = 0;
+  int64_t volume_start = 0;
+  int rx1 = MIN(tx1, sr->clip_width);
+  int ry1 = MIN(ty1, sr->clip_height);
+
+  for (int i = 0; i < bin->num_tris; i++) {
+    int entry = bin->tris[i];
+
+    if (entry < 0) {
+      const struct sr_resolve *resolve = &sr->resolves[-1 - entry];
+
+      if (!volume_start) {
+        volume_start = time_nanoseconds();
+      }
+
+      if (volume >= 0) {
+        sr_fold_volume(sr->target, outside, tx0, ty0, rx1, ry1);
+        num_outside += outside;
+      }
+
+      sr_resolve_tile(sr->target, resolve, num_outside < resolve->num_outside,
+                      tx0, ty0, rx1, ry1);
+
+      bin->volume_time += time_nanoseconds() - volume_start;
+      volume = -1;
+      num_outside = 0;
+      volume_start = 0;
+      continue;
+    }
+
+    const struct sr_tri *tri = &sr->tris[entry];
+    const struct sr_state *state = &sr->states[tri->state];
+
+    if (state->volume && tri->state != volume) {
+      if (!volume_start) {
+        volume_start = time_nanoseconds();
+      }
+
+      if (volume >= 0) {
+        sr_fold_volume(sr->target, outside, tx0, ty0, rx1, ry1);
+        num_outside += outside;
+      }
+
+      volume = tri->state;
+      outside = state->outside;
+    }
+
+    int x0 = MAX(tri->x0, tx0);
+    int y0 = MAX(tri->y0, ty0);
+    int x1 = MIN(tri->x1, tx1);
+    int y1 = MIN(tri->y1, ty1);
+
+    sr->raster(sr, tri, x0, y0, x1, y1);
+  }
+}
+
+static void sr_raster_job(void *data, int n) {
+  sr_raster_bin(data, n);
+}
+
+static void sr_bin_push(struct sr_bin *bin, int entry) {
+  if (bin->num_tris >= bin->max_tris) {
+    bin->max_tris = MAX(bin->max_tris * 2, 256);
+    bin->tris = realloc(bin->tris, bin->max_tris * sizeof(bin->tris[0]));
+    CHECK_NOTNULL(bin->tris);
+  }
+
+  bin->tris[bin->num_tris++] = entry;
+}
+
+static void sr_bin_tri(struct sr *sr, int n) {
+  const struct sr_tri *tri = &sr->tris[n];
+  int bx0 = tri->x0 / SR_TILE_SIZE;
+  int by0 = tri->y0 / SR_TILE_SIZE;
+  int bx1 = (tri->x1 - 1) / SR_TILE_SIZE;
+  int by1 = (tri->y1 - 1) / SR_TILE_SIZE;
+
+  for (int by = by0; by <= by1; by++) {
+    for (int bx = bx0; bx <= bx1; bx++) {
+      /* skip tiles entirely outside of one of the edges, testing the pixel
+         center in each tile which is furthest inside of the edge. the edge
+         is evaluated the same way as when rasterizing, so the test is exact */
+      float tx0 = (float)(bx * SR_TILE_SIZE) + 0.5f;
+      float ty0 = (float)(by * SR_TILE_SIZE) + 0.5f;
+      float tx1 = tx0 + (float)(SR_TILE_SIZE - 1);
+      float ty1 = ty0 + (float)(SR_TILE_SIZE - 1);
+      int outside = 0;
+
+      for (int i = 0; i < 3 && !outside; i++) {
+        const float *e = tri->edges[i];
+        float px = e[0] >= 0.0f ? tx1 : tx0;
+        float py = e[1] >= 0.0f ? ty1 : ty0;
+        outside = e[0] * px + (e[1] * py + e[2]) < 0.0f;
+      }
+
+      if (outside) {
+        continue;
+      }
+
+      sr_bin_push(&sr->bins[by * sr->bins_x + bx], n);
+    }
+  }
+}
+
+static void sr_setup_plane(float *plane, const float edges[3][3], float q0,
+                           float q1, float q2, float inv_area) {
+  /* each barycentric coordinate is the edge function opposite of its vertex
+     divided by the triangle's area */
+  for (int i = 0; i < 3; i++) {
+    plane[i] = (q0 * edges[0][i] + q1 * edges[1][i] + q2 * edges[2][i]) *
+               inv_area;
+  }
+}
+
+static void sr_setup_tri(struct sr *sr, int state, const int *clip,
+                         const struct ta_vertex *v0,
+                         const struct ta_vertex *v1,
+                         const struct ta_vertex *v2) {
+  const struct ta_surface *surf = &sr->states[state].surf;
+  const struct ta_vertex *v[3] = {v0, v1, v2};
+
+  /* triangles crossing the w = 0 plane would need to be clipped. these are
+     rare in practice, so they're dropped entirely */
+  if (!(v0->xyz[2] > 0.0f && v1->xyz[2] > 0.0f && v2->xyz[2] > 0.0f)) {
+    return;
+  }
+
+  float x[3], y[3];
+  for (int i = 0; i < 3; i++) {
+    x[i] = v[i]->xyz[0] * sr->xform[0] + sr->xform[1];
+    y[i] = v[i]->xyz[1] * sr->xform[2] + sr->xform[3];
+  }
+
+  /* counter-clockwise triangles are front facing, matching OpenGL */
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+  if (!(area != 0.0f && isfinite(area))) {
+    return;
+  }
+
+  if ((surf->cull == CULL_BACK && area < 0.0f) ||
+      (surf->cull == CULL_FRONT && area > 0.0f)) {
+    return;
+  }
+
+  /* reorder clockwise triangles so the edge functions are positive inside */
+  if (area < 0.0f) {
+    const struct ta_vertex *tmpv = v[1];
+    float tmpx = x[1];
+    float tmpy = y[1];
+    v[1] = v[2];
+    x[1] = x[2];
+    y[1] = y[2];
+    v[2] = tmpv;
+    x[2] = tmpx;
+    y[2] = tmpy;
+    area = -area;
+  }
+
+  float minx = MIN(MIN(x[0], x[1]), x[2]);
+  float miny = MIN(MIN(y[0], y[1]), y[2]);
+  float maxx = MAX(MAX(x[0], x[1]), x[2]);
+  float maxy = MAX(MAX(y[0], y[1]), y[2]);
+
+  /* clamp the bounds before converting them to ints */
+  int x0 = (int)floorf(CLAMP(minx, (float)clip[0], (float)clip[2]));
+  int y0 = (int)floorf(CLAMP(miny, (float)clip[1], (float)clip[3]));
+  int x1 = (int)ceilf(CLAMP(maxx, (float)clip[0], (float)clip[2]));
+  int y1 = (int)ceilf(CLAMP(maxy, (float)clip[1], (float)clip[3]));
+
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  if (sr->num_tris >= sr->max_tris) {
+    sr->max_tris = MAX(sr->max_tris * 2, 4096);
+    sr->tris = realloc(sr->tris, sr->max_tris * sizeof(sr->tris[0]));
+    CHECK_NOTNULL(sr->tris);
+  }
+
+  int n = sr->num_tris++;
+  struct sr_tri *tri = &sr->tris[n];
+  tri->state = state;
+  tri->x0 = x0;
+  tri->y0 = y0;
+  tri->x1 = x1;
+  tri->y1 = y1;
+
+  /* edge i is opposite of vertex i */
+  for (int i = 0; i < 3; i++) {
+    int a = (i + 1) % 3;
+    int b = (i + 2) % 3;
+    float *e = tri->edges[i];
+    e[0] = y[a] - y[b];
+    e[1] = x[b] - x[a];
+    e[2] = x[a] * y[b] - y[a] * x[b];
+
+    /* top-left fill rule, pixel centers exactly on an edge are only covered
+       by left edges and top edges */
+    tri->topleft[i] = e[0] > 0.0f || (e[0] == 0.0f && e[1] < 0.0f);
+  }
+
+  float inv_area = 1.0f / area;
+  float iz[3], col[3][4], offset[3][4];
+
+  for (int i = 0; i < 3; i++) {
+    iz[i] = v[i]->xyz[2];
+    sr_unpack_rgba(v[i]->color, col[i]);
+    sr_unpack_rgba(v[i]->offset_color, offset[i]);
+  }
+
+  sr_setup_plane(tri->planes[SR_PLANE_IZ], tri->edges, iz[0], iz[1], iz[2],
+                 inv_area);
+  sr_setup_plane(tri->planes[SR_PLANE_U], tri->edges, v[0]->uv[0] * iz[0],
+                 v[1]->uv[0] * iz[1], v[2]->uv[0] * iz[2], inv_area);
+  sr_setup_plane(tri->planes[SR_PLANE_V], tri->edges, v[0]->uv[1] * iz[0],
+                 v[1]->uv[1] * iz[1], v[2]->uv[1] * iz[2], inv_area);
+
+  for (int i = 0; i < 4; i++) {
+    sr_setup_plane(tri->planes[SR_PLANE_R + i], tri->edges, col[0][i] * iz[0],
+                   col[1][i] * iz[1], col[2][i] * iz[2], inv_area);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    sr_setup_plane(tri->planes[SR_PLANE_OFFSET_R + i], tri->edges,
+                   offset[0][i] * iz[0], offset[1][i] * iz[1],
+                   offset[2][i] * iz[2], inv_area);
+  }
+
+  sr_bin_tri(sr, n);
+}
+
+int64_t sr_volume_time(struct sr *sr) {
+  int64_t total = 0;
+  for (int i = 0; i < sr->num_bins; i++) {
+    total += sr->bins[i].volume_time;
+  }
+  return total;
+}
+
+int sr_num_tris(struct sr *sr) {
+  return sr->num_tris;
+}
+
+void sr_end(struct sr *sr) {
+  worker_pool_run(sr->workers, &sr_raster_job, sr, sr->num_bins);
+}
+
+static int sr_push_state(struct sr *sr, const struct sr_state *state) {
+  if (sr->num_states >= sr->max_states) {
+    sr->max_states = MAX(sr->max_states * 2, 1024);
+    sr->states = realloc(sr->states, sr->max_states * sizeof(sr->states[0]));
+    CHECK_NOTNULL(sr->states);
+  }
+
+  int n = sr->num_states++;
+  sr->states[n] = *state;
+  return n;
+}
+
+void sr_resolve_volumes(struct sr *sr, float scale) {
+  if (sr->num_resolves >= sr->max_resolves) {
+    sr->max_resolves = MAX(sr->max_resolves * 2, 16);
+    sr->resolves =
+        realloc(sr->resolves, sr->max_resolves * sizeof(sr->resolves[0]));
+    CHECK_NOTNULL(sr->resolves);
+  }
+
+  int n = sr->num_resolves++;
+  struct sr_resolve *resolve = &sr->resolves[n];
+  resolve->scale = scale;
+  resolve->num_outside = sr->num_outside;
+  sr->num_outside = 0;
+
+  /* the resolve applies to every tile, whether or not a volume was drawn in
+     it */
+  for (int i = 0; i < sr->num_bins; i++) {
+    sr_bin_push(&sr->bins[i], -1 - n);
+  }
+}
+
+void sr_draw_volume(struct sr *sr, const struct ta_volume_tri *tris,
+                    int num_tris, int outside) {
+  struct sr_state state = {0};
+  state.surf.depth_func = DEPTH_LESS;
+  state.surf.cull = CULL_NONE;
+  state.volume = 1;
+  state.outside = outside;
+
+  int n = sr_push_state(sr, &state);
+  int clip[4] = {0, 0, sr->clip_width, sr->clip_height};
+
+  sr->num_outside += outside;
+
+  if (clip[0] >= clip[2] || clip[1] >= clip[3]) {
+    return;
+  }
+
+  for (int i = 0; i < num_tris; i++) {
+    struct ta_vertex v[3];
+    memset(v, 0, sizeof(v));
+
+    for (int j = 0; j < 3; j++) {
+      memcpy(v[j].xyz, tris[i].xyz[j], sizeof(v[j].xyz));
+    }
+
+    sr_setup_tri(sr, n, clip, &v[0], &v[1], &v[2]);
+  }
+}
+
+void sr_draw(struct sr *sr, const struct sr_state *state,
+             const uint16_t *indices, int first, int num_verts) {
+  int n = sr_push_state(sr, state);
+
+  /* clip rect as x0, y0, x1, y1 */
+  int clip[4] = {0, 0, sr->clip_width, sr->clip_height};
+
+  if (state->scissor) {
+    const int *rect = state->scissor_rect;
+    clip[0] = MAX(clip[0], rect[0]);
+    clip[1] = MAX(clip[1], rect[1]);
+    clip[2] = MIN(clip[2], rect[0] + rect[2]);
+    clip[3] = MIN(clip[3], rect[1] + rect[3]);
+  }
+
+  if (clip[0] >= clip[2] || clip[1] >= clip[3]) {
+    return;
+  }
+
+  for (int i = first; i + 2 < first + num_verts; i += 3) {
+    int i0 = indices ? indices[i] : i;
+    int i1 = indices ? indices[i + 1] : i + 1;
+    int i2 = indices ? indices[i + 2] : i + 2;
+    DCHECK(i0 < sr->num_verts && i1 < sr->num_verts && i2 < sr->num_verts);
+
+    sr_setup_tri(sr, n, clip, &sr->verts[i0], &sr->verts[i1], &sr->verts[i2]);
+  }
+}
+
+void sr_begin(struct sr *sr, struct sr_target *target, int viewport_width,
+              int viewport_height, const float *xform,
+              const struct ta_vertex *verts, int num_verts) {
+  sr->target = target;
+  sr->clip_width = MIN(viewport_width, target->width);
+  sr->clip_height = MIN(viewport_height, target->height);
+  memcpy(sr->xform, xform, sizeof(sr->xform));
+  sr->verts = verts;
+  sr->num_verts = num_verts;
+  sr->num_states = 0;
+  sr->num_tris = 0;
+  sr->num_resolves = 0;
+  sr->num_outside = 0;
+
+  sr->bins_x = (MAX(sr->clip_width, 0) + SR_TILE_SIZE - 1) / SR_TILE_SIZE;
+  sr->bins_y = (MAX(sr->clip_height, 0) + SR_TILE_SIZE - 1) / SR_TILE_SIZE;
+  sr->num_bins = sr->bins_x * sr->bins_y;
+
+  if (sr->num_bins > sr->max_bins) {
+    sr->bins = realloc(sr->bins, sr->num_bins * sizeof(sr->bins[0]));
+    CHECK_NOTNULL(sr->bins);
+    memset(sr->bins + sr->max_bins, 0,
+           (sr->num_bins - sr->max_bins) * sizeof(sr->bins[0]));
+    sr->max_bins = sr->num_bins;
+  }
+
+  for (int i = 0; i < sr->num_bins; i++) {
+    sr->bins[i].num_tris = 0;
+    sr->bins[i].volume_time = 0;
+  }
+}
+
+void sr_clear(struct sr_target *target, uint32_t color) {
+  int num_pixels = target->width * target->height;
+
+  for (int i = 0; i < num_pixels; i++) {
+    target->color[i] = color;
+    target->depth[i] = SR_MAX_DEPTH;
+    target->stencil[i] = 0;
+  }
+}
+
+void sr_destroy(struct sr *sr) {
+  worker_pool_destroy(sr->workers);
+
+  for (int i = 0; i < sr->max_bins; i++) {
+    free(sr->bins[i].tris);
+  }
+
+  free(sr->bins);
+  free(sr->resolves);
+  free(sr->tris);
+  free(sr->states);
+  free(sr);
+}
+
+struct sr *sr_create(int num_workers, enum sr_impl impl) {
+  CHECK(sr_supported(impl));
+
+  struct sr *sr = calloc(1, sizeof(struct sr));
+
+  sr->impl = impl;
+  sr->raster = &sr_raster_tri_scalar;
+#if ARCH_X64
+  if (impl == SR_SSE2) {
+    sr->raster = &sr_raster_tri_sse2;
+  }
+#endif
+
+  sr->workers = worker_pool_create(CLAMP(num_workers, 0, SR_MAX_WORKERS));
+
+  return sr;
+}
+
+enum sr_impl sr_selected() {
+  return sr_supported(SR_SSE2) ? SR_SSE2 : SR_SCALAR;
+}
+
+int sr_supported(enum sr_impl impl) {
+  switch (impl) {
+    case SR_SCALAR:
+      return 1;
+    case SR_SSE2:
+#if ARCH_X64
+      return 1;
+#else
+      return 0;
+#endif
+    default:
+      return 0;
+  }
+}
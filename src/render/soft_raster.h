@@ -0,0 +1,112 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <stdint.h>
+#include "render/render_backend.h"
+
+/*
+ * tile-based software rasterizer
+ *
+ * triangles are set up and binned into fixed-size screen tiles as they're
+ * submitted, preserving their submission order inside of each tile. when the
+ * pass ends, the tiles are rasterized in parallel by a pool of worker threads.
+ * each tile is owned by a single thread while it's rasterized, so no further
+ * synchronization is needed on the render target
+ *
+ * the pipeline mirrors the ta shaders used by the gl backend. positions are
+ * in window space with the origin at the bottom left, and the render target
+ * and texture rows are stored bottom to top like OpenGL
+ */
+
+#define SR_TILE_SIZE 32
+#define SR_MAX_WORKERS 16
+
+/* the depth buffer stores w instead of the log2(1 + w) / 17 written by the gl
+   backend, which orders fragments the same way. this is the largest w that
+   normalization can represent, and the value the depth buffer is cleared to */
+#define SR_MAX_DEPTH 131071.0f
+
+enum sr_impl {
+  SR_SCALAR,
+  SR_SSE2,
+  SR_NUM_IMPLS,
+};
+
+extern const char *sr_impl_names[SR_NUM_IMPLS];
+
+struct sr_texture {
+  int width;
+  int height;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+  /* rgba8888 pixels, with the red component in the low byte. for textures
+     of palette indices, each pixel is an index instead */
+  uint32_t *pixels;
+};
+
+struct sr_target {
+  int width;
+  int height;
+  uint32_t *color;
+  float *depth;
+  /* modifier volume state of each pixel */
+  uint8_t *stencil;
+};
+
+struct sr_state {
+  /* render state of the surface, its texture handles and vertex range are
+     ignored */
+  struct ta_surface surf;
+  const struct sr_texture *texture;
+  /* set when the texture's pixels are palette indices, pointing at the entry
+     of the palette at the surface's palette base */
+  const uint32_t *palette;
+
+  /* scissor rect in window space, x, y, width and height */
+  int scissor;
+  int scissor_rect[4];
+
+  /* set for the triangles of a modifier volume by sr_draw_volume */
+  int volume;
+  int outside;
+};
+
+struct sr;
+
+int sr_supported(enum sr_impl impl);
+enum sr_impl sr_selected();
+
+struct sr *sr_create(int num_workers, enum sr_impl impl);
+void sr_destroy(struct sr *sr);
+
+void sr_clear(struct sr_target *target, uint32_t color);
+
+/* begin a pass rendering to the target. xform scales and offsets the vertex
+   positions into window space, x' = x * xform[0] + xform[1] and
+   y' = y * xform[2] + xform[3] */
+void sr_begin(struct sr *sr, struct sr_target *target, int viewport_width,
+              int viewport_height, const float *xform,
+              const struct ta_vertex *verts, int num_verts);
+/* set up and bin the triangles. if indices is NULL, the vertices are drawn in
+   order starting at first */
+void sr_draw(struct sr *sr, const struct sr_state *state,
+             const uint16_t *indices, int first, int num_verts);
+/* bin the triangles of a modifier volume. each pixel tracks the parity of
+   the volume's triangles in front of it, which is odd for pixels inside of
+   the volume */
+void sr_draw_volume(struct sr *sr, const struct ta_volume_tri *tris,
+                    int num_tris, int outside);
+/* scale the color of each pixel modified by a volume drawn since the last
+   resolve, if the surface drawn there has shadow set */
+void sr_resolve_volumes(struct sr *sr, float scale);
+/* rasterize the binned triangles, returning once the target is complete */
+void sr_end(struct sr *sr);
+
+/* number of triangles binned during the last pass */
+int sr_num_tris(struct sr *sr);
+/* time spent drawing and resolving modifier volumes during the last pass,
+   summed across each thread */
+int64_t sr_volume_time(struct sr *sr);
+
+#endif
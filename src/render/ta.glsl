@@ -38,13 +38,47 @@ static const char *ta_fp =
 
 "layout(location = 0) out mediump vec4 fragcolor;\n"
 
+"#ifdef PALETTE\n"
+"uniform sampler2D u_palette;\n"
+"uniform int u_palette_base;\n"
+
+"// the diffuse texture holds palette indices, sampled with nearest filtering\n"
+"// so they're never blended together. bilinear filtering is performed on\n"
+"// the colors looked up for the four surrounding texels instead\n"
+"mediump vec4 lookup_palette(highp vec2 uv) {\n"
+"  int idx = int(texture(u_diffuse, uv).r * 255.0 + 0.5);\n"
+"  return texelFetch(u_palette, ivec2(u_palette_base + idx, 0), 0);\n"
+"}\n"
+
+"mediump vec4 sample_diffuse(highp vec2 uv) {\n"
+"  #ifdef PALETTE_BILINEAR\n"
+"    highp vec2 size = vec2(textureSize(u_diffuse, 0));\n"
+"    highp vec2 texel = 1.0 / size;\n"
+"    highp vec2 st = uv * size - 0.5;\n"
+"    highp vec2 base = (floor(st) + 0.5) * texel;\n"
+"    highp vec2 f = fract(st);\n"
+"    mediump vec4 c00 = lookup_palette(base);\n"
+"    mediump vec4 c10 = lookup_palette(base + vec2(texel.x, 0.0));\n"
+"    mediump vec4 c01 = lookup_palette(base + vec2(0.0, texel.y));\n"
+"    mediump vec4 c11 = lookup_palette(base + texel);\n"
+"    return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);\n"
+"  #else\n"
+"    return lookup_palette(uv);\n"
+"  #endif\n"
+"}\n"
+"#else\n"
+"mediump vec4 sample_diffuse(highp vec2 uv) {\n"
+"  return texture(u_diffuse, uv);\n"
+"}\n"
+"#endif\n"
+
 "void main() {\n"
 "  mediump vec4 col = var_color;\n"
 "  #ifdef IGNORE_ALPHA\n"
 "    col.a = 1.0;\n"
 "  #endif\n"
 "  #ifdef TEXTURE\n"
-"    mediump vec4 tex = texture(u_diffuse, var_texcoord);\n"
+"    mediump vec4 tex = sample_diffuse(var_texcoord);\n"
 "    #ifdef IGNORE_TEXTURE_ALPHA\n"
 "      tex.a = 1.0;\n"
 "    #endif\n"
@@ -99,3 +133,31 @@ static const char *ta_fp =
 "    fragcolor.rgb = vec3(gl_FragDepth);\n"
 "  #endif\n"
 "}";
+
+/* modifier volume triangles are drawn with ta_vp, only writing depth. the
+   depth written must match ta_fp's for the volumes to be tested against the
+   surfaces correctly */
+static const char *ta_volume_fp =
+"void main() {\n"
+"  highp float w = 1.0 / gl_FragCoord.w;\n"
+"  gl_FragDepth = log2(1.0 + w) / 17.0;\n"
+"}";
+
+/* full screen quad scaling the color of the pixels selected by the stencil
+   test, the color is multiplied in by the blend func */
+static const char *ta_resolve_vp =
+"const vec2 verts[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0),\n"
+"                              vec2(-1.0, 1.0), vec2(1.0, 1.0));\n"
+
+"void main() {\n"
+"  gl_Position = vec4(verts[gl_VertexID], 0.0, 1.0);\n"
+"}";
+
+static const char *ta_resolve_fp =
+"uniform mediump float u_shadow_scale;\n"
+
+"layout(location = 0) out mediump vec4 fragcolor;\n"
+
+"void main() {\n"
+"  fragcolor = vec4(vec3(u_shadow_scale), 1.0);\n"
+"}";
@@ -22,7 +22,7 @@ static const char *list_names[] = {
 
 static const char *pxl_names[] = {
     "PXL_INVALID", "PXL_RGBA",     "PXL_RGBA5551",
-    "PXL_RGB565",  "PXL_RGBA4444", "PXL_RGBA8888",
+    "PXL_RGB565",  "PXL_RGBA4444", "PXL_INDEX8",
 };
 
 static const char *filter_names[] = {
@@ -85,6 +85,7 @@ struct tracer {
 
   /* render state */
   struct tr_context rc;
+  struct r_cmdbuf *cmds;
   int debug_depth;
   struct tracer_texture textures[1024];
   struct rb_tree live_textures;
@@ -212,8 +213,8 @@ static void tracer_prev_context(struct tracer *tracer) {
   tracer->current_param = -1;
   tracer->scroll_to_param = 0;
   trace_copy_context(tracer->current_cmd, &tracer->ctx);
-  tr_convert_context(tracer->r, tracer, &tracer_find_texture, &tracer->ctx,
-                     &tracer->rc);
+  tr_convert_context(tracer->r, NULL, tracer, &tracer_find_texture,
+                     &tracer->ctx, &tracer->rc);
 }
 
 static void tracer_next_context(struct tracer *tracer) {
@@ -251,8 +252,8 @@ static void tracer_next_context(struct tracer *tracer) {
   tracer->current_param = -1;
   tracer->scroll_to_param = 0;
   trace_copy_context(tracer->current_cmd, &tracer->ctx);
-  tr_convert_context(tracer->r, tracer, &tracer_find_texture, &tracer->ctx,
-                     &tracer->rc);
+  tr_convert_context(tracer->r, NULL, tracer, &tracer_find_texture,
+                     &tracer->ctx, &tracer->rc);
 }
 
 static void tracer_reset_context(struct tracer *tracer) {
@@ -656,7 +657,9 @@ void tracer_run_frame(struct tracer *tracer) {
     surf->debug_depth = tracer->debug_depth;
   }
 
-  tr_render_context_until(tracer->r, rc, end_surf);
+  r_reset_cmdbuf(tracer->cmds);
+  tr_record_context_until(tracer->cmds, rc, end_surf);
+  r_replay_cmdbuf(tracer->r, tracer->cmds);
 
   /* render ui */
   imgui_render(tracer->imgui);
@@ -689,6 +692,10 @@ void tracer_destroy(struct tracer *tracer) {
 
   video_destroy_renderer(tracer->host, tracer->r);
 
+  tr_free_context(&tracer->rc);
+  r_destroy_cmdbuf(tracer->cmds);
+  ta_release_params(&tracer->ctx);
+
   free(tracer);
 }
 
@@ -704,6 +711,7 @@ struct tracer *tracer_create(struct host *host) {
   /* setup renderer */
   tracer->r = video_create_renderer(tracer->host);
   tracer->imgui = imgui_create(tracer->r);
+  tracer->cmds = r_create_cmdbuf();
 
   /* add all textures to free list */
   for (int i = 0, n = array_size(tracer->textures); i < n; i++) {
@@ -0,0 +1,45 @@
+#include "core/hash.h"
+#include "retest.h"
+
+struct hash_vector {
+  const char *input;
+  uint64_t seed;
+  uint64_t expected;
+};
+
+/* reference xxh64 results */
+static struct hash_vector vectors[] = {
+    {"", 0, 0xef46db3751d8e999ull},
+    {"a", 0, 0xd24ec4f1a98c6e5bull},
+    {"abc", 0, 0x44bc2cf5ad770999ull},
+    {"Nobody inspects the spammish repetition", 0, 0xfbcea83c8a378bf1ull},
+};
+
+TEST(hash64_vectors) {
+  for (int i = 0; i < array_size(vectors); i++) {
+    struct hash_vector *v = &vectors[i];
+    uint64_t actual = hash64(v->input, (int)strlen(v->input), v->seed);
+    CHECK_EQ(actual, v->expected);
+  }
+}
+
+TEST(hash64_sensitivity) {
+  uint8_t data[4096];
+
+  for (int i = 0; i < array_size(data); i++) {
+    data[i] = (uint8_t)i;
+  }
+
+  /* flipping any single bit must change the hash, regardless of where it
+     lands relative to the 32 byte stripes */
+  uint64_t original = hash64(data, sizeof(data), 0);
+
+  for (int i = 0; i < array_size(data); i += 37) {
+    data[i] ^= 0x10;
+    CHECK_NE(hash64(data, sizeof(data), 0), original);
+    data[i] ^= 0x10;
+  }
+
+  CHECK_EQ(hash64(data, sizeof(data), 0), original);
+  CHECK_NE(hash64(data, sizeof(data), 1), original);
+}
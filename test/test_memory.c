@@ -0,0 +1,161 @@
+#include "core/memory.h"
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+#include "guest/sh4/sh4.h"
+#include "retest.h"
+
+/* main ram and 64-bit interleaved video ram, as seen by the sh4 */
+#define RAM_ADDR 0x8c100000
+#define VRAM64_ADDR 0xa5000000
+#define TA_TEXTURE_ADDR 0x11000000
+
+#define COPY_SIZE 0x10000
+
+/* textures packed back to back in video ram, without being page aligned,
+   with a fraction of them being uploaded through the ta texture fifo each
+   frame */
+#define TRACK_TEXTURE_SIZE 0x1800
+#define TRACK_NUM_TEXTURES 256
+#define TRACK_UPLOAD_SIZE 0x400
+#define TRACK_FRAMES 64
+
+static uint8_t src_data[COPY_SIZE + 0x100];
+static uint8_t dst_data[COPY_SIZE + 0x100];
+
+static void fill_data(uint8_t *data, int size) {
+  for (int i = 0; i < size; i++) {
+    data[i] = (uint8_t)rand();
+  }
+}
+
+TEST(as_memcpy_multi_page) {
+  struct dreamcast *dc = dc_create(NULL);
+  CHECK_NOTNULL(dc);
+  struct address_space *space = dc->sh4->memory_if->space;
+
+  /* use an unaligned size and address so each copy straddles several pages
+     with partial pages on either end */
+  int size = COPY_SIZE + 0x64;
+  uint32_t src = RAM_ADDR + 0x10;
+  uint32_t dst = RAM_ADDR + 0x40030;
+
+  fill_data(src_data, size);
+  as_memcpy_to_guest(space, src, src_data, size);
+  as_memcpy(space, dst, src, size);
+  as_memcpy_to_host(space, dst_data, dst, size);
+
+  CHECK_EQ(memcmp(src_data, dst_data, size), 0);
+
+  dc_destroy(dc);
+}
+
+TEST(as_memcpy_mmio) {
+  struct dreamcast *dc = dc_create(NULL);
+  CHECK_NOTNULL(dc);
+  struct address_space *space = dc->sh4->memory_if->space;
+
+  /* copy through the interleaved video ram handlers, which span many pages of
+     the same mmio region */
+  fill_data(src_data, COPY_SIZE);
+  as_memcpy_to_guest(space, RAM_ADDR, src_data, COPY_SIZE);
+  as_memcpy(space, VRAM64_ADDR, RAM_ADDR, COPY_SIZE);
+
+  for (int i = 0; i < COPY_SIZE; i += 4) {
+    uint32_t expected = *(uint32_t *)&src_data[i];
+    uint32_t actual = as_read32(space, VRAM64_ADDR + i);
+    CHECK_EQ(expected, actual);
+  }
+
+  /* mmio to mmio copies are bounced through a temporary buffer */
+  as_memcpy(space, VRAM64_ADDR + COPY_SIZE, VRAM64_ADDR, COPY_SIZE);
+  as_memcpy_to_host(space, dst_data, VRAM64_ADDR + COPY_SIZE, COPY_SIZE);
+
+  CHECK_EQ(memcmp(src_data, dst_data, COPY_SIZE), 0);
+
+  dc_destroy(dc);
+}
+
+/*
+ * texture invalidation
+ */
+static int track_written[TRACK_NUM_TEXTURES];
+static int track_page_written[TRACK_NUM_TEXTURES * TRACK_TEXTURE_SIZE / 4096];
+
+static void track_upload_textures(struct dreamcast *dc, int frame) {
+  struct address_space *space = dc->sh4->memory_if->space;
+  int page_size = (int)get_page_size();
+
+  memset(track_written, 0, sizeof(track_written));
+  memset(track_page_written, 0, sizeof(track_page_written));
+
+  for (int i = 0; i < TRACK_NUM_TEXTURES; i++) {
+    if ((i * 7 + frame) % 8) {
+      continue;
+    }
+
+    uint32_t offset = (frame * TRACK_UPLOAD_SIZE) % TRACK_TEXTURE_SIZE;
+    uint32_t dst = i * TRACK_TEXTURE_SIZE + offset;
+    as_memcpy_to_guest(space, TA_TEXTURE_ADDR + dst, src_data,
+                       TRACK_UPLOAD_SIZE);
+    track_written[i] = 1;
+
+    int first = dst / page_size;
+    int last = (dst + TRACK_UPLOAD_SIZE - 1) / page_size;
+    for (int p = first; p <= last; p++) {
+      track_page_written[p] = 1;
+    }
+  }
+}
+
+/* if a page granular write watch on the texture would have fired */
+static int track_watch_fired(int i) {
+  int page_size = (int)get_page_size();
+  int first = (i * TRACK_TEXTURE_SIZE) / page_size;
+  int last = ((i + 1) * TRACK_TEXTURE_SIZE - 1) / page_size;
+
+  for (int p = first; p <= last; p++) {
+    if (track_page_written[p]) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+TEST(vram_write_tracking) {
+  struct dreamcast *dc = dc_create(NULL);
+  CHECK_NOTNULL(dc);
+
+  uint64_t vram_dirty[PVR_VRAM_DIRTY_WORDS];
+  uint64_t palette_dirty;
+
+  fill_data(src_data, TRACK_UPLOAD_SIZE);
+  pvr_collect_dirty(dc->pvr, vram_dirty, &palette_dirty);
+
+  for (int frame = 0; frame < TRACK_FRAMES; frame++) {
+    track_upload_textures(dc, frame);
+
+    pvr_collect_dirty(dc->pvr, vram_dirty, &palette_dirty);
+
+    for (int i = 0; i < TRACK_NUM_TEXTURES; i++) {
+      int first = (i * TRACK_TEXTURE_SIZE) >> PVR_VRAM_BLOCK_SHIFT;
+      int last = ((i + 1) * TRACK_TEXTURE_SIZE - 1) >> PVR_VRAM_BLOCK_SHIFT;
+      int invalidated = 0;
+
+      for (int b = first; b <= last; b++) {
+        if (vram_dirty[b >> 6] & (UINT64_C(1) << (b & 63))) {
+          invalidated = 1;
+          break;
+        }
+      }
+
+      /* the bitmap must never miss a write, and its sub-page blocks shouldn't
+         over invalidate any more than page granular watches would */
+      CHECK(!track_written[i] || invalidated);
+      CHECK(!invalidated || track_watch_fired(i));
+    }
+  }
+
+  dc_destroy(dc);
+}
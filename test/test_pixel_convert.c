@@ -0,0 +1,297 @@
+#include "guest/pvr/pixel_convert.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "retest.h"
+
+#define MAX_TEXTURE_SIZE 0x100000
+
+enum {
+  FMT_1555,
+  FMT_565,
+  FMT_4444,
+  FMT_PAL4_1555,
+  FMT_PAL4_565,
+  FMT_PAL4_4444,
+  FMT_PAL4_8888,
+  FMT_PAL8_1555,
+  FMT_PAL8_565,
+  FMT_PAL8_4444,
+  FMT_PAL8_8888,
+  NUM_FMTS,
+};
+
+enum {
+  LAYOUT_PLANAR,
+  LAYOUT_TWIDDLED,
+  LAYOUT_VQ,
+  NUM_LAYOUTS,
+};
+
+static const char *fmt_names[NUM_FMTS] = {
+    "1555",      "565",       "4444",     "pal4 1555", "pal4 565",
+    "pal4 4444", "pal4 8888", "pal8 1555", "pal8 565", "pal8 4444",
+    "pal8 8888",
+};
+
+static const char *layout_names[NUM_LAYOUTS] = {"planar", "twiddled", "vq"};
+
+/* tcw pixel format and palette pixel format of each format */
+static const int fmt_pixel_formats[NUM_FMTS] = {
+    TA_PIXEL_1555, TA_PIXEL_565,  TA_PIXEL_4444, TA_PIXEL_4BPP,
+    TA_PIXEL_4BPP, TA_PIXEL_4BPP, TA_PIXEL_4BPP, TA_PIXEL_8BPP,
+    TA_PIXEL_8BPP, TA_PIXEL_8BPP, TA_PIXEL_8BPP,
+};
+
+static const int fmt_pal_formats[NUM_FMTS] = {
+    0, 0, 0, TA_PAL_ARGB1555, TA_PAL_RGB565, TA_PAL_ARGB4444, TA_PAL_ARGB8888,
+    TA_PAL_ARGB1555, TA_PAL_RGB565, TA_PAL_ARGB4444, TA_PAL_ARGB8888,
+};
+
+static uint8_t texture[MAX_TEXTURE_SIZE];
+static uint32_t palette[256];
+static uint16_t converted_palette[256];
+static uint16_t expected[1024 * 1024];
+static uint16_t actual[1024 * 1024];
+
+static int fmt_paletted(int fmt) {
+  return fmt >= FMT_PAL4_1555;
+}
+
+static int fmt_pal4(int fmt) {
+  return fmt >= FMT_PAL4_1555 && fmt <= FMT_PAL4_8888;
+}
+
+static int case_valid(int fmt, int layout) {
+  /* paletted textures are always twiddled and never compressed */
+  return !fmt_paletted(fmt) || layout == LAYOUT_TWIDDLED;
+}
+
+static int size_bits(int size) {
+  int bits = 0;
+  while ((8 << bits) < size) {
+    bits++;
+  }
+  return bits;
+}
+
+/* describe the case as the texture the tile renderer would convert */
+static void case_texture(int fmt, int layout, int mipmaps, int width,
+                         int height, struct tr_texture *tex) {
+  memset(tex, 0, sizeof(*tex));
+  tex->tsp.texture_u_size = size_bits(width);
+  tex->tsp.texture_v_size = size_bits(height);
+  tex->tcw.pixel_format = fmt_pixel_formats[fmt];
+  tex->tcw.scan_order = layout == LAYOUT_PLANAR;
+  tex->tcw.vq_compressed = layout == LAYOUT_VQ;
+  tex->tcw.mip_mapped = mipmaps;
+  tex->texture = texture;
+  tex->palette = (const uint8_t *)palette;
+}
+
+static void fill_data(uint8_t *data, int size) {
+  for (int i = 0; i < size; i++) {
+    data[i] = (uint8_t)rand();
+  }
+}
+
+/* convert using the original per-pixel helpers */
+static void convert_reference(int fmt, int layout, const uint8_t *input,
+                              uint16_t *dst, int width, int height) {
+  const uint8_t *codebook = texture;
+  const uint8_t *index = input + TA_CODEBOOK_SIZE;
+  const uint16_t *src = (const uint16_t *)input;
+
+  switch (fmt) {
+    case FMT_1555:
+      if (layout == LAYOUT_VQ) {
+        convert_vq_ARGB1555_RGBA5551(codebook, index, dst, width, height);
+      } else if (layout == LAYOUT_TWIDDLED) {
+        convert_twiddled_ARGB1555_RGBA5551(src, dst, width, height);
+      } else {
+        convert_ARGB1555_RGBA5551(src, dst, width, height, width);
+      }
+      break;
+    case FMT_565:
+      if (layout == LAYOUT_VQ) {
+        convert_vq_RGB565_RGB565(codebook, index, dst, width, height);
+      } else if (layout == LAYOUT_TWIDDLED) {
+        convert_twiddled_RGB565_RGB565(src, dst, width, height);
+      } else {
+        convert_RGB565_RGB565(src, dst, width, height, width);
+      }
+      break;
+    case FMT_4444:
+      if (layout == LAYOUT_VQ) {
+        convert_vq_ARGB4444_RGBA4444(codebook, index, dst, width, height);
+      } else if (layout == LAYOUT_TWIDDLED) {
+        convert_twiddled_ARGB4444_RGBA4444(src, dst, width, height);
+      } else {
+        convert_ARGB4444_RGBA4444(src, dst, width, height, width);
+      }
+      break;
+    case FMT_PAL4_1555:
+      convert_pal4_ARGB1555_RGBA5551(input, dst, palette, width, height);
+      break;
+    case FMT_PAL4_565:
+      convert_pal4_RGB565_RGB565(input, dst, palette, width, height);
+      break;
+    case FMT_PAL4_4444:
+      convert_pal4_ARGB4444_RGBA4444(input, dst, palette, width, height);
+      break;
+    case FMT_PAL4_8888:
+      convert_pal4_ARGB8888_RGBA4444(input, dst, palette, width, height);
+      break;
+    case FMT_PAL8_1555:
+      convert_pal8_ARGB1555_RGBA5551(input, dst, palette, width, height);
+      break;
+    case FMT_PAL8_565:
+      convert_pal8_RGB565_RGB565(input, dst, palette, width, height);
+      break;
+    case FMT_PAL8_4444:
+      convert_pal8_ARGB4444_RGBA4444(input, dst, palette, width, height);
+      break;
+    case FMT_PAL8_8888:
+      convert_pal8_ARGB8888_RGBA4444(input, dst, palette, width, height);
+      break;
+  }
+}
+
+TEST(pixel_convert_exact) {
+  static const int sizes[][2] = {{8, 8}, {256, 256}, {512, 64}, {64, 512}};
+
+  fill_data(texture, sizeof(texture));
+  fill_data((uint8_t *)palette, sizeof(palette));
+
+  for (int s = 0; s < array_size(sizes); s++) {
+    int width = sizes[s][0];
+    int height = sizes[s][1];
+
+    for (int fmt = 0; fmt < NUM_FMTS; fmt++) {
+      for (int layout = 0; layout < NUM_LAYOUTS; layout++) {
+        if (!case_valid(fmt, layout)) {
+          continue;
+        }
+
+        for (int mipmaps = 0; mipmaps < 2; mipmaps++) {
+          /* planar textures can't have mipmaps */
+          if (mipmaps && layout == LAYOUT_PLANAR) {
+            continue;
+          }
+
+          /* mipmapped textures are always square */
+          struct tr_texture tex;
+          case_texture(fmt, layout, mipmaps, width, height, &tex);
+          int w = ta_texture_width(tex.tsp, tex.tcw);
+          int h = ta_texture_height(tex.tsp, tex.tcw);
+          int size = w * h * sizeof(uint16_t);
+
+          const uint8_t *input = tr_texture_source(tex.tsp, tex.tcw, texture);
+          convert_reference(fmt, layout, input, expected, w, h);
+
+          for (int impl = 0; impl < PIXEL_CONVERT_NUM_IMPLS; impl++) {
+            if (!pixel_convert_supported(impl)) {
+              continue;
+            }
+
+            memset(actual, 0, size);
+            tr_texture_convert_impl(impl, &tex, fmt_pal_formats[fmt], 0,
+                                    (uint8_t *)actual);
+
+            int res = memcmp(expected, actual, size);
+            if (res) {
+              LOG_INFO("%s %s %s mipmaps=%d %dx%d mismatch",
+                       pixel_convert_names[impl], fmt_names[fmt],
+                       layout_names[layout], mipmaps, w, h);
+            }
+            CHECK_EQ(res, 0);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* 4 x 4 macroblocks, the output texture is 64 x 64 UYVY pixels */
+#define YUV_MACROBLOCKS 4
+#define YUV_MACROBLOCK_SIZE 384
+#define YUV_STRIDE (YUV_MACROBLOCKS * 16 * 2)
+
+static uint8_t yuv_expected[YUV_STRIDE * YUV_MACROBLOCKS * 16];
+static uint8_t yuv_actual[YUV_STRIDE * YUV_MACROBLOCKS * 16];
+
+/* reencode an 8x8 subblock of YUV420 data as UYVY422 the way the ta
+   originally did, one pair of pixels at a time */
+static void convert_yuv420_block(const uint8_t *in_uv, const uint8_t *in_y,
+                                 uint8_t *out_uyvy, int stride) {
+  uint8_t *out_row0 = out_uyvy;
+  uint8_t *out_row1 = out_uyvy + stride;
+
+  for (int j = 0; j < 8; j += 2) {
+    for (int i = 0; i < 8; i += 2) {
+      out_row0[0] = in_uv[0];
+      out_row0[1] = in_y[0];
+      out_row0[2] = in_uv[64];
+      out_row0[3] = in_y[1];
+
+      out_row1[0] = in_uv[0];
+      out_row1[1] = in_y[8];
+      out_row1[2] = in_uv[64];
+      out_row1[3] = in_y[9];
+
+      in_uv += 1;
+      in_y += 2;
+      out_row0 += 4;
+      out_row1 += 4;
+    }
+
+    in_uv += 4;
+    in_y += 8;
+    out_row0 += (stride << 1) - 16;
+    out_row1 += (stride << 1) - 16;
+  }
+}
+
+static void convert_yuv420_reference(const uint8_t *in, uint8_t *out,
+                                     int stride) {
+  convert_yuv420_block(&in[0], &in[128], &out[0], stride);
+  convert_yuv420_block(&in[4], &in[192], &out[16], stride);
+  convert_yuv420_block(&in[32], &in[256], &out[stride * 8], stride);
+  convert_yuv420_block(&in[36], &in[320], &out[stride * 8 + 16], stride);
+}
+
+static void convert_yuv420_macroblocks(enum pixel_convert_impl impl,
+                                       uint8_t *dst) {
+  for (int i = 0; i < YUV_MACROBLOCKS * YUV_MACROBLOCKS; i++) {
+    const uint8_t *in = &texture[i * YUV_MACROBLOCK_SIZE];
+    int x = (i % YUV_MACROBLOCKS) * 16;
+    int y = (i / YUV_MACROBLOCKS) * 16;
+    uint8_t *out = &dst[y * YUV_STRIDE + x * 2];
+
+    if (impl == PIXEL_CONVERT_NUM_IMPLS) {
+      convert_yuv420_reference(in, out, YUV_STRIDE);
+    } else {
+      pixel_convert_yuv420(impl, in, out, YUV_STRIDE);
+    }
+  }
+}
+
+TEST(pixel_convert_yuv420_exact) {
+  fill_data(texture, sizeof(texture));
+
+  convert_yuv420_macroblocks(PIXEL_CONVERT_NUM_IMPLS, yuv_expected);
+
+  for (int impl = 0; impl < PIXEL_CONVERT_NUM_IMPLS; impl++) {
+    if (!pixel_convert_supported(impl)) {
+      continue;
+    }
+
+    memset(yuv_actual, 0, sizeof(yuv_actual));
+    convert_yuv420_macroblocks(impl, yuv_actual);
+
+    int res = memcmp(yuv_expected, yuv_actual, sizeof(yuv_actual));
+    if (res) {
+      LOG_INFO("%s yuv420 mismatch", pixel_convert_names[impl]);
+    }
+    CHECK_EQ(res, 0);
+  }
+}
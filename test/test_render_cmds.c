@@ -0,0 +1,82 @@
+#include "render/render_backend.h"
+#include "retest.h"
+
+static struct ta_vertex test_verts[4] = {
+    {{0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, 0xffffffff, 0},
+    {{1.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, 0xff0000ff, 0},
+    {{0.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, 0xff00ff00, 0},
+    {{1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}, 0xffff0000, 0},
+};
+
+static uint16_t test_indices[6] = {0, 1, 2, 2, 1, 3};
+
+static void record_test_cmds(struct r_cmdbuf *cb) {
+  struct ta_surface surfs[3] = {0};
+  const struct ta_surface *draws[2] = {&surfs[1], &surfs[2]};
+
+  for (int i = 0; i < array_size(surfs); i++) {
+    surfs[i].texture = i;
+    surfs[i].depth_func = DEPTH_GEQUAL;
+    surfs[i].first_vert = 0;
+    surfs[i].num_verts = 6;
+  }
+
+  r_cmd_bind_framebuffer(cb, 1);
+  r_cmd_viewport(cb, 640, 480);
+  r_cmd_begin_ta_surfaces(cb, 640, 480, test_verts, array_size(test_verts),
+                          test_indices, array_size(test_indices));
+  r_cmd_draw_ta_surface(cb, &surfs[0]);
+  r_cmd_draw_ta_surfaces(cb, draws, array_size(draws));
+  r_cmd_end_ta_surfaces(cb);
+  r_cmd_bind_framebuffer(cb, 0);
+}
+
+static int num_remapped;
+
+static texture_handle_t remap_texture(void *userdata, texture_handle_t handle) {
+  num_remapped++;
+  return handle + 100;
+}
+
+TEST(render_cmds_serialize) {
+  struct r_cmdbuf *cb = r_create_cmdbuf();
+  struct r_cmdbuf *copy = r_create_cmdbuf();
+
+  record_test_cmds(cb);
+  CHECK_GT(r_cmdbuf_size(cb), 0);
+
+  /* buffers are written back to back, and read until the end of the file */
+  FILE *fp = tmpfile();
+  CHECK_NOTNULL(fp);
+  r_write_cmdbuf(cb, fp);
+  r_write_cmdbuf(cb, fp);
+  rewind(fp);
+
+  CHECK(r_read_cmdbuf(copy, fp));
+  CHECK_EQ(r_cmdbuf_size(copy), r_cmdbuf_size(cb));
+  CHECK(r_read_cmdbuf(copy, fp));
+  CHECK_EQ(r_cmdbuf_size(copy), r_cmdbuf_size(cb));
+  CHECK(!r_read_cmdbuf(copy, fp));
+
+  fclose(fp);
+
+  /* resetting a buffer discards its commands */
+  r_reset_cmdbuf(cb);
+  CHECK_EQ(r_cmdbuf_size(cb), 0);
+
+  r_destroy_cmdbuf(copy);
+  r_destroy_cmdbuf(cb);
+}
+
+TEST(render_cmds_remap_textures) {
+  struct r_cmdbuf *cb = r_create_cmdbuf();
+
+  record_test_cmds(cb);
+
+  /* untextured surfaces aren't remapped */
+  num_remapped = 0;
+  r_remap_cmdbuf_textures(cb, &remap_texture, NULL);
+  CHECK_EQ(num_remapped, 2);
+
+  r_destroy_cmdbuf(cb);
+}
@@ -0,0 +1,173 @@
+#include "core/time.h"
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/sh4/sh4.h"
+#include "retest.h"
+
+#define CODE_ADDR 0x8c010000
+#define DATA_PHYS_ADDR 0x0c200000
+#define DATA_VIRT_ADDR 0x00200000
+#define WORKLOAD_SIZE 0x10000
+#define NUM_PASSES 32
+
+/* increments each word in [r4, r4 + r5 * 32), 8 words per iteration */
+static const uint16_t mmu_workload[] = {
+    0x5040, 0x7001, 0x1400, /* mov.l @(0,r4),r0; add #1,r0; mov.l r0,@(0,r4) */
+    0x5041, 0x7001, 0x1401, /* mov.l @(4,r4),r0; add #1,r0; mov.l r0,@(4,r4) */
+    0x5042, 0x7001, 0x1402, /* mov.l @(8,r4),r0; add #1,r0; mov.l r0,@(8,r4) */
+    0x5043, 0x7001, 0x1403, /* ... */
+    0x5044, 0x7001, 0x1404,
+    0x5045, 0x7001, 0x1405,
+    0x5046, 0x7001, 0x1406,
+    0x5047, 0x7001, 0x1407,
+    0x7420, /* add #32,r4 */
+    0x4510, /* dt r5 */
+    0x8be4, /* bf 0 */
+    0x000b, /* rts */
+    0x0009, /* nop */
+};
+
+static void map_data(struct dreamcast *dc) {
+  struct sh4 *sh4 = dc->sh4;
+  struct address_space *space = sh4->memory_if->space;
+
+  /* load a single 1mb page mapping the virtual data address to its physical
+     address, and enable address translation */
+  union pteh pteh = {0};
+  pteh.VPN = DATA_VIRT_ADDR >> 10;
+
+  union ptel ptel = {0};
+  ptel.PPN = DATA_PHYS_ADDR >> 10;
+  ptel.V = 1;
+  ptel.SZ1 = 1;
+  ptel.SZ0 = 1;
+  ptel.D = 1;
+
+  *sh4->PTEH = pteh;
+  *sh4->PTEL = ptel;
+  sh4->MMUCR->URC = 0;
+  sh4_mmu_load_tlb(sh4);
+
+  as_write32(space, 0xff000010, 0x1);
+  CHECK(sh4->mmu_enabled);
+}
+
+static int64_t run_workload(struct dreamcast *dc, int mmu) {
+  struct sh4 *sh4 = dc->sh4;
+  struct address_space *space = sh4->memory_if->space;
+  int64_t elapsed = 0;
+
+  for (int i = 0; i < NUM_PASSES; i++) {
+    as_memcpy_to_guest(space, CODE_ADDR, mmu_workload, sizeof(mmu_workload));
+    sh4_reset(sh4, CODE_ADDR);
+
+    if (mmu) {
+      map_data(dc);
+    }
+
+    sh4->ctx.r[4] = mmu ? DATA_VIRT_ADDR : (0x80000000 | DATA_PHYS_ADDR);
+    sh4->ctx.r[5] = WORKLOAD_SIZE / 32;
+
+    int64_t start = time_nanoseconds();
+
+    dc_resume(dc);
+
+    while (sh4->ctx.pc) {
+      dc_tick(dc, 1);
+    }
+
+    elapsed += time_nanoseconds() - start;
+  }
+
+  /* each word should have been incremented once per pass */
+  for (int i = 0; i < WORKLOAD_SIZE; i += 4) {
+    uint32_t data = as_read32(space, 0x80000000 | (DATA_PHYS_ADDR + i));
+    CHECK_EQ(data, NUM_PASSES);
+  }
+
+  return elapsed;
+}
+
+TEST(sh4_mmu_throughput) {
+  struct dreamcast *dc = dc_create(NULL);
+  CHECK_NOTNULL(dc);
+  struct address_space *space = dc->sh4->memory_if->space;
+
+  const char *names[] = {"mmu off", "mmu on"};
+
+  for (int mmu = 0; mmu < 2; mmu++) {
+    for (int i = 0; i < WORKLOAD_SIZE; i += 4) {
+      as_write32(space, 0x80000000 | (DATA_PHYS_ADDR + i), 0);
+    }
+
+    int64_t elapsed = run_workload(dc, mmu);
+    double secs = (double)elapsed / NS_PER_SEC;
+    double accesses = (WORKLOAD_SIZE / 4) * 2.0 * NUM_PASSES;
+
+    LOG_INFO("%-8s %8.2f M accesses/s", names[mmu],
+             secs > 0.0 ? accesses / secs / 1000000.0 : 0.0);
+  }
+
+  dc_destroy(dc);
+}
+
+#define MISS_ADDR 0x00400000
+#define VBR_ADDR (CODE_ADDR + 0x1000)
+
+/* loads from r4, then from r5 in the delay slot of the return */
+static const uint16_t miss_code[] = {
+    0x6042, /* mov.l @r4,r0 */
+    0x000b, /* rts */
+    0x6252, /* mov.l @r5,r2 */
+};
+
+/* points r4 and r5 at mapped memory and restarts the faulting instruction */
+static const uint16_t miss_handler[] = {
+    0x6463, /* mov r6,r4 */
+    0x6563, /* mov r6,r5 */
+    0x7101, /* add #1,r1 */
+    0x002b, /* rte */
+    0x0009, /* nop */
+};
+
+TEST(sh4_mmu_tlb_miss) {
+  struct dreamcast *dc = dc_create(NULL);
+  CHECK_NOTNULL(dc);
+  struct sh4 *sh4 = dc->sh4;
+  struct address_space *space = sh4->memory_if->space;
+
+  as_memcpy_to_guest(space, CODE_ADDR, miss_code, sizeof(miss_code));
+  as_memcpy_to_guest(space, VBR_ADDR + 0x400, miss_handler,
+                     sizeof(miss_handler));
+  sh4_reset(sh4, CODE_ADDR);
+  map_data(dc);
+
+  /* unblock exceptions */
+  uint32_t old_sr = sh4->ctx.sr;
+  sh4->ctx.sr &= ~BL_MASK;
+  sh4_sr_updated(sh4, old_sr);
+
+  sh4->ctx.vbr = VBR_ADDR;
+  sh4->ctx.r[1] = 0;
+  sh4->ctx.r[4] = MISS_ADDR;
+  sh4->ctx.r[5] = MISS_ADDR + 4;
+  sh4->ctx.r[6] = DATA_VIRT_ADDR;
+  as_write32(space, 0x80000000 | DATA_PHYS_ADDR, 0x12345678);
+
+  dc_resume(dc);
+
+  while (sh4->ctx.pc) {
+    dc_tick(dc, 1);
+  }
+
+  /* both loads should have missed once, the second from the delay slot which
+     restarts at the branch */
+  CHECK_EQ(sh4->ctx.r[1], 2);
+  CHECK_EQ(*sh4->EXPEVT, SH4_EXC_TLB_MISS_READ);
+  CHECK_EQ(*sh4->TEA, MISS_ADDR + 4);
+  CHECK_EQ(sh4->ctx.spc, CODE_ADDR + 2);
+  CHECK_EQ(sh4->ctx.r[0], 0x12345678);
+  CHECK_EQ(sh4->ctx.r[2], 0x12345678);
+
+  dc_destroy(dc);
+}
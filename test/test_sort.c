@@ -0,0 +1,81 @@
+#include <float.h>
+#include <stdlib.h>
+#include "core/sort.h"
+#include "retest.h"
+
+#define SORT_SIZE 4096
+
+static float sort_keys[SORT_SIZE];
+static uint32_t radix_keys[SORT_SIZE];
+static uint32_t radix_tmp_keys[SORT_SIZE];
+static int radix_values[SORT_SIZE];
+static int radix_tmp_values[SORT_SIZE];
+static int merge_values[SORT_SIZE];
+static int merge_tmp[SORT_SIZE];
+
+static int sort_cmp_keys(const void *a, const void *b) {
+  int i = *(const int *)a;
+  int j = *(const int *)b;
+  return sort_keys[i] <= sort_keys[j];
+}
+
+static void sort_compare(int num) {
+  for (int i = 0; i < num; i++) {
+    radix_keys[i] = rsort_float_key(sort_keys[i]);
+    radix_values[i] = i;
+    merge_values[i] = i;
+  }
+
+  rsort_noalloc(radix_keys, radix_values, radix_tmp_keys, radix_tmp_values,
+                num);
+  msort_noalloc(merge_values, merge_tmp, num, sizeof(int), &sort_cmp_keys);
+
+  /* both sorts are stable, so equal keys must keep the same order too */
+  for (int i = 0; i < num; i++) {
+    CHECK_EQ(radix_values[i], merge_values[i]);
+  }
+}
+
+TEST(rsort_float_keys) {
+  static const float specials[] = {0.0f,     -0.0f,    1.0f,    -1.0f,
+                                   FLT_MIN,  -FLT_MIN, FLT_MAX, -FLT_MAX,
+                                   1.0e-30f, 1.0e30f};
+
+  for (int i = 0; i < array_size(specials); i++) {
+    for (int j = 0; j < array_size(specials); j++) {
+      float a = specials[i];
+      float b = specials[j];
+      CHECK_EQ(a < b, rsort_float_key(a) < rsort_float_key(b));
+      CHECK_EQ(a == b, rsort_float_key(a) == rsort_float_key(b));
+    }
+  }
+}
+
+TEST(rsort_matches_msort) {
+  /* random keys of both signs */
+  for (int i = 0; i < SORT_SIZE; i++) {
+    sort_keys[i] = ((float)rand() / RAND_MAX - 0.5f) * 1000.0f;
+  }
+  sort_compare(SORT_SIZE);
+
+  /* few distinct keys, exercising stability */
+  for (int i = 0; i < SORT_SIZE; i++) {
+    sort_keys[i] = (float)(rand() % 8) * 0.125f;
+  }
+  sort_compare(SORT_SIZE);
+
+  /* keys sharing their upper bytes, skipping some of the passes */
+  for (int i = 0; i < SORT_SIZE; i++) {
+    sort_keys[i] = 1.0f + (float)(rand() % 256) / (1 << 23);
+  }
+  sort_compare(SORT_SIZE);
+
+  /* degenerate sizes */
+  sort_compare(0);
+  sort_compare(1);
+}
+
+TEST(rsort_empty) {
+  /* empty lists may not have had any storage allocated for them yet */
+  rsort_noalloc(NULL, NULL, NULL, NULL, 0);
+}
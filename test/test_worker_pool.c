@@ -0,0 +1,62 @@
+#include <string.h>
+#include "core/thread.h"
+#include "core/worker_pool.h"
+#include "retest.h"
+
+#define NUM_JOBS 1024
+
+static int job_counts[NUM_JOBS];
+static mutex_t job_mutex;
+
+static void count_job(void *data, int n) {
+  mutex_lock(job_mutex);
+  job_counts[n]++;
+  mutex_unlock(job_mutex);
+}
+
+static void check_counts(int num_jobs, int expected) {
+  for (int i = 0; i < num_jobs; i++) {
+    CHECK_EQ(job_counts[i], expected);
+  }
+}
+
+TEST(worker_pool_run) {
+  job_mutex = mutex_create();
+
+  /* every job should be ran exactly once, with and without workers */
+  for (int num_workers = 0; num_workers <= 4; num_workers++) {
+    struct worker_pool *pool = worker_pool_create(num_workers);
+    CHECK_EQ(worker_pool_num_workers(pool), num_workers);
+
+    memset(job_counts, 0, sizeof(job_counts));
+    worker_pool_run(pool, &count_job, NULL, NUM_JOBS);
+    check_counts(NUM_JOBS, 1);
+
+    /* empty batches shouldn't block */
+    worker_pool_run(pool, &count_job, NULL, 0);
+    check_counts(NUM_JOBS, 1);
+
+    worker_pool_destroy(pool);
+  }
+
+  mutex_destroy(job_mutex);
+}
+
+TEST(worker_pool_queue) {
+  job_mutex = mutex_create();
+
+  struct worker_pool *pool = worker_pool_create(2);
+
+  /* jobs queued onto an open batch one at a time */
+  memset(job_counts, 0, sizeof(job_counts));
+  worker_pool_begin(pool, &count_job, NULL);
+  for (int i = 0; i < NUM_JOBS; i++) {
+    worker_pool_queue(pool, 1);
+  }
+  worker_pool_end(pool);
+  check_counts(NUM_JOBS, 1);
+
+  worker_pool_destroy(pool);
+
+  mutex_destroy(job_mutex);
+}
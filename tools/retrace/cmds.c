@@ -0,0 +1,187 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "retrace.h"
+#include "render/render_backend.h"
+
+/* number of times the recorded command buffers are replayed */
+#define CMDS_ITERATIONS 10
+
+/* the recorded textures aren't available when replaying, every textured
+   surface samples a checkerboard instead */
+#define CMDS_TEXTURE_SIZE 64
+
+static texture_handle_t remap_texture(void *userdata, texture_handle_t handle) {
+  return *(texture_handle_t *)userdata;
+}
+
+static texture_handle_t cmds_create_texture(struct render_backend *r) {
+  uint32_t *pixels =
+      calloc(CMDS_TEXTURE_SIZE * CMDS_TEXTURE_SIZE, sizeof(pixels[0]));
+  CHECK_NOTNULL(pixels);
+
+  for (int y = 0; y < CMDS_TEXTURE_SIZE; y++) {
+    for (int x = 0; x < CMDS_TEXTURE_SIZE; x++) {
+      int odd = ((x >> 3) ^ (y >> 3)) & 1;
+      pixels[y * CMDS_TEXTURE_SIZE + x] = odd ? 0xffc0c0c0 : 0x80404040;
+    }
+  }
+
+  texture_handle_t handle = r_create_texture(
+      r, PXL_RGBA, FILTER_BILINEAR, WRAP_REPEAT, WRAP_REPEAT, 0,
+      CMDS_TEXTURE_SIZE, CMDS_TEXTURE_SIZE, (const uint8_t *)pixels);
+
+  free(pixels);
+
+  return handle;
+}
+
+static int cmds_record(const char *filename, const char *output) {
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  FILE *fp = fopen(output, "wb");
+  if (!fp) {
+    LOG_WARNING("failed to open %s", output);
+    trace_destroy(trace);
+    return 0;
+  }
+
+  struct tile_context *ctx = calloc(1, sizeof(struct tile_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  struct r_cmdbuf *cb = r_create_cmdbuf();
+  int64_t num_contexts = 0;
+  int64_t num_bytes = 0;
+
+  /* record each context as it would be drawn by the emulator, sized to its
+     original video dimensions */
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(next, ctx);
+      tr_convert_context(NULL, NULL, NULL, &retrace_find_texture, ctx, rc);
+
+      r_reset_cmdbuf(cb);
+      r_cmd_viewport(cb, rc->width, rc->height);
+      tr_record_context(cb, rc);
+      r_write_cmdbuf(cb, fp);
+
+      num_contexts++;
+      num_bytes += r_cmdbuf_size(cb);
+    }
+    next = next->next;
+  }
+
+  r_destroy_cmdbuf(cb);
+  tr_free_context(rc);
+  free(rc);
+  ta_release_params(ctx);
+  free(ctx);
+  fclose(fp);
+  trace_destroy(trace);
+
+  LOG_INFO("recorded %" PRId64 " contexts, %" PRId64 " bytes to %s",
+           num_contexts, num_bytes, output);
+
+  return 1;
+}
+
+static int cmds_replay(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    LOG_WARNING("failed to open %s", filename);
+    return 0;
+  }
+
+  /* the backend is created without a video context, so only backends which
+     don't require one can replay */
+  struct render_backend *r = r_create(NULL);
+  texture_handle_t tex = cmds_create_texture(r);
+
+  struct r_cmdbuf **cbs = NULL;
+  int num_cbs = 0;
+  int max_cbs = 0;
+  int64_t num_bytes = 0;
+
+  while (1) {
+    if (num_cbs == max_cbs) {
+      max_cbs = MAX(max_cbs * 2, 64);
+      cbs = realloc(cbs, max_cbs * sizeof(cbs[0]));
+      CHECK_NOTNULL(cbs);
+    }
+
+    struct r_cmdbuf *cb = r_create_cmdbuf();
+
+    if (!r_read_cmdbuf(cb, fp)) {
+      r_destroy_cmdbuf(cb);
+      break;
+    }
+
+    r_remap_cmdbuf_textures(cb, &remap_texture, &tex);
+
+    cbs[num_cbs++] = cb;
+    num_bytes += r_cmdbuf_size(cb);
+  }
+
+  fclose(fp);
+
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < CMDS_ITERATIONS; i++) {
+    for (int j = 0; j < num_cbs; j++) {
+      r_replay_cmdbuf(r, cbs[j]);
+    }
+  }
+
+  int64_t elapsed = time_nanoseconds() - start;
+
+  for (int i = 0; i < num_cbs; i++) {
+    r_destroy_cmdbuf(cbs[i]);
+  }
+  free(cbs);
+
+  r_destroy_texture(r, tex);
+  r_destroy(r);
+
+  double secs = (double)elapsed / NS_PER_SEC;
+  double frames = (double)num_cbs * CMDS_ITERATIONS;
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("command buffer replay results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("buffers        %d", num_cbs);
+  LOG_INFO("iterations     %d", CMDS_ITERATIONS);
+  LOG_INFO("bytes          %" PRId64, num_bytes);
+  LOG_INFO("frames/s       %.2f", secs > 0.0 ? frames / secs : 0.0);
+  LOG_INFO("ms/frame       %.3f",
+           frames > 0.0 ? (double)elapsed / frames / 1000000.0 : 0.0);
+
+  return 1;
+}
+
+int cmd_cmds(int argc, const char **argv) {
+  if (argc < 2) {
+    return 0;
+  }
+
+  const char *mode = argv[0];
+
+  if (!strcmp(mode, "record") && argc >= 3) {
+    return cmds_record(argv[1], argv[2]);
+  } else if (!strcmp(mode, "replay")) {
+    return cmds_replay(argv[1]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "retrace.h"
+
+/* number of times each context is converted by each configuration */
+#define CONVERT_ITERATIONS 10
+
+/* default max number of worker threads measured, each power of two up to it
+   is measured */
+#define CONVERT_MAX_WORKERS 4
+
+#define CONVERT_MAX_CONFIGS 8
+
+struct convert_config {
+  int num_workers;
+  struct tr_workers *workers;
+  struct tr_context rc;
+  int64_t elapsed;
+  int64_t mismatches;
+};
+
+static int convert_compare(const struct tr_context *a,
+                           const struct tr_context *b) {
+  if (a->num_surfs != b->num_surfs || a->num_verts != b->num_verts ||
+      a->num_indices != b->num_indices || a->num_volumes != b->num_volumes ||
+      a->num_volume_tris != b->num_volume_tris) {
+    return 0;
+  }
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    const struct tr_list *la = &a->lists[i];
+    const struct tr_list *lb = &b->lists[i];
+
+    if (la->num_surfs != lb->num_surfs ||
+        memcmp(la->surfs, lb->surfs, la->num_surfs * sizeof(la->surfs[0]))) {
+      return 0;
+    }
+
+    if (la->num_volumes != lb->num_volumes ||
+        memcmp(la->volumes, lb->volumes,
+               la->num_volumes * sizeof(la->volumes[0]))) {
+      return 0;
+    }
+  }
+
+  return !memcmp(a->surfs, b->surfs, a->num_surfs * sizeof(a->surfs[0])) &&
+         !memcmp(a->verts, b->verts, a->num_verts * sizeof(a->verts[0])) &&
+         !memcmp(a->indices, b->indices,
+                 a->num_indices * sizeof(a->indices[0])) &&
+         !memcmp(a->volumes, b->volumes,
+                 a->num_volumes * sizeof(a->volumes[0])) &&
+         !memcmp(a->volume_tris, b->volume_tris,
+                 a->num_volume_tris * sizeof(a->volume_tris[0]));
+}
+
+int cmd_convert(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  int max_workers = argc > 1 ? atoi(argv[1]) : CONVERT_MAX_WORKERS;
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  /* the first configuration converts serially, and is the reference the
+     others are validated against */
+  struct convert_config *configs =
+      calloc(CONVERT_MAX_CONFIGS, sizeof(struct convert_config));
+  int num_configs = 1;
+
+  for (int workers = 1;
+       workers <= max_workers && num_configs < CONVERT_MAX_CONFIGS;
+       workers *= 2) {
+    struct convert_config *config = &configs[num_configs++];
+    config->num_workers = workers;
+    config->workers = tr_create_workers(workers);
+  }
+
+  struct tile_context *ctx = calloc(1, sizeof(struct tile_context));
+  int64_t num_contexts = 0;
+  int64_t num_bytes = 0;
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type != TRACE_CMD_CONTEXT) {
+      next = next->next;
+      continue;
+    }
+
+    trace_copy_context(next, ctx);
+
+    for (int i = 0; i < num_configs; i++) {
+      struct convert_config *config = &configs[i];
+
+      int64_t start = time_nanoseconds();
+
+      for (int j = 0; j < CONVERT_ITERATIONS; j++) {
+        if (config->workers) {
+          tr_convert_context_parallel(config->workers, NULL, NULL, NULL,
+                                      &retrace_find_texture, ctx, &config->rc);
+        } else {
+          tr_convert_context(NULL, NULL, NULL, &retrace_find_texture, ctx,
+                             &config->rc);
+        }
+      }
+
+      config->elapsed += time_nanoseconds() - start;
+
+      if (i && !convert_compare(&configs[0].rc, &config->rc)) {
+        config->mismatches++;
+      }
+    }
+
+    num_contexts++;
+    num_bytes += ctx->size;
+    next = next->next;
+  }
+
+  for (int i = 0; i < num_configs; i++) {
+    if (configs[i].workers) {
+      tr_destroy_workers(configs[i].workers);
+    }
+    tr_free_context(&configs[i].rc);
+  }
+
+  ta_release_params(ctx);
+  free(ctx);
+  trace_destroy(trace);
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("context conversion results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("contexts       %" PRId64, num_contexts);
+  LOG_INFO("iterations     %d", CONVERT_ITERATIONS);
+  LOG_INFO("param bytes    %" PRId64, num_bytes);
+  LOG_INFO("");
+  LOG_INFO("%-8s %-12s %-12s %-10s %s", "workers", "ms/context", "MB/s",
+           "speedup", "mismatches");
+
+  double ref_secs = (double)configs[0].elapsed / NS_PER_SEC;
+
+  for (int i = 0; i < num_configs; i++) {
+    struct convert_config *config = &configs[i];
+    double secs = (double)config->elapsed / NS_PER_SEC;
+    double contexts = (double)num_contexts * CONVERT_ITERATIONS;
+    double mbytes = (double)num_bytes * CONVERT_ITERATIONS / 1000000.0;
+    char name[16];
+
+    if (config->workers) {
+      snprintf(name, sizeof(name), "%d", config->num_workers);
+    } else {
+      snprintf(name, sizeof(name), "serial");
+    }
+
+    LOG_INFO("%-8s %-12.3f %-12.2f %-10.2f %" PRId64, name,
+             contexts > 0.0 ? secs * 1000.0 / contexts : 0.0,
+             secs > 0.0 ? mbytes / secs : 0.0,
+             secs > 0.0 ? ref_secs / secs : 0.0, config->mismatches);
+  }
+
+  free(configs);
+
+  return 1;
+}
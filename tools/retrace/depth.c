@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include "core/assert.h"
 #include "core/sort.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
 #include "guest/pvr/tr.h"
-#include "guest/pvr/trace.h"
+#include "retrace.h"
 
 struct depth_entry {
   /* vertex index */
@@ -26,15 +28,6 @@ struct test {
   int total;
 };
 
-static struct tr_texture *find_texture(void *userdata, union tsp tsp,
-                                       union tcw tcw) {
-  /* return a non-zero handle so it doesn't try to create a texture with
-     the render backend (which is NULL) */
-  static struct tr_texture tex;
-  tex.handle = 1;
-  return &tex;
-}
-
 static int depth_cmp(const void *a, const void *b) {
   const struct depth_entry *ea = (const struct depth_entry *)a;
   const struct depth_entry *eb = (const struct depth_entry *)b;
@@ -56,7 +49,7 @@ static void test_context(struct trace_cmd *cmd, struct test *tests,
 
   /* parse the context */
   trace_copy_context(cmd, ctx);
-  tr_convert_context(NULL, NULL, &find_texture, ctx, rc);
+  tr_convert_context(NULL, NULL, NULL, &retrace_find_texture, ctx, rc);
 
   /* sort each vertex by the original w */
   struct depth_entry *original =
@@ -105,7 +98,9 @@ static void test_context(struct trace_cmd *cmd, struct test *tests,
   }
 
   free(original);
+  tr_free_context(rc);
   free(rc);
+  ta_release_params(ctx);
   free(ctx);
 }
 
@@ -1,11 +1,41 @@
 #include "core/log.h"
+#include "retrace.h"
 
+extern int cmd_cmds(int argc, const char **argv);
+extern int cmd_convert(int argc, const char **argv);
 extern int cmd_depth(int argc, const char **argv);
+extern int cmd_memcpy(int argc, const char **argv);
+extern int cmd_pixels(int argc, const char **argv);
+extern int cmd_raster(int argc, const char **argv);
+extern int cmd_sort(int argc, const char **argv);
+extern int cmd_ta(int argc, const char **argv);
+extern int cmd_timing(int argc, const char **argv);
+extern int cmd_verts(int argc, const char **argv);
+extern int cmd_vram(int argc, const char **argv);
+
+struct tr_texture *retrace_find_texture(void *userdata, union tsp tsp,
+                                        union tcw tcw) {
+  /* return a non-zero handle so it doesn't try to create a texture with
+     the render backend (which is NULL) */
+  static struct tr_texture tex;
+  tex.handle = 1;
+  return &tex;
+}
 
 static void print_help() {
   LOG_INFO("usage: retrace <command> [<args> ...]");
   LOG_INFO("the available commands are:");
+  LOG_INFO("    cmds     record or replay render command buffers");
+  LOG_INFO("    convert  measure parallel context conversion scaling");
   LOG_INFO("    depth    compare depth function accuracies");
+  LOG_INFO("    memcpy   measure guest memcpy bandwidth");
+  LOG_INFO("    pixels   measure texture conversion throughput");
+  LOG_INFO("    raster   measure software rasterizer throughput");
+  LOG_INFO("    sort     measure translucent list sort performance");
+  LOG_INFO("    ta       measure ta parameter throughput");
+  LOG_INFO("    timing   estimate render times or fit them to measurements");
+  LOG_INFO("    verts    measure vertex decode throughput");
+  LOG_INFO("    vram     measure video ram write tracking overhead");
 }
 
 int main(int argc, const char **argv) {
@@ -14,8 +44,28 @@ int main(int argc, const char **argv) {
   if (argc >= 2) {
     const char *cmd = argv[1];
 
-    if (!strcmp(cmd, "depth")) {
+    if (!strcmp(cmd, "cmds")) {
+      res = cmd_cmds(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "convert")) {
+      res = cmd_convert(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "depth")) {
       res = cmd_depth(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "memcpy")) {
+      res = cmd_memcpy(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "pixels")) {
+      res = cmd_pixels(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "raster")) {
+      res = cmd_raster(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "sort")) {
+      res = cmd_sort(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "ta")) {
+      res = cmd_ta(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "timing")) {
+      res = cmd_timing(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "verts")) {
+      res = cmd_verts(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "vram")) {
+      res = cmd_vram(argc - 2, argv + 2);
     }
   }
 
@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include "core/assert.h"
+#include "core/time.h"
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/sh4/sh4.h"
+
+/* main ram and 64-bit interleaved video ram, as seen by the sh4 */
+#define MEMCPY_RAM_ADDR 0x8c100000
+#define MEMCPY_VRAM64_ADDR 0xa5000000
+
+#define MEMCPY_SIZE 0x400000
+#define MEMCPY_ITERATIONS 16
+
+static void memcpy_bench(struct address_space *space, const char *name,
+                         uint32_t dst, uint32_t src) {
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < MEMCPY_ITERATIONS; i++) {
+    as_memcpy(space, dst, src, MEMCPY_SIZE);
+  }
+
+  int64_t elapsed = time_nanoseconds() - start;
+  double secs = (double)elapsed / NS_PER_SEC;
+  double mb = (double)MEMCPY_SIZE * MEMCPY_ITERATIONS / (1024.0 * 1024.0);
+
+  LOG_INFO("%-16s %8.2f MB/s", name, secs > 0.0 ? mb / secs : 0.0);
+}
+
+int cmd_memcpy(int argc, const char **argv) {
+  struct dreamcast *dc = dc_create(NULL);
+  if (!dc) {
+    LOG_WARNING("failed to create dreamcast");
+    return 0;
+  }
+
+  struct address_space *space = dc->sh4->memory_if->space;
+
+  /* measure as_memcpy between the ram and mmio handled regions */
+  memcpy_bench(space, "ram -> ram", MEMCPY_RAM_ADDR + MEMCPY_SIZE,
+               MEMCPY_RAM_ADDR);
+  memcpy_bench(space, "ram -> vram64", MEMCPY_VRAM64_ADDR, MEMCPY_RAM_ADDR);
+  memcpy_bench(space, "vram64 -> ram", MEMCPY_RAM_ADDR, MEMCPY_VRAM64_ADDR);
+
+  dc_destroy(dc);
+
+  return 1;
+}
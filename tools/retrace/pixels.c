@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/time.h"
+#include "guest/pvr/pixel_convert.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+
+#define PIXELS_TEXTURE_SIZE 0x100000
+#define PIXELS_WIDTH 256
+#define PIXELS_HEIGHT 256
+#define PIXELS_ITERATIONS 64
+
+/* yuv420 macroblocks are converted into a 64 x 64 UYVY texture */
+#define PIXELS_YUV_MACROBLOCK_SIZE 384
+#define PIXELS_YUV_STRIDE (64 * 2)
+#define PIXELS_YUV_ITERATIONS 100000
+
+/* the conversion is timed on the texture the tile renderer would see, so
+   mipmapped textures start at their 256 x 256 level */
+struct pixels_fmt {
+  const char *name;
+  int pixel_format;
+  int pal_pxl_format;
+};
+
+static const struct pixels_fmt fmts[] = {
+    {"1555", TA_PIXEL_1555, 0},
+    {"565", TA_PIXEL_565, 0},
+    {"4444", TA_PIXEL_4444, 0},
+    {"pal4 1555", TA_PIXEL_4BPP, TA_PAL_ARGB1555},
+    {"pal4 565", TA_PIXEL_4BPP, TA_PAL_RGB565},
+    {"pal4 4444", TA_PIXEL_4BPP, TA_PAL_ARGB4444},
+    {"pal4 8888", TA_PIXEL_4BPP, TA_PAL_ARGB8888},
+    {"pal8 1555", TA_PIXEL_8BPP, TA_PAL_ARGB1555},
+    {"pal8 565", TA_PIXEL_8BPP, TA_PAL_RGB565},
+    {"pal8 4444", TA_PIXEL_8BPP, TA_PAL_ARGB4444},
+    {"pal8 8888", TA_PIXEL_8BPP, TA_PAL_ARGB8888},
+};
+
+enum {
+  PIXELS_PLANAR,
+  PIXELS_TWIDDLED,
+  PIXELS_VQ,
+  PIXELS_NUM_LAYOUTS,
+};
+
+static const char *layout_names[PIXELS_NUM_LAYOUTS] = {"planar", "twiddled",
+                                                       "vq"};
+
+static uint8_t texture[PIXELS_TEXTURE_SIZE];
+static uint32_t palette[256];
+static uint16_t output[PIXELS_WIDTH * PIXELS_HEIGHT];
+static uint8_t yuv_output[PIXELS_YUV_STRIDE * 64];
+
+static int fmt_paletted(const struct pixels_fmt *fmt) {
+  return fmt->pixel_format == TA_PIXEL_4BPP ||
+         fmt->pixel_format == TA_PIXEL_8BPP;
+}
+
+static void pixels_fill(uint8_t *data, int size) {
+  for (int i = 0; i < size; i++) {
+    data[i] = (uint8_t)rand();
+  }
+}
+
+static void pixels_texture(const struct pixels_fmt *fmt, int layout,
+                           int mipmaps, struct tr_texture *tex) {
+  memset(tex, 0, sizeof(*tex));
+  /* 8 << 5 == PIXELS_WIDTH == PIXELS_HEIGHT */
+  tex->tsp.texture_u_size = 5;
+  tex->tsp.texture_v_size = 5;
+  tex->tcw.pixel_format = fmt->pixel_format;
+  tex->tcw.scan_order = layout == PIXELS_PLANAR;
+  tex->tcw.vq_compressed = layout == PIXELS_VQ;
+  tex->tcw.mip_mapped = mipmaps;
+  tex->texture = texture;
+  tex->palette = (const uint8_t *)palette;
+}
+
+static void pixels_textures() {
+  double mpixels =
+      (double)PIXELS_WIDTH * PIXELS_HEIGHT * PIXELS_ITERATIONS / 1000000.0;
+
+  LOG_INFO("%-10s %-9s %-8s %-8s %s", "format", "layout", "mipmaps", "impl",
+           "Mpixels/s");
+
+  for (int f = 0; f < array_size(fmts); f++) {
+    const struct pixels_fmt *fmt = &fmts[f];
+
+    for (int layout = 0; layout < PIXELS_NUM_LAYOUTS; layout++) {
+      /* paletted textures are always twiddled and never compressed */
+      if (fmt_paletted(fmt) && layout != PIXELS_TWIDDLED) {
+        continue;
+      }
+
+      for (int mipmaps = 0; mipmaps < 2; mipmaps++) {
+        struct tr_texture tex;
+        pixels_texture(fmt, layout, mipmaps, &tex);
+
+        for (int impl = 0; impl < PIXEL_CONVERT_NUM_IMPLS; impl++) {
+          if (!pixel_convert_supported(impl)) {
+            continue;
+          }
+
+          int64_t start = time_nanoseconds();
+          for (int i = 0; i < PIXELS_ITERATIONS; i++) {
+            tr_texture_convert_impl(impl, &tex, fmt->pal_pxl_format, 0,
+                                    (uint8_t *)output);
+          }
+          double secs = (double)(time_nanoseconds() - start) / NS_PER_SEC;
+
+          LOG_INFO("%-10s %-9s %-8d %-8s %.2f", fmt->name,
+                   layout_names[layout], mipmaps, pixel_convert_names[impl],
+                   secs > 0.0 ? mpixels / secs : 0.0);
+        }
+      }
+    }
+  }
+}
+
+static void pixels_yuv420() {
+  double macroblocks = (double)PIXELS_YUV_ITERATIONS;
+
+  LOG_INFO("%-8s %s", "impl", "macroblocks/s");
+
+  for (int impl = 0; impl < PIXEL_CONVERT_NUM_IMPLS; impl++) {
+    if (!pixel_convert_supported(impl)) {
+      continue;
+    }
+
+    int64_t start = time_nanoseconds();
+    for (int i = 0; i < PIXELS_YUV_ITERATIONS; i++) {
+      const uint8_t *in = &texture[(i & 15) * PIXELS_YUV_MACROBLOCK_SIZE];
+      pixel_convert_yuv420(impl, in, yuv_output, PIXELS_YUV_STRIDE);
+    }
+    double secs = (double)(time_nanoseconds() - start) / NS_PER_SEC;
+
+    LOG_INFO("%-8s %.0f", pixel_convert_names[impl],
+             secs > 0.0 ? macroblocks / secs : 0.0);
+  }
+}
+
+int cmd_pixels(int argc, const char **argv) {
+  pixel_convert_init();
+
+  pixels_fill(texture, sizeof(texture));
+  pixels_fill((uint8_t *)palette, sizeof(palette));
+
+  /* each implementation is measured, the scalar one being the baseline */
+  pixels_textures();
+  pixels_yuv420();
+
+  return 1;
+}
@@ -0,0 +1,221 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "render/soft_raster.h"
+#include "retrace.h"
+
+/* number of times each context is rendered by each configuration */
+#define RASTER_ITERATIONS 10
+
+/* default max number of worker threads measured */
+#define RASTER_MAX_WORKERS 3
+
+/* the trace's textures aren't converted, every textured surface samples a
+   checkerboard instead */
+#define RASTER_TEXTURE_SIZE 64
+
+static const int raster_lists[] = {TA_LIST_OPAQUE, TA_LIST_PUNCH_THROUGH,
+                                   TA_LIST_TRANSLUCENT};
+
+struct raster_config {
+  enum sr_impl impl;
+  int num_workers;
+  struct sr *sr;
+  int64_t elapsed;
+  int64_t mismatches;
+};
+
+static void raster_init_texture(struct sr_texture *tex) {
+  tex->width = RASTER_TEXTURE_SIZE;
+  tex->height = RASTER_TEXTURE_SIZE;
+  tex->filter = FILTER_BILINEAR;
+  tex->wrap_u = WRAP_REPEAT;
+  tex->wrap_v = WRAP_REPEAT;
+  tex->pixels = calloc(tex->width * tex->height, sizeof(tex->pixels[0]));
+  CHECK_NOTNULL(tex->pixels);
+
+  for (int y = 0; y < tex->height; y++) {
+    for (int x = 0; x < tex->width; x++) {
+      int odd = ((x >> 3) ^ (y >> 3)) & 1;
+      tex->pixels[y * tex->width + x] = odd ? 0xffc0c0c0 : 0x80404040;
+    }
+  }
+}
+
+static void raster_resize_target(struct sr_target *target, int width,
+                                 int height) {
+  if (target->width == width && target->height == height) {
+    return;
+  }
+
+  target->width = width;
+  target->height = height;
+  target->color =
+      realloc(target->color, width * height * sizeof(target->color[0]));
+  target->depth =
+      realloc(target->depth, width * height * sizeof(target->depth[0]));
+  target->stencil =
+      realloc(target->stencil, width * height * sizeof(target->stencil[0]));
+  CHECK(target->color && target->depth && target->stencil);
+}
+
+static void raster_context(struct sr *sr, struct sr_target *target,
+                           const struct tr_context *rc,
+                           const struct sr_texture *tex) {
+  /* the target is the size of the original video, only y needs flipping */
+  float xform[4] = {1.0f, 0.0f, -1.0f, (float)target->height};
+
+  sr_clear(target, 0xff000000);
+  sr_begin(sr, target, target->width, target->height, xform, rc->verts,
+           rc->num_verts);
+
+  for (int i = 0; i < (int)array_size(raster_lists); i++) {
+    const struct tr_list *list = &rc->lists[raster_lists[i]];
+
+    for (int j = 0; j < list->num_surfs; j++) {
+      const struct ta_surface *surf = &rc->surfs[list->surfs[j]];
+      struct sr_state state = {0};
+      state.surf = *surf;
+      state.texture = surf->texture ? tex : NULL;
+
+      sr_draw(sr, &state, rc->indices, surf->first_vert, surf->num_verts);
+    }
+  }
+
+  sr_end(sr);
+}
+
+int cmd_raster(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  int max_workers = argc > 1 ? atoi(argv[1]) : RASTER_MAX_WORKERS;
+  max_workers = CLAMP(max_workers, 0, SR_MAX_WORKERS);
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  /* each implementation is measured single-threaded and with each number of
+     worker threads, the first configuration is the reference the others are
+     validated against */
+  struct raster_config configs[SR_NUM_IMPLS * (SR_MAX_WORKERS + 1)];
+  int num_configs = 0;
+
+  for (int impl = 0; impl < SR_NUM_IMPLS; impl++) {
+    if (!sr_supported(impl)) {
+      continue;
+    }
+
+    for (int workers = 0; workers <= max_workers; workers++) {
+      struct raster_config *config = &configs[num_configs++];
+      memset(config, 0, sizeof(*config));
+      config->impl = impl;
+      config->num_workers = workers;
+      config->sr = sr_create(workers, impl);
+    }
+  }
+
+  struct tile_context *ctx = calloc(1, sizeof(struct tile_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  struct sr_target reference = {0};
+  struct sr_target target = {0};
+  struct sr_texture tex = {0};
+  int64_t num_contexts = 0;
+  int64_t num_tris = 0;
+  int64_t num_pixels = 0;
+
+  raster_init_texture(&tex);
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type != TRACE_CMD_CONTEXT) {
+      next = next->next;
+      continue;
+    }
+
+    trace_copy_context(next, ctx);
+    tr_convert_context(NULL, NULL, NULL, &retrace_find_texture, ctx, rc);
+
+    raster_resize_target(&reference, rc->width, rc->height);
+    raster_resize_target(&target, rc->width, rc->height);
+
+    for (int i = 0; i < num_configs; i++) {
+      struct raster_config *config = &configs[i];
+      struct sr_target *dst = i ? &target : &reference;
+
+      int64_t start = time_nanoseconds();
+
+      for (int j = 0; j < RASTER_ITERATIONS; j++) {
+        raster_context(config->sr, dst, rc, &tex);
+      }
+
+      config->elapsed += time_nanoseconds() - start;
+
+      if (i) {
+        int n = target.width * target.height;
+        for (int j = 0; j < n; j++) {
+          config->mismatches += target.color[j] != reference.color[j];
+        }
+      }
+    }
+
+    num_contexts++;
+    num_tris += sr_num_tris(configs[0].sr);
+    num_pixels += rc->width * rc->height;
+    next = next->next;
+  }
+
+  for (int i = 0; i < num_configs; i++) {
+    sr_destroy(configs[i].sr);
+  }
+
+  free(tex.pixels);
+  free(target.color);
+  free(target.depth);
+  free(target.stencil);
+  free(reference.color);
+  free(reference.depth);
+  free(reference.stencil);
+  tr_free_context(rc);
+  free(rc);
+  ta_release_params(ctx);
+  free(ctx);
+  trace_destroy(trace);
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("software rasterizer results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("contexts       %" PRId64, num_contexts);
+  LOG_INFO("iterations     %d", RASTER_ITERATIONS);
+  LOG_INFO("triangles      %" PRId64, num_tris);
+  LOG_INFO("pixels         %" PRId64, num_pixels);
+  LOG_INFO("tile size      %d", SR_TILE_SIZE);
+  LOG_INFO("");
+  LOG_INFO("%-8s %-8s %-12s %-12s %s", "impl", "workers", "frames/s",
+           "Mpixels/s", "mismatches");
+
+  for (int i = 0; i < num_configs; i++) {
+    struct raster_config *config = &configs[i];
+    double secs = (double)config->elapsed / NS_PER_SEC;
+    double frames = (double)num_contexts * RASTER_ITERATIONS;
+    double mpixels = (double)num_pixels * RASTER_ITERATIONS / 1000000.0;
+
+    LOG_INFO("%-8s %-8d %-12.2f %-12.2f %" PRId64, sr_impl_names[config->impl],
+             config->num_workers, secs > 0.0 ? frames / secs : 0.0,
+             secs > 0.0 ? mpixels / secs : 0.0, config->mismatches);
+  }
+
+  return 1;
+}
@@ -0,0 +1,11 @@
+#ifndef RETRACE_H
+#define RETRACE_H
+
+#include "guest/pvr/tr.h"
+
+/* texture provider for the commands converting contexts without a render
+   backend */
+struct tr_texture *retrace_find_texture(void *userdata, union tsp tsp,
+                                        union tcw tcw);
+
+#endif
@@ -0,0 +1,187 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "retrace.h"
+
+/* number of times the lists of each context are sorted */
+#define SORT_ITERATIONS 100
+
+/* lists which are sorted when autosort is enabled */
+static const int sort_lists[] = {TA_LIST_TRANSLUCENT, TA_LIST_PUNCH_THROUGH};
+#define SORT_NUM_LISTS (int)array_size(sort_lists)
+
+struct sort_result {
+  int64_t elapsed;
+  int64_t surfs_out;
+  int64_t mismatches;
+};
+
+/* state of a converted context before any of its lists were sorted. the
+   lists own copies of their surfaces, as the context's are sorted in place */
+struct sort_snapshot {
+  int num_surfs;
+  int num_indices;
+  struct tr_list lists[SORT_NUM_LISTS];
+};
+
+static void sort_copy_list(struct tr_list *dst, const struct tr_list *src) {
+  if (src->num_surfs > dst->max_surfs) {
+    dst->max_surfs = src->num_surfs;
+    dst->surfs = realloc(dst->surfs, dst->max_surfs * sizeof(dst->surfs[0]));
+    CHECK_NOTNULL(dst->surfs);
+  }
+
+  memcpy(dst->surfs, src->surfs, src->num_surfs * sizeof(dst->surfs[0]));
+  dst->num_surfs = src->num_surfs;
+}
+
+static void sort_save(const struct tr_context *rc,
+                      struct sort_snapshot *snap) {
+  snap->num_surfs = rc->num_surfs;
+  snap->num_indices = rc->num_indices;
+
+  for (int i = 0; i < SORT_NUM_LISTS; i++) {
+    sort_copy_list(&snap->lists[i], &rc->lists[sort_lists[i]]);
+  }
+}
+
+static void sort_restore(struct tr_context *rc,
+                         const struct sort_snapshot *snap) {
+  rc->num_surfs = snap->num_surfs;
+  rc->num_indices = snap->num_indices;
+
+  for (int i = 0; i < SORT_NUM_LISTS; i++) {
+    sort_copy_list(&rc->lists[sort_lists[i]], &snap->lists[i]);
+  }
+}
+
+static int sort_count_tris(const struct tr_context *rc,
+                           const struct tr_list *list) {
+  int num_tris = 0;
+
+  for (int i = 0; i < list->num_surfs; i++) {
+    num_tris += rc->surfs[list->surfs[i]].num_verts / 3;
+  }
+
+  return num_tris;
+}
+
+int cmd_sort(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  struct tile_context *ctx = calloc(1, sizeof(struct tile_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  struct sort_snapshot *snap = calloc(1, sizeof(struct sort_snapshot));
+  struct tr_list *merged = calloc(SORT_NUM_LISTS, sizeof(struct tr_list));
+  struct sort_result results[TR_NUM_SORTS];
+  int64_t num_contexts = 0;
+  int64_t num_surfs = 0;
+  int64_t num_tris = 0;
+
+  memset(results, 0, sizeof(results));
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type != TRACE_CMD_CONTEXT) {
+      next = next->next;
+      continue;
+    }
+
+    /* convert the context without sorting it, every context's lists are
+       sorted regardless of whether autosort was enabled for them */
+    trace_copy_context(next, ctx);
+    ctx->autosort = 0;
+    tr_convert_context(NULL, NULL, NULL, &retrace_find_texture, ctx, rc);
+    sort_save(rc, snap);
+
+    for (int i = 0; i < SORT_NUM_LISTS; i++) {
+      num_surfs += snap->lists[i].num_surfs;
+      num_tris += sort_count_tris(rc, &snap->lists[i]);
+    }
+
+    for (int sort = 0; sort < TR_NUM_SORTS; sort++) {
+      struct sort_result *res = &results[sort];
+
+      for (int i = 0; i < SORT_ITERATIONS; i++) {
+        sort_restore(rc, snap);
+
+        int64_t start = time_nanoseconds();
+
+        for (int j = 0; j < SORT_NUM_LISTS; j++) {
+          tr_sort_render_list(rc, sort_lists[j], sort);
+        }
+
+        res->elapsed += time_nanoseconds() - start;
+      }
+
+      /* validate the surface sorts against the original merge sort */
+      for (int i = 0; i < SORT_NUM_LISTS; i++) {
+        struct tr_list *list = &rc->lists[sort_lists[i]];
+
+        res->surfs_out += list->num_surfs;
+
+        if (sort == TR_SORT_SURFS_MERGE) {
+          sort_copy_list(&merged[i], list);
+        } else if (sort == TR_SORT_SURFS_RADIX) {
+          for (int j = 0; j < list->num_surfs; j++) {
+            res->mismatches += list->surfs[j] != merged[i].surfs[j];
+          }
+        }
+      }
+    }
+
+    num_contexts++;
+    next = next->next;
+  }
+
+  for (int i = 0; i < SORT_NUM_LISTS; i++) {
+    free(merged[i].surfs);
+    free(snap->lists[i].surfs);
+  }
+  free(merged);
+  free(snap);
+  tr_free_context(rc);
+  free(rc);
+  ta_release_params(ctx);
+  free(ctx);
+  trace_destroy(trace);
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("list sort results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("contexts       %" PRId64, num_contexts);
+  LOG_INFO("iterations     %d", SORT_ITERATIONS);
+  LOG_INFO("surfaces       %" PRId64, num_surfs);
+  LOG_INFO("triangles      %" PRId64, num_tris);
+  LOG_INFO("");
+  LOG_INFO("%-10s %-12s %-12s %s", "sort", "usec/ctx", "surfs out",
+           "mismatches");
+
+  for (int sort = 0; sort < TR_NUM_SORTS; sort++) {
+    struct sort_result *res = &results[sort];
+    double usecs = num_contexts ? (double)res->elapsed / 1000.0 /
+                                      (num_contexts * SORT_ITERATIONS)
+                                : 0.0;
+
+    LOG_INFO("%-10s %-12.2f %-12" PRId64 " %" PRId64, tr_sort_names[sort],
+             usecs, res->surfs_out, res->mismatches);
+  }
+
+  return 1;
+}
@@ -0,0 +1,88 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+
+/* number of times each context is replayed through the ta */
+#define TA_ITERATIONS 100
+
+static void ta_reset_context(struct tile_context *ctx) {
+  ctx->cursor = 0;
+  ctx->size = 0;
+  ctx->list_type = TA_NUM_LISTS;
+  ctx->vertex_type = TA_NUM_VERTS;
+  ctx->strip_verts = 0;
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
+int cmd_ta(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct tile_context *ctx = calloc(1, sizeof(struct tile_context));
+  int64_t num_contexts = 0;
+  int64_t num_bytes = 0;
+  int64_t num_lists = 0;
+  int64_t elapsed = 0;
+
+  /* replay the raw params of each context through the ta's parser 32 bytes at
+     a time, the same granularity they arrive at from the store queues */
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_CONTEXT) {
+      const uint8_t *params = next->context.params;
+      int params_size = next->context.params_size;
+
+      int64_t start = time_nanoseconds();
+
+      for (int i = 0; i < TA_ITERATIONS; i++) {
+        ta_reset_context(ctx);
+
+        for (int j = 0; j < params_size; j += 32) {
+          if (ta_write_context(ctx, &params[j], 32) != TA_NUM_LISTS) {
+            num_lists++;
+          }
+        }
+      }
+
+      elapsed += time_nanoseconds() - start;
+      num_bytes += (int64_t)params_size * TA_ITERATIONS;
+      num_contexts++;
+    }
+    next = next->next;
+  }
+
+  ta_release_params(ctx);
+  free(ctx);
+  trace_destroy(trace);
+
+  /* print results */
+  double secs = (double)elapsed / NS_PER_SEC;
+  double mb = (double)num_bytes / (1024.0 * 1024.0);
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("ta throughput results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("contexts       %" PRId64, num_contexts);
+  LOG_INFO("iterations     %d", TA_ITERATIONS);
+  LOG_INFO("lists ended    %" PRId64, num_lists);
+  LOG_INFO("bytes written  %" PRId64, num_bytes);
+  LOG_INFO("elapsed        %.3f sec", secs);
+  LOG_INFO("throughput     %.2f MB/s", secs > 0.0 ? mb / secs : 0.0);
+
+  return 1;
+}
@@ -0,0 +1,268 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+
+/* the fit is regularized slightly, so features which don't vary across the
+   trace (e.g. the output resolution) don't leave the system singular */
+#define TIMING_RIDGE 1e-6
+
+struct timing_sample {
+  float features[TA_NUM_FEATURES];
+  int64_t measured;
+};
+
+static void timing_reset_context(struct tile_context *ctx) {
+  ctx->cursor = 0;
+  ctx->size = 0;
+  ctx->list_type = TA_NUM_LISTS;
+  ctx->vertex_type = TA_NUM_VERTS;
+  ctx->strip_verts = 0;
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
+static int timing_read_measured(const char *filename,
+                                struct timing_sample *samples,
+                                int num_samples) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    LOG_WARNING("failed to open %s", filename);
+    return 0;
+  }
+
+  int n = 0;
+  int64_t measured;
+
+  while (fscanf(fp, "%" SCNd64, &measured) == 1) {
+    if (n < num_samples) {
+      samples[n].measured = measured;
+    }
+    n++;
+  }
+
+  fclose(fp);
+
+  if (n != num_samples) {
+    LOG_WARNING("%s has %d times, expected one for each of the %d contexts",
+                filename, n, num_samples);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* least squares fit of the coefficients to the measured times, solving the
+   normal equations with gaussian elimination. each feature is scaled by its
+   largest value first to keep the system well conditioned */
+static int timing_fit(const struct timing_sample *samples, int num_samples,
+                      float *coefs) {
+  double scale[TA_NUM_FEATURES] = {0};
+  double a[TA_NUM_FEATURES][TA_NUM_FEATURES + 1] = {{0}};
+
+  for (int i = 0; i < num_samples; i++) {
+    for (int j = 0; j < TA_NUM_FEATURES; j++) {
+      scale[j] = MAX(scale[j], fabs(samples[i].features[j]));
+    }
+  }
+
+  for (int j = 0; j < TA_NUM_FEATURES; j++) {
+    scale[j] = scale[j] > 0.0 ? 1.0 / scale[j] : 0.0;
+  }
+
+  for (int i = 0; i < num_samples; i++) {
+    const struct timing_sample *s = &samples[i];
+    /* the coefficients are in picoseconds */
+    double y = (double)s->measured * 1000.0;
+
+    for (int j = 0; j < TA_NUM_FEATURES; j++) {
+      double xj = s->features[j] * scale[j];
+
+      for (int k = 0; k < TA_NUM_FEATURES; k++) {
+        a[j][k] += xj * s->features[k] * scale[k];
+      }
+      a[j][TA_NUM_FEATURES] += xj * y;
+    }
+  }
+
+  for (int j = 0; j < TA_NUM_FEATURES; j++) {
+    a[j][j] += TIMING_RIDGE * num_samples;
+  }
+
+  for (int col = 0; col < TA_NUM_FEATURES; col++) {
+    int pivot = col;
+    for (int row = col + 1; row < TA_NUM_FEATURES; row++) {
+      if (fabs(a[row][col]) > fabs(a[pivot][col])) {
+        pivot = row;
+      }
+    }
+
+    if (fabs(a[pivot][col]) < 1e-12) {
+      return 0;
+    }
+
+    for (int k = 0; k <= TA_NUM_FEATURES; k++) {
+      double tmp = a[col][k];
+      a[col][k] = a[pivot][k];
+      a[pivot][k] = tmp;
+    }
+
+    for (int row = 0; row < TA_NUM_FEATURES; row++) {
+      if (row == col) {
+        continue;
+      }
+
+      double f = a[row][col] / a[col][col];
+      for (int k = col; k <= TA_NUM_FEATURES; k++) {
+        a[row][k] -= f * a[col][k];
+      }
+    }
+  }
+
+  for (int j = 0; j < TA_NUM_FEATURES; j++) {
+    coefs[j] = (float)(a[j][TA_NUM_FEATURES] / a[j][j] * scale[j]);
+  }
+
+  return 1;
+}
+
+static double timing_rms_error(const struct timing_sample *samples,
+                               int num_samples, const float *coefs) {
+  double sum = 0.0;
+
+  for (int i = 0; i < num_samples; i++) {
+    double err =
+        (double)(ta_estimate_render_time(samples[i].features, coefs) -
+                 samples[i].measured);
+    sum += err * err;
+  }
+
+  return num_samples ? sqrt(sum / num_samples) : 0.0;
+}
+
+static void timing_format_coefs(const float *coefs, char *buffer,
+                                int size) {
+  int len = 0;
+
+  for (int i = 0; i < TA_NUM_FEATURES && len < size; i++) {
+    len += snprintf(buffer + len, size - len, "%s%.0f", i ? "," : "",
+                    coefs[i]);
+  }
+}
+
+int cmd_timing(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  const char *measured = argc >= 2 ? argv[1] : NULL;
+
+  float coefs[TA_NUM_FEATURES];
+  if (!ta_parse_render_coefs(OPTION_render_time_coefs, coefs)) {
+    LOG_WARNING("failed to parse coefficients %s", OPTION_render_time_coefs);
+    return 0;
+  }
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct tile_context *ctx = calloc(1, sizeof(struct tile_context));
+  struct timing_sample *samples = NULL;
+  int num_samples = 0;
+  int max_samples = 0;
+
+  /* replay the raw params of each context through the ta's parser to gather
+     the stats the estimate is made from */
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_CONTEXT) {
+      const uint8_t *params = next->context.params;
+      int params_size = next->context.params_size;
+
+      timing_reset_context(ctx);
+      ctx->video_width = next->context.video_width;
+      ctx->video_height = next->context.video_height;
+
+      for (int j = 0; j < params_size; j += 32) {
+        ta_write_context(ctx, &params[j], 32);
+      }
+
+      if (num_samples == max_samples) {
+        max_samples = MAX(max_samples * 2, 64);
+        samples = realloc(samples, max_samples * sizeof(samples[0]));
+        CHECK_NOTNULL(samples);
+      }
+
+      struct timing_sample *s = &samples[num_samples++];
+      ta_render_features(ctx, s->features);
+      s->measured = 0;
+    }
+    next = next->next;
+  }
+
+  ta_release_params(ctx);
+  free(ctx);
+  trace_destroy(trace);
+
+  int res = 1;
+
+  if (measured) {
+    float fit[TA_NUM_FEATURES];
+    char buffer[OPTION_MAX_LENGTH];
+
+    if (!timing_read_measured(measured, samples, num_samples)) {
+      res = 0;
+    } else if (!timing_fit(samples, num_samples, fit)) {
+      LOG_WARNING("failed to fit coefficients to %s", measured);
+      res = 0;
+    } else {
+      timing_format_coefs(fit, buffer, sizeof(buffer));
+
+      LOG_INFO("===-----------------------------------------------------===");
+      LOG_INFO("render time fit results");
+      LOG_INFO("===-----------------------------------------------------===");
+      LOG_INFO("");
+      LOG_INFO("contexts       %d", num_samples);
+      LOG_INFO("rms error      %.3f ms -> %.3f ms",
+               timing_rms_error(samples, num_samples, coefs) / 1000000.0,
+               timing_rms_error(samples, num_samples, fit) / 1000000.0);
+      LOG_INFO("config         render_time_coefs: %s", buffer);
+    }
+  } else {
+    int64_t min_time = INT64_MAX;
+    int64_t max_time = 0;
+    int64_t total_time = 0;
+
+    for (int i = 0; i < num_samples; i++) {
+      int64_t t = ta_estimate_render_time(samples[i].features, coefs);
+      min_time = MIN(min_time, t);
+      max_time = MAX(max_time, t);
+      total_time += t;
+    }
+
+    LOG_INFO("===-----------------------------------------------------===");
+    LOG_INFO("render time estimate results");
+    LOG_INFO("===-----------------------------------------------------===");
+    LOG_INFO("");
+    LOG_INFO("contexts       %d", num_samples);
+    LOG_INFO("min time       %.3f ms",
+             num_samples ? min_time / 1000000.0 : 0.0);
+    LOG_INFO("max time       %.3f ms", max_time / 1000000.0);
+    LOG_INFO("avg time       %.3f ms",
+             num_samples ? total_time / 1000000.0 / num_samples : 0.0);
+  }
+
+  free(samples);
+
+  return res;
+}
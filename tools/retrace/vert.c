@@ -0,0 +1,176 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/vert_decode.h"
+
+/* number of times the vertices of each type are decoded */
+#define VERT_ITERATIONS 100
+
+/* vertex types which can be batch decoded */
+#define VERT_NUM_TYPES 9
+
+struct vert_run {
+  const union vert_param **params;
+  int num_params;
+  int max_params;
+};
+
+static void vert_run_add(struct vert_run *run,
+                         const union vert_param *param) {
+  if (run->num_params >= run->max_params) {
+    run->max_params = MAX(run->max_params * 2, 1024);
+    run->params =
+        realloc(run->params, run->max_params * sizeof(run->params[0]));
+    CHECK_NOTNULL(run->params);
+  }
+  run->params[run->num_params++] = param;
+}
+
+/* gather each polygon vertex param in the context by its vertex type */
+static void vert_gather_params(const uint8_t *params, int params_size,
+                               struct vert_run *runs) {
+  int list_type = TA_NUM_LISTS;
+  int vertex_type = TA_NUM_VERTS;
+  int offset = 0;
+
+  while (offset < params_size) {
+    union pcw pcw = *(const union pcw *)&params[offset];
+
+    if (ta_pcw_list_type_valid(pcw, list_type)) {
+      list_type = pcw.list_type;
+    }
+
+    switch (pcw.para_type) {
+      case TA_PARAM_END_OF_LIST:
+        list_type = TA_NUM_LISTS;
+        vertex_type = TA_NUM_VERTS;
+        break;
+
+      case TA_PARAM_POLY_OR_VOL:
+      case TA_PARAM_SPRITE:
+        vertex_type = ta_get_vert_type(pcw);
+        break;
+
+      case TA_PARAM_VERTEX:
+        if (vert_decode_batched(vertex_type)) {
+          vert_run_add(&runs[vertex_type],
+                       (const union vert_param *)&params[offset]);
+        }
+        break;
+    }
+
+    offset += ta_get_param_size(pcw, vertex_type);
+  }
+}
+
+static int64_t vert_decode_run(enum vert_decode_impl impl, int vertex_type,
+                               const struct vert_run *run,
+                               struct ta_vertex *verts) {
+  static const float face_color[4] = {0.75f, 0.5f, 0.25f, 1.0f};
+  static const float face_offset_color[4] = {0.25f, 0.5f, 0.75f, 0.5f};
+  struct ta_vertex *vert_ptrs[VERT_DECODE_BATCH_SIZE];
+
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < VERT_ITERATIONS; i++) {
+    for (int j = 0; j < run->num_params; j += VERT_DECODE_BATCH_SIZE) {
+      int n = MIN(run->num_params - j, VERT_DECODE_BATCH_SIZE);
+
+      for (int k = 0; k < n; k++) {
+        vert_ptrs[k] = &verts[j + k];
+      }
+
+      vert_decode_with(impl, vertex_type, &run->params[j], vert_ptrs, n,
+                       face_color, face_offset_color);
+    }
+  }
+
+  return time_nanoseconds() - start;
+}
+
+int cmd_verts(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+  vert_decode_init();
+
+  struct vert_run runs[VERT_NUM_TYPES];
+  memset(runs, 0, sizeof(runs));
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_CONTEXT) {
+      vert_gather_params(next->context.params, next->context.params_size,
+                         runs);
+    }
+    next = next->next;
+  }
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("vertex decode results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("iterations     %d", VERT_ITERATIONS);
+  LOG_INFO("selected       %s", vert_decode_names[vert_decode_selected()]);
+  LOG_INFO("");
+  LOG_INFO("%-6s %-10s %-8s %-14s %s", "type", "verts", "impl", "Mverts/s",
+           "mismatches");
+
+  for (int type = 0; type < VERT_NUM_TYPES; type++) {
+    struct vert_run *run = &runs[type];
+
+    if (!run->num_params) {
+      continue;
+    }
+
+    struct ta_vertex *expected = calloc(run->num_params, sizeof(*expected));
+    struct ta_vertex *actual = calloc(run->num_params, sizeof(*actual));
+    CHECK(expected && actual);
+
+    for (int impl = 0; impl < VERT_DECODE_NUM_IMPLS; impl++) {
+      if (!vert_decode_supported(impl)) {
+        continue;
+      }
+
+      struct ta_vertex *verts = impl == VERT_DECODE_SCALAR ? expected : actual;
+      int64_t elapsed = vert_decode_run(impl, type, run, verts);
+
+      /* validate the simd output against the scalar output */
+      int mismatches = 0;
+      if (verts != expected) {
+        for (int i = 0; i < run->num_params; i++) {
+          mismatches += memcmp(&expected[i], &actual[i], sizeof(*actual)) != 0;
+        }
+      }
+
+      double secs = (double)elapsed / NS_PER_SEC;
+      double mverts = (double)run->num_params * VERT_ITERATIONS / 1000000.0;
+
+      LOG_INFO("%-6d %-10d %-8s %-14.2f %d", type, run->num_params,
+               vert_decode_names[impl], secs > 0.0 ? mverts / secs : 0.0,
+               mismatches);
+    }
+
+    free(expected);
+    free(actual);
+    free(run->params);
+  }
+
+  trace_destroy(trace);
+
+  return 1;
+}
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include "core/assert.h"
+#include "core/core.h"
+#include "core/exception_handler.h"
+#include "core/time.h"
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+#include "guest/sh4/sh4.h"
+
+#define VRAM_TA_TEXTURE_ADDR 0x11000000
+
+/* textures packed back to back in video ram, without being page aligned,
+   with a fraction of them being uploaded through the ta texture fifo each
+   frame */
+#define VRAM_TEXTURE_SIZE 0x1800
+#define VRAM_NUM_TEXTURES 256
+#define VRAM_UPLOAD_SIZE 0x400
+#define VRAM_FRAMES 64
+
+struct vram_state {
+  struct dreamcast *dc;
+  struct memory_watch *watches[VRAM_NUM_TEXTURES];
+  int written[VRAM_NUM_TEXTURES];
+  int invalidated[VRAM_NUM_TEXTURES];
+  uintptr_t last_fault;
+  int faults;
+};
+
+struct vram_results {
+  int64_t elapsed;
+  int faults;
+  int invalidated;
+  int missed;
+};
+
+/* state is global so the watch callbacks can find their texture from the
+   address of its watch slot */
+static struct vram_state vram;
+static uint8_t upload_data[VRAM_UPLOAD_SIZE];
+
+static void vram_texture_modified(const struct exception_state *ex,
+                                  void *data) {
+  struct vram_state *st = &vram;
+  int i = (int)((struct memory_watch **)data - st->watches);
+
+  /* a single fault fires the watches of each texture sharing its page */
+  if (ex->fault_addr != st->last_fault) {
+    st->last_fault = ex->fault_addr;
+    st->faults++;
+  }
+
+  st->watches[i] = NULL;
+  st->invalidated[i] = 1;
+}
+
+static uint8_t *vram_texture(struct vram_state *st, int i) {
+  return st->dc->pvr->video_ram + i * VRAM_TEXTURE_SIZE;
+}
+
+static void vram_upload_textures(struct vram_state *st, int frame) {
+  struct address_space *space = st->dc->sh4->memory_if->space;
+
+  memset(st->written, 0, sizeof(st->written));
+  memset(st->invalidated, 0, sizeof(st->invalidated));
+
+  for (int i = 0; i < VRAM_NUM_TEXTURES; i++) {
+    if ((i * 7 + frame) % 8) {
+      continue;
+    }
+
+    uint32_t offset = (frame * VRAM_UPLOAD_SIZE) % VRAM_TEXTURE_SIZE;
+    uint32_t dst = i * VRAM_TEXTURE_SIZE + offset;
+    as_memcpy_to_guest(space, VRAM_TA_TEXTURE_ADDR + dst, upload_data,
+                       VRAM_UPLOAD_SIZE);
+    st->written[i] = 1;
+  }
+}
+
+static void vram_tally(struct vram_state *st, struct vram_results *res) {
+  for (int i = 0; i < VRAM_NUM_TEXTURES; i++) {
+    res->invalidated += st->invalidated[i];
+    res->missed += st->written[i] && !st->invalidated[i];
+  }
+}
+
+static void vram_watches(struct vram_state *st, struct vram_results *res) {
+  int64_t start = time_nanoseconds();
+
+  for (int frame = 0; frame < VRAM_FRAMES; frame++) {
+    /* rearm the watches fired since the last frame */
+    for (int i = 0; i < VRAM_NUM_TEXTURES; i++) {
+      if (!st->watches[i]) {
+        st->watches[i] = add_single_write_watch(
+            vram_texture(st, i), VRAM_TEXTURE_SIZE, &vram_texture_modified,
+            &st->watches[i]);
+      }
+    }
+
+    st->last_fault = 0;
+    vram_upload_textures(st, frame);
+    vram_tally(st, res);
+  }
+
+  res->elapsed = time_nanoseconds() - start;
+  res->faults = st->faults;
+
+  for (int i = 0; i < VRAM_NUM_TEXTURES; i++) {
+    if (st->watches[i]) {
+      remove_memory_watch(st->watches[i]);
+      st->watches[i] = NULL;
+    }
+  }
+}
+
+static void vram_bitmap(struct vram_state *st, struct vram_results *res) {
+  uint64_t vram_dirty[PVR_VRAM_DIRTY_WORDS];
+  uint64_t palette_dirty;
+
+  /* discard the writes made by the previous pass */
+  pvr_collect_dirty(st->dc->pvr, vram_dirty, &palette_dirty);
+
+  int64_t start = time_nanoseconds();
+
+  for (int frame = 0; frame < VRAM_FRAMES; frame++) {
+    vram_upload_textures(st, frame);
+
+    pvr_collect_dirty(st->dc->pvr, vram_dirty, &palette_dirty);
+
+    for (int i = 0; i < VRAM_NUM_TEXTURES; i++) {
+      int first = (i * VRAM_TEXTURE_SIZE) >> PVR_VRAM_BLOCK_SHIFT;
+      int last = ((i + 1) * VRAM_TEXTURE_SIZE - 1) >> PVR_VRAM_BLOCK_SHIFT;
+
+      for (int b = first; b <= last; b++) {
+        if (vram_dirty[b >> 6] & (UINT64_C(1) << (b & 63))) {
+          st->invalidated[i] = 1;
+          break;
+        }
+      }
+    }
+
+    vram_tally(st, res);
+  }
+
+  res->elapsed = time_nanoseconds() - start;
+}
+
+int cmd_vram(int argc, const char **argv) {
+  struct dreamcast *dc = dc_create(NULL);
+  if (!dc) {
+    LOG_WARNING("failed to create dreamcast");
+    return 0;
+  }
+
+  struct vram_state *st = &vram;
+  memset(st, 0, sizeof(*st));
+  st->dc = dc;
+
+  for (int i = 0; i < VRAM_UPLOAD_SIZE; i++) {
+    upload_data[i] = (uint8_t)rand();
+  }
+
+  /* compare invalidating textures with page granular write watches against
+     the pvr's dirty block bitmap */
+  struct vram_results watches = {0};
+  struct vram_results bitmap = {0};
+  vram_watches(st, &watches);
+  vram_bitmap(st, &bitmap);
+
+  LOG_INFO("%-8s %-8s %-12s %-8s %s", "method", "faults", "invalidated",
+           "missed", "us/frame");
+
+  struct vram_results *results[] = {&watches, &bitmap};
+  const char *names[] = {"watches", "bitmap"};
+
+  for (int i = 0; i < (int)array_size(results); i++) {
+    struct vram_results *res = results[i];
+    double us = (double)res->elapsed / 1000.0 / VRAM_FRAMES;
+    LOG_INFO("%-8s %-8d %-12d %-8d %.2f", names[i], res->faults,
+             res->invalidated, res->missed, us);
+  }
+
+  dc_destroy(dc);
+
+  return 1;
+}